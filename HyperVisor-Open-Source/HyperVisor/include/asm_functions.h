@@ -3,8 +3,46 @@
 #define ASM_FUNCTIONS_H
 
 #include <stdint.h>
+#include "stage2.h"
+#include "vmid.h"
+#include "sysreg.h"
 
-// Estrutura para contexto do guest
+// Número máximo de CPUs físicas com frame de contexto em EL2
+#define EL2_MAX_CPUS    8
+
+// Ring de console do fast path (HVC putchar tratado no vetor)
+// O vetor produz em buf[head % tamanho]; o caminho C drena até head.
+// Ambos executam no mesmo pCPU, então não há necessidade de barreiras.
+// A saída fica retida no máximo até um '\n', FASTPATH_CONSOLE_FLUSH
+// caracteres ou o próximo WFI: nesses casos o vetor desvia para o caminho C,
+// que enfileira o caractere e drena o ring. Uma linha parcial (um prompt)
+// não espera por outro exit: o primeiro caractere retido num ring vazio arma
+// o timer físico de EL2 (CNTHP) para FASTPATH_CONSOLE_DRAIN_US, e o IRQ dele
+// entra pelo caminho C, que drena o ring e desarma o timer.
+#define FASTPATH_CONSOLE_SIZE   256
+#define FASTPATH_CONSOLE_FLUSH  64
+#define FASTPATH_CONSOLE_DRAIN_US   10000
+
+typedef struct {
+    uint32_t head;          // Escrito pelo vetor
+    uint32_t tail;          // Escrito por fastpath_console_drain()
+    char buf[FASTPATH_CONSOLE_SIZE];
+} fastpath_console_t;
+
+// Estado FP/SIMD do guest, trocado de forma preguiçosa (fpsimd_el2.c).
+// Offsets usados por el2_fpsimd_save/restore em entry.s: q @ 0, fpsr @ 512,
+// fpcr @ 516. O estado vivo atravessa os exits; só é salvo quando o código C
+// de EL2 usa os registradores V (trap de TFP em EL2) ou o guest é trocado.
+typedef struct {
+    uint64_t q[64];         // Q0-Q31 (128 bits cada)
+    uint32_t fpsr;
+    uint32_t fpcr;
+    uint64_t reserved;
+} fpsimd_state_t;
+
+// Estrutura para contexto do guest (frame por pCPU, apontado por TPIDR_EL2)
+// Os offsets são usados diretamente por save_guest_frame e pelo fast path
+// em entry.s
 typedef struct {
     uint64_t x[31];         // x0-x30
     uint64_t sp_el1;        // Stack pointer EL1
@@ -12,8 +50,17 @@ typedef struct {
     uint64_t spsr_el2;      // Saved Program Status Register
     uint64_t esr_el2;       // Exception Syndrome Register
     uint64_t far_el2;       // Fault Address Register
+    fastpath_console_t console;  // @ 288: ring do fast path de putchar
+    fpsimd_state_t* fpsimd_guest;   // @ 552: estado FP/SIMD do guest deste pCPU
+    uint64_t fpsimd_live;       // @ 560: registradores V contêm *fpsimd_guest
+    volatile uint32_t irq_pending;  // @ 568: IRQ pendente para o guest deste pCPU (fast path de WFI)
+    uint32_t console_drain_ticks;   // @ 572: CNTHP_TVAL_EL2 do prazo de drenagem do ring
 } guest_context_t;
 
+// Extrai campos do ESR_EL2 salvo no frame
+#define ESR_EC(esr)     (((esr) >> 26) & 0x3F)
+#define ESR_ISS(esr)    ((uint32_t)((esr) & 0x1FFFFFF))
+
 // Estrutura para contexto do hypervisor
 typedef struct {
     uint64_t x[31];         // x0-x30
@@ -28,27 +75,66 @@ typedef struct {
 // Funções assembly - entry.s
 extern void setup_exception_vectors(void);
 extern void enter_guest(uint64_t entry_point, uint64_t stack_pointer);
-extern void save_guest_context(guest_context_t* ctx);
-extern void restore_guest_context(const guest_context_t* ctx);
+extern void el2_set_cpu_context(guest_context_t* ctx);
+extern guest_context_t* el2_get_cpu_context(void);
+extern void el2_enable_stage2(uint64_t vtcr);
+extern void el2_timer_traps(uint64_t ecv);
+extern void el2_console_timer_arm(uint64_t ticks);
+extern void el2_console_timer_disarm(void);
+extern void el2_load_vttbr(uint64_t vttbr, uint64_t flush_all);
+extern void el2_tlbi_ipa_vmid(uint64_t vttbr, uint64_t ipa, uint64_t pages);
+extern void el2_tlbi_vmid(uint64_t vttbr);
+extern uint64_t el2_read_mmfr0(void);
+extern uint64_t el2_read_mmfr1(void);
+extern void el2_fpsimd_trap(uint64_t enable);
+extern void el2_fpsimd_save(fpsimd_state_t* state);
+extern void el2_fpsimd_restore(const fpsimd_state_t* state);
+
+// Guest do modo EL2: tabela stage-2 própria e VMID com geração (vmid.h)
+typedef struct {
+    stage2_t s2;
+    uint64_t vmid;
+    uint64_t vttbr;
+    fpsimd_state_t fpsimd;      // Válido enquanto fpsimd_live == 0 no pCPU do guest
+    sysreg_vcpu_t sysregs;      // Registradores de sistema emulados
+} el2_guest_t;
+
+// Stage-2 e VMIDs em EL2 - stage2_el2.c (pool estático de tabelas, PA == VA)
+extern hypervisor_context_t g_hyp_context;
+extern vmid_allocator_t g_vmid_allocator;
+int el2_vmid_init(void);
+int el2_guest_init(el2_guest_t* guest);
+void el2_guest_destroy(el2_guest_t* guest);
+void el2_guest_switch(el2_guest_t* guest, uint32_t cpu);
+el2_guest_t* el2_current_guest(const guest_context_t* ctx);
+
+// FP/SIMD preguiçoso - fpsimd_el2.c
+void el2_fpsimd_guest_enter(el2_guest_t* guest, uint32_t cpu);
+void el2_fpsimd_guest_release(el2_guest_t* guest);
+void handle_guest_fpsimd_trap(guest_context_t* ctx);
+
+// Frames de contexto do guest, um por CPU física
+extern guest_context_t g_cpu_context[EL2_MAX_CPUS];
 
-// Buffers globais para contexto
-extern guest_context_t guest_context_buffer;
+void fastpath_console_drain(guest_context_t* ctx);
 
 // Handlers de exceção implementados em C
+// Os handlers de guest recebem o frame salvo na entrada e o editam in-place;
+// o vetor restaura o guest a partir dele ao retornar.
 void handle_hypervisor_exception(uint32_t exception_type);
-void handle_guest_exception(uint32_t exception_type, uint64_t esr, uint64_t far, uint64_t elr);
+void handle_guest_exception(guest_context_t* ctx, uint32_t exception_type);
 
 // Funções específicas para tratamento de exceções
-void handle_guest_sync_exception(uint64_t esr, uint64_t far, uint64_t elr);
-void handle_guest_hvc(uint32_t iss, uint64_t elr);
-void handle_guest_data_abort(uint32_t iss, uint64_t far, uint64_t elr);
-void handle_guest_instruction_abort(uint32_t iss, uint64_t far, uint64_t elr);
-void handle_guest_system_register_trap(uint32_t iss, uint64_t elr);
-void handle_guest_wfi_wfe(uint32_t iss, uint64_t elr);
+void handle_guest_sync_exception(guest_context_t* ctx);
+void handle_guest_hvc(guest_context_t* ctx, uint32_t iss);
+void handle_guest_data_abort(guest_context_t* ctx, uint32_t iss);
+void handle_guest_instruction_abort(guest_context_t* ctx, uint32_t iss);
+void handle_guest_system_register_trap(guest_context_t* ctx, uint32_t iss);
+void handle_guest_wfi_wfe(guest_context_t* ctx, uint32_t iss);
 void handle_guest_irq(void);
 void handle_guest_fiq(void);
-void handle_guest_serror(uint64_t esr, uint64_t far);
-void handle_guest_sync_exception_aarch32(uint64_t esr, uint64_t far, uint64_t elr);
+void handle_guest_serror(guest_context_t* ctx);
+void handle_guest_sync_exception_aarch32(guest_context_t* ctx);
 void inject_exception_to_guest(uint64_t esr, uint64_t far);
 
 // Função principal do hypervisor
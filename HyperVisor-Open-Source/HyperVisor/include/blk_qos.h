@@ -0,0 +1,111 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef BLK_QOS_H
+#define BLK_QOS_H
+
+#include "hypervisor.h"
+
+// QoS de I/O de bloco: limites de IOPS e banda por VM e por disco.
+//
+// Cada limite é um token bucket (taxa por segundo + rajada). Um request só
+// é despachado se cabe no balde do seu disco e no da VM; o balde pode ficar
+// negativo, então um request maior que a rajada passa assim que o nível
+// volta a ser positivo. Requests que não cabem esperam na fila do disco
+// (flow) e a thread de QoS os libera por start-time fair queuing: entre os
+// discos com backlog ganha o de menor tag virtual, avançada por custo/peso,
+// de modo que os discos dividem a banda da VM na proporção dos pesos.
+//
+// O request liberado vai para a porta (uma por virtqueue) de onde veio e
+// a thread da fila o recolhe com blk_qos_take(). Ordem de locks: lock da
+// fila -> lock do QoS; a thread de QoS nunca toma o lock de uma fila.
+
+#define BLK_QOS_WEIGHT_DEFAULT  100
+#define BLK_QOS_WEIGHT_MAX      1000
+#define BLK_QOS_OP_COST         4096    // Custo fixo de um request na tag (bytes)
+#define BLK_QOS_BURST_MAX       (1ULL << 32)
+
+typedef struct {
+    uint64_t iops;              // 0 = sem limite
+    uint64_t iops_burst;        // 0 = um segundo de taxa
+    uint64_t bps;
+    uint64_t bps_burst;
+} blk_qos_limits_t;
+
+typedef struct {
+    int64_t level;              // Tokens disponíveis (negativo = dívida)
+    uint64_t rate;              // Tokens por segundo (0 = sem limite)
+    uint64_t burst;
+    uint64_t last_ns;
+} blk_qos_bucket_t;
+
+typedef struct {
+    blk_qos_bucket_t iops;
+    blk_qos_bucket_t bps;
+} blk_qos_group_t;
+
+typedef struct blk_qos_item blk_qos_item_t;
+typedef struct blk_qos_port blk_qos_port_t;
+
+// Embutido no request do device
+struct blk_qos_item {
+    blk_qos_item_t* next;
+    blk_qos_port_t* port;
+    uint32_t bytes;
+    uint64_t tag;               // Tag virtual de início (SFQ)
+    uint64_t queued_ns;
+};
+
+// Uma por virtqueue: requests liberados esperando a thread da fila
+struct blk_qos_port {
+    blk_qos_item_t* granted;
+    blk_qos_item_t* granted_tail;
+    void (*wake)(void* ctx);    // Chamado com o lock do QoS: só pode postar
+    void* ctx;
+    bool wake_pending;
+    blk_qos_port_t* wake_next;
+};
+
+typedef struct {
+    uint64_t requests;          // Admitidos (direto ou após espera)
+    uint64_t throttled;         // Que esperaram por tokens
+    uint64_t wait_ns;           // Espera acumulada dos throttled
+    uint64_t max_wait_ns;
+    uint32_t backlog;           // Esperando agora
+} blk_qos_stats_t;
+
+// Um por disco
+typedef struct blk_qos_flow {
+    const char* name;
+    blk_qos_group_t group;
+    uint32_t weight;
+    bool limited;               // Disco ou VM com limite: passa pelo QoS
+    uint64_t last_tag;          // Tag de fim do último request enfileirado
+    blk_qos_item_t* head;
+    blk_qos_item_t* tail;
+    blk_qos_stats_t stats;
+    struct blk_qos_flow* next;
+} blk_qos_flow_t;
+
+// Limites da VM: antes de registrar discos
+void blk_qos_set_vm_limits(const blk_qos_limits_t* limits);
+
+// "iops=N,bw=MB,iops_burst=N,bw_burst=MB,weight=N" (campos opcionais)
+int blk_qos_parse(const char* spec, blk_qos_limits_t* limits, uint32_t* weight);
+
+int blk_qos_flow_register(blk_qos_flow_t* flow, const char* name, const blk_qos_limits_t* limits,
+                          uint32_t weight);
+void blk_qos_flow_unregister(blk_qos_flow_t* flow);
+
+// true = despachar agora; false = item enfileirado, volta por port->wake
+bool blk_qos_admit(blk_qos_flow_t* flow, blk_qos_port_t* port, blk_qos_item_t* item, uint32_t bytes);
+
+// Lista liberada da porta (ordem de liberação)
+blk_qos_item_t* blk_qos_take(blk_qos_port_t* port);
+
+// Reset do device: tira da espera e devolve os itens da porta, liberados ou não
+blk_qos_item_t* blk_qos_cancel(blk_qos_flow_t* flow, blk_qos_port_t* port);
+
+void blk_qos_get_stats(blk_qos_flow_t* flow, blk_qos_stats_t* stats);
+
+void blk_qos_cleanup(void);
+
+#endif // BLK_QOS_H
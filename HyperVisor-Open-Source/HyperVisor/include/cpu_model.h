@@ -0,0 +1,64 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef CPU_MODEL_H
+#define CPU_MODEL_H
+
+// Modelos de CPU do guest. O hypervisor descobre as features do host uma
+// vez (hypervisor_init) e um modelo nomeado decide o que o guest vê: o
+// banco de ProcessorFeatures da partição e os registradores de ID
+// emulados (ID_AA64PFR0/ISAR0/ISAR1). A resolução é C puro - não inclui
+// windows.h - para poder ser verificada em qualquer host.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint64_t cpu_features_t;
+
+#define CPU_FEAT_FP             (1ULL << 0)
+#define CPU_FEAT_ASIMD          (1ULL << 1)
+#define CPU_FEAT_AES            (1ULL << 2)
+#define CPU_FEAT_PMULL          (1ULL << 3)
+#define CPU_FEAT_SHA1           (1ULL << 4)
+#define CPU_FEAT_SHA256         (1ULL << 5)
+#define CPU_FEAT_SHA512         (1ULL << 6)
+#define CPU_FEAT_SHA3           (1ULL << 7)
+#define CPU_FEAT_CRC32          (1ULL << 8)
+#define CPU_FEAT_ATOMICS        (1ULL << 9)     // LSE (ARMv8.1)
+#define CPU_FEAT_RDM            (1ULL << 10)    // SQRDMLAH (ARMv8.1)
+#define CPU_FEAT_FP16           (1ULL << 11)    // ARMv8.2
+#define CPU_FEAT_DOTPROD        (1ULL << 12)    // ARMv8.2
+#define CPU_FEAT_JSCVT          (1ULL << 13)    // ARMv8.3
+#define CPU_FEAT_LRCPC          (1ULL << 14)    // ARMv8.3
+
+#define CPU_FEAT_V80            (CPU_FEAT_FP | CPU_FEAT_ASIMD)
+#define CPU_FEAT_CRYPTO         (CPU_FEAT_AES | CPU_FEAT_PMULL | CPU_FEAT_SHA1 | CPU_FEAT_SHA256)
+
+// Dependências entre features (ex.: PMULL exige AES, SHA512 exige SHA256)
+cpu_features_t cpu_features_normalize(cpu_features_t features);
+
+// Descoberto uma vez no início
+typedef struct {
+    cpu_features_t features;
+    uint64_t hv_features;       // WHV ProcessorFeatures suportado (banco opaco)
+} cpu_host_t;
+
+extern cpu_host_t g_host_cpu;
+
+// Resultado da resolução de um modelo contra o host
+typedef struct {
+    const char* name;
+    cpu_features_t features;            // Efetivamente expostas ao guest
+    uint64_t partition_features;        // WHvPartitionPropertyCodeProcessorFeatures
+    uint64_t id_aa64pfr0;
+    uint64_t id_aa64isar0;
+    uint64_t id_aa64isar1;
+} cpu_model_config_t;
+
+#define CPU_MODEL_DEFAULT       "host"
+
+// 0 em sucesso; -1 se o modelo não existe ou o host não o suporta
+int cpu_model_resolve(const char* name, const cpu_host_t* host, cpu_model_config_t* out);
+
+// Iteração sobre os modelos conhecidos (NULL ao final)
+const char* cpu_model_name(uint32_t index, const char** description);
+
+#endif // CPU_MODEL_H
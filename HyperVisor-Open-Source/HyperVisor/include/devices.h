@@ -3,6 +3,7 @@
 #define DEVICES_H
 
 #include "hypervisor.h"
+#include "regmap.h"
 
 // Device access result
 typedef enum {
@@ -11,6 +12,16 @@ typedef enum {
     DEVICE_ACCESS_ERROR
 } device_access_result_t;
 
+// Identificadores de device (sinalização de mudança de estado)
+typedef enum {
+    DEVICE_ID_UART,
+    DEVICE_ID_TIMER,
+    DEVICE_ID_GIC,
+    DEVICE_ID_VIRTIO,
+    DEVICE_ID_COUNT,
+    DEVICE_ID_NONE = DEVICE_ID_COUNT
+} device_id_t;
+
 // Device I/O structure
 typedef struct {
     uint64_t address;
@@ -36,6 +47,7 @@ typedef struct {
     uint64_t compare_value;
     uint32_t control;
     bool interrupt_pending;
+    uint64_t host_frequency;    // Frequência do contador do host (Hz)
 } timer_state_t;
 
 // GIC (interrupt controller) state
@@ -45,6 +57,7 @@ typedef struct {
     uint32_t pending_interrupts[8];  // Support up to 256 interrupts
     uint32_t enabled_interrupts[8];
     uint32_t priorities[256];
+    uint32_t ppi_level[32];          // Por PPI: bit por vCPU com a linha em nível alto
 } gic_state_t;
 
 // Global device states
@@ -52,30 +65,61 @@ extern uart_state_t g_uart;
 extern timer_state_t g_timer;
 extern gic_state_t g_gic;
 
+// Serializa o estado dos devices entre threads de vCPU (recursivo)
+extern CRITICAL_SECTION g_device_lock;
+
+// Mapas de registradores de cada device
+extern regmap_t g_uart_regmap;
+extern regmap_t g_timer_regmap;
+extern regmap_t g_gic_dist_regmap;
+extern regmap_t g_gic_cpu_regmap;
+
 // Device initialization
 int devices_init(void);
 void devices_cleanup(void);
 
 // UART functions
-device_access_result_t uart_handle_access(const device_io_t* io);
+device_access_result_t uart_handle_access(device_io_t* io);
 void uart_write_char(char c);
+void uart_write_buffer(const char* buf, size_t len);
 char uart_read_char(void);
 bool uart_has_pending_rx(void);
 
 // Timer functions
-device_access_result_t timer_handle_access(const device_io_t* io);
+device_access_result_t timer_handle_access(device_io_t* io);
 void timer_tick(void);
 bool timer_has_interrupt(void);
 void timer_clear_interrupt(void);
+uint64_t timer_get_time_ns(void);
+uint64_t timer_get_host_counter(void);
+uint64_t timer_ticks_to_ns(uint64_t ticks);
+uint64_t timer_get_arch_counter(void);
+uint64_t timer_get_arch_frequency(void);
 
 // GIC functions
-device_access_result_t gic_handle_access(const device_io_t* io);
-device_access_result_t gic_handle_distributor_access(uint64_t offset, const device_io_t* io);
-device_access_result_t gic_handle_cpu_access(uint64_t offset, const device_io_t* io);
+device_access_result_t gic_handle_access(device_io_t* io);
+device_access_result_t gic_handle_distributor_access(device_io_t* io);
+device_access_result_t gic_handle_cpu_access(device_io_t* io);
 void gic_set_interrupt(uint32_t irq_num, bool pending);
+void gic_set_ppi_level(uint32_t ppi, uint32_t vcpu, bool level);
 uint32_t gic_get_pending_interrupt(void);
 void gic_ack_interrupt(uint32_t irq_num);
 
+// Despacho genérico via mapa de registradores
+device_access_result_t regmap_access(const regmap_t* map, device_io_t* io);
+
+// Páginas sombra somente-leitura (requer partição criada)
+int mmio_shadow_map(regmap_t* map);
+void mmio_shadow_unmap(regmap_t* map);
+int devices_map_shadow_pages(void);
+void devices_unmap_shadow_pages(void);
+
+// Mudanças de estado visíveis ao guest (acorda vCPUs estacionados em poll)
+device_id_t device_id_from_address(uint64_t guest_addr);
+uint64_t devices_change_generation(device_id_t id);
+void devices_signal_change(device_id_t id);
+bool devices_wait_change(device_id_t id, uint64_t generation, uint32_t timeout_ms);
+
 // Main device dispatcher
 device_access_result_t handle_device_access(uint64_t guest_addr, uint64_t* data, 
                                           uint32_t size, bool is_write);
@@ -0,0 +1,92 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef DISK_IMAGE_H
+#define DISK_IMAGE_H
+
+#include "hypervisor.h"
+
+// Imagens de disco dos devices de bloco: raw ou HVDK (thin provisioning).
+//
+// HVDK mapeia o disco virtual em clusters por duas tabelas: a L1, sempre em
+// memória, aponta para tabelas L2 de um cluster cada, que apontam para os
+// clusters de dados. Cluster não alocado é lido da imagem base (backing) ou
+// como zero; clusters são alocados no fim do arquivo na primeira escrita,
+// copiando antes o conteúdo da base (copy-on-write). O arquivo é esparso:
+// discard e write-zeroes de clusters inteiros liberam o espaço no host.
+//
+// Uma cadeia é overlay -> base -> ... (DISK_MAX_CHAIN camadas); só o topo
+// é gravável e as bases são abertas somente leitura, compartilháveis entre
+// VMs. As tabelas L2 lidas ficam num cache LRU por camada, write-through.
+//
+// disk_map() traduz um range do disco virtual para um trecho contíguo de
+// uma camada; o device faz o I/O de dados com handles próprios e só os
+// metadados passam pelo handle síncrono da camada.
+//
+// Um cluster alocado para uma escrita que o cobre inteiro não recebe cópia
+// COW: a entrada da L2 fica pendente (só em memória) até o device concluir
+// a escrita dos dados e chamar disk_commit(). Até lá, uma queda deixa o
+// cluster lendo da base, nunca zeros.
+
+#define DISK_MAGIC              0x4B445648  // "HVDK"
+#define DISK_VERSION            1
+#define DISK_CLUSTER_BITS       16          // 64KB
+#define DISK_BACKING_MAX        400
+#define DISK_MAX_CHAIN          8
+#define DISK_L2_CACHE_SIZE      16          // Tabelas L2 por camada
+#define DISK_PENDING_MAX        128         // Clusters à espera de disk_commit()
+
+// Entradas da L2: offset do cluster no arquivo | flags
+#define DISK_L2_ZERO            0x1ULL      // Lê zero, sem consultar a base
+#define DISK_L2_OFFSET_MASK     (~0xFFFFULL)
+
+// Cabeçalho no offset 0 (o cluster 0 é reservado para ele)
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t cluster_bits;
+    uint32_t l1_entries;
+    uint64_t size;                  // Tamanho virtual em bytes
+    uint64_t l1_offset;
+    char backing[DISK_BACKING_MAX]; // Relativo ao diretório da imagem ou absoluto; "" = sem base
+} disk_header_t;
+
+typedef enum {
+    DISK_EXTENT_DATA,               // layer/host_offset válidos
+    DISK_EXTENT_ZERO                // Nada no host: lê zero
+} disk_extent_kind_t;
+
+typedef struct {
+    disk_extent_kind_t kind;
+    uint32_t layer;                 // 0 = topo da cadeia
+    uint64_t host_offset;
+    uint64_t len;                   // <= len pedido
+    uint32_t pending;               // Escrita: clusters com a entrada à espera de disk_commit()
+} disk_extent_t;
+
+typedef struct disk disk_t;
+
+int disk_open(const char* path, bool read_only, disk_t** out);
+void disk_close(disk_t* disk);
+
+uint64_t disk_size(const disk_t* disk);
+bool disk_is_sparse(const disk_t* disk);
+uint32_t disk_layer_count(const disk_t* disk);
+const char* disk_layer_path(const disk_t* disk, uint32_t layer);
+
+// Traduz [offset, offset+len); em escrita aloca (e copia da base) o que
+// faltar no topo. Thread-safe.
+int disk_map(disk_t* disk, uint64_t offset, uint64_t len, bool write, disk_extent_t* extent);
+
+// Conclusão da escrita de um trecho com extent.pending (offset = início
+// virtual do trecho): publica as entradas pendentes dele se os dados foram
+// gravados ou devolve os clusters se a escrita falhou ou não foi submetida.
+int disk_commit(disk_t* disk, uint64_t offset, const disk_extent_t* extent, bool written);
+
+// Operações síncronas de metadados (thread de I/O do device)
+int disk_discard(disk_t* disk, uint64_t offset, uint64_t len);
+int disk_write_zeroes(disk_t* disk, uint64_t offset, uint64_t len, bool unmap);
+int disk_flush(disk_t* disk);
+
+// Provisionamento: imagem vazia ou overlay sobre uma base (tamanho da base)
+int disk_create(const char* path, uint64_t size, const char* backing);
+
+#endif // DISK_IMAGE_H
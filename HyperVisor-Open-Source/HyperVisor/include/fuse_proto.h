@@ -0,0 +1,325 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef FUSE_PROTO_H
+#define FUSE_PROTO_H
+
+#include <stdint.h>
+
+// Formato das mensagens FUSE (protocolo do kernel Linux, versão 7.31) como
+// transportadas pelo virtio-fs. Cada request é um fuse_in_header seguido
+// dos argumentos do opcode; a resposta é um fuse_out_header seguido do
+// resultado. Só os opcodes atendidos por virtio_fs.c estão aqui.
+//
+// Erros vão em fuse_out_header.error como errno negativo do guest (valores
+// do Linux, que não coincidem com os do CRT do Windows).
+
+#define FUSE_KERNEL_VERSION         7
+#define FUSE_KERNEL_MINOR_VERSION   31
+#define FUSE_ROOT_ID                1
+
+// Opcodes
+#define FUSE_LOOKUP             1
+#define FUSE_FORGET             2
+#define FUSE_GETATTR            3
+#define FUSE_SETATTR            4
+#define FUSE_MKDIR              9
+#define FUSE_UNLINK             10
+#define FUSE_RMDIR              11
+#define FUSE_RENAME             12
+#define FUSE_OPEN               14
+#define FUSE_READ               15
+#define FUSE_WRITE              16
+#define FUSE_STATFS             17
+#define FUSE_RELEASE            18
+#define FUSE_FSYNC              20
+#define FUSE_FLUSH              25
+#define FUSE_INIT               26
+#define FUSE_OPENDIR            27
+#define FUSE_READDIR            28
+#define FUSE_RELEASEDIR         29
+#define FUSE_FSYNCDIR           30
+#define FUSE_CREATE             35
+#define FUSE_DESTROY            38
+#define FUSE_BATCH_FORGET       42
+#define FUSE_SETUPMAPPING       48
+#define FUSE_REMOVEMAPPING      49
+
+// FUSE_INIT: flags negociadas
+#define FUSE_ASYNC_READ         (1u << 0)
+#define FUSE_BIG_WRITES         (1u << 5)
+#define FUSE_AUTO_INVAL_DATA    (1u << 12)
+#define FUSE_MAX_PAGES          (1u << 22)
+#define FUSE_MAP_ALIGNMENT      (1u << 26)
+
+// FUSE_SETATTR: campos válidos
+#define FATTR_MODE              (1u << 0)
+#define FATTR_SIZE              (1u << 3)
+#define FATTR_ATIME             (1u << 4)
+#define FATTR_MTIME             (1u << 5)
+#define FATTR_FH                (1u << 6)
+#define FATTR_ATIME_NOW         (1u << 7)
+#define FATTR_MTIME_NOW         (1u << 8)
+
+#define FUSE_GETATTR_FH         (1u << 0)
+#define FOPEN_KEEP_CACHE        (1u << 1)
+
+#define FUSE_SETUPMAPPING_FLAG_WRITE    (1ull << 0)
+#define FUSE_SETUPMAPPING_FLAG_READ     (1ull << 1)
+
+// Tipo e permissões (st_mode do guest)
+#define FUSE_S_IFDIR            0040000
+#define FUSE_S_IFREG            0100000
+#define FUSE_DT_DIR             4
+#define FUSE_DT_REG             8
+
+// Flags de open(2) do guest
+#define FUSE_O_ACCMODE          03
+#define FUSE_O_RDONLY           00
+#define FUSE_O_CREAT            0100
+#define FUSE_O_EXCL             0200
+#define FUSE_O_TRUNC            01000
+#define FUSE_O_APPEND           02000
+
+// errno do guest (Linux)
+#define FUSE_EPERM              1
+#define FUSE_ENOENT             2
+#define FUSE_EIO                5
+#define FUSE_EBADF              9
+#define FUSE_ENOMEM             12
+#define FUSE_EACCES             13
+#define FUSE_EBUSY              16
+#define FUSE_EEXIST             17
+#define FUSE_EXDEV              18
+#define FUSE_ENOTDIR            20
+#define FUSE_EISDIR             21
+#define FUSE_EINVAL             22
+#define FUSE_EFBIG              27
+#define FUSE_ENOSPC             28
+#define FUSE_EROFS              30
+#define FUSE_ENAMETOOLONG       36
+#define FUSE_ENOSYS             38
+#define FUSE_ENOTEMPTY          39
+#define FUSE_EPROTO             71
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t len;
+    uint32_t opcode;
+    uint64_t unique;
+    uint64_t nodeid;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t pid;
+    uint16_t total_extlen;
+    uint16_t padding;
+} fuse_in_header_t;
+
+typedef struct {
+    uint32_t len;
+    int32_t error;
+    uint64_t unique;
+} fuse_out_header_t;
+
+typedef struct {
+    uint64_t ino;
+    uint64_t size;
+    uint64_t blocks;
+    uint64_t atime;
+    uint64_t mtime;
+    uint64_t ctime;
+    uint32_t atimensec;
+    uint32_t mtimensec;
+    uint32_t ctimensec;
+    uint32_t mode;
+    uint32_t nlink;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t rdev;
+    uint32_t blksize;
+    uint32_t flags;
+} fuse_attr_t;
+
+typedef struct {
+    uint64_t nodeid;
+    uint64_t generation;
+    uint64_t entry_valid;
+    uint64_t attr_valid;
+    uint32_t entry_valid_nsec;
+    uint32_t attr_valid_nsec;
+    fuse_attr_t attr;
+} fuse_entry_out_t;
+
+typedef struct {
+    uint64_t attr_valid;
+    uint32_t attr_valid_nsec;
+    uint32_t dummy;
+    fuse_attr_t attr;
+} fuse_attr_out_t;
+
+typedef struct {
+    uint32_t major;
+    uint32_t minor;
+    uint32_t max_readahead;
+    uint32_t flags;
+} fuse_init_in_t;
+
+typedef struct {
+    uint32_t major;
+    uint32_t minor;
+    uint32_t max_readahead;
+    uint32_t flags;
+    uint16_t max_background;
+    uint16_t congestion_threshold;
+    uint32_t max_write;
+    uint32_t time_gran;
+    uint16_t max_pages;
+    uint16_t map_alignment;     // log2 do alinhamento de SETUPMAPPING
+    uint32_t unused[8];
+} fuse_init_out_t;
+
+typedef struct {
+    uint64_t nlookup;
+} fuse_forget_in_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t dummy;
+} fuse_batch_forget_in_t;
+
+typedef struct {
+    uint64_t nodeid;
+    uint64_t nlookup;
+} fuse_forget_one_t;
+
+typedef struct {
+    uint32_t getattr_flags;
+    uint32_t dummy;
+    uint64_t fh;
+} fuse_getattr_in_t;
+
+typedef struct {
+    uint32_t valid;
+    uint32_t padding;
+    uint64_t fh;
+    uint64_t size;
+    uint64_t lock_owner;
+    uint64_t atime;
+    uint64_t mtime;
+    uint64_t ctime;
+    uint32_t atimensec;
+    uint32_t mtimensec;
+    uint32_t ctimensec;
+    uint32_t mode;
+    uint32_t unused4;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t unused5;
+} fuse_setattr_in_t;
+
+typedef struct {
+    uint32_t mode;
+    uint32_t umask;
+} fuse_mkdir_in_t;
+
+typedef struct {
+    uint64_t newdir;
+} fuse_rename_in_t;
+
+typedef struct {
+    uint32_t flags;
+    uint32_t open_flags;
+} fuse_open_in_t;
+
+typedef struct {
+    uint32_t flags;
+    uint32_t mode;
+    uint32_t umask;
+    uint32_t open_flags;
+} fuse_create_in_t;
+
+typedef struct {
+    uint64_t fh;
+    uint32_t open_flags;
+    uint32_t padding;
+} fuse_open_out_t;
+
+typedef struct {
+    uint64_t fh;
+    uint32_t flags;
+    uint32_t release_flags;
+    uint64_t lock_owner;
+} fuse_release_in_t;
+
+typedef struct {
+    uint64_t fh;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t read_flags;
+    uint64_t lock_owner;
+    uint32_t flags;
+    uint32_t padding;
+} fuse_read_in_t;
+
+typedef struct {
+    uint64_t fh;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t write_flags;
+    uint64_t lock_owner;
+    uint32_t flags;
+    uint32_t padding;
+} fuse_write_in_t;
+
+typedef struct {
+    uint32_t size;
+    uint32_t padding;
+} fuse_write_out_t;
+
+typedef struct {
+    uint64_t fh;
+    uint32_t fsync_flags;
+    uint32_t padding;
+} fuse_fsync_in_t;
+
+typedef struct {
+    uint64_t blocks;
+    uint64_t bfree;
+    uint64_t bavail;
+    uint64_t files;
+    uint64_t ffree;
+    uint32_t bsize;
+    uint32_t namelen;
+    uint32_t frsize;
+    uint32_t padding;
+    uint32_t spare[6];
+} fuse_kstatfs_t;
+
+typedef struct {
+    uint64_t ino;
+    uint64_t off;               // Posição da próxima entrada
+    uint32_t namelen;
+    uint32_t type;
+    char name[];                // Sem terminador, alinhado a 8 bytes
+} fuse_dirent_t;
+
+typedef struct {
+    uint64_t fh;
+    uint64_t foffset;
+    uint64_t len;
+    uint64_t flags;
+    uint64_t moffset;           // Offset na janela DAX
+} fuse_setupmapping_in_t;
+
+typedef struct {
+    uint32_t count;
+} fuse_removemapping_in_t;
+
+typedef struct {
+    uint64_t moffset;
+    uint64_t len;
+} fuse_removemapping_one_t;
+#pragma pack(pop)
+
+#define FUSE_DIRENT_ALIGN(x)    (((x) + 7) & ~(size_t)7)
+#define FUSE_DIRENT_SIZE(n)     FUSE_DIRENT_ALIGN(offsetof(fuse_dirent_t, name) + (n))
+
+#endif // FUSE_PROTO_H
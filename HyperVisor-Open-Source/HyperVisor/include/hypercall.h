@@ -0,0 +1,88 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef HYPERCALL_H
+#define HYPERCALL_H
+
+#include "hypervisor.h"
+
+// ABI dos hypercalls: x0 = número, x1-x3 = parâmetros, retorno em x0
+#define HYPERCALL_MAX               64
+
+// Números de hypercall
+#define HC_HELLO                    0   // Hello from guest
+#define HC_SHUTDOWN                 1   // Request shutdown
+#define HC_PUTCHAR                  2   // x1 = caractere
+#define HC_BATCH                    3   // x1 = GPA do ring de requisições
+#define HC_CONSOLE_WRITE            4   // x1 = GPA do buffer, x2 = tamanho
+#define HC_SIGNAL_IRQ               5   // x1 = número da IRQ a sinalizar
+#define HC_CLOCK_READ               6   // Retorna tempo monotônico em ns
+#define HC_PVCLOCK_REGISTER         7   // x1 = GPA da página pvclock (0 = desativar), x2 = CNTVCT_EL0
+#define HC_STEAL_TIME_REGISTER      8   // x1 = GPA do registro de steal time do vCPU
+#define HC_BENCH_REPORT             9   // x1 = caso, x2 = ticks de CNTVCT, x3 = iterações
+
+// Bit 31 de w0 identifica uma chamada SMCCC (PSCI); ver psci.h
+#define HC_SMCCC_FAST_CALL          0x80000000U
+
+// Códigos de retorno (x0)
+#define HC_SUCCESS                  0
+#define HC_ERR_NOT_SUPPORTED        (-1)
+#define HC_ERR_INVALID              (-2)
+
+// Flags de registro
+#define HC_FLAG_NO_BATCH            0x1  // Não pode ser enfileirado no ring
+
+// Limite de um único HC_CONSOLE_WRITE
+#define HC_CONSOLE_WRITE_MAX        (64 * 1024)
+
+// Argumentos de um hypercall já decodificados
+typedef struct {
+    uint64_t nr;
+    uint64_t args[3];
+    uint32_t vcpu;      // Índice do vCPU que executou o HVC
+} hypercall_args_t;
+
+typedef int64_t (*hypercall_handler_t)(const hypercall_args_t* call);
+
+// Entrada da tabela de despacho
+typedef struct {
+    hypercall_handler_t handler;
+    const char* name;
+    uint32_t flags;
+    uint64_t count;
+} hypercall_entry_t;
+
+// Ring de hypercalls em lote (em RAM do guest)
+// Layout: cabeçalho seguido de 'size' entradas. O guest preenche
+// entries[head % size], incrementa head e executa HC_BATCH; o host processa
+// de tail até head e grava o resultado em cada entrada.
+typedef struct {
+    uint32_t nr;
+    uint32_t flags;
+    uint64_t args[3];
+    int64_t result;
+} hypercall_batch_entry_t;
+
+typedef struct {
+    volatile uint32_t head;   // Escrito pelo guest
+    volatile uint32_t tail;   // Escrito pelo host
+    uint32_t size;            // Número de entradas (potência de 2)
+    uint32_t reserved;
+} hypercall_ring_t;
+
+#define HC_RING_MAX_ENTRIES         256
+
+// Número a partir de x0: function ID SMCCC em w0 ou hypercall nos 16 bits baixos
+static inline uint64_t hypercall_decode_nr(uint64_t x0)
+{
+    return (x0 & HC_SMCCC_FAST_CALL) ? (x0 & 0xFFFFFFFF) : (x0 & 0xFFFF);
+}
+
+// Registro e despacho
+int hypercall_init(void);
+int hypercall_register(uint32_t nr, hypercall_handler_t handler, const char* name, uint32_t flags);
+void hypercall_unregister(uint32_t nr);
+int64_t hypercall_dispatch(const hypercall_args_t* call);
+
+// Chamadas atendidas fora do despacho (fast path do vetor em EL2)
+void hypercall_account(uint32_t nr, uint64_t calls);
+
+#endif // HYPERCALL_H
@@ -14,6 +14,27 @@
 #define LOG_ERROR(fmt, ...) printf("[ERROR] " fmt "\n", ##__VA_ARGS__)
 #define LOG_DEBUG(fmt, ...) printf("[DEBUG] " fmt "\n", ##__VA_ARGS__)
 
+// Trace de caminhos quentes (exits, hypercalls) - compilado só com HV_TRACE
+#ifdef HV_TRACE
+#define LOG_TRACE(fmt, ...) printf("[TRACE] " fmt "\n", ##__VA_ARGS__)
+#else
+#define LOG_TRACE(fmt, ...) ((void)0)
+#endif
+
+// Alinhamento de variáveis estáticas (antes da declaração)
+#ifdef _MSC_VER
+#define HV_ALIGN(n) __declspec(align(n))
+#else
+#define HV_ALIGN(n) __attribute__((aligned(n)))
+#endif
+
+// Variável por thread (ex.: vCPU corrente de cada thread de execução)
+#ifdef _MSC_VER
+#define HV_THREAD_LOCAL __declspec(thread)
+#else
+#define HV_THREAD_LOCAL __thread
+#endif
+
 // Constants
 #define GUEST_RAM_SIZE      (64 * 1024 * 1024)  // 64MB
 #define GUEST_RAM_BASE      0x40000000           // ARM64 typical RAM base
@@ -29,6 +50,9 @@
 #define TIMER_BASE          (DEVICE_BASE + 0x00010000) 
 #define GIC_DIST_BASE       (DEVICE_BASE + 0x00020000)
 #define GIC_CPU_BASE        (DEVICE_BASE + 0x00030000)
+#define VIRTIO_MMIO_BASE    (DEVICE_BASE + 0x00040000)   // Slots de 0x200 (ver virtio.h)
+#define VIRTIO_SHM_BASE     0x1000000000ULL              // Memória de devices virtio: janelas DAX, pmem (64GB)
+#define GUEST_PA_BITS_FALLBACK  36                       // IPA sem a capability do WHP (builds antigos)
 
 // UART registers (PL011)
 #define UART_DR             0x000
@@ -39,6 +63,7 @@
 #define UART_CR             0x030
 #define UART_IMSC           0x038
 #define UART_ICR            0x044
+#define UART_PERIPH_ID0     0xFE0
 
 // Exit codes
 #define EXIT_SUCCESS        0
@@ -46,6 +71,9 @@
 #define EXIT_VM_FAILED      2
 #define EXIT_RUN_FAILED     3
 
+// Largura de IPA da partição (bits), descoberta em hypervisor_init()
+extern uint32_t g_guest_pa_bits;
+
 // Function declarations
 int hypervisor_init(void);
 void hypervisor_cleanup(void);
@@ -0,0 +1,78 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef PMU_H
+#define PMU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// PMU virtual (PMUv3) por vCPU: contador de ciclos e PMU_NUM_COUNTERS
+// contadores de eventos. Os registradores PM* entram na tabela de sysreg.c
+// via pmu_init(); os valores vêm de uma fonte fornecida pelo VMM
+// (pmu_source_fn), que devolve uma contagem cumulativa por evento. Deltas são
+// acumulados nas leituras dos contadores e em pmu_poll(), chamado a cada
+// exit; overflow com interrupção habilitada vira o nível deste vCPU no PPI
+// PMU_IRQ_PPI (gic_set_ppi_level).
+//
+// Ler CPU_CYCLES da fonte custa uma chamada ao WHP, então pmu_poll() só
+// amostra os contadores de ciclos quando passa o prazo mais curto em que um
+// deles com interrupção habilitada poderia transbordar: a fonte avança no
+// máximo PMU_CYCLE_HZ ciclos por segundo de relógio. Os demais eventos são
+// baratos e acompanham cada exit.
+
+#define PMU_NUM_COUNTERS        6       // PMCR_EL0.N (mesmo do Cortex-A57)
+#define PMU_CYCLE_INDEX         31      // Bit do contador de ciclos nas máscaras
+#define PMU_IRQ_PPI             23
+#define PMU_CYCLE_HZ            2000000000ULL   // Frequência nominal de PMCCNTR_EL0
+
+// Eventos comuns suportados (PMCEID0_EL0)
+#define PMU_EVT_SW_INCR         0x00
+#define PMU_EVT_EXC_TAKEN       0x09
+#define PMU_EVT_EXC_RETURN      0x0A
+#define PMU_EVT_CPU_CYCLES      0x11
+
+// PMCR_EL0
+#define PMCR_E                  (1U << 0)
+#define PMCR_P                  (1U << 1)   // Zera contadores de eventos (escrita)
+#define PMCR_C                  (1U << 2)   // Zera o contador de ciclos (escrita)
+#define PMCR_D                  (1U << 3)   // Ciclos divididos por 64
+#define PMCR_LC                 (1U << 6)   // Overflow de ciclos em 64 bits
+#define PMCR_WRITABLE           (PMCR_E | PMCR_D | (1U << 4) | (1U << 5) | PMCR_LC)
+#define PMCR_N_SHIFT            11
+#define PMCR_IMP_SHIFT          24
+
+// Contagem cumulativa do evento desde a criação do vCPU (0 = não suportado)
+typedef uint64_t (*pmu_source_fn)(void* opaque, uint32_t event);
+
+typedef struct {
+    uint32_t pmcr;
+    uint32_t cnten;             // PMCNTENSET/CLR: bits 0..N-1 e 31 (ciclos)
+    uint32_t inten;             // PMINTENSET/CLR
+    uint32_t ovs;               // PMOVSSET/CLR
+    uint32_t selr;
+    uint32_t userenr;
+    uint32_t evtype[PMU_NUM_COUNTERS];
+    uint64_t ccfiltr;
+    // Índice PMU_NUM_COUNTERS = contador de ciclos
+    uint64_t count[PMU_NUM_COUNTERS + 1];
+    uint64_t base[PMU_NUM_COUNTERS + 1];    // Leitura da fonte no último sync
+    uint64_t cycles_deadline_ns;    // Próxima amostragem de CPU_CYCLES em pmu_poll (0 = já)
+    bool irq_level;             // Nível deste vCPU na linha PMU_IRQ_PPI
+    uint32_t vcpu;              // Índice do vCPU (banco do PPI)
+    pmu_source_fn source;
+    void* opaque;
+} pmu_vcpu_t;
+
+// Registra os registradores PM* (depois de sysreg_init)
+int pmu_init(void);
+
+// Chamado depois de sysreg_vcpu_init(); source pode ser NULL (só SW_INCR)
+void pmu_vcpu_init(pmu_vcpu_t* pmu, uint32_t vcpu, pmu_source_fn source, void* opaque);
+
+// Acumula deltas da fonte, marca overflows e sinaliza PMU_IRQ_PPI
+void pmu_sync(pmu_vcpu_t* pmu);
+
+// Versão do exit (now_ns de timer_get_time_ns()): eventos baratos sempre,
+// CPU_CYCLES só depois de cycles_deadline_ns
+void pmu_poll(pmu_vcpu_t* pmu, uint64_t now_ns);
+
+#endif // PMU_H
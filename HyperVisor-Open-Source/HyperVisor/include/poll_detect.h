@@ -0,0 +1,37 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef POLL_DETECT_H
+#define POLL_DETECT_H
+
+#include "hypervisor.h"
+
+// Detecção de spin-poll em registradores de status de devices.
+//
+// Um guest que relê o mesmo registrador, no mesmo PC, obtendo sempre o mesmo
+// valor, está esperando uma mudança de estado do device. Após
+// POLL_DETECT_THRESHOLD leituras idênticas o vCPU é estacionado até o device
+// sinalizar mudança (devices_signal_change) ou até POLL_PARK_TIMEOUT_MS, o que
+// limita o atraso visto pelo guest.
+//
+// As leituras precisam ser consecutivas: uma escrita MMIO ou qualquer outro
+// exit no meio chama poll_detect_reset(). Um loop que lê o FR da UART e
+// escreve o DR a cada caractere faz progresso e nunca estaciona.
+
+#define POLL_DETECT_THRESHOLD   32
+#define POLL_PARK_TIMEOUT_MS    10
+
+typedef struct {
+    uint64_t pc;
+    uint64_t gpa;
+    uint64_t value;
+    uint64_t generation;    // Geração do device antes da última leitura
+    uint32_t repeats;
+    uint64_t parks;
+} poll_detect_t;
+
+// Quebra a sequência de leituras (escrita MMIO ou exit de outro tipo)
+void poll_detect_reset(poll_detect_t* pd);
+bool poll_detect_observe(poll_detect_t* pd, uint64_t pc, uint64_t gpa,
+                         uint64_t value, uint64_t generation);
+void poll_detect_park(poll_detect_t* pd);
+
+#endif // POLL_DETECT_H
@@ -0,0 +1,58 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef PSCI_H
+#define PSCI_H
+
+#include "hypercall.h"
+
+// PSCI 1.1 / SMCCC 1.1 sobre HVC (conduit "hvc" no device tree do guest).
+// Function IDs têm o bit 31 (fast call) ligado e chegam pelo mesmo exit dos
+// hypercalls; hypercall_dispatch() os encaminha para psci_dispatch().
+
+#define PSCI_VERSION_VALUE          0x00010001  // 1.1
+#define SMCCC_VERSION_VALUE         0x00010001  // 1.1
+
+// Function IDs (SMC32 e SMC64)
+#define SMCCC_VERSION               0x80000000
+#define SMCCC_ARCH_FEATURES         0x80000001
+#define PSCI_0_2_FN_BASE            0x84000000
+#define PSCI_0_2_FN64_BASE          0xC4000000
+#define PSCI_FN(n)                  (PSCI_0_2_FN_BASE + (n))
+#define PSCI_FN64(n)                (PSCI_0_2_FN64_BASE + (n))
+
+#define PSCI_VERSION                PSCI_FN(0)
+#define PSCI_CPU_SUSPEND            PSCI_FN(1)
+#define PSCI_CPU_SUSPEND_64         PSCI_FN64(1)
+#define PSCI_CPU_OFF                PSCI_FN(2)
+#define PSCI_CPU_ON                 PSCI_FN(3)
+#define PSCI_CPU_ON_64              PSCI_FN64(3)
+#define PSCI_AFFINITY_INFO          PSCI_FN(4)
+#define PSCI_AFFINITY_INFO_64       PSCI_FN64(4)
+#define PSCI_MIGRATE_INFO_TYPE      PSCI_FN(6)
+#define PSCI_SYSTEM_OFF             PSCI_FN(8)
+#define PSCI_SYSTEM_RESET           PSCI_FN(9)
+#define PSCI_FEATURES               PSCI_FN(10)
+
+// Códigos de retorno
+#define PSCI_RET_SUCCESS            0
+#define PSCI_RET_NOT_SUPPORTED      (-1)
+#define PSCI_RET_INVALID_PARAMS     (-2)
+#define PSCI_RET_DENIED             (-3)
+#define PSCI_RET_ALREADY_ON         (-4)
+#define PSCI_RET_ON_PENDING         (-5)
+#define PSCI_RET_INTERNAL_FAILURE   (-6)
+#define PSCI_RET_INVALID_ADDRESS    (-9)
+
+// AFFINITY_INFO
+#define PSCI_AFFINITY_ON            0
+#define PSCI_AFFINITY_OFF           1
+#define PSCI_AFFINITY_ON_PENDING    2
+
+// MIGRATE_INFO_TYPE: sem Trusted OS
+#define PSCI_TOS_NOT_PRESENT        2
+
+// power_state de CPU_SUSPEND (formato original)
+#define PSCI_POWER_STATE_TYPE       (1U << 16)  // 1 = power down
+
+int64_t psci_dispatch(const hypercall_args_t* call);
+
+#endif // PSCI_H
@@ -0,0 +1,86 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef PVCLOCK_H
+#define PVCLOCK_H
+
+#include <stdint.h>
+
+// Página de relógio paravirtual compartilhada com o guest.
+// Este header não depende do host para poder ser incluído pelo código guest.
+//
+// O host publica um par escala/offset protegido por seqlock: 'version' é
+// ímpar enquanto a página está sendo atualizada. O guest lê o contador
+// virtual (CNTVCT_EL0) sem exit e calcula:
+//   ns = system_time_ns + ((counter - counter_timestamp) * mul) >> shift
+//
+// CNTVCT_EL0 não é interceptado: é o contador genérico do hardware, na
+// frequência de CNTFRQ_EL0, menos o CNTVOFF da partição. A escala vem da
+// frequência real e counter_timestamp é o valor que o guest leria no
+// instante publicado.
+
+#define PVCLOCK_FLAG_STABLE     0x1   // Contador estável entre vCPUs
+#define PVCLOCK_SHIFT           32    // Escala fixa: ns = (ticks * mul) >> 32
+
+typedef struct {
+    volatile uint32_t version;
+    uint32_t flags;
+    uint64_t counter_timestamp;   // Contador virtual no momento da publicação
+    uint64_t system_time_ns;      // Tempo do guest (ns) em counter_timestamp
+    uint64_t mul;                 // Multiplicador ponto-fixo ticks -> ns
+    uint32_t shift;               // Deslocamento do multiplicador
+    uint32_t reserved;
+    uint64_t counter_frequency;   // Frequência do contador (Hz), informativa
+} pvclock_page_t;
+
+// (delta * mul) >> shift com produto intermediário de 128 bits
+static inline uint64_t pvclock_scale_delta(uint64_t delta, uint64_t mul, uint32_t shift)
+{
+    uint64_t a_lo = (uint32_t)delta, a_hi = delta >> 32;
+    uint64_t b_lo = (uint32_t)mul, b_hi = mul >> 32;
+
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi;
+    uint64_t hi_hi = a_hi * b_hi;
+
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    uint64_t upper = hi_hi + (hi_lo >> 32) + (cross >> 32);
+    uint64_t lower = (cross << 32) | (uint32_t)lo_lo;
+
+    if (shift == 0) {
+        return lower;
+    }
+    return (lower >> shift) | (upper << (64 - shift));
+}
+
+// Multiplicador de um contador de 'freq' Hz na escala PVCLOCK_SHIFT,
+// arredondado (erro abaixo de 1 ns por segundo de delta)
+static inline uint64_t pvclock_mul_for_freq(uint64_t freq)
+{
+    return ((1000000000ULL << PVCLOCK_SHIFT) + freq / 2) / freq;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+// Leitura do lado guest: repete enquanto o host estiver publicando
+static inline uint64_t pvclock_read_ns(const volatile pvclock_page_t* page, uint64_t (*read_counter)(void))
+{
+    uint32_t version;
+    uint64_t ns;
+
+    do {
+        version = page->version;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        ns = page->system_time_ns +
+             pvclock_scale_delta(read_counter() - page->counter_timestamp, page->mul, page->shift);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((version & 1) || version != page->version);
+
+    return ns;
+}
+#endif
+
+// Lado host
+int pvclock_init(void);
+int pvclock_register(uint64_t page_gpa, uint64_t guest_counter);
+void pvclock_update(void);
+
+#endif // PVCLOCK_H
@@ -0,0 +1,110 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef REGMAP_H
+#define REGMAP_H
+
+#include "hypervisor.h"
+
+// Mapa declarativo de registradores MMIO.
+//
+// Cada device descreve seus registradores em uma tabela constante de
+// regmap_reg_t (offset, largura, acesso, campo de estado, hooks). A partir
+// dela regmap_init() monta um índice denso offset/4 -> descritor, de modo
+// que o despacho no caminho quente é uma indexação, sem switch. A mesma
+// tabela serve para save/restore do estado e para trace com nomes.
+
+// Tipo de acesso
+#define REGMAP_RO           0x1
+#define REGMAP_WO           0x2
+#define REGMAP_RW           (REGMAP_RO | REGMAP_WO)
+
+// Flags
+// VOLATILE: a leitura tem efeito colateral ou o valor muda sem que o host
+// seja notificado. Registradores que mudam apenas por eventos do host (ex.:
+// pending do GIC) não são voláteis, desde que o device chame
+// regmap_shadow_sync() após o evento. Uma escrita do guest atualiza na
+// página sombra só os elementos escritos e os que compartilham o hook de
+// leitura ou o campo deles; uma escrita que muda outros registradores
+// precisa que o device os sincronize.
+#define REGMAP_F_VOLATILE   0x1
+// W1: registrador de ação (set/clear por bit) em que bits 0 não têm efeito.
+// Uma escrita mais estreita que o elemento completa os outros bytes com 0
+// em vez do valor atual, que reaplicaria a ação neles.
+#define REGMAP_F_W1         0x2
+
+// Registrador sem campo de estado associado
+#define REGMAP_NO_FIELD     (-1)
+
+struct regmap_reg;
+
+// Hooks: 'index' é o elemento dentro de um array de registradores
+typedef uint64_t (*regmap_read_fn)(void* state, const struct regmap_reg* reg, uint32_t index);
+typedef void (*regmap_write_fn)(void* state, const struct regmap_reg* reg, uint32_t index, uint64_t value);
+
+typedef struct regmap_reg {
+    const char* name;
+    uint32_t offset;        // Offset do primeiro registrador na janela
+    uint16_t count;         // Elementos no array (1 = escalar)
+    uint8_t width;          // Bytes por elemento
+    uint8_t access;         // REGMAP_RO / REGMAP_WO / REGMAP_RW
+    uint8_t flags;
+    int32_t field;          // offsetof() de um uint32_t[count] no estado, ou REGMAP_NO_FIELD
+    uint32_t mask;          // Bits graváveis no campo
+    uint32_t reset;         // Valor de reset (ou valor constante sem campo/hook)
+    regmap_read_fn read;    // Opcional: substitui a leitura do campo
+    regmap_write_fn write;  // Opcional: substitui a escrita no campo
+} regmap_reg_t;
+
+// Descritores com inicializadores nomeados
+#define REGMAP_REG(nm, off, acc, fld, msk, rst) \
+    { .name = nm, .offset = (off), .count = 1, .width = 4, .access = (acc), \
+      .field = (fld), .mask = (msk), .reset = (rst) }
+
+#define REGMAP_ARRAY(nm, off, cnt, w, acc, fld, msk) \
+    { .name = nm, .offset = (off), .count = (cnt), .width = (w), .access = (acc), \
+      .field = (fld), .mask = (msk) }
+
+#define REGMAP_HOOK(nm, off, cnt, acc, flg, rd, wr) \
+    { .name = nm, .offset = (off), .count = (cnt), .width = 4, .access = (acc), \
+      .flags = (flg), .field = REGMAP_NO_FIELD, .read = (rd), .write = (wr) }
+
+#define REGMAP_MAX_WINDOW   0x1000
+
+typedef struct {
+    const char* name;
+    uint64_t base;                  // Endereço físico guest da janela
+    uint32_t size;                  // Tamanho da janela (<= REGMAP_MAX_WINDOW)
+    void* state;                    // Estrutura de estado do device
+    const regmap_reg_t* regs;
+    uint32_t nregs;
+    uint8_t index[REGMAP_MAX_WINDOW / 4];  // offset/4 -> índice+1 em regs (0 = nenhum)
+    
+    // Página sombra somente-leitura (ver mmio_shadow.c)
+    bool shadowable;                // Nenhum registrador legível é volátil
+    uint32_t* shadow;               // Cópia host dos valores lidos pelo guest
+} regmap_t;
+
+#define REGMAP_COUNT(table) ((uint32_t)(sizeof(table) / sizeof((table)[0])))
+
+int regmap_init(regmap_t* map);
+void regmap_reset(regmap_t* map);
+
+// Acesso MMIO: 'offset' relativo a map->base; reads preenchem *data
+bool regmap_read(const regmap_t* map, uint32_t offset, uint32_t size, uint64_t* data);
+bool regmap_write(const regmap_t* map, uint32_t offset, uint32_t size, uint64_t data);
+
+// Save/restore de todos os campos de estado descritos (em palavras de 32 bits)
+uint32_t regmap_state_words(const regmap_t* map);
+uint32_t regmap_save(const regmap_t* map, uint32_t* buffer, uint32_t max_words);
+uint32_t regmap_restore(const regmap_t* map, const uint32_t* buffer, uint32_t words);
+
+// Recalcula a página sombra (no-op se a janela não estiver sombreada)
+void regmap_shadow_sync(const regmap_t* map);
+
+// Recalcula só as palavras em [offset, offset + size): para eventos do host
+// que mudam registradores conhecidos, sem varrer a janela inteira
+void regmap_shadow_sync_range(const regmap_t* map, uint32_t offset, uint32_t size);
+
+// Descritor que cobre um offset (trace/debug), NULL se não implementado
+const regmap_reg_t* regmap_lookup(const regmap_t* map, uint32_t offset);
+
+#endif // REGMAP_H
@@ -0,0 +1,110 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef STAGE2_H
+#define STAGE2_H
+
+// Tabelas de tradução stage-2 (IPA -> PA) para o modo EL2 bare-metal.
+// Granule de 4KB, início no nível 1: blocos de 1GB (L1), 2MB (L2) e páginas
+// de 4KB (L3). O módulo é C puro - não inclui windows.h nem executa
+// instruções privilegiadas; memória para tabelas e invalidação de TLB vêm
+// de stage2_mm_ops_t, o que permite verificar os descritores gerados em
+// qualquer host.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define STAGE2_TABLE_ENTRIES    512
+#define STAGE2_START_LEVEL      1
+#define STAGE2_MAX_IPA_BITS     39      // 512 entradas no nível 1, sem concatenação
+#define STAGE2_MIN_IPA_BITS     32
+
+#define STAGE2_LEVEL_SHIFT(l)   (39 - 9 * (l))             // L1=30, L2=21, L3=12
+#define STAGE2_LEVEL_SIZE(l)    (1ULL << STAGE2_LEVEL_SHIFT(l))
+
+// Formato dos descritores (ARM ARM D8.3)
+#define S2_DESC_VALID           (1ULL << 0)
+#define S2_DESC_TABLE           (3ULL << 0)    // L1/L2: aponta para próxima tabela
+#define S2_DESC_BLOCK           (1ULL << 0)    // L1/L2: bloco
+#define S2_DESC_PAGE            (3ULL << 0)    // L3: página
+#define S2_DESC_TYPE_MASK       (3ULL << 0)
+#define S2_DESC_OA_MASK         0x0000FFFFFFFFF000ULL
+#define S2_DESC_ATTR_MASK       (~S2_DESC_OA_MASK & ~S2_DESC_TYPE_MASK)
+
+#define S2_MEMATTR_SHIFT        2
+#define S2_MEMATTR_MASK         (0xFULL << S2_MEMATTR_SHIFT)
+#define S2_MEMATTR_DEVICE       (0x1ULL << S2_MEMATTR_SHIFT)   // Device-nGnRE
+#define S2_MEMATTR_NORMAL       (0xFULL << S2_MEMATTR_SHIFT)   // Normal WB inner/outer
+#define S2_AP_R                 (1ULL << 6)
+#define S2_AP_W                 (1ULL << 7)
+#define S2_SH_INNER             (3ULL << 8)
+#define S2_AF                   (1ULL << 10)
+#define S2_XN                   (2ULL << 53)   // XN[54:53] = 0b10: sem execução em EL1/EL0
+
+// Permissões e tipos de memória aceitos pela API
+#define STAGE2_PERM_R           0x1
+#define STAGE2_PERM_W           0x2
+#define STAGE2_PERM_X           0x4
+#define STAGE2_PERM_RW          (STAGE2_PERM_R | STAGE2_PERM_W)
+#define STAGE2_PERM_RWX         (STAGE2_PERM_RW | STAGE2_PERM_X)
+
+typedef enum {
+    STAGE2_MEM_NORMAL,
+    STAGE2_MEM_DEVICE
+} stage2_memtype_t;
+
+// Operações fornecidas pelo ambiente (EL2 real ou teste no host)
+typedef struct {
+    // Página de 4KB zerada e alinhada; devolve o endereço físico em *phys
+    void* (*alloc_page)(void* opaque, uint64_t* phys);
+    void (*free_page)(void* opaque, void* page, uint64_t phys);
+    void* (*phys_to_virt)(void* opaque, uint64_t phys);
+    // Opcional: invalida traduções da faixa [ipa, ipa + size) (break-before-make)
+    void (*tlb_invalidate)(void* opaque, uint64_t ipa, uint64_t size);
+    void* opaque;
+} stage2_mm_ops_t;
+
+typedef struct {
+    uint32_t blocks_1g;
+    uint32_t blocks_2m;
+    uint32_t pages_4k;
+    uint32_t tables;            // Tabelas abaixo da raiz
+} stage2_stats_t;
+
+typedef struct {
+    stage2_mm_ops_t mm;
+    uint64_t* root;
+    uint64_t root_phys;
+    uint32_t ipa_bits;
+} stage2_t;
+
+int stage2_init(stage2_t* s2, const stage2_mm_ops_t* mm, uint32_t ipa_bits);
+void stage2_destroy(stage2_t* s2);
+
+// Mapeia [ipa, ipa + size) -> [pa, pa + size) usando o maior bloco que o
+// alinhamento de IPA e PA permitir. Faixas devem ser múltiplas de 4KB.
+int stage2_map(stage2_t* s2, uint64_t ipa, uint64_t pa, uint64_t size,
+               uint32_t perms, stage2_memtype_t type);
+int stage2_unmap(stage2_t* s2, uint64_t ipa, uint64_t size);
+
+// Altera permissões da faixa; blocos parcialmente cobertos são divididos
+int stage2_protect(stage2_t* s2, uint64_t ipa, uint64_t size, uint32_t perms);
+
+// Dirty tracking: divide blocos da faixa até páginas de 4KB e, ao final,
+// volta a agrupar tabelas uniformes em blocos
+int stage2_split(stage2_t* s2, uint64_t ipa, uint64_t size);
+int stage2_merge(stage2_t* s2, uint64_t ipa, uint64_t size);
+
+// Tradução por software; devolve o descritor folha e seu nível
+bool stage2_lookup(const stage2_t* s2, uint64_t ipa, uint64_t* pa,
+                   uint64_t* desc, uint32_t* level);
+void stage2_get_stats(const stage2_t* s2, stage2_stats_t* stats);
+
+// Bits de PA de ID_AA64MMFR0_EL1.PARange (limitado a 48: 4KB sem FEAT_LPA2)
+uint32_t stage2_pa_bits(uint32_t parange);
+
+// Valores de registradores para esta tabela. VTCR_EL2.PS é o tamanho do PA
+// do host (PARange), não o do IPA.
+uint64_t stage2_vtcr(const stage2_t* s2, uint32_t parange);
+uint64_t stage2_vttbr(const stage2_t* s2, uint16_t vmid);
+
+#endif // STAGE2_H
@@ -0,0 +1,63 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef STEAL_TIME_H
+#define STEAL_TIME_H
+
+#include <stdint.h>
+
+// Registro de steal time por vCPU, compartilhado com o guest.
+// Como o pvclock, este header pode ser incluído pelo código guest.
+//
+// steal_ns acumula o tempo em que o vCPU estava pronto para executar mas a
+// thread que o executa não estava em CPU física. 'version' é ímpar enquanto
+// o host atualiza o registro.
+
+#define STEAL_TIME_ALIGN    64
+
+// Déficit máximo carregado entre amostras: dois ticks do relógio do host,
+// a granularidade dos tempos de thread
+#define STEAL_TIME_CARRY_NS 32000000LL
+
+typedef struct {
+    uint64_t steal_ns;
+    volatile uint32_t version;
+    uint32_t flags;
+    uint8_t reserved[48];
+} steal_time_record_t;
+
+// Credita uma amostra: parede em que o vCPU estava pronto contra o tempo
+// que ele passou em CPU. O excesso de CPU de uma amostra (granularidade do
+// host, runtime de janelas fora da parede) vira déficit descontado das
+// seguintes, limitado a STEAL_TIME_CARRY_NS. steal_ns nunca diminui.
+static inline void steal_time_credit(uint64_t* steal_ns, int64_t* balance_ns,
+                                     uint64_t wall_ns, uint64_t ran_ns)
+{
+    int64_t balance = *balance_ns + (int64_t)(wall_ns - ran_ns);
+
+    if (balance > 0) {
+        *steal_ns += (uint64_t)balance;
+        balance = 0;
+    } else if (balance < -STEAL_TIME_CARRY_NS) {
+        balance = -STEAL_TIME_CARRY_NS;
+    }
+    *balance_ns = balance;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+// Leitura do lado guest: repete enquanto o host estiver publicando
+static inline uint64_t steal_time_read_ns(const volatile steal_time_record_t* record)
+{
+    uint32_t version;
+    uint64_t ns;
+
+    do {
+        version = record->version;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        ns = record->steal_ns;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((version & 1) || version != record->version);
+
+    return ns;
+}
+#endif
+
+#endif // STEAL_TIME_H
@@ -0,0 +1,117 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef SYSREG_H
+#define SYSREG_H
+
+#include "hypervisor.h"
+#include "pmu.h"
+
+// Emulação de registradores de sistema (MRS/MSR/SYS, EC 0x18).
+//
+// Cada registrador é descrito por um sysreg_desc_t com a codificação
+// op0/op1/CRn/CRm/op2 empacotada em 16 bits. sysreg_register() monta um
+// índice denso codificação -> descritor, de modo que o despacho de um trap é
+// uma indexação. Registradores com SYSREG_F_SHADOW guardam valor por vCPU
+// em sysreg_vcpu_t. Os dois caminhos (WHP e EL2) usam a mesma tabela e
+// apenas escrevem o resultado em Rt do seu próprio contexto.
+//
+// Os timers genéricos são exceção: sem FEAT_ECV nem o WHP nem CNTHCTL_EL2
+// interceptam CNTV_*/CNTVCT, e o WHP também não intercepta CNTP_*. As
+// entradas de timer só são alcançadas no modo EL2, que desvia CNTP_* e
+// CNTPCT (e CNTV_*/CNTVCT quando há ECV).
+
+// Codificação empacotada: op0[15:14] op1[13:11] CRn[10:7] CRm[6:3] op2[2:0]
+#define SYSREG_ENC(op0, op1, crn, crm, op2) \
+    ((uint16_t)(((op0) << 14) | ((op1) << 11) | ((crn) << 7) | ((crm) << 3) | (op2)))
+
+// Campos do ISS de EC 0x18
+#define SYSREG_ISS_ENC(iss) \
+    SYSREG_ENC(((iss) >> 20) & 3, ((iss) >> 14) & 7, ((iss) >> 10) & 15, \
+               ((iss) >> 1) & 15, ((iss) >> 17) & 7)
+#define SYSREG_ISS_RT(iss)      (((iss) >> 5) & 31)
+#define SYSREG_ISS_IS_READ(iss) ((iss) & 1)
+
+// Registradores usados fora da tabela
+#define SYSREG_MIDR_EL1         SYSREG_ENC(3, 0, 0, 0, 0)
+#define SYSREG_MPIDR_EL1        SYSREG_ENC(3, 0, 0, 0, 5)
+#define SYSREG_ID_AA64PFR0_EL1  SYSREG_ENC(3, 0, 0, 4, 0)
+#define SYSREG_ID_AA64PFR1_EL1  SYSREG_ENC(3, 0, 0, 4, 1)
+#define SYSREG_ID_AA64DFR0_EL1  SYSREG_ENC(3, 0, 0, 5, 0)
+#define SYSREG_ID_AA64ISAR0_EL1 SYSREG_ENC(3, 0, 0, 6, 0)
+#define SYSREG_ID_AA64ISAR1_EL1 SYSREG_ENC(3, 0, 0, 6, 1)
+#define SYSREG_ID_AA64MMFR0_EL1 SYSREG_ENC(3, 0, 0, 7, 0)
+#define SYSREG_ID_AA64MMFR1_EL1 SYSREG_ENC(3, 0, 0, 7, 1)
+#define SYSREG_ID_AA64MMFR2_EL1 SYSREG_ENC(3, 0, 0, 7, 2)
+#define SYSREG_CTR_EL0          SYSREG_ENC(3, 3, 0, 0, 1)
+
+#define SYSREG_MAX_REGS         128
+
+// Tipo de acesso e flags
+#define SYSREG_RO               0x1
+#define SYSREG_WO               0x2
+#define SYSREG_RW               (SYSREG_RO | SYSREG_WO)
+#define SYSREG_F_SHADOW         0x4     // Valor por vCPU em sysreg_vcpu_t
+
+typedef struct {
+    uint32_t vcpu;                      // Índice do vCPU (MPIDR, PMU)
+    uint64_t shadow[SYSREG_MAX_REGS];   // Indexado pelo slot do registrador
+    uint32_t timer_level;               // Bit 0 = CNTV, bit 1 = CNTP: PPI em nível alto
+    pmu_vcpu_t pmu;                     // Contadores do PMU virtual
+} sysreg_vcpu_t;
+
+struct sysreg_desc;
+
+typedef uint64_t (*sysreg_read_fn)(sysreg_vcpu_t* vcpu, const struct sysreg_desc* reg);
+typedef void (*sysreg_write_fn)(sysreg_vcpu_t* vcpu, const struct sysreg_desc* reg, uint64_t value);
+
+typedef struct sysreg_desc {
+    const char* name;
+    uint16_t enc;
+    uint16_t flags;             // SYSREG_RO/WO/RW | SYSREG_F_*
+    uint64_t reset;             // Valor de reset (ou constante sem shadow/hook)
+    uint64_t mask;              // Bits graváveis no shadow
+    sysreg_read_fn read;        // Opcional: substitui a leitura do shadow
+    sysreg_write_fn write;      // Opcional: substitui a escrita no shadow
+} sysreg_desc_t;
+
+#define SYSREG_CONST(nm, e, val) \
+    { .name = nm, .enc = (e), .flags = SYSREG_RO | SYSREG_F_SHADOW, .reset = (val) }
+
+#define SYSREG_SHADOW(nm, e, acc, rst, msk) \
+    { .name = nm, .enc = (e), .flags = (acc) | SYSREG_F_SHADOW, .reset = (rst), .mask = (msk) }
+
+#define SYSREG_HOOK(nm, e, acc, rd, wr) \
+    { .name = nm, .enc = (e), .flags = (acc) | SYSREG_F_SHADOW, .read = (rd), .write = (wr) }
+
+#define SYSREG_COUNT(table) ((uint32_t)(sizeof(table) / sizeof((table)[0])))
+
+typedef enum {
+    SYSREG_OK,
+    SYSREG_UNDEF                // Guest deve receber UNDEFINED
+} sysreg_result_t;
+
+// Frequência do contador exposto ao guest (CNTFRQ_EL0)
+#define SYSREG_CNTFRQ           62500000ULL
+
+int sysreg_init(void);
+int sysreg_register(const sysreg_desc_t* regs, uint32_t count);
+const sysreg_desc_t* sysreg_lookup(uint16_t enc);
+
+// Valor de reset usado por sysreg_vcpu_init (modelos de CPU)
+int sysreg_set_reset(uint16_t enc, uint64_t value);
+
+void sysreg_vcpu_init(sysreg_vcpu_t* vcpu, uint32_t index);
+uint64_t* sysreg_shadow(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg);
+
+// Atualiza o nível do PPI dos timers emulados (sobe nos deadlines vencidos)
+// e devolve o próximo deadline armado em ns de timer_get_time_ns()
+// (UINT64_MAX = nenhum). Chamado a cada exit do modo EL2, já que nada mais
+// observa o contador passar; sob o WHP os timers não são interceptados.
+uint64_t sysreg_timer_poll(sysreg_vcpu_t* vcpu);
+
+// Valor do contador do guest (CNTVCT_EL0) no instante ns de timer_get_time_ns()
+uint64_t sysreg_counter_at(uint64_t ns);
+
+// Executa o acesso; em leituras *value recebe o valor a gravar em Rt
+sysreg_result_t sysreg_access(sysreg_vcpu_t* vcpu, uint16_t enc, bool is_read, uint64_t* value);
+
+#endif // SYSREG_H
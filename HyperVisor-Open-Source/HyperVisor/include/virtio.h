@@ -0,0 +1,279 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include "devices.h"
+#include "blk_qos.h"
+
+// Transporte virtio-mmio (virtio 1.1, seção 4.2, versão 2 "modern").
+// Cada device ocupa um slot de VIRTIO_MMIO_SLOT_SIZE bytes a partir de
+// VIRTIO_MMIO_BASE e sinaliza pela SPI VIRTIO_IRQ_BASE + slot. Os
+// registradores comuns são um regmap com state = virtio_dev_t; o espaço de
+// configuração (offset 0x100) é servido byte a byte da config do device.
+//
+// Os anéis (split virtqueue) são lidos e escritos direto na RAM do guest
+// via vm_gpa_to_hva(). Cada fila pertence à thread de processamento do
+// device; o transporte só troca os anéis com o processamento parado (reset,
+// ver virtio_dev_ops_t). QueueReady = 0 apenas interrompe o consumo.
+
+#define VIRTIO_MMIO_SLOT_SIZE       0x200
+#define VIRTIO_MMIO_SLOTS           32
+#define VIRTIO_IRQ_BASE             48      // SPI 16
+
+#define VIRTIO_MMIO_MAGIC           0x74726976  // "virt"
+#define VIRTIO_MMIO_VERSION_MODERN  2
+#define VIRTIO_MMIO_VENDOR          0x4F535648  // "HVSO"
+
+// Registradores do transporte
+#define VIRTIO_MMIO_MAGIC_VALUE         0x000
+#define VIRTIO_MMIO_VERSION             0x004
+#define VIRTIO_MMIO_DEVICE_ID           0x008
+#define VIRTIO_MMIO_VENDOR_ID           0x00C
+#define VIRTIO_MMIO_DEVICE_FEATURES     0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014
+#define VIRTIO_MMIO_DRIVER_FEATURES     0x020
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024
+#define VIRTIO_MMIO_QUEUE_SEL           0x030
+#define VIRTIO_MMIO_QUEUE_NUM_MAX       0x034
+#define VIRTIO_MMIO_QUEUE_NUM           0x038
+#define VIRTIO_MMIO_QUEUE_READY         0x044
+#define VIRTIO_MMIO_QUEUE_NOTIFY        0x050
+#define VIRTIO_MMIO_INTERRUPT_STATUS    0x060
+#define VIRTIO_MMIO_INTERRUPT_ACK       0x064
+#define VIRTIO_MMIO_STATUS              0x070
+#define VIRTIO_MMIO_QUEUE_DESC_LOW      0x080
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH     0x084
+#define VIRTIO_MMIO_QUEUE_DRIVER_LOW    0x090
+#define VIRTIO_MMIO_QUEUE_DRIVER_HIGH   0x094
+#define VIRTIO_MMIO_QUEUE_DEVICE_LOW    0x0A0
+#define VIRTIO_MMIO_QUEUE_DEVICE_HIGH   0x0A4
+#define VIRTIO_MMIO_SHM_SEL             0x0AC
+#define VIRTIO_MMIO_SHM_LEN_LOW         0x0B0
+#define VIRTIO_MMIO_SHM_LEN_HIGH        0x0B4
+#define VIRTIO_MMIO_SHM_BASE_LOW        0x0B8
+#define VIRTIO_MMIO_SHM_BASE_HIGH       0x0BC
+#define VIRTIO_MMIO_CONFIG_GENERATION   0x0FC
+#define VIRTIO_MMIO_CONFIG              0x100
+
+// Device IDs
+#define VIRTIO_ID_NET               1
+#define VIRTIO_ID_BLOCK             2
+#define VIRTIO_ID_CONSOLE           3
+#define VIRTIO_ID_VSOCK             19
+#define VIRTIO_ID_FS                26
+#define VIRTIO_ID_PMEM              27
+
+// Device status
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FEATURES_OK   0x08
+#define VIRTIO_STATUS_NEEDS_RESET   0x40
+#define VIRTIO_STATUS_FAILED        0x80
+
+// InterruptStatus
+#define VIRTIO_INT_USED_RING        0x1
+#define VIRTIO_INT_CONFIG           0x2
+
+// Features independentes do tipo de device
+#define VIRTIO_RING_F_INDIRECT_DESC (1ULL << 28)
+#define VIRTIO_RING_F_EVENT_IDX     (1ULL << 29)
+#define VIRTIO_F_VERSION_1          (1ULL << 32)
+
+// Split virtqueue (seção 2.6)
+#define VIRTQ_DESC_F_NEXT           0x1
+#define VIRTQ_DESC_F_WRITE          0x2
+#define VIRTQ_DESC_F_INDIRECT       0x4
+#define VIRTQ_AVAIL_F_NO_INTERRUPT  0x1
+#define VIRTQ_USED_F_NO_NOTIFY      0x1
+
+#define VIRTQ_MAX_SIZE              256     // QueueNumMax
+#define VIRTQ_MAX_IOV               64      // Segmentos por cadeia
+#define VIRTIO_MAX_QUEUES           16
+#define VIRTIO_MAX_SHM              2       // Regiões de memória compartilhada por device
+#define VIRTIO_SHM_ALIGN            (2ULL * 1024 * 1024)
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} virtq_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];        // num entradas + used_event (EVENT_IDX)
+} virtq_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} virtq_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[];   // num entradas + avail_event (uint16_t, EVENT_IDX)
+} virtq_used_t;
+
+typedef struct {
+    // Registradores do transporte para esta fila (QueueSel)
+    uint32_t num;
+    uint32_t ready;
+    uint64_t desc_gpa;
+    uint64_t driver_gpa;
+    uint64_t device_gpa;
+
+    // Anéis no espaço do host, válidos enquanto ready
+    virtq_desc_t* desc;
+    virtq_avail_t* avail;
+    virtq_used_t* used;
+
+    // Privado da thread que processa a fila
+    uint16_t last_avail;        // Próxima entrada do avail a consumir
+    uint16_t used_idx;          // Cópia de used->idx
+    uint16_t signalled_used;    // used_idx na última interrupção (EVENT_IDX)
+    bool signalled_valid;
+} virtqueue_t;
+
+// Segmento de uma cadeia traduzido para o host
+typedef struct {
+    void* addr;
+    uint32_t len;
+} virtq_iov_t;
+
+// Cadeia retirada do avail: segmentos lidos pelo device (out) seguidos
+// dos escritos pelo device (in), como exige a especificação
+typedef struct {
+    uint16_t head;
+    uint16_t out_num;
+    uint16_t in_num;
+    virtq_iov_t iov[VIRTQ_MAX_IOV];
+} virtq_elem_t;
+
+// Região de memória compartilhada (virtio 1.2, seção 2.10): um range de
+// GPAs que o device popula sozinho, fora da RAM do guest
+typedef struct {
+    uint32_t id;
+    uint64_t size;                      // Múltiplo de VIRTIO_SHM_ALIGN
+    uint64_t base;                      // Atribuída por virtio_mmio_register()
+} virtio_shm_region_t;
+
+struct virtio_dev;
+
+// Hooks chamados pelo transporte na thread do vCPU, sob g_device_lock. A
+// thread de processamento de um device nunca toma g_device_lock com o lock
+// próprio do device, então os hooks podem tomar o lock do device.
+typedef struct {
+    // QueueNotify: deve apenas acordar quem processa a fila
+    void (*notify)(struct virtio_dev* dev, uint32_t queue);
+    // Escrita de 0 em Status: parar o processamento e chamar
+    // virtio_queues_reset() antes de retornar
+    void (*reset)(struct virtio_dev* dev);
+    // Depois do reset (opcional): verdadeiro enquanto operações de antes
+    // dele ainda podem escrever na RAM do guest. Status só lê 0 quando
+    // termina: o driver espera o 0 antes de reinicializar (seção 2.4.2)
+    bool (*reset_busy)(struct virtio_dev* dev);
+    // DRIVER_OK escrito (opcional)
+    void (*start)(struct virtio_dev* dev);
+    // Escrita no espaço de configuração (opcional; sem hook é ignorada)
+    void (*config_write)(struct virtio_dev* dev, uint32_t offset, uint64_t value, uint32_t size);
+    // Partição criada (opcional): mapear no guest a memória do device
+    int (*map_memory)(struct virtio_dev* dev);
+    // Encerramento: parar threads e liberar o device (antes de vm_destroy)
+    void (*destroy)(struct virtio_dev* dev);
+} virtio_dev_ops_t;
+
+typedef struct virtio_dev {
+    const char* name;
+    uint32_t device_id;
+    uint64_t host_features;             // Oferecidas ao driver
+    uint64_t driver_features;           // Aceitas pelo driver (válidas após FEATURES_OK)
+    const virtio_dev_ops_t* ops;
+
+    void* config;                       // Espaço de configuração do device
+    uint32_t config_size;
+    volatile LONG config_generation;
+
+    uint32_t num_queues;
+    virtqueue_t queues[VIRTIO_MAX_QUEUES];
+
+    virtio_shm_region_t shm[VIRTIO_MAX_SHM];
+    uint32_t num_shm;
+
+    // Registradores do transporte
+    uint32_t device_features_sel;
+    uint32_t driver_features_sel;
+    uint32_t queue_sel;
+    uint32_t shm_sel;
+    uint32_t status;
+    volatile LONG isr;                  // InterruptStatus (thread do device e vCPUs)
+
+    uint32_t slot;
+    uint32_t irq;
+    regmap_t regmap;
+} virtio_dev_t;
+
+// Transporte
+int virtio_mmio_register(virtio_dev_t* dev);
+device_access_result_t virtio_mmio_handle_access(device_io_t* io);
+void virtio_mmio_cleanup(void);
+void virtio_queues_reset(virtio_dev_t* dev);
+bool virtio_has_feature(const virtio_dev_t* dev, uint64_t feature);
+
+// GPA dentro de alguma região de memória compartilhada registrada
+bool virtio_shm_contains(uint64_t gpa);
+
+// Reserva GPAs para memória de device a partir de VIRTIO_SHM_BASE (ou da
+// metade superior do IPA, se menor); 0 se não cabe em g_guest_pa_bits.
+// Só na criação dos devices
+uint64_t virtio_alloc_gpa(uint64_t size, uint64_t align);
+
+// Chama map_memory de cada device; depois de vm_create()
+int virtio_mmio_map_memory(void);
+
+// Levanta a SPI do device (qualquer thread, sem locks do device). Para
+// filas, decidir antes com virtq_should_notify() na thread da fila.
+void virtio_raise_irq(virtio_dev_t* dev, uint32_t cause);
+void virtio_notify_config(virtio_dev_t* dev);
+
+// Virtqueue (thread que processa a fila)
+int virtq_pop(virtio_dev_t* dev, virtqueue_t* vq, virtq_elem_t* elem);   // 1 = cadeia, 0 = vazio, -1 = inválida
+void virtq_push(virtqueue_t* vq, uint16_t head, uint32_t len);
+void virtq_unpop(virtqueue_t* vq, uint16_t count);                     // Devolve cadeias ao avail
+void virtq_fill(virtqueue_t* vq, uint16_t head, uint32_t len, uint16_t offset);
+void virtq_flush(virtqueue_t* vq, uint16_t count);                     // Publica 'count' fills de uma vez
+bool virtq_should_notify(virtio_dev_t* dev, virtqueue_t* vq);
+void virtq_disable_notify(virtio_dev_t* dev, virtqueue_t* vq);
+bool virtq_enable_notify(virtio_dev_t* dev, virtqueue_t* vq);          // true se chegou trabalho no meio tempo
+size_t virtq_iov_read(const virtq_iov_t* iov, uint32_t count, size_t offset, void* buf, size_t len);
+size_t virtq_iov_write(const virtq_iov_t* iov, uint32_t count, size_t offset, const void* buf, size_t len);
+
+// virtio-blk sobre imagem raw ou HVDK, uma fila (e thread de I/O) por vCPU;
+// limites de QoS do disco (zerados = só os da VM) e peso no escalonador
+int virtio_blk_create(const char* path, bool read_only, uint32_t num_queues,
+                      const blk_qos_limits_t* limits, uint32_t weight);
+
+// virtio-console multiport; uma porta por especificação
+// "<stdout|null|arquivo>[,name=<nome>]", a primeira é o console do guest
+int virtio_console_create(const char* const* ports, uint32_t count);
+
+// virtio-net ligado ao switch L2 do processo, um par de filas por vCPU;
+// options "" ou "mac=<MAC>"
+int virtio_net_create(const char* options, uint32_t num_pairs);
+
+// virtio-vsock com o host em sockets AF_UNIX: o host conecta em 'path'
+// ("CONNECT <porta>"), o guest conecta em "<path>_<porta>"
+int virtio_vsock_create(uint64_t guest_cid, const char* path);
+
+// virtio-fs exportando um diretório do host: "<dir>[,tag=<tag>][,ro][,dax=<MB>]".
+// dax=0 desliga a janela DAX (padrão: 1024MB)
+int virtio_fs_create(const char* spec);
+
+// virtio-pmem sobre um arquivo do host (tamanho múltiplo de 2MB). Com
+// read_only o arquivo nunca é alterado: escritas do guest ficam em cópias
+// privadas das páginas
+int virtio_pmem_create(const char* path, bool read_only);
+
+#endif // VIRTIO_H
@@ -3,40 +3,150 @@
 #define VM_H
 
 #include "hypervisor.h"
+#include "steal_time.h"
+#include "poll_detect.h"
+#include "sysreg.h"
+#include "cpu_model.h"
+
+#define VM_MAX_VCPUS        8
+#define VM_DEFAULT_VCPUS    4
+#define VM_MAX_MEMSLOTS     16
+
+// Espera máxima de um vCPU ocioso (CPU_SUSPEND) antes de reavaliar o estado
+#define VCPU_IDLE_MAX_MS    10
+
+// Estado de energia (PSCI)
+typedef enum {
+    VCPU_POWER_OFF,
+    VCPU_POWER_ON_PENDING,      // CPU_ON aceito; a thread do vCPU ainda não retomou
+    VCPU_POWER_ON
+} vcpu_power_t;
+
+// Slot de memória: região do host mapeada em um range de GPAs
+typedef struct {
+    bool in_use;
+    uint64_t guest_addr;
+    uint64_t size;
+    void* host_addr;
+    WHV_MAP_GPA_RANGE_FLAGS flags;
+} vm_memslot_t;
+
+// Estado por vCPU
+typedef struct {
+    WHV_VPINDEX index;
+    bool created;
+    
+    // Thread de execução e PSCI
+    volatile LONG power;                // vcpu_power_t
+    HANDLE thread;                      // NULL no vCPU de boot (thread principal)
+    HANDLE wake;                        // Sinalizado por CPU_ON e no encerramento
+    uint64_t entry_pc;                  // CPU_ON: aplicados pela própria thread
+    uint64_t entry_context;
+    
+    // Steal time (totais em g_vm.metrics.vcpus)
+    steal_time_record_t* steal_record;  // Registro no guest (NULL = não registrado)
+    uint64_t last_runtime_100ns;        // TotalRuntime do WHP na última amostra
+    uint64_t last_user_100ns;           // Tempos da thread na última amostra
+    uint64_t last_kernel_100ns;
+    uint64_t sample_wall_ns;            // Parede contável desde a última amostra
+    int64_t steal_balance_ns;           // Déficit carregado (steal_time_credit)
+    uint64_t exit_ns;                   // Fim do último WHvRunVirtualProcessor (0 = após espera)
+    uint64_t pmu_runtime_100ns;         // Último TotalRuntime lido pelo PMU
+    
+    poll_detect_t poll;                 // Detecção de spin-poll em MMIO
+    uint64_t exits;                     // Exits deste vCPU (eventos do PMU e métricas)
+    sysreg_vcpu_t sysregs;              // Registradores de sistema emulados
+} vcpu_state_t;
+
+// Métricas por vCPU: escritas só pela thread do vCPU, legíveis de qualquer
+// thread com a VM rodando (campos de 64 bits alinhados)
+typedef struct {
+    volatile uint64_t run_ns;   // Parede dentro de WHvRunVirtualProcessor
+    volatile uint64_t steal_ns; // Pronto para executar, fora de CPU física
+} vcpu_metrics_t;
+
+// Métricas da VM. poll_parks é atualizado por várias threads de vCPU com
+// Interlocked; os de bloco ficam sob o lock do QoS.
+typedef struct {
+    vcpu_metrics_t vcpus[VM_MAX_VCPUS];
+    volatile LONG64 poll_parks; // vCPUs estacionados por spin-poll em MMIO
+    uint64_t blk_throttled;     // Requests de bloco retidos pelo QoS
+    uint64_t blk_throttle_ns;   // Espera acumulada desses requests
+} vm_metrics_t;
 
 // VM state structure
 typedef struct {
     WHV_PARTITION_HANDLE partition;
-    WHV_VPINDEX vpindex;
     void* guest_memory;
     uint64_t guest_memory_size;
     bool running;
+    
+    vm_memslot_t memslots[VM_MAX_MEMSLOTS];
+    
+    vcpu_state_t vcpus[VM_MAX_VCPUS];
+    uint32_t vcpu_count;
+    volatile LONG vcpus_online;         // ON ou ON_PENDING
+    cpu_model_config_t cpu;             // Modelo de CPU resolvido
+    vm_metrics_t metrics;
 } vm_state_t;
 
 // Global VM state
 extern vm_state_t g_vm;
 
+// vCPU executado pela thread corrente (NULL fora das threads de vCPU)
+extern HV_THREAD_LOCAL vcpu_state_t* g_current_vcpu;
+
+static inline vcpu_state_t* vcpu_current(void)
+{
+    return g_current_vcpu;
+}
+
 // VM management functions
+int vm_set_cpu_model(const char* name);    // Antes de vm_create(), após sysreg_init()
 int vm_create(void);
 void vm_destroy(void);
 int vm_setup_memory(void);
 int vm_setup_vcpu(void);
 int vm_load_guest_code(const void* code, size_t code_size, uint64_t load_addr);
 
-// vCPU functions  
+// Threads de vCPU: o de boot roda na thread principal, os secundários em
+// threads próprias criadas por vm_start_vcpus() e estacionadas até CPU_ON
+int vm_start_vcpus(void);
+void vm_request_stop(void);
+void vm_stop_vcpus(void);
+vcpu_power_t vcpu_power_on(vcpu_state_t* vcpu, uint64_t entry, uint64_t context);
+void vcpu_power_off(vcpu_state_t* vcpu);
+bool vcpu_wait_online(vcpu_state_t* vcpu);
+void vcpu_idle(vcpu_state_t* vcpu, uint32_t timeout_ms);
+
+// vCPU functions (operam sobre vcpu_current())
 int vcpu_run(void);
 int vcpu_get_registers(WHV_REGISTER_NAME* reg_names, WHV_REGISTER_VALUE* reg_values, UINT32 count);
 int vcpu_set_registers(WHV_REGISTER_NAME* reg_names, WHV_REGISTER_VALUE* reg_values, UINT32 count);
 
 // Memory management
-int vm_map_gpa_range(uint64_t guest_addr, uint64_t size, WHV_MAP_GPA_RANGE_FLAGS flags);
+int vm_map_gpa_range(void* host_addr, uint64_t guest_addr, uint64_t size, WHV_MAP_GPA_RANGE_FLAGS flags);
+int vm_unmap_gpa_range(uint64_t guest_addr, uint64_t size);
+
+// Ranges transitórios sem slot (views de arquivo numa janela DAX): não
+// entram em vm_gpa_to_hva(), que serve aos anéis e buffers do guest
+int vm_map_gpa_view(void* host_addr, uint64_t guest_addr, uint64_t size, WHV_MAP_GPA_RANGE_FLAGS flags);
+int vm_unmap_gpa_view(uint64_t guest_addr, uint64_t size);
 int vm_read_guest_memory(uint64_t guest_addr, void* buffer, size_t size);
 int vm_write_guest_memory(uint64_t guest_addr, const void* buffer, size_t size);
+void* vm_gpa_to_hva(uint64_t guest_addr, uint64_t size);
+
+// Steal time
+int steal_time_init(void);
+int steal_time_register(vcpu_state_t* vcpu, uint64_t record_gpa);
+void steal_time_account(vcpu_state_t* vcpu, uint64_t start_ns, uint64_t wall_ns, bool countable);
+void steal_time_wait(vcpu_state_t* vcpu);
 
 // ARM64 register helpers
 int vcpu_get_pc(uint64_t* pc);
 int vcpu_set_pc(uint64_t pc);
 int vcpu_get_sp(uint64_t* sp);
 int vcpu_set_sp(uint64_t sp);
+int vcpu_inject_undef(void);
 
 #endif // VM_H
@@ -0,0 +1,52 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef VMID_H
+#define VMID_H
+
+// Alocador de VMIDs com rollover por geração (modo EL2 bare-metal).
+//
+// Cada guest guarda um valor de 64 bits: geração nos bits altos, VMID nos
+// VMID_BITS baixos. Enquanto a geração do guest é a atual, trocar de guest
+// só recarrega VTTBR_EL2 - as entradas de TLB dos outros guests continuam
+// válidas. Quando os VMIDs se esgotam a geração avança, os VMIDs ativos em
+// cada CPU são preservados e cada CPU invalida sua TLB uma única vez antes
+// do próximo guest. C puro, sem dependências de plataforma; um spinlock
+// próprio serializa vmid_update entre CPUs.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VMID_MAX_BITS       16
+#define VMID_MAX_CPUS       8
+
+typedef struct {
+    volatile long lock;                     // Spinlock de vmid_update
+    uint32_t bits;                          // 8 ou 16 (ID_AA64MMFR1_EL1.VMIDBits)
+    uint64_t generation;                    // Múltiplo de (1 << bits)
+    uint32_t next;                          // Próximo VMID a procurar
+    uint32_t ncpus;
+    uint64_t active[VMID_MAX_CPUS];         // VMID carregado em cada CPU
+    uint64_t reserved[VMID_MAX_CPUS];       // Ativos no último rollover
+    bool flush_pending[VMID_MAX_CPUS];      // CPU deve invalidar a TLB inteira
+    uint64_t rollovers;
+    uint64_t map[(1u << VMID_MAX_BITS) / 64];   // VMIDs usados na geração atual
+} vmid_allocator_t;
+
+int vmid_allocator_init(vmid_allocator_t* alloc, uint32_t bits, uint32_t ncpus);
+
+// Garante um VMID válido para o guest antes de executá-lo na CPU 'cpu'.
+// Retorna true se a CPU deve invalidar todas as traduções de guest
+// (TLBI ALLE1) antes de entrar - apenas após um rollover.
+bool vmid_update(vmid_allocator_t* alloc, uint64_t* guest_vmid, uint32_t cpu);
+
+// O guest ainda tem VMID na geração atual. Não serve para pular um TLBI:
+// outra CPU pode continuar executando o guest com o VMID da geração antiga
+// até o próximo vmid_update, que é quando o flush agendado pelo rollover
+// acontece. Invalidações usam sempre o VMID carregado em VTTBR.
+bool vmid_is_current(const vmid_allocator_t* alloc, uint64_t guest_vmid);
+
+static inline uint16_t vmid_value(const vmid_allocator_t* alloc, uint64_t guest_vmid)
+{
+    return (uint16_t)(guest_vmid & ((1ULL << alloc->bits) - 1));
+}
+
+#endif // VMID_H
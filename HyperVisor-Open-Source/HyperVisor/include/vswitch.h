@@ -0,0 +1,144 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef VSWITCH_H
+#define VSWITCH_H
+
+#include "virtio.h"
+
+// Switch Ethernet L2 dentro do processo, ligando as placas virtio-net.
+//
+// Cada placa é uma porta. O switch aprende o MAC de origem de cada frame
+// (tabela com envelhecimento) e encaminha unicast conhecido para a porta
+// aprendida; broadcast, multicast e destino desconhecido vão para todas as
+// outras portas. Nada passa pela pilha de rede do host.
+//
+// A entrega tenta primeiro o anel de RX do destino: o frame é copiado uma
+// única vez, dos buffers de TX de um guest direto para os de RX do outro.
+// Sem buffer de RX livre, o frame vai para um buffer do pool do switch e
+// espera na fila da porta, em ordem, até o driver repor o anel
+// (vswitch_port_drain()). Fila cheia ou pool vazio descarta o frame.
+//
+// Interrupções são agrupadas: a entrega só marca a porta, e
+// vswitch_flush() chama o signal de cada porta marcada, fora do lock do
+// switch (o signal toma g_device_lock para levantar a SPI).
+//
+// Frames carregam os offloads do virtio_net_hdr de origem: checksum parcial
+// e segmentos TCP de até 64KB (GSO) atravessam o switch inteiros até uma
+// porta que os aceite (caps). Só para uma porta sem a capacidade o switch
+// completa o checksum ou segmenta em software, por destino.
+
+#define VSWITCH_PORTS_MAX       32
+#define VSWITCH_FRAME_MAX       1522        // 1500 + Ethernet + VLAN
+#define VSWITCH_GSO_FRAME_MAX   (65535 + 18)
+#define VSWITCH_POOL_BUFS       1024        // Buffers de VSWITCH_FRAME_MAX
+#define VSWITCH_POOL_GSO_BUFS   32          // Buffers de VSWITCH_GSO_FRAME_MAX
+#define VSWITCH_PORT_QUEUE      256         // Frames retidos por porta
+#define VSWITCH_MAC_TABLE       256         // Potência de 2
+#define VSWITCH_MAC_AGE_MS      300000
+
+#define VSWITCH_DELIVERED       1
+#define VSWITCH_NO_BUFFER       0           // Sem RX livre: o switch retém uma cópia
+#define VSWITCH_DROPPED         -1
+
+// Offloads do frame (mesma semântica e valores do virtio_net_hdr)
+#define VSWITCH_CSUM_PARTIAL    0x01        // Checksum L4 a completar em csum_start/csum_offset
+#define VSWITCH_CSUM_VALID      0x02        // Checksum conferido
+
+#define VSWITCH_GSO_NONE        0
+#define VSWITCH_GSO_TCPV4       1
+#define VSWITCH_GSO_TCPV6       4
+#define VSWITCH_GSO_ECN         0x80
+
+// Capacidades da porta: o que o guest de destino aceita sem ajuda
+#define VSWITCH_CAP_CSUM        (1u << 0)
+#define VSWITCH_CAP_TSO4        (1u << 1)
+#define VSWITCH_CAP_TSO6        (1u << 2)
+#define VSWITCH_CAP_TSO_ECN     (1u << 3)
+
+typedef struct {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;           // Cabeçalhos L2-L4 (dica)
+    uint16_t gso_size;          // MSS
+    uint16_t csum_start;
+    uint16_t csum_offset;
+} vswitch_offload_t;
+
+// Frame em segmentos (cadeia de TX ou buffer do pool)
+typedef struct {
+    const virtq_iov_t* iov;
+    uint32_t iov_count;
+    size_t offset;              // Início do frame no primeiro byte dos segmentos
+    uint32_t len;
+    vswitch_offload_t off;
+} vswitch_frame_t;
+
+typedef struct vswitch_buf {
+    struct vswitch_buf* next;
+    uint32_t len;
+    uint32_t size;              // VSWITCH_FRAME_MAX ou VSWITCH_GSO_FRAME_MAX
+    vswitch_offload_t off;
+    uint8_t* data;
+} vswitch_buf_t;
+
+typedef struct vswitch_port vswitch_port_t;
+
+typedef struct {
+    // Copiar o frame para o anel de RX do device (lock do switch tomado)
+    int (*deliver)(vswitch_port_t* port, const vswitch_frame_t* frame);
+    // Frames entregues desde o último flush: decidir a interrupção
+    void (*signal)(vswitch_port_t* port);
+} vswitch_port_ops_t;
+
+typedef struct {
+    uint64_t tx_packets;        // Recebidos do guest da porta
+    uint64_t tx_bytes;
+    uint64_t tx_dropped;        // Frames malformados
+    uint64_t rx_packets;        // Entregues ao guest da porta
+    uint64_t rx_bytes;
+    uint64_t rx_queued;         // Que passaram pelo pool
+    uint64_t rx_soft_csum;      // Checksums completados pelo switch
+    uint64_t rx_soft_segments;  // Segmentos gerados pelo switch (TSO em software)
+    uint64_t rx_dropped;
+} vswitch_port_stats_t;
+
+struct vswitch_port {
+    const char* name;
+    const vswitch_port_ops_t* ops;
+    void* ctx;
+    uint32_t id;
+    uint32_t caps;              // VSWITCH_CAP_*
+    bool dirty;                 // Entregas desde o último flush
+
+    vswitch_buf_t* queue_head;  // Retidos sem buffer de RX
+    vswitch_buf_t* queue_tail;
+    uint32_t queue_len;
+
+    vswitch_port_stats_t stats;
+};
+
+int vswitch_port_add(vswitch_port_t* port, const char* name, const vswitch_port_ops_t* ops, void* ctx);
+void vswitch_port_remove(vswitch_port_t* port);
+
+// Frame de TX do guest da porta; deliver dos destinos chamado aqui
+void vswitch_send(vswitch_port_t* port, const vswitch_frame_t* frame);
+
+// Driver repôs buffers de RX: entregar os retidos
+void vswitch_port_drain(vswitch_port_t* port);
+
+// Reset do device: descarta os retidos (eram do driver anterior) e zera caps
+void vswitch_port_reset(vswitch_port_t* port);
+
+// Driver ativo: offloads negociados pelo guest da porta
+void vswitch_port_set_caps(vswitch_port_t* port, uint32_t caps);
+
+// Signal das portas que receberam frames (sem locks do switch)
+void vswitch_flush(void);
+
+// Copia o frame para segmentos de destino a partir de 'offset'
+size_t vswitch_frame_copy(const vswitch_frame_t* frame, const virtq_iov_t* dst, uint32_t count, size_t offset);
+size_t vswitch_frame_read(const vswitch_frame_t* frame, size_t offset, void* buf, size_t len);
+
+// Depois de virtio_mmio_cleanup(): nenhuma porta registrada
+void vswitch_cleanup(void);
+
+#endif // VSWITCH_H
@@ -48,48 +48,165 @@ exception_vector_table:
     .align 7
     b serror_exception_lower_el_aarch32
 
-# Macro para salvar registradores
+# Macro para salvar registradores (exceções do próprio hypervisor)
+# Um único ajuste de SP; os stores não dependem uns dos outros
 .macro save_registers
-    stp x0, x1, [sp, #-16]!
-    stp x2, x3, [sp, #-16]!
-    stp x4, x5, [sp, #-16]!
-    stp x6, x7, [sp, #-16]!
-    stp x8, x9, [sp, #-16]!
-    stp x10, x11, [sp, #-16]!
-    stp x12, x13, [sp, #-16]!
-    stp x14, x15, [sp, #-16]!
-    stp x16, x17, [sp, #-16]!
-    stp x18, x19, [sp, #-16]!
-    stp x20, x21, [sp, #-16]!
-    stp x22, x23, [sp, #-16]!
-    stp x24, x25, [sp, #-16]!
-    stp x26, x27, [sp, #-16]!
-    stp x28, x29, [sp, #-16]!
-    str x30, [sp, #-8]!
+    sub sp, sp, #256
+    stp x0, x1, [sp, #0]
+    stp x2, x3, [sp, #16]
+    stp x4, x5, [sp, #32]
+    stp x6, x7, [sp, #48]
+    stp x8, x9, [sp, #64]
+    stp x10, x11, [sp, #80]
+    stp x12, x13, [sp, #96]
+    stp x14, x15, [sp, #112]
+    stp x16, x17, [sp, #128]
+    stp x18, x19, [sp, #144]
+    stp x20, x21, [sp, #160]
+    stp x22, x23, [sp, #176]
+    stp x24, x25, [sp, #192]
+    stp x26, x27, [sp, #208]
+    stp x28, x29, [sp, #224]
+    str x30, [sp, #240]
 .endm
 
 # Macro para restaurar registradores
 .macro restore_registers
-    ldr x30, [sp], #8
-    ldp x28, x29, [sp], #16
-    ldp x26, x27, [sp], #16
-    ldp x24, x25, [sp], #16
-    ldp x22, x23, [sp], #16
-    ldp x20, x21, [sp], #16
-    ldp x18, x19, [sp], #16
-    ldp x16, x17, [sp], #16
-    ldp x14, x15, [sp], #16
-    ldp x12, x13, [sp], #16
-    ldp x10, x11, [sp], #16
-    ldp x8, x9, [sp], #16
-    ldp x6, x7, [sp], #16
-    ldp x4, x5, [sp], #16
-    ldp x2, x3, [sp], #16
+    ldr x30, [sp, #240]
+    ldp x0, x1, [sp, #0]
+    ldp x2, x3, [sp, #16]
+    ldp x4, x5, [sp, #32]
+    ldp x6, x7, [sp, #48]
+    ldp x8, x9, [sp, #64]
+    ldp x10, x11, [sp, #80]
+    ldp x12, x13, [sp, #96]
+    ldp x14, x15, [sp, #112]
+    ldp x16, x17, [sp, #128]
+    ldp x18, x19, [sp, #144]
+    ldp x20, x21, [sp, #160]
+    ldp x22, x23, [sp, #176]
+    ldp x24, x25, [sp, #192]
+    ldp x26, x27, [sp, #208]
+    ldp x28, x29, [sp, #224]
+    add sp, sp, #256
+.endm
+
+# FP/SIMD do guest (fpsimd_el2.c): fpsimd_guest @ 552 aponta para o estado
+# do guest deste pCPU e fpsimd_live @ 560 indica que os registradores V o
+# contêm. Com o estado vivo a entrada do caminho C só arma CPTR_EL2.TFP
+# (que também pega EL2): o estado é salvo apenas se o código C usar os
+# registradores V (el2_fpsimd_trap_check).
+.macro fpsimd_guard_live
+    ldr x0, [x19, #560]
+    cbz x0, 1f
+    bl el2_fpsimd_trap          # x0 = 1: arma
+1:
+.endm
+
+# Saída para o guest: estado ainda vivo volta sem armadilha; estado salvo
+# (pelo código C ou por troca de guest) deixa TFP armado para a recarga
+# preguiçosa em fastpath_fpsimd
+.macro fpsimd_exit_trap
+    ldr x0, [x19, #560]
+    cmp x0, #0
+    cset x0, eq
+    bl el2_fpsimd_trap
+.endm
+
+# FP/SIMD em EL2 com TFP armado (EC 0x07 do próprio EL2): salva o estado do
+# guest se ainda vivo nos registradores V, desarma e reexecuta a instrução
+.macro el2_fpsimd_trap_check
+    stp x0, x1, [sp, #-16]!
+    mrs x0, esr_el2
+    lsr x0, x0, #26
+    cmp x0, #0x07
+    b.ne 2f
+    mrs x0, cptr_el2
+    bic x0, x0, #(1 << 10)
+    msr cptr_el2, x0
+    isb
+    mrs x0, tpidr_el2
+    cbz x0, 1f
+    ldr x1, [x0, #560]          # fpsimd_live
+    cbz x1, 1f
+    str xzr, [x0, #560]
+    ldr x0, [x0, #552]          # fpsimd_guest
+    stp x2, x30, [sp, #-16]!
+    bl el2_fpsimd_save
+    ldp x2, x30, [sp], #16
+1:
+    ldp x0, x1, [sp], #16
+    eret
+2:
     ldp x0, x1, [sp], #16
 .endm
 
+# Frame do guest por pCPU (guest_context_t, apontado por TPIDR_EL2):
+#   x0-x30 @ 0, sp_el1 @ 248, elr_el2 @ 256, spsr_el2 @ 264,
+#   esr_el2 @ 272, far_el2 @ 280
+# O estado do guest é salvo uma única vez na entrada; os handlers C editam
+# o frame e a saída restaura dele. x19 (callee-saved) guarda o ponteiro.
+.macro save_guest_frame
+    str x0, [sp, #-16]!         # x0 como rascunho para o ponteiro do frame
+    mrs x0, tpidr_el2
+    stp x1, x2, [x0, #8]
+    stp x3, x4, [x0, #24]
+    stp x5, x6, [x0, #40]
+    stp x7, x8, [x0, #56]
+    stp x9, x10, [x0, #72]
+    stp x11, x12, [x0, #88]
+    stp x13, x14, [x0, #104]
+    stp x15, x16, [x0, #120]
+    stp x17, x18, [x0, #136]
+    stp x19, x20, [x0, #152]
+    stp x21, x22, [x0, #168]
+    stp x23, x24, [x0, #184]
+    stp x25, x26, [x0, #200]
+    stp x27, x28, [x0, #216]
+    stp x29, x30, [x0, #232]
+    ldr x1, [sp], #16
+    str x1, [x0, #0]
+    mrs x1, sp_el1
+    mrs x2, elr_el2
+    mrs x3, spsr_el2
+    mrs x4, esr_el2
+    mrs x5, far_el2
+    stp x1, x2, [x0, #248]
+    stp x3, x4, [x0, #264]
+    str x5, [x0, #280]
+    mov x19, x0
+    fpsimd_guard_live
+.endm
+
+.macro restore_guest_frame
+    fpsimd_exit_trap
+    mov x0, x19
+    ldp x1, x2, [x0, #248]      # sp_el1, elr_el2
+    ldr x3, [x0, #264]          # spsr_el2
+    msr sp_el1, x1
+    msr elr_el2, x2
+    msr spsr_el2, x3
+    ldp x1, x2, [x0, #8]
+    ldp x3, x4, [x0, #24]
+    ldp x5, x6, [x0, #40]
+    ldp x7, x8, [x0, #56]
+    ldp x9, x10, [x0, #72]
+    ldp x11, x12, [x0, #88]
+    ldp x13, x14, [x0, #104]
+    ldp x15, x16, [x0, #120]
+    ldp x17, x18, [x0, #136]
+    ldp x19, x20, [x0, #152]
+    ldp x21, x22, [x0, #168]
+    ldp x23, x24, [x0, #184]
+    ldp x25, x26, [x0, #200]
+    ldp x27, x28, [x0, #216]
+    ldp x29, x30, [x0, #232]
+    ldr x0, [x0, #0]
+.endm
+
 # Handlers de exceção
 sync_exception_current_el_sp0:
+    el2_fpsimd_trap_check
     save_registers
     mov x0, #0  # Exception type
     bl handle_hypervisor_exception
@@ -118,6 +235,7 @@ serror_exception_current_el_sp0:
     eret
 
 sync_exception_current_el_spx:
+    el2_fpsimd_trap_check
     save_registers
     mov x0, #4  # Sync current EL SPx
     bl handle_hypervisor_exception
@@ -147,62 +265,170 @@ serror_exception_current_el_spx:
 
 # Handlers para guest (Lower EL)
 sync_exception_lower_el_aarch64:
-    save_registers
-    mov x0, #8  # Sync from guest
-    mrs x1, esr_el2     # Exception Syndrome Register
-    mrs x2, far_el2     # Fault Address Register
-    mrs x3, elr_el2     # Exception Link Register
+    # Fast path: x0/x1 como rascunho, salvos na pilha EL2; demais casos
+    # seguem para o caminho C com o frame completo
+    stp x0, x1, [sp, #-16]!
+    mrs x0, esr_el2
+    lsr x1, x0, #26             # EC
+    cmp x1, #0x16
+    b.eq fastpath_hvc
+    cmp x1, #0x01
+    b.eq fastpath_wfi
+    cmp x1, #0x07
+    b.eq fastpath_fpsimd
+sync_exception_lower_el_aarch64_slow:
+    ldp x0, x1, [sp], #16
+    save_guest_frame
+    mov x0, x19         # guest_context_t* (ESR/FAR/ELR já no frame)
+    mov w1, #8  # Sync from guest
     bl handle_guest_exception
-    restore_registers
+    restore_guest_frame
+    eret
+
+# HVC #0 com x0 = HC_PUTCHAR: enfileira x1 no ring de console do pCPU
+# (guest_context_t.console @ 288: head @ 288, tail @ 292, buf @ 296).
+# '\n' ou o caractere que completa FASTPATH_CONSOLE_FLUSH vão ao caminho C,
+# que os enfileira e drena o ring. O primeiro caractere retido num ring vazio
+# arma CNTHP com console_drain_ticks @ 572: o IRQ do timer drena uma linha
+# parcial. HVC com imediato diferente de zero sempre vai ao caminho C.
+fastpath_hvc:
+    tst x0, #0xFFFF             # Imediato do HVC
+    b.ne sync_exception_lower_el_aarch64_slow
+    ldr x1, [sp]                # x0 do guest = número do hypercall
+    cmp x1, #2                  # HC_PUTCHAR
+    b.ne sync_exception_lower_el_aarch64_slow
+    stp x2, x3, [sp, #-16]!
+    mrs x0, tpidr_el2
+    add x0, x0, #288            # x0 = &ctx->console
+    ldp w2, w3, [x0]            # head, tail
+    sub w1, w2, w3
+    cmp w1, #63                 # FASTPATH_CONSOLE_FLUSH - 1
+    b.hs fastpath_hvc_flush
+    ldr x1, [sp, #24]           # x1 do guest = caractere
+    and w1, w1, #0xFF
+    cmp w1, #10                 # '\n'
+    b.eq fastpath_hvc_flush
+    cmp w2, w3                  # Ring vazio: arma o prazo de drenagem
+    b.ne 1f
+    ldr w3, [x0, #284]          # console_drain_ticks (572 - 288)
+    msr cnthp_tval_el2, x3
+    mov x3, #1                  # ENABLE, sem IMASK
+    msr cnthp_ctl_el2, x3
+1:
+    and w3, w2, #255
+    add x3, x0, x3
+    strb w1, [x3, #8]           # buf[head % 256]
+    add w2, w2, #1
+    str w2, [x0]
+    ldp x2, x3, [sp], #16
+    ldr x1, [sp, #8]
+    add sp, sp, #16
+    mov x0, #0                  # HC_SUCCESS; ELR já aponta após o HVC
+    eret
+
+fastpath_hvc_flush:
+    # Limite de retenção: o caminho C enfileira o caractere e drena o ring
+    ldp x2, x3, [sp], #16
+    b sync_exception_lower_el_aarch64_slow
+
+# WFI com IRQ pendente neste pCPU: retornar direto, o guest recebe a
+# interrupção. Com saída retida no ring o caminho C drena antes.
+fastpath_wfi:
+    tst x0, #0x3                # TI: 00 = WFI
+    b.ne sync_exception_lower_el_aarch64_slow
+    mrs x0, tpidr_el2
+    ldr w1, [x0, #568]          # irq_pending
+    cbz w1, sync_exception_lower_el_aarch64_slow
+    add x0, x0, #288
+    ldp w0, w1, [x0]            # console head, tail
+    cmp w0, w1
+    b.ne sync_exception_lower_el_aarch64_slow
+    mrs x0, elr_el2
+    add x0, x0, #4
+    msr elr_el2, x0
+    ldp x0, x1, [sp], #16
+    eret
+
+# Primeiro uso de FP/SIMD depois que o estado do guest saiu dos registradores
+# V (uso pelo código C de EL2 ou troca de guest): carrega o estado e
+# reexecuta a instrução (ELR aponta para ela)
+fastpath_fpsimd:
+    mrs x0, tpidr_el2
+    ldr x0, [x0, #552]          # fpsimd_guest
+    cbz x0, sync_exception_lower_el_aarch64_slow
+    mrs x1, cptr_el2
+    bic x1, x1, #(1 << 10)      # TFP
+    msr cptr_el2, x1
+    isb
+    stp x2, x30, [sp, #-16]!
+    bl el2_fpsimd_restore
+    ldp x2, x30, [sp], #16
+    mrs x0, tpidr_el2
+    mov x1, #1
+    str x1, [x0, #560]          # fpsimd_live
+    ldp x0, x1, [sp], #16
     eret
 
 irq_exception_lower_el_aarch64:
-    save_registers
-    mov x0, #9  # IRQ from guest
+    save_guest_frame
+    mov x0, x19
+    mov w1, #9  # IRQ from guest
     bl handle_guest_exception
-    restore_registers
+    restore_guest_frame
     eret
 
 fiq_exception_lower_el_aarch64:
-    save_registers
-    mov x0, #10  # FIQ from guest
+    save_guest_frame
+    mov x0, x19
+    mov w1, #10  # FIQ from guest
     bl handle_guest_exception
-    restore_registers
+    restore_guest_frame
     eret
 
 serror_exception_lower_el_aarch64:
-    save_registers
-    mov x0, #11  # SError from guest
+    save_guest_frame
+    mov x0, x19
+    mov w1, #11  # SError from guest
     bl handle_guest_exception
-    restore_registers
+    restore_guest_frame
     eret
 
 sync_exception_lower_el_aarch32:
-    save_registers
-    mov x0, #12  # Sync from AArch32 guest
+    stp x0, x1, [sp, #-16]!
+    mrs x0, esr_el2
+    lsr x1, x0, #26             # EC
+    cmp x1, #0x07
+    b.eq fastpath_fpsimd
+    ldp x0, x1, [sp], #16
+    save_guest_frame
+    mov x0, x19
+    mov w1, #12  # Sync from AArch32 guest
     bl handle_guest_exception
-    restore_registers
+    restore_guest_frame
     eret
 
 irq_exception_lower_el_aarch32:
-    save_registers
-    mov x0, #13  # IRQ from AArch32 guest
+    save_guest_frame
+    mov x0, x19
+    mov w1, #13  # IRQ from AArch32 guest
     bl handle_guest_exception
-    restore_registers
+    restore_guest_frame
     eret
 
 fiq_exception_lower_el_aarch32:
-    save_registers
-    mov x0, #14  # FIQ from AArch32 guest
+    save_guest_frame
+    mov x0, x19
+    mov w1, #14  # FIQ from AArch32 guest
     bl handle_guest_exception
-    restore_registers
+    restore_guest_frame
     eret
 
 serror_exception_lower_el_aarch32:
-    save_registers
-    mov x0, #15  # SError from AArch32 guest
+    save_guest_frame
+    mov x0, x19
+    mov w1, #15  # SError from AArch32 guest
     bl handle_guest_exception
-    restore_registers
+    restore_guest_frame
     eret
 
 # Função para configurar VBAR_EL2 (Vector Base Address Register)
@@ -266,70 +492,185 @@ enter_guest:
     # Entrar no guest
     eret
 
-# Função para salvar contexto do guest
-.global save_guest_context
-save_guest_context:
-    # x0 = ponteiro para estrutura de contexto
-    
-    # Salvar registradores gerais
-    stp x1, x2, [x0, #8]
-    stp x3, x4, [x0, #24]
-    stp x5, x6, [x0, #40]
-    stp x7, x8, [x0, #56]
-    stp x9, x10, [x0, #72]
-    stp x11, x12, [x0, #88]
-    stp x13, x14, [x0, #104]
-    stp x15, x16, [x0, #120]
-    stp x17, x18, [x0, #136]
-    stp x19, x20, [x0, #152]
-    stp x21, x22, [x0, #168]
-    stp x23, x24, [x0, #184]
-    stp x25, x26, [x0, #200]
-    stp x27, x28, [x0, #216]
-    stp x29, x30, [x0, #232]
-    
-    # Salvar registradores de sistema
-    mrs x1, sp_el1
-    str x1, [x0, #248]
-    mrs x1, elr_el2
-    str x1, [x0, #256]
-    mrs x1, spsr_el2
-    str x1, [x0, #264]
-    mrs x1, esr_el2
-    str x1, [x0, #272]
-    mrs x1, far_el2
-    str x1, [x0, #280]
-    
+# Define o frame de contexto do guest deste pCPU
+.global el2_set_cpu_context
+el2_set_cpu_context:
+    # x0 = ponteiro para guest_context_t
+    msr tpidr_el2, x0
     ret
 
-# Função para restaurar contexto do guest
-.global restore_guest_context
-restore_guest_context:
-    # x0 = ponteiro para estrutura de contexto
-    
-    # Restaurar registradores de sistema
-    ldr x1, [x0, #248]
-    msr sp_el1, x1
-    ldr x1, [x0, #256]
-    msr elr_el2, x1
-    ldr x1, [x0, #264]
-    msr spsr_el2, x1
-    
-    # Restaurar registradores gerais
-    ldp x1, x2, [x0, #8]
-    ldp x3, x4, [x0, #24]
-    ldp x5, x6, [x0, #40]
-    ldp x7, x8, [x0, #56]
-    ldp x9, x10, [x0, #72]
-    ldp x11, x12, [x0, #88]
-    ldp x13, x14, [x0, #104]
-    ldp x15, x16, [x0, #120]
-    ldp x17, x18, [x0, #136]
-    ldp x19, x20, [x0, #152]
-    ldp x21, x22, [x0, #168]
-    ldp x23, x24, [x0, #184]
-    ldp x25, x26, [x0, #200]
-    ldp x27, x28, [x0, #216]
-    ldp x29, x30, [x0, #232]
-    
+.global el2_get_cpu_context
+el2_get_cpu_context:
+    mrs x0, tpidr_el2
+    ret
+
+# Ativa a tradução stage-2 (HCR_EL2.VM) e o roteamento de IRQs físicos para
+# EL2 (HCR_EL2.IMO: timer de drenagem do console); VTTBR vem de el2_load_vttbr
+.global el2_enable_stage2
+el2_enable_stage2:
+    # x0 = VTCR_EL2
+    dsb ishst                   # Tabelas visíveis ao walker
+    msr vtcr_el2, x0
+    isb
+    mrs x2, hcr_el2
+    orr x2, x2, #1              # VM
+    orr x2, x2, #(1 << 4)       # IMO
+    msr hcr_el2, x2
+    isb
+    ret
+
+# Desvia para EL2 os acessos de EL1/EL0 ao timer físico e ao CNTPCT
+# (CNTHCTL_EL2.EL1PCEN/EL1PCTEN = 0, com E2H = 0) e, com FEAT_ECV, também
+# ao timer virtual e ao CNTVCT (EL1TVT/EL1TVCT)
+.global el2_timer_traps
+el2_timer_traps:
+    # x0 = != 0 se há FEAT_ECV
+    mrs x1, cnthctl_el2
+    bic x1, x1, #3              # EL1PCTEN, EL1PCEN
+    cbz x0, 1f
+    orr x1, x1, #(3 << 13)      # EL1TVT, EL1TVCT
+1:
+    msr cnthctl_el2, x1
+    isb
+    ret
+
+# Prazo de drenagem do ring de console (CNTHP), armado pelo caminho C quando
+# ele retém o primeiro caractere; o vetor arma inline
+.global el2_console_timer_arm
+el2_console_timer_arm:
+    # x0 = ticks até o IRQ
+    msr cnthp_tval_el2, x0
+    mov x0, #1                  # ENABLE, sem IMASK
+    msr cnthp_ctl_el2, x0
+    isb
+    ret
+
+.global el2_console_timer_disarm
+el2_console_timer_disarm:
+    msr cnthp_ctl_el2, xzr
+    isb
+    ret
+
+# Troca de guest: carrega VTTBR_EL2 (VMID + tabela) antes de enter_guest
+.global el2_load_vttbr
+el2_load_vttbr:
+    # x0 = VTTBR_EL2, x1 = != 0 após rollover de VMID
+    msr vttbr_el2, x0
+    isb
+    cbz x1, 1f
+    tlbi alle1                  # Traduções de todos os VMIDs antigos nesta CPU
+    dsb nsh
+    isb
+1:
+    ret
+
+# Invalida páginas de 4KB de um guest específico (VMID de x0), sem flush global
+.global el2_tlbi_ipa_vmid
+el2_tlbi_ipa_vmid:
+    # x0 = VTTBR_EL2 do guest, x1 = IPA, x2 = páginas (>= 1)
+    mrs x3, vttbr_el2
+    msr vttbr_el2, x0
+    isb
+    dsb ishst
+    lsr x1, x1, #12
+1:
+    tlbi ipas2e1is, x1
+    add x1, x1, #1
+    subs x2, x2, #1
+    b.ne 1b
+    dsb ish
+    tlbi vmalle1is              # Entradas combinadas stage-1+2 do VMID
+    dsb ish
+    msr vttbr_el2, x3
+    isb
+    ret
+
+# Invalida todas as traduções de um guest (VMID de x0)
+.global el2_tlbi_vmid
+el2_tlbi_vmid:
+    # x0 = VTTBR_EL2 do guest
+    mrs x2, vttbr_el2
+    msr vttbr_el2, x0
+    isb
+    dsb ishst                   # Descritores atualizados antes do TLBI
+    tlbi vmalls12e1is
+    dsb ish
+    msr vttbr_el2, x2
+    isb
+    ret
+
+# Liga/desliga a armadilha de FP/SIMD (CPTR_EL2.TFP)
+.global el2_fpsimd_trap
+el2_fpsimd_trap:
+    # x0 = != 0 para armar
+    mrs x1, cptr_el2
+    bic x1, x1, #(1 << 10)
+    cbz x0, 1f
+    orr x1, x1, #(1 << 10)
+1:
+    msr cptr_el2, x1
+    isb
+    ret
+
+# Salva Q0-Q31, FPSR e FPCR em fpsimd_state_t (TFP deve estar desarmado)
+.global el2_fpsimd_save
+el2_fpsimd_save:
+    # x0 = ponteiro para fpsimd_state_t
+    stp q0, q1, [x0, #0]
+    stp q2, q3, [x0, #32]
+    stp q4, q5, [x0, #64]
+    stp q6, q7, [x0, #96]
+    stp q8, q9, [x0, #128]
+    stp q10, q11, [x0, #160]
+    stp q12, q13, [x0, #192]
+    stp q14, q15, [x0, #224]
+    stp q16, q17, [x0, #256]
+    stp q18, q19, [x0, #288]
+    stp q20, q21, [x0, #320]
+    stp q22, q23, [x0, #352]
+    stp q24, q25, [x0, #384]
+    stp q26, q27, [x0, #416]
+    stp q28, q29, [x0, #448]
+    stp q30, q31, [x0, #480]
+    mrs x1, fpsr
+    mrs x2, fpcr
+    str w1, [x0, #512]
+    str w2, [x0, #516]
+    ret
+
+.global el2_fpsimd_restore
+el2_fpsimd_restore:
+    # x0 = ponteiro para fpsimd_state_t
+    ldp q0, q1, [x0, #0]
+    ldp q2, q3, [x0, #32]
+    ldp q4, q5, [x0, #64]
+    ldp q6, q7, [x0, #96]
+    ldp q8, q9, [x0, #128]
+    ldp q10, q11, [x0, #160]
+    ldp q12, q13, [x0, #192]
+    ldp q14, q15, [x0, #224]
+    ldp q16, q17, [x0, #256]
+    ldp q18, q19, [x0, #288]
+    ldp q20, q21, [x0, #320]
+    ldp q22, q23, [x0, #352]
+    ldp q24, q25, [x0, #384]
+    ldp q26, q27, [x0, #416]
+    ldp q28, q29, [x0, #448]
+    ldp q30, q31, [x0, #480]
+    ldr w1, [x0, #512]
+    ldr w2, [x0, #516]
+    msr fpsr, x1
+    msr fpcr, x2
+    ret
+
+# ID_AA64MMFR0_EL1 (PARange em [3:0])
+.global el2_read_mmfr0
+el2_read_mmfr0:
+    mrs x0, id_aa64mmfr0_el1
+    ret
+
+# ID_AA64MMFR1_EL1 (VMIDBits em [7:4])
+.global el2_read_mmfr1
+el2_read_mmfr1:
+    mrs x0, id_aa64mmfr1_el1
     ret
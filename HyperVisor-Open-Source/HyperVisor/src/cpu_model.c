@@ -0,0 +1,194 @@
+/* Desenvolvido por: Escanearcpl */
+#include "cpu_model.h"
+#include <string.h>
+
+// Campos dos registradores de ID (ARM ARM D19.2)
+#define ISAR0_AES_SHIFT         4
+#define ISAR0_SHA1_SHIFT        8
+#define ISAR0_SHA2_SHIFT        12
+#define ISAR0_CRC32_SHIFT       16
+#define ISAR0_ATOMIC_SHIFT      20
+#define ISAR0_RDM_SHIFT         28
+#define ISAR0_SHA3_SHIFT        32
+#define ISAR0_DP_SHIFT          44
+#define ISAR1_JSCVT_SHIFT       12
+#define ISAR1_LRCPC_SHIFT       20
+#define PFR0_FP_SHIFT           16
+#define PFR0_ADVSIMD_SHIFT      20
+
+// EL0-EL3 em AArch64/AArch32, GIC por MMIO (mesma base do Cortex-A57)
+#define PFR0_BASE               0x0000000000002222ULL
+
+// Bits do banco WHV_PROCESSOR_FEATURES no ARM64 (WinHvPlatformDefs.h)
+#define HV_FEAT_FP              (1ULL << 9)
+#define HV_FEAT_FP_HP           (1ULL << 10)
+#define HV_FEAT_ADVSIMD         (1ULL << 11)
+#define HV_FEAT_ADVSIMD_HP      (1ULL << 12)
+#define HV_FEAT_AES             (1ULL << 20)
+#define HV_FEAT_POLYMUL         (1ULL << 21)
+#define HV_FEAT_SHA1            (1ULL << 22)
+#define HV_FEAT_SHA256          (1ULL << 23)
+#define HV_FEAT_SHA512          (1ULL << 24)
+#define HV_FEAT_CRC32           (1ULL << 25)
+#define HV_FEAT_ATOMIC          (1ULL << 26)
+#define HV_FEAT_RDM             (1ULL << 27)
+#define HV_FEAT_SHA3            (1ULL << 28)
+#define HV_FEAT_DP              (1ULL << 31)
+#define HV_FEAT_JSCVT           (1ULL << 40)
+#define HV_FEAT_RCPC_V83        (1ULL << 42)
+
+// Extensões de instrução do banco (FP..AdvSimdHp, Aes..RcpcV84), inclusive
+// as que os modelos não descrevem (SM3/SM4, FHM, PAuth, FCMA...). Os demais
+// bits são da plataforma (granules, GIC, PMU, RAS) e seguem o host.
+#define HV_FEAT_ISA_MASK        ((0xFULL << 9) | (0xFFFFFFULL << 20))
+
+static const struct {
+    cpu_features_t feature;
+    uint64_t hv_bits;
+} g_cpu_hv_bits[] = {
+    { CPU_FEAT_FP,      HV_FEAT_FP },
+    { CPU_FEAT_ASIMD,   HV_FEAT_ADVSIMD },
+    { CPU_FEAT_FP16,    HV_FEAT_FP_HP | HV_FEAT_ADVSIMD_HP },
+    { CPU_FEAT_AES,     HV_FEAT_AES },
+    { CPU_FEAT_PMULL,   HV_FEAT_POLYMUL },
+    { CPU_FEAT_SHA1,    HV_FEAT_SHA1 },
+    { CPU_FEAT_SHA256,  HV_FEAT_SHA256 },
+    { CPU_FEAT_SHA512,  HV_FEAT_SHA512 },
+    { CPU_FEAT_SHA3,    HV_FEAT_SHA3 },
+    { CPU_FEAT_CRC32,   HV_FEAT_CRC32 },
+    { CPU_FEAT_ATOMICS, HV_FEAT_ATOMIC },
+    { CPU_FEAT_RDM,     HV_FEAT_RDM },
+    { CPU_FEAT_DOTPROD, HV_FEAT_DP },
+    { CPU_FEAT_JSCVT,   HV_FEAT_JSCVT },
+    { CPU_FEAT_LRCPC,   HV_FEAT_RCPC_V83 },
+};
+
+typedef struct {
+    const char* name;
+    const char* description;
+    cpu_features_t features;    // Conjunto do modelo (ignorado em passthrough)
+    bool passthrough;           // Tudo que o host tiver
+    bool strict;                // Falha se o host não tiver o conjunto inteiro
+} cpu_model_def_t;
+
+static const cpu_model_def_t g_cpu_models[] = {
+    { "host", "todas as features do host (host-passthrough)",
+      0, true, false },
+    { "baseline", "ARMv8.0 com FP/ASIMD, roda em qualquer host",
+      CPU_FEAT_V80, false, false },
+    // Mesmo conjunto em todo host da frota: recusar é melhor do que expor
+    // menos em um host e quebrar uma migração depois
+    { "migratable", "ARMv8.1 + crypto + CRC32, idêntico em qualquer host compatível",
+      CPU_FEAT_V80 | CPU_FEAT_CRYPTO | CPU_FEAT_CRC32 | CPU_FEAT_ATOMICS | CPU_FEAT_RDM,
+      false, true },
+};
+
+#define CPU_MODEL_COUNT (sizeof(g_cpu_models) / sizeof(g_cpu_models[0]))
+
+cpu_features_t cpu_features_normalize(cpu_features_t features)
+{
+    if (!(features & CPU_FEAT_FP) || !(features & CPU_FEAT_ASIMD)) {
+        // Sem FP/ASIMD nenhuma extensão SIMD faz sentido
+        features &= ~(CPU_FEAT_ASIMD | CPU_FEAT_CRYPTO | CPU_FEAT_SHA512 | CPU_FEAT_SHA3 |
+                      CPU_FEAT_RDM | CPU_FEAT_FP16 | CPU_FEAT_DOTPROD | CPU_FEAT_JSCVT);
+    }
+    if (!(features & CPU_FEAT_AES)) {
+        features &= ~CPU_FEAT_PMULL;
+    }
+    if (!(features & CPU_FEAT_SHA256)) {
+        features &= ~CPU_FEAT_SHA512;
+    }
+    if (!(features & CPU_FEAT_SHA512)) {
+        features &= ~CPU_FEAT_SHA3;
+    }
+    return features;
+}
+
+static inline uint64_t cpu_field(cpu_features_t features, cpu_features_t bit,
+                                 uint64_t value, uint32_t shift)
+{
+    return (features & bit) ? (value << shift) : 0;
+}
+
+// Banco da partição: bits de plataforma do host e, das extensões de
+// instrução, só as do modelo. O WHP não intercepta necessariamente as
+// leituras dos registradores de ID, então o banco é o que o guest enxerga.
+static uint64_t cpu_model_hv_features(cpu_features_t features, uint64_t host_bank)
+{
+    uint64_t bank = host_bank & ~HV_FEAT_ISA_MASK;
+
+    for (uint32_t i = 0; i < sizeof(g_cpu_hv_bits) / sizeof(g_cpu_hv_bits[0]); i++) {
+        if (features & g_cpu_hv_bits[i].feature) {
+            bank |= host_bank & g_cpu_hv_bits[i].hv_bits;
+        }
+    }
+    return bank;
+}
+
+static void cpu_model_id_regs(cpu_model_config_t* out)
+{
+    cpu_features_t f = out->features;
+
+    // FP/AdvSIMD: 0 = presente, 1 = com FP16, 0xF = ausente
+    out->id_aa64pfr0 = PFR0_BASE |
+        ((uint64_t)(!(f & CPU_FEAT_FP) ? 0xF : (f & CPU_FEAT_FP16) ? 1 : 0) << PFR0_FP_SHIFT) |
+        ((uint64_t)(!(f & CPU_FEAT_ASIMD) ? 0xF : (f & CPU_FEAT_FP16) ? 1 : 0) << PFR0_ADVSIMD_SHIFT);
+
+    out->id_aa64isar0 =
+        cpu_field(f, CPU_FEAT_AES, (f & CPU_FEAT_PMULL) ? 2 : 1, ISAR0_AES_SHIFT) |
+        cpu_field(f, CPU_FEAT_SHA1, 1, ISAR0_SHA1_SHIFT) |
+        cpu_field(f, CPU_FEAT_SHA256, (f & CPU_FEAT_SHA512) ? 2 : 1, ISAR0_SHA2_SHIFT) |
+        cpu_field(f, CPU_FEAT_CRC32, 1, ISAR0_CRC32_SHIFT) |
+        cpu_field(f, CPU_FEAT_ATOMICS, 2, ISAR0_ATOMIC_SHIFT) |
+        cpu_field(f, CPU_FEAT_RDM, 1, ISAR0_RDM_SHIFT) |
+        cpu_field(f, CPU_FEAT_SHA3, 1, ISAR0_SHA3_SHIFT) |
+        cpu_field(f, CPU_FEAT_DOTPROD, 1, ISAR0_DP_SHIFT);
+
+    out->id_aa64isar1 =
+        cpu_field(f, CPU_FEAT_JSCVT, 1, ISAR1_JSCVT_SHIFT) |
+        cpu_field(f, CPU_FEAT_LRCPC, 1, ISAR1_LRCPC_SHIFT);
+}
+
+int cpu_model_resolve(const char* name, const cpu_host_t* host, cpu_model_config_t* out)
+{
+    const cpu_model_def_t* model = NULL;
+
+    for (uint32_t i = 0; i < CPU_MODEL_COUNT; i++) {
+        if (strcmp(g_cpu_models[i].name, name) == 0) {
+            model = &g_cpu_models[i];
+            break;
+        }
+    }
+    if (!model) {
+        return -1;
+    }
+
+    cpu_features_t host_features = cpu_features_normalize(host->features);
+    cpu_features_t features = model->passthrough ? host_features : model->features;
+
+    if (model->strict && (features & ~host_features)) {
+        return -1;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->name = model->name;
+    out->features = cpu_features_normalize(features & host_features);
+
+    // Passthrough expõe também as extensões que os modelos não descrevem
+    out->partition_features = model->passthrough ? host->hv_features :
+                              cpu_model_hv_features(out->features, host->hv_features);
+
+    cpu_model_id_regs(out);
+    return 0;
+}
+
+const char* cpu_model_name(uint32_t index, const char** description)
+{
+    if (index >= CPU_MODEL_COUNT) {
+        return NULL;
+    }
+    if (description) {
+        *description = g_cpu_models[index].description;
+    }
+    return g_cpu_models[index].name;
+}
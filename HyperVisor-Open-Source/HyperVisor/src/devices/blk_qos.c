@@ -0,0 +1,462 @@
+/* Desenvolvido por: Escanearcpl */
+#include "blk_qos.h"
+#include "devices.h"
+#include "vm.h"
+
+#define QOS_NS_PER_SEC          1000000000ULL
+#define QOS_IOPS_MAX            (1ULL << 24)
+#define QOS_BPS_MAX             (1ULL << 34)    // Mantém taxa * 1e9 em 64 bits
+
+static struct {
+    CRITICAL_SECTION lock;      // Baldes, flows, portas
+    bool initialized;
+    blk_qos_group_t vm;
+    bool vm_limited;
+    bool vm_blocked;            // Há flow pronto esperando só pelo balde da VM
+    blk_qos_flow_t* flows;
+    blk_qos_port_t* wake_list;  // Portas com itens liberados nesta volta
+    uint64_t vtime;             // Tag do último request liberado
+
+    HANDLE thread;
+    HANDLE event;               // Item novo na espera
+    volatile bool stop;
+} g_qos;
+
+// ---------------------------------------------------------------------------
+// Token buckets
+// ---------------------------------------------------------------------------
+
+static void qos_bucket_init(blk_qos_bucket_t* bucket, uint64_t rate, uint64_t burst, uint64_t now)
+{
+    bucket->rate = rate;
+    bucket->burst = burst ? burst : rate;
+    if (bucket->burst > BLK_QOS_BURST_MAX) {
+        bucket->burst = BLK_QOS_BURST_MAX;
+    }
+    bucket->level = (int64_t)bucket->burst;    // Começa cheio
+    bucket->last_ns = now;
+}
+
+static void qos_bucket_refill(blk_qos_bucket_t* bucket, uint64_t now)
+{
+    if (!bucket->rate) {
+        return;
+    }
+
+    uint64_t elapsed = now - bucket->last_ns;
+    uint64_t add = (elapsed / QOS_NS_PER_SEC) * bucket->rate +
+                   (elapsed % QOS_NS_PER_SEC) * bucket->rate / QOS_NS_PER_SEC;
+
+    if (bucket->level + (int64_t)add >= (int64_t)bucket->burst) {
+        bucket->level = (int64_t)bucket->burst;
+        bucket->last_ns = now;
+    } else if (add) {
+        // Avança só o tempo convertido em tokens: a fração fica para depois
+        bucket->level += (int64_t)add;
+        bucket->last_ns += add * QOS_NS_PER_SEC / bucket->rate;
+    }
+}
+
+// ns até o balde poder pagar 'cost' (0 = já pode). Um custo maior que a
+// rajada só exige o balde cheio; o resto vira dívida
+static uint64_t qos_bucket_wait(const blk_qos_bucket_t* bucket, uint64_t cost)
+{
+    int64_t need = (int64_t)(cost < bucket->burst ? cost : bucket->burst);
+
+    if (!bucket->rate || bucket->level >= need) {
+        return 0;
+    }
+
+    uint64_t deficit = (uint64_t)(need - bucket->level);
+    return (deficit / bucket->rate) * QOS_NS_PER_SEC + (deficit % bucket->rate) * QOS_NS_PER_SEC / bucket->rate + 1;
+}
+
+static void qos_group_init(blk_qos_group_t* group, const blk_qos_limits_t* limits, uint64_t now)
+{
+    qos_bucket_init(&group->iops, limits ? limits->iops : 0, limits ? limits->iops_burst : 0, now);
+    qos_bucket_init(&group->bps, limits ? limits->bps : 0, limits ? limits->bps_burst : 0, now);
+}
+
+static void qos_group_refill(blk_qos_group_t* group, uint64_t now)
+{
+    qos_bucket_refill(&group->iops, now);
+    qos_bucket_refill(&group->bps, now);
+}
+
+static uint64_t qos_group_wait(const blk_qos_group_t* group, uint32_t bytes)
+{
+    uint64_t iops = qos_bucket_wait(&group->iops, 1);
+    uint64_t bps = qos_bucket_wait(&group->bps, bytes);
+    return iops > bps ? iops : bps;
+}
+
+static void qos_group_consume(blk_qos_group_t* group, uint32_t bytes)
+{
+    if (group->iops.rate) {
+        group->iops.level -= 1;
+    }
+    if (group->bps.rate) {
+        group->bps.level -= (int64_t)bytes;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Escalonador (start-time fair queuing entre flows)
+// ---------------------------------------------------------------------------
+
+static inline uint64_t qos_cost(const blk_qos_flow_t* flow, uint32_t bytes)
+{
+    return ((uint64_t)bytes + BLK_QOS_OP_COST) * BLK_QOS_WEIGHT_DEFAULT / flow->weight;
+}
+
+static void qos_grant(blk_qos_flow_t* flow, blk_qos_item_t* item, uint64_t now)
+{
+    blk_qos_port_t* port = item->port;
+    uint64_t waited = now - item->queued_ns;
+
+    flow->head = item->next;
+    if (!flow->head) {
+        flow->tail = NULL;
+    }
+
+    qos_group_consume(&flow->group, item->bytes);
+    qos_group_consume(&g_qos.vm, item->bytes);
+    g_qos.vtime = item->tag;
+
+    flow->stats.backlog--;
+    flow->stats.wait_ns += waited;
+    if (waited > flow->stats.max_wait_ns) {
+        flow->stats.max_wait_ns = waited;
+    }
+    g_vm.metrics.blk_throttled++;
+    g_vm.metrics.blk_throttle_ns += waited;
+
+    item->next = NULL;
+    if (port->granted_tail) {
+        port->granted_tail->next = item;
+    } else {
+        port->granted = item;
+    }
+    port->granted_tail = item;
+
+    if (!port->wake_pending) {
+        port->wake_pending = true;
+        port->wake_next = g_qos.wake_list;
+        g_qos.wake_list = port;
+    }
+}
+
+// Libera o que os baldes permitem; devolve ns até a próxima liberação
+// possível (UINT64_MAX = ninguém esperando)
+static uint64_t qos_dispatch_locked(uint64_t now)
+{
+    uint64_t wait = UINT64_MAX;
+
+    qos_group_refill(&g_qos.vm, now);
+    g_qos.vm_blocked = false;
+
+    for (;;) {
+        blk_qos_flow_t* best = NULL;
+
+        // Entre os flows com tokens próprios, a menor tag de início
+        for (blk_qos_flow_t* flow = g_qos.flows; flow; flow = flow->next) {
+            if (!flow->head) {
+                continue;
+            }
+
+            qos_group_refill(&flow->group, now);
+            uint64_t flow_wait = qos_group_wait(&flow->group, flow->head->bytes);
+            if (flow_wait) {
+                wait = flow_wait < wait ? flow_wait : wait;
+            } else if (!best || flow->head->tag < best->head->tag) {
+                best = flow;
+            }
+        }
+
+        if (!best) {
+            break;
+        }
+
+        uint64_t vm_wait = qos_group_wait(&g_qos.vm, best->head->bytes);
+        if (vm_wait) {
+            g_qos.vm_blocked = true;
+            wait = vm_wait < wait ? vm_wait : wait;
+            break;
+        }
+
+        qos_grant(best, best->head, now);
+    }
+
+    // Sob o lock: um flow removido não é acordado depois de sair da lista
+    while (g_qos.wake_list) {
+        blk_qos_port_t* port = g_qos.wake_list;
+        g_qos.wake_list = port->wake_next;
+        port->wake_pending = false;
+        port->wake(port->ctx);
+    }
+    return wait;
+}
+
+static DWORD WINAPI qos_thread(LPVOID param)
+{
+    DWORD timeout = INFINITE;
+
+    (void)param;
+
+    while (!g_qos.stop) {
+        WaitForSingleObject(g_qos.event, timeout);
+
+        EnterCriticalSection(&g_qos.lock);
+        uint64_t wait = qos_dispatch_locked(timer_get_time_ns());
+        LeaveCriticalSection(&g_qos.lock);
+
+        // Arredondado para cima: acordar cedo só repete a volta
+        timeout = wait == UINT64_MAX ? INFINITE : (DWORD)((wait + 999999) / 1000000);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// API
+// ---------------------------------------------------------------------------
+
+static void qos_init(void)
+{
+    if (!g_qos.initialized) {
+        InitializeCriticalSection(&g_qos.lock);
+        g_qos.initialized = true;
+    }
+}
+
+void blk_qos_set_vm_limits(const blk_qos_limits_t* limits)
+{
+    qos_init();
+    qos_group_init(&g_qos.vm, limits, timer_get_time_ns());
+    g_qos.vm_limited = limits && (limits->iops || limits->bps);
+}
+
+int blk_qos_parse(const char* spec, blk_qos_limits_t* limits, uint32_t* weight)
+{
+    memset(limits, 0, sizeof(*limits));
+    if (weight) {
+        *weight = BLK_QOS_WEIGHT_DEFAULT;
+    }
+
+    while (*spec) {
+        const char* comma = strchr(spec, ',');
+        size_t len = comma ? (size_t)(comma - spec) : strlen(spec);
+        const char* eq = (const char*)memchr(spec, '=', len);
+        char key[16];
+        char* stop;
+
+        if (!eq || eq == spec || (size_t)(eq - spec) >= sizeof(key)) {
+            goto invalid;
+        }
+        snprintf(key, sizeof(key), "%.*s", (int)(eq - spec), spec);
+
+        uint64_t value = strtoull(eq + 1, &stop, 10);
+        if (stop == eq + 1 || stop != spec + len) {
+            goto invalid;
+        }
+
+        if (strcmp(key, "iops") == 0) {
+            limits->iops = value < QOS_IOPS_MAX ? value : QOS_IOPS_MAX;
+        } else if (strcmp(key, "iops_burst") == 0) {
+            limits->iops_burst = value;
+        } else if (strcmp(key, "bw") == 0) {
+            limits->bps = value < (QOS_BPS_MAX >> 20) ? value << 20 : QOS_BPS_MAX;
+        } else if (strcmp(key, "bw_burst") == 0) {
+            limits->bps_burst = value < (BLK_QOS_BURST_MAX >> 20) ? value << 20 : BLK_QOS_BURST_MAX;
+        } else if (strcmp(key, "weight") == 0 && weight && value >= 1 && value <= BLK_QOS_WEIGHT_MAX) {
+            *weight = (uint32_t)value;
+        } else {
+            goto invalid;
+        }
+
+        spec += len + (comma ? 1 : 0);
+    }
+    return 0;
+
+invalid:
+    LOG_ERROR("Opção de QoS inválida em '%s' (iops=N, iops_burst=N, bw=MB, bw_burst=MB%s)", spec,
+              weight ? ", weight=1..1000" : "");
+    return -1;
+}
+
+int blk_qos_flow_register(blk_qos_flow_t* flow, const char* name, const blk_qos_limits_t* limits,
+                          uint32_t weight)
+{
+    qos_init();
+
+    memset(flow, 0, sizeof(*flow));
+    flow->name = name;
+    flow->weight = weight ? weight : BLK_QOS_WEIGHT_DEFAULT;
+    qos_group_init(&flow->group, limits, timer_get_time_ns());
+    flow->limited = g_qos.vm_limited || (limits && (limits->iops || limits->bps));
+
+    // Thread de QoS só existe se algum disco é limitado
+    if (flow->limited && !g_qos.thread) {
+        g_qos.event = CreateEventA(NULL, FALSE, FALSE, NULL);
+        g_qos.thread = g_qos.event ? CreateThread(NULL, 0, qos_thread, NULL, 0, NULL) : NULL;
+        if (!g_qos.thread) {
+            LOG_ERROR("Falha ao criar thread de QoS de I/O: %lu", GetLastError());
+            return -1;
+        }
+    }
+
+    EnterCriticalSection(&g_qos.lock);
+    flow->next = g_qos.flows;
+    g_qos.flows = flow;
+    LeaveCriticalSection(&g_qos.lock);
+    return 0;
+}
+
+void blk_qos_flow_unregister(blk_qos_flow_t* flow)
+{
+    if (!g_qos.initialized) {
+        return;
+    }
+
+    // Depois daqui a thread de QoS não libera nem acorda nada deste flow
+    EnterCriticalSection(&g_qos.lock);
+    for (blk_qos_flow_t** link = &g_qos.flows; *link; link = &(*link)->next) {
+        if (*link == flow) {
+            *link = flow->next;
+            break;
+        }
+    }
+    LeaveCriticalSection(&g_qos.lock);
+}
+
+bool blk_qos_admit(blk_qos_flow_t* flow, blk_qos_port_t* port, blk_qos_item_t* item, uint32_t bytes)
+{
+    if (!flow->limited) {
+        return true;
+    }
+
+    uint64_t now = timer_get_time_ns();
+    uint64_t cost = qos_cost(flow, bytes);
+    bool direct;
+
+    EnterCriticalSection(&g_qos.lock);
+
+    qos_group_refill(&flow->group, now);
+    qos_group_refill(&g_qos.vm, now);
+    flow->stats.requests++;
+
+    // Direto só sem fila à frente: nem do próprio disco, nem na da VM
+    direct = !flow->head && !g_qos.vm_blocked &&
+             qos_group_wait(&flow->group, bytes) == 0 && qos_group_wait(&g_qos.vm, bytes) == 0;
+
+    // Tag de início: não antes do tempo virtual (um flow ocioso não acumula crédito)
+    uint64_t tag = flow->last_tag > g_qos.vtime ? flow->last_tag : g_qos.vtime;
+    flow->last_tag = tag + cost;
+
+    if (direct) {
+        qos_group_consume(&flow->group, bytes);
+        qos_group_consume(&g_qos.vm, bytes);
+        g_qos.vtime = tag;
+    } else {
+        item->next = NULL;
+        item->port = port;
+        item->bytes = bytes;
+        item->tag = tag;
+        item->queued_ns = now;
+        if (flow->tail) {
+            flow->tail->next = item;
+        } else {
+            flow->head = item;
+        }
+        flow->tail = item;
+        flow->stats.throttled++;
+        flow->stats.backlog++;
+    }
+
+    LeaveCriticalSection(&g_qos.lock);
+
+    if (!direct) {
+        SetEvent(g_qos.event);
+    }
+    return direct;
+}
+
+blk_qos_item_t* blk_qos_take(blk_qos_port_t* port)
+{
+    if (!g_qos.initialized) {
+        return NULL;
+    }
+
+    EnterCriticalSection(&g_qos.lock);
+    blk_qos_item_t* list = port->granted;
+    port->granted = NULL;
+    port->granted_tail = NULL;
+    LeaveCriticalSection(&g_qos.lock);
+    return list;
+}
+
+blk_qos_item_t* blk_qos_cancel(blk_qos_flow_t* flow, blk_qos_port_t* port)
+{
+    if (!flow->limited) {
+        return NULL;
+    }
+
+    EnterCriticalSection(&g_qos.lock);
+
+    blk_qos_item_t* list = port->granted;
+    blk_qos_item_t** tail = port->granted_tail ? &port->granted_tail->next : &list;
+    port->granted = NULL;
+    port->granted_tail = NULL;
+
+    // Da espera do flow só os itens desta porta; a ordem dos outros se mantém
+    blk_qos_item_t** link = &flow->head;
+    flow->tail = NULL;
+    while (*link) {
+        blk_qos_item_t* item = *link;
+        if (item->port == port) {
+            *link = item->next;
+            item->next = NULL;
+            *tail = item;
+            tail = &item->next;
+            flow->stats.backlog--;
+        } else {
+            flow->tail = item;
+            link = &item->next;
+        }
+    }
+
+    LeaveCriticalSection(&g_qos.lock);
+    return list;
+}
+
+void blk_qos_get_stats(blk_qos_flow_t* flow, blk_qos_stats_t* stats)
+{
+    if (!g_qos.initialized) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    EnterCriticalSection(&g_qos.lock);
+    *stats = flow->stats;
+    LeaveCriticalSection(&g_qos.lock);
+}
+
+void blk_qos_cleanup(void)
+{
+    if (g_qos.thread) {
+        g_qos.stop = true;
+        SetEvent(g_qos.event);
+        WaitForSingleObject(g_qos.thread, INFINITE);
+        CloseHandle(g_qos.thread);
+        g_qos.thread = NULL;
+    }
+    if (g_qos.event) {
+        CloseHandle(g_qos.event);
+        g_qos.event = NULL;
+    }
+    if (g_qos.initialized) {
+        DeleteCriticalSection(&g_qos.lock);
+        g_qos.initialized = false;
+    }
+    g_qos.flows = NULL;
+    g_qos.stop = false;
+}
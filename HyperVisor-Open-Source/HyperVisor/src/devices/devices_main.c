@@ -1,15 +1,27 @@
 /* Desenvolvido por: Escanearcpl */
 #include "devices.h"
+#include "virtio.h"
+#include "vswitch.h"
 
 // Global device states
 uart_state_t g_uart = {0};
 timer_state_t g_timer = {0};
 gic_state_t g_gic = {0};
+CRITICAL_SECTION g_device_lock;
+
+// Geração por device: incrementada a cada mudança de estado sinalizada pelo host
+static volatile LONG64 g_device_generation[DEVICE_ID_COUNT];
+static CRITICAL_SECTION g_device_change_lock;
+static CONDITION_VARIABLE g_device_changed;
 
 int devices_init(void)
 {
     LOG_INFO("Inicializando devices...");
     
+    InitializeCriticalSection(&g_device_lock);
+    InitializeCriticalSection(&g_device_change_lock);
+    InitializeConditionVariable(&g_device_changed);
+    
     // Initialize UART (PL011)
     g_uart.flag_reg = 0x90;  // TXFE (TX FIFO empty) + RXFE (RX FIFO empty) 
     g_uart.control_reg = 0x300;  // TXE + RXE (TX/RX enabled)
@@ -24,12 +36,26 @@ int devices_init(void)
     g_timer.control = 0;
     g_timer.interrupt_pending = false;
     
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    g_timer.host_frequency = (uint64_t)freq.QuadPart;
+    
     // Initialize GIC
     g_gic.distributor_ctrl = 0;
     g_gic.cpu_ctrl = 0;
     memset(g_gic.pending_interrupts, 0, sizeof(g_gic.pending_interrupts));
     memset(g_gic.enabled_interrupts, 0, sizeof(g_gic.enabled_interrupts));
     memset(g_gic.priorities, 0, sizeof(g_gic.priorities));
+    memset(g_gic.ppi_level, 0, sizeof(g_gic.ppi_level));
+    
+    // Montar índices dos mapas de registradores (aplica valores de reset)
+    if (regmap_init(&g_uart_regmap) != 0 ||
+        regmap_init(&g_timer_regmap) != 0 ||
+        regmap_init(&g_gic_dist_regmap) != 0 ||
+        regmap_init(&g_gic_cpu_regmap) != 0) {
+        LOG_ERROR("Falha ao montar mapas de registradores");
+        return -1;
+    }
     
     LOG_INFO("Devices inicializados com sucesso");
     return 0;
@@ -37,9 +63,65 @@ int devices_init(void)
 
 void devices_cleanup(void)
 {
+    virtio_mmio_cleanup();
+    blk_qos_cleanup();
+    vswitch_cleanup();
+    devices_unmap_shadow_pages();
+    DeleteCriticalSection(&g_device_change_lock);
+    DeleteCriticalSection(&g_device_lock);
     LOG_INFO("Limpeza dos devices concluída");
 }
 
+device_id_t device_id_from_address(uint64_t guest_addr)
+{
+    if (guest_addr >= UART_BASE && guest_addr < UART_BASE + 0x1000) {
+        return DEVICE_ID_UART;
+    }
+    if (guest_addr >= TIMER_BASE && guest_addr < TIMER_BASE + 0x1000) {
+        return DEVICE_ID_TIMER;
+    }
+    if (guest_addr >= GIC_DIST_BASE && guest_addr < GIC_CPU_BASE + 0x1000) {
+        return DEVICE_ID_GIC;
+    }
+    if (guest_addr >= VIRTIO_MMIO_BASE && guest_addr < VIRTIO_MMIO_BASE + VIRTIO_MMIO_SLOTS * VIRTIO_MMIO_SLOT_SIZE) {
+        return DEVICE_ID_VIRTIO;
+    }
+    return DEVICE_ID_NONE;
+}
+
+uint64_t devices_change_generation(device_id_t id)
+{
+    return (uint64_t)g_device_generation[id];
+}
+
+void devices_signal_change(device_id_t id)
+{
+    EnterCriticalSection(&g_device_change_lock);
+    g_device_generation[id]++;
+    LeaveCriticalSection(&g_device_change_lock);
+    WakeAllConditionVariable(&g_device_changed);
+}
+
+// Espera a geração do device sair de 'generation'; false em timeout
+bool devices_wait_change(device_id_t id, uint64_t generation, uint32_t timeout_ms)
+{
+    uint64_t deadline = GetTickCount64() + timeout_ms;
+    bool changed;
+    
+    EnterCriticalSection(&g_device_change_lock);
+    while (!(changed = ((uint64_t)g_device_generation[id] != generation))) {
+        uint64_t now = GetTickCount64();
+        if (now >= deadline ||
+            !SleepConditionVariableCS(&g_device_changed, &g_device_change_lock, (DWORD)(deadline - now))) {
+            changed = ((uint64_t)g_device_generation[id] != generation);
+            break;
+        }
+    }
+    LeaveCriticalSection(&g_device_change_lock);
+    
+    return changed;
+}
+
 device_access_result_t handle_device_access(uint64_t guest_addr, uint64_t* data, 
                                           uint32_t size, bool is_write)
 {
@@ -50,11 +132,13 @@ device_access_result_t handle_device_access(uint64_t guest_addr, uint64_t* data,
         .is_write = is_write
     };
     
-    LOG_DEBUG("Device access: addr=0x%llX, data=0x%llX, size=%d, write=%d",
+    LOG_TRACE("Device access: addr=0x%llX, data=0x%llX, size=%d, write=%d",
               guest_addr, io.data, size, is_write);
     
     device_access_result_t result = DEVICE_ACCESS_IGNORE;
     
+    EnterCriticalSection(&g_device_lock);
+    
     // UART range
     if (guest_addr >= UART_BASE && guest_addr < UART_BASE + 0x1000) {
         result = uart_handle_access(&io);
@@ -71,11 +155,17 @@ device_access_result_t handle_device_access(uint64_t guest_addr, uint64_t* data,
     else if (guest_addr >= GIC_CPU_BASE && guest_addr < GIC_CPU_BASE + 0x1000) {
         result = gic_handle_access(&io);
     }
+    // Slots virtio-mmio
+    else if (guest_addr >= VIRTIO_MMIO_BASE && guest_addr < VIRTIO_MMIO_BASE + VIRTIO_MMIO_SLOTS * VIRTIO_MMIO_SLOT_SIZE) {
+        result = virtio_mmio_handle_access(&io);
+    }
     else {
         LOG_DEBUG("Acesso a endereço não mapeado: 0x%llX", guest_addr);
         result = DEVICE_ACCESS_IGNORE;
     }
     
+    LeaveCriticalSection(&g_device_lock);
+    
     // Update data for reads
     if (!is_write && result == DEVICE_ACCESS_OK && data) {
         *data = io.data;
@@ -0,0 +1,816 @@
+/* Desenvolvido por: Escanearcpl */
+#include "disk_image.h"
+#include <winioctl.h>
+
+#define DISK_L1_NONE            UINT32_MAX  // Slot do cache sem tabela válida
+
+typedef struct {
+    uint32_t l1_index;
+    uint64_t* table;            // Um cluster de entradas (NULL = slot nunca usado)
+    uint64_t last_use;
+} disk_l2_cache_t;
+
+// Cluster alocado no topo cuja entrada só vai à L2 em disk_commit()
+typedef struct {
+    uint64_t cluster;
+    uint64_t host;
+} disk_pending_t;
+
+typedef struct {
+    char path[MAX_PATH];
+    HANDLE meta;                // Síncrono: cabeçalho, tabelas, cópias COW
+    bool sparse;                // HVDK (false = raw)
+    bool read_only;
+    uint64_t size;
+
+    // HVDK
+    uint32_t cluster_bits;
+    uint64_t cluster_size;
+    uint32_t l2_entries;
+    uint64_t* l1;
+    uint32_t l1_entries;
+    uint64_t l1_offset;
+    uint64_t file_end;          // Próxima alocação, alinhada ao cluster
+    disk_l2_cache_t cache[DISK_L2_CACHE_SIZE];
+    uint64_t tick;
+    disk_pending_t pending[DISK_PENDING_MAX];   // Só no topo
+    uint32_t pending_count;
+} disk_layer_t;
+
+struct disk {
+    CRITICAL_SECTION lock;      // Metadados de todas as camadas
+    uint32_t layers;
+    disk_layer_t layer[DISK_MAX_CHAIN];
+    uint8_t* cluster_buffer;    // Cópia COW e zeros de write-zeroes
+    uint64_t cluster_buffer_size;
+};
+
+static bool disk_pread(HANDLE file, void* buf, uint32_t len, uint64_t offset)
+{
+    OVERLAPPED ov = {0};
+    DWORD done = 0;
+
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    return ReadFile(file, buf, len, &done, &ov) && done == len;
+}
+
+static bool disk_pwrite(HANDLE file, const void* buf, uint32_t len, uint64_t offset)
+{
+    OVERLAPPED ov = {0};
+    DWORD done = 0;
+
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    return WriteFile(file, buf, len, &done, &ov) && done == len;
+}
+
+static bool disk_set_end(HANDLE file, uint64_t size)
+{
+    LARGE_INTEGER end;
+    end.QuadPart = (int64_t)size;
+    return SetFilePointerEx(file, end, NULL, FILE_BEGIN) && SetEndOfFile(file);
+}
+
+// Devolve o espaço de um range ao sistema de arquivos (arquivo esparso)
+static void disk_punch_hole(HANDLE file, uint64_t offset, uint64_t len)
+{
+    FILE_ZERO_DATA_INFORMATION zero;
+    DWORD returned;
+
+    zero.FileOffset.QuadPart = (int64_t)offset;
+    zero.BeyondFinalZero.QuadPart = (int64_t)(offset + len);
+    DeviceIoControl(file, FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), NULL, 0, &returned, NULL);
+}
+
+// Base relativa ao diretório da imagem que a referencia, ou absoluta
+static void disk_resolve_backing(const char* image, const char* backing, char* out, size_t size)
+{
+    if (backing[0] == '\\' || backing[0] == '/' || (backing[0] && backing[1] == ':')) {
+        snprintf(out, size, "%s", backing);
+        return;
+    }
+
+    const char* slash = strrchr(image, '\\');
+    const char* fwd = strrchr(image, '/');
+    if (!slash || (fwd && fwd > slash)) {
+        slash = fwd;
+    }
+
+    int dir = slash ? (int)(slash - image + 1) : 0;
+    snprintf(out, size, "%.*s%s", dir, image, backing);
+}
+
+// ---------------------------------------------------------------------------
+// Tabelas L1/L2
+// ---------------------------------------------------------------------------
+
+static uint64_t disk_alloc_cluster(disk_layer_t* layer)
+{
+    uint64_t offset = layer->file_end;
+
+    // Estender antes de publicar o cluster: a região nova lê zero
+    if (!disk_set_end(layer->meta, offset + layer->cluster_size)) {
+        LOG_ERROR("%s: falha ao estender a imagem: %lu", layer->path, GetLastError());
+        return 0;
+    }
+    layer->file_end += layer->cluster_size;
+    return offset;
+}
+
+// Tabela L2 de uma entrada da L1 via cache LRU; NULL se não existe (e
+// !allocate) ou em erro de I/O
+static uint64_t* disk_l2_table(disk_layer_t* layer, uint32_t l1_index, bool allocate, bool* io_error)
+{
+    disk_l2_cache_t* victim = &layer->cache[0];
+
+    for (uint32_t i = 0; i < DISK_L2_CACHE_SIZE; i++) {
+        disk_l2_cache_t* slot = &layer->cache[i];
+        if (slot->table && slot->l1_index == l1_index) {
+            slot->last_use = ++layer->tick;
+            return slot->table;
+        }
+        if (slot->last_use < victim->last_use) {
+            victim = slot;
+        }
+    }
+
+    uint64_t l2_offset = layer->l1[l1_index];
+    if (!l2_offset) {
+        if (!allocate) {
+            return NULL;
+        }
+
+        // Tabela nova: o cluster recém-estendido já lê zero
+        l2_offset = disk_alloc_cluster(layer);
+        if (!l2_offset || !disk_pwrite(layer->meta, &l2_offset, sizeof(l2_offset),
+                                       layer->l1_offset + (uint64_t)l1_index * sizeof(uint64_t))) {
+            *io_error = true;
+            return NULL;
+        }
+        layer->l1[l1_index] = l2_offset;
+    }
+
+    if (!victim->table) {
+        victim->table = (uint64_t*)malloc(layer->cluster_size);
+        if (!victim->table) {
+            *io_error = true;
+            return NULL;
+        }
+    }
+
+    victim->l1_index = DISK_L1_NONE;
+    victim->last_use = 0;
+    if (!disk_pread(layer->meta, victim->table, (uint32_t)layer->cluster_size, l2_offset)) {
+        LOG_ERROR("%s: falha ao ler tabela L2 em 0x%llX", layer->path, l2_offset);
+        *io_error = true;
+        return NULL;
+    }
+
+    victim->l1_index = l1_index;
+    victim->last_use = ++layer->tick;
+    return victim->table;
+}
+
+static int disk_pending_find(const disk_layer_t* layer, uint64_t cluster)
+{
+    for (uint32_t i = 0; i < layer->pending_count; i++) {
+        if (layer->pending[i].cluster == cluster) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void disk_pending_remove(disk_layer_t* layer, int index)
+{
+    layer->pending[index] = layer->pending[--layer->pending_count];
+}
+
+// Entrada da L2; um cluster pendente já conta como alocado na tradução
+static int disk_l2_get(disk_layer_t* layer, uint64_t cluster, uint64_t* entry)
+{
+    bool io_error = false;
+    uint64_t* table = disk_l2_table(layer, (uint32_t)(cluster / layer->l2_entries), false, &io_error);
+
+    *entry = table ? table[cluster % layer->l2_entries] : 0;
+    if (*entry == 0 && layer->pending_count) {
+        int index = disk_pending_find(layer, cluster);
+        if (index >= 0) {
+            *entry = layer->pending[index].host;
+        }
+    }
+    return io_error ? -1 : 0;
+}
+
+// Write-through: a entrada vai ao arquivo antes de valer no cache. Substitui
+// uma entrada pendente do cluster (discard sobre uma escrita em voo)
+static int disk_l2_set(disk_layer_t* layer, uint64_t cluster, uint64_t entry)
+{
+    bool io_error = false;
+    uint32_t l1_index = (uint32_t)(cluster / layer->l2_entries);
+    uint32_t l2_index = (uint32_t)(cluster % layer->l2_entries);
+    uint64_t* table = disk_l2_table(layer, l1_index, true, &io_error);
+
+    if (!table || !disk_pwrite(layer->meta, &entry, sizeof(entry),
+                               layer->l1[l1_index] + (uint64_t)l2_index * sizeof(uint64_t))) {
+        return -1;
+    }
+    table[l2_index] = entry;
+
+    int index = layer->pending_count ? disk_pending_find(layer, cluster) : -1;
+    if (index >= 0) {
+        disk_pending_remove(layer, index);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Tradução (com disk->lock)
+// ---------------------------------------------------------------------------
+
+static int disk_map_read_locked(disk_t* disk, uint32_t first, uint64_t offset, uint64_t len,
+                                disk_extent_t* extent)
+{
+    for (uint32_t i = first; i < disk->layers; i++) {
+        disk_layer_t* layer = &disk->layer[i];
+
+        // Além do fim de uma base menor que o overlay: zero
+        if (offset >= layer->size) {
+            break;
+        }
+        if (len > layer->size - offset) {
+            len = layer->size - offset;
+        }
+
+        if (!layer->sparse) {
+            *extent = (disk_extent_t){ DISK_EXTENT_DATA, i, offset, len, 0 };
+            return 0;
+        }
+
+        uint64_t cluster = offset >> layer->cluster_bits;
+        uint64_t within = offset & (layer->cluster_size - 1);
+        uint64_t avail = len;
+        uint64_t entry;
+
+        if (len > layer->cluster_size - within) {
+            len = layer->cluster_size - within;
+        }
+        if (disk_l2_get(layer, cluster, &entry) != 0) {
+            return -1;
+        }
+
+        if (entry & DISK_L2_ZERO) {
+            *extent = (disk_extent_t){ DISK_EXTENT_ZERO, i, 0, len, 0 };
+            return 0;
+        }
+
+        if (entry & DISK_L2_OFFSET_MASK) {
+            uint64_t host = entry & DISK_L2_OFFSET_MASK;
+            *extent = (disk_extent_t){ DISK_EXTENT_DATA, i, host + within, len, 0 };
+
+            // Clusters seguintes contíguos no arquivo estendem o trecho
+            while (extent->len < avail) {
+                uint64_t next;
+                if (disk_l2_get(layer, ++cluster, &next) != 0 || (next & DISK_L2_ZERO) ||
+                    (next & DISK_L2_OFFSET_MASK) != (host += layer->cluster_size)) {
+                    break;
+                }
+                extent->len += avail - extent->len < layer->cluster_size ? avail - extent->len : layer->cluster_size;
+            }
+            return 0;
+        }
+
+        // Não alocado nesta camada: a próxima decide, dentro deste cluster
+    }
+
+    *extent = (disk_extent_t){ DISK_EXTENT_ZERO, 0, 0, len, 0 };
+    return 0;
+}
+
+// Leitura síncrona pela cadeia a partir de 'first' (cópia COW)
+static int disk_read_locked(disk_t* disk, uint32_t first, uint64_t offset, uint8_t* buf, uint64_t len)
+{
+    while (len) {
+        disk_extent_t extent;
+        if (disk_map_read_locked(disk, first, offset, len, &extent) != 0) {
+            return -1;
+        }
+
+        if (extent.kind == DISK_EXTENT_ZERO) {
+            memset(buf, 0, extent.len);
+        } else if (!disk_pread(disk->layer[extent.layer].meta, buf, (uint32_t)extent.len, extent.host_offset)) {
+            return -1;
+        }
+
+        buf += extent.len;
+        offset += extent.len;
+        len -= extent.len;
+    }
+    return 0;
+}
+
+// Aloca no topo o cluster de 'offset'; copia da base o que a escrita não
+// cobre. *pending indica entrada à espera de disk_commit()
+static int disk_alloc_locked(disk_t* disk, uint64_t offset, uint64_t covered, uint64_t entry,
+                             uint64_t* host, bool* pending)
+{
+    disk_layer_t* top = &disk->layer[0];
+    uint64_t cluster = offset >> top->cluster_bits;
+    uint64_t cluster_start = cluster << top->cluster_bits;
+    bool from_base = !(entry & DISK_L2_ZERO) && disk->layers > 1;
+
+    *pending = false;
+    *host = disk_alloc_cluster(top);
+    if (!*host) {
+        return -1;
+    }
+
+    // Escrita cobrindo o cluster sobre a base: sem cópia, mas a entrada só
+    // vale no arquivo depois dos dados. Com a tabela cheia, cópia COW
+    if (from_base && covered == top->cluster_size && top->pending_count < DISK_PENDING_MAX) {
+        top->pending[top->pending_count++] = (disk_pending_t){ cluster, *host };
+        *pending = true;
+        return 0;
+    }
+
+    // Cluster zero ou sem base: a região nova já lê zero
+    if (from_base) {
+        if (disk_read_locked(disk, 1, cluster_start, disk->cluster_buffer, top->cluster_size) != 0 ||
+            !disk_pwrite(top->meta, disk->cluster_buffer, (uint32_t)top->cluster_size, *host)) {
+            LOG_ERROR("%s: cópia COW do cluster %llu falhou", top->path, cluster);
+            return -1;
+        }
+    }
+
+    // Dados (cópia) no arquivo antes da entrada que aponta para eles
+    return disk_l2_set(top, cluster, *host);
+}
+
+static int disk_map_write_locked(disk_t* disk, uint64_t offset, uint64_t len, disk_extent_t* extent)
+{
+    disk_layer_t* top = &disk->layer[0];
+
+    if (!top->sparse) {
+        *extent = (disk_extent_t){ DISK_EXTENT_DATA, 0, offset, len, 0 };
+        return 0;
+    }
+
+    uint64_t within = offset & (top->cluster_size - 1);
+    uint64_t first_len = len < top->cluster_size - within ? len : top->cluster_size - within;
+    uint64_t entry;
+    uint64_t host;
+    bool pending;
+
+    if (disk_l2_get(top, offset >> top->cluster_bits, &entry) != 0) {
+        return -1;
+    }
+
+    // Já alocado no topo: mesma tradução da leitura
+    if ((entry & DISK_L2_OFFSET_MASK) && !(entry & DISK_L2_ZERO)) {
+        return disk_map_read_locked(disk, 0, offset, len, extent);
+    }
+
+    if (disk_alloc_locked(disk, offset, first_len, entry, &host, &pending) != 0) {
+        return -1;
+    }
+    *extent = (disk_extent_t){ DISK_EXTENT_DATA, 0, host + within, first_len, pending };
+
+    // Clusters seguintes inteiramente sobrescritos e ainda não alocados
+    // entram no mesmo trecho enquanto a alocação sair contígua
+    while (len - extent->len >= top->cluster_size) {
+        uint64_t next_offset = offset + extent->len;
+        uint64_t next_host;
+
+        if (disk_l2_get(top, next_offset >> top->cluster_bits, &entry) != 0 ||
+            ((entry & DISK_L2_OFFSET_MASK) && !(entry & DISK_L2_ZERO)) ||
+            top->file_end != host + top->cluster_size) {
+            break;
+        }
+        if (disk_alloc_locked(disk, next_offset, top->cluster_size, entry, &next_host, &pending) != 0) {
+            return -1;
+        }
+        if (next_host != host + top->cluster_size) {
+            // Alocado, mas fora do trecho: a próxima chamada o encontra. Um
+            // pendente não teria escrita que o publicasse
+            if (pending) {
+                int index = disk_pending_find(top, next_offset >> top->cluster_bits);
+                disk_pending_remove(top, index);
+                disk_punch_hole(top->meta, next_host, top->cluster_size);
+            }
+            break;
+        }
+        host = next_host;
+        extent->len += top->cluster_size;
+        extent->pending += pending;
+    }
+    return 0;
+}
+
+// Entradas pendentes de clusters alocados para este trecho (outro trecho
+// sobre o mesmo cluster virtual não as publica)
+static int disk_commit_locked(disk_t* disk, uint64_t offset, const disk_extent_t* extent, bool written)
+{
+    disk_layer_t* top = &disk->layer[0];
+    uint64_t last = (offset + extent->len - 1) >> top->cluster_bits;
+    int result = 0;
+
+    for (uint64_t cluster = offset >> top->cluster_bits; cluster <= last; cluster++) {
+        int index = disk_pending_find(top, cluster);
+        if (index < 0) {
+            continue;
+        }
+
+        uint64_t host = top->pending[index].host;
+        if (host + top->cluster_size <= extent->host_offset || host >= extent->host_offset + extent->len) {
+            continue;
+        }
+
+        if (written) {
+            if (disk_l2_set(top, cluster, host) != 0) {
+                LOG_ERROR("%s: falha ao publicar o cluster %llu", top->path, cluster);
+                result = -1;
+            }
+        } else {
+            // Escrita perdida: o cluster volta a ler da base
+            disk_pending_remove(top, index);
+            disk_punch_hole(top->meta, host, top->cluster_size);
+        }
+    }
+    return result;
+}
+
+int disk_map(disk_t* disk, uint64_t offset, uint64_t len, bool write, disk_extent_t* extent)
+{
+    if (offset >= disk->layer[0].size || len == 0) {
+        return -1;
+    }
+    if (len > disk->layer[0].size - offset) {
+        len = disk->layer[0].size - offset;
+    }
+    if (write && disk->layer[0].read_only) {
+        return -1;
+    }
+
+    EnterCriticalSection(&disk->lock);
+    int result = write ? disk_map_write_locked(disk, offset, len, extent)
+                       : disk_map_read_locked(disk, 0, offset, len, extent);
+    LeaveCriticalSection(&disk->lock);
+    return result;
+}
+
+int disk_commit(disk_t* disk, uint64_t offset, const disk_extent_t* extent, bool written)
+{
+    if (!extent->pending) {
+        return 0;
+    }
+
+    EnterCriticalSection(&disk->lock);
+    int result = disk_commit_locked(disk, offset, extent, written);
+    LeaveCriticalSection(&disk->lock);
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Discard / write-zeroes / flush
+// ---------------------------------------------------------------------------
+
+// Clusters inteiros de [offset, offset+len) passam a 'entry' (0 ou ZERO) e
+// o espaço que ocupavam volta ao host
+static int disk_unmap_clusters(disk_t* disk, uint64_t offset, uint64_t len, uint64_t new_entry)
+{
+    disk_layer_t* top = &disk->layer[0];
+    uint64_t first = (offset + top->cluster_size - 1) >> top->cluster_bits;
+    uint64_t end = (offset + len) >> top->cluster_bits;
+
+    for (uint64_t cluster = first; cluster < end; cluster++) {
+        uint64_t entry;
+        if (disk_l2_get(top, cluster, &entry) != 0) {
+            return -1;
+        }
+        if (entry == new_entry) {
+            continue;
+        }
+        if (disk_l2_set(top, cluster, new_entry) != 0) {
+            return -1;
+        }
+        if (entry & DISK_L2_OFFSET_MASK) {
+            disk_punch_hole(top->meta, entry & DISK_L2_OFFSET_MASK, top->cluster_size);
+        }
+    }
+    return 0;
+}
+
+int disk_discard(disk_t* disk, uint64_t offset, uint64_t len)
+{
+    disk_layer_t* top = &disk->layer[0];
+
+    // Raw e trechos parciais de cluster: discard é só uma dica
+    if (!top->sparse || top->read_only || offset >= top->size) {
+        return 0;
+    }
+    if (len > top->size - offset) {
+        len = top->size - offset;
+    }
+
+    // Com base, o cluster descartado precisa esconder o conteúdo dela
+    EnterCriticalSection(&disk->lock);
+    int result = disk_unmap_clusters(disk, offset, len, disk->layers > 1 ? DISK_L2_ZERO : 0);
+    LeaveCriticalSection(&disk->lock);
+    return result;
+}
+
+// Zeros escritos no topo para um trecho parcial ou quando não se pode desalocar
+static int disk_write_zero_range(disk_t* disk, uint64_t offset, uint64_t len)
+{
+    while (len) {
+        disk_extent_t extent;
+        uint64_t chunk = len < disk->cluster_buffer_size ? len : disk->cluster_buffer_size;
+
+        if (disk_map_write_locked(disk, offset, chunk, &extent) != 0) {
+            return -1;
+        }
+
+        // Zerado depois da tradução: a cópia COW usa o mesmo buffer
+        memset(disk->cluster_buffer, 0, extent.len);
+        bool written = disk_pwrite(disk->layer[0].meta, disk->cluster_buffer, (uint32_t)extent.len,
+                                   extent.host_offset);
+        if ((extent.pending && disk_commit_locked(disk, offset, &extent, written) != 0) || !written) {
+            return -1;
+        }
+        offset += extent.len;
+        len -= extent.len;
+    }
+    return 0;
+}
+
+int disk_write_zeroes(disk_t* disk, uint64_t offset, uint64_t len, bool unmap)
+{
+    disk_layer_t* top = &disk->layer[0];
+    int result = 0;
+
+    if (top->read_only || offset >= top->size) {
+        return -1;
+    }
+    if (len > top->size - offset) {
+        len = top->size - offset;
+    }
+
+    EnterCriticalSection(&disk->lock);
+
+    if (!top->sparse || !unmap) {
+        result = disk_write_zero_range(disk, offset, len);
+    } else {
+        // Clusters inteiros viram entradas ZERO; as pontas são escritas
+        uint64_t head_end = (offset + top->cluster_size - 1) & ~(top->cluster_size - 1);
+        uint64_t tail_start = (offset + len) & ~(top->cluster_size - 1);
+
+        if (head_end >= offset + len || tail_start <= head_end) {
+            result = disk_write_zero_range(disk, offset, len);
+        } else {
+            if (head_end > offset) {
+                result = disk_write_zero_range(disk, offset, head_end - offset);
+            }
+            if (result == 0) {
+                result = disk_unmap_clusters(disk, head_end, tail_start - head_end, DISK_L2_ZERO);
+            }
+            if (result == 0 && offset + len > tail_start) {
+                result = disk_write_zero_range(disk, tail_start, offset + len - tail_start);
+            }
+        }
+    }
+
+    LeaveCriticalSection(&disk->lock);
+    return result;
+}
+
+int disk_flush(disk_t* disk)
+{
+    // O cache do arquivo é comum a todos os handles abertos sobre ele
+    return disk->layer[0].read_only || FlushFileBuffers(disk->layer[0].meta) ? 0 : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Abertura e criação
+// ---------------------------------------------------------------------------
+
+static int disk_layer_open(disk_layer_t* layer, const char* path, bool read_only, char* backing, size_t backing_size)
+{
+    disk_header_t header;
+    LARGE_INTEGER file_size;
+
+    snprintf(layer->path, sizeof(layer->path), "%s", path);
+    layer->read_only = read_only;
+    backing[0] = '\0';
+
+    // Bases somente leitura negam escritores: várias VMs podem compartilhá-las
+    layer->meta = CreateFileA(path, GENERIC_READ | (read_only ? 0 : GENERIC_WRITE),
+                              read_only ? FILE_SHARE_READ : FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (layer->meta == INVALID_HANDLE_VALUE) {
+        LOG_ERROR("Falha ao abrir imagem %s: %lu", path, GetLastError());
+        return -1;
+    }
+    if (!GetFileSizeEx(layer->meta, &file_size)) {
+        return -1;
+    }
+
+    if (file_size.QuadPart < (int64_t)sizeof(header) ||
+        !disk_pread(layer->meta, &header, sizeof(header), 0) || header.magic != DISK_MAGIC) {
+        layer->size = (uint64_t)file_size.QuadPart;
+        return 0;   // Raw
+    }
+
+    if (header.version != DISK_VERSION || header.cluster_bits < 12 || header.cluster_bits > 21 ||
+        header.l1_entries == 0 || header.l1_offset == 0) {
+        LOG_ERROR("%s: cabeçalho HVDK inválido ou versão não suportada", path);
+        return -1;
+    }
+
+    layer->sparse = true;
+    layer->size = header.size;
+    layer->cluster_bits = header.cluster_bits;
+    layer->cluster_size = 1ULL << header.cluster_bits;
+    layer->l2_entries = (uint32_t)(layer->cluster_size / sizeof(uint64_t));
+    layer->l1_entries = header.l1_entries;
+    layer->l1_offset = header.l1_offset;
+    layer->file_end = ((uint64_t)file_size.QuadPart + layer->cluster_size - 1) & ~(layer->cluster_size - 1);
+
+    if ((uint64_t)layer->l1_entries * layer->l2_entries < ((layer->size + layer->cluster_size - 1) >> layer->cluster_bits)) {
+        LOG_ERROR("%s: L1 não cobre o tamanho virtual", path);
+        return -1;
+    }
+
+    layer->l1 = (uint64_t*)malloc((size_t)layer->l1_entries * sizeof(uint64_t));
+    if (!layer->l1 ||
+        !disk_pread(layer->meta, layer->l1, layer->l1_entries * (uint32_t)sizeof(uint64_t), layer->l1_offset)) {
+        LOG_ERROR("%s: falha ao ler a L1", path);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < DISK_L2_CACHE_SIZE; i++) {
+        layer->cache[i].l1_index = DISK_L1_NONE;
+    }
+
+    // Imagens copiadas podem ter perdido o atributo; sem ele o discard não libera espaço
+    if (!read_only) {
+        DWORD returned;
+        DeviceIoControl(layer->meta, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned, NULL);
+    }
+
+    header.backing[DISK_BACKING_MAX - 1] = '\0';
+    if (header.backing[0]) {
+        disk_resolve_backing(path, header.backing, backing, backing_size);
+    }
+    return 0;
+}
+
+int disk_open(const char* path, bool read_only, disk_t** out)
+{
+    disk_t* disk = (disk_t*)calloc(1, sizeof(disk_t));
+    char next[MAX_PATH];
+
+    if (!disk) {
+        return -1;
+    }
+    InitializeCriticalSection(&disk->lock);
+    snprintf(next, sizeof(next), "%s", path);
+
+    // Só o topo é gravável; bases sempre somente leitura
+    while (next[0]) {
+        char backing[MAX_PATH];
+
+        if (disk->layers == DISK_MAX_CHAIN) {
+            LOG_ERROR("%s: cadeia de imagens base maior que %u", path, DISK_MAX_CHAIN);
+            disk_close(disk);
+            return -1;
+        }
+
+        disk_layer_t* layer = &disk->layer[disk->layers++];
+        if (disk_layer_open(layer, next, disk->layers > 1 || read_only, backing, sizeof(backing)) != 0) {
+            disk_close(disk);
+            return -1;
+        }
+        if (layer->sparse && layer->cluster_size > disk->cluster_buffer_size) {
+            disk->cluster_buffer_size = layer->cluster_size;
+        }
+        snprintf(next, sizeof(next), "%s", backing);
+    }
+
+    if (disk->cluster_buffer_size == 0) {
+        disk->cluster_buffer_size = 1ULL << DISK_CLUSTER_BITS;
+    }
+    disk->cluster_buffer = (uint8_t*)malloc(disk->cluster_buffer_size);
+    if (!disk->cluster_buffer) {
+        disk_close(disk);
+        return -1;
+    }
+
+    *out = disk;
+    return 0;
+}
+
+void disk_close(disk_t* disk)
+{
+    for (uint32_t i = 0; i < disk->layers; i++) {
+        disk_layer_t* layer = &disk->layer[i];
+
+        if (layer->meta && layer->meta != INVALID_HANDLE_VALUE) {
+            CloseHandle(layer->meta);
+        }
+        for (uint32_t c = 0; c < DISK_L2_CACHE_SIZE; c++) {
+            free(layer->cache[c].table);
+        }
+        free(layer->l1);
+    }
+    free(disk->cluster_buffer);
+    DeleteCriticalSection(&disk->lock);
+    free(disk);
+}
+
+uint64_t disk_size(const disk_t* disk)
+{
+    return disk->layer[0].size;
+}
+
+bool disk_is_sparse(const disk_t* disk)
+{
+    return disk->layer[0].sparse;
+}
+
+uint32_t disk_layer_count(const disk_t* disk)
+{
+    return disk->layers;
+}
+
+const char* disk_layer_path(const disk_t* disk, uint32_t layer)
+{
+    return layer < disk->layers ? disk->layer[layer].path : NULL;
+}
+
+int disk_create(const char* path, uint64_t size, const char* backing)
+{
+    disk_header_t header;
+    uint64_t cluster_size = 1ULL << DISK_CLUSTER_BITS;
+    uint64_t l2_coverage = cluster_size * (cluster_size / sizeof(uint64_t));
+
+    memset(&header, 0, sizeof(header));
+
+    if (backing && backing[0]) {
+        char resolved[MAX_PATH];
+        disk_t* base;
+
+        if (strlen(backing) >= DISK_BACKING_MAX) {
+            LOG_ERROR("Caminho da base longo demais: %s", backing);
+            return -1;
+        }
+
+        // Valida a cadeia inteira e herda o tamanho da base
+        disk_resolve_backing(path, backing, resolved, sizeof(resolved));
+        if (disk_open(resolved, true, &base) != 0) {
+            return -1;
+        }
+        if (size == 0) {
+            size = disk_size(base);
+        }
+        disk_close(base);
+        snprintf(header.backing, sizeof(header.backing), "%s", backing);
+    }
+
+    if (size == 0) {
+        LOG_ERROR("Tamanho da imagem não informado");
+        return -1;
+    }
+
+    header.magic = DISK_MAGIC;
+    header.version = DISK_VERSION;
+    header.cluster_bits = DISK_CLUSTER_BITS;
+    header.size = size;
+    header.l1_entries = (uint32_t)((size + l2_coverage - 1) / l2_coverage);
+    header.l1_offset = cluster_size;
+
+    uint64_t l1_bytes = (uint64_t)header.l1_entries * sizeof(uint64_t);
+    uint64_t end = header.l1_offset + ((l1_bytes + cluster_size - 1) & ~(cluster_size - 1));
+
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        LOG_ERROR("Falha ao criar %s: %lu", path, GetLastError());
+        return -1;
+    }
+
+    // Arquivo esparso: a L1 zerada e os clusters futuros não ocupam espaço
+    DWORD returned;
+    DeviceIoControl(file, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned, NULL);
+
+    bool ok = disk_set_end(file, end) && disk_pwrite(file, &header, sizeof(header), 0);
+    CloseHandle(file);
+
+    if (!ok) {
+        LOG_ERROR("Falha ao gravar o cabeçalho de %s", path);
+        return -1;
+    }
+
+    LOG_INFO("Imagem %s criada: %llu MB%s%s", path, size >> 20,
+             header.backing[0] ? ", base " : "", header.backing);
+    return 0;
+}
@@ -1,156 +1,132 @@
 /* Desenvolvido por: Escanearcpl */
 #include "devices.h"
 
-device_access_result_t gic_handle_access(const device_io_t* io)
+// Registradores de bitmap (set/clear) - um elemento por banco de 32 IRQs
+static uint64_t gic_enable_read(void* state, const regmap_reg_t* reg, uint32_t index)
 {
-    uint64_t base_addr = 0;
-    bool is_distributor = false;
+    (void)reg;
+    return ((gic_state_t*)state)->enabled_interrupts[index];
+}
+
+static void gic_set_enable_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)reg;
+    ((gic_state_t*)state)->enabled_interrupts[index] |= (uint32_t)value;
+}
+
+static void gic_clear_enable_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)reg;
+    ((gic_state_t*)state)->enabled_interrupts[index] &= ~(uint32_t)value;
+}
+
+static uint64_t gic_pending_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)reg;
+    return ((gic_state_t*)state)->pending_interrupts[index];
+}
+
+static void gic_set_pending_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)reg;
+    ((gic_state_t*)state)->pending_interrupts[index] |= (uint32_t)value;
+}
+
+static void gic_clear_pending_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)reg;
+    ((gic_state_t*)state)->pending_interrupts[index] &= ~(uint32_t)value;
+}
+
+// GICC_IAR: leitura reconhece a interrupção de maior prioridade
+static uint64_t gic_iar_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)state; (void)reg; (void)index;
     
+    uint32_t irq = gic_get_pending_interrupt();
+    if (irq != 1023) {  // 1023 = spurious interrupt
+        // Auto-acknowledge
+        gic_ack_interrupt(irq);
+    }
+    return irq;
+}
+
+static void gic_eoir_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)state; (void)reg; (void)index;
+    // End of interrupt processing
+    gic_ack_interrupt((uint32_t)value);
+}
+
+#define GICD_ISPENDR     0x200
+#define GICD_ICPENDR     0x280
+
+static const regmap_reg_t gic_dist_regs[] = {
+    REGMAP_REG("GICD_CTLR", 0x000, REGMAP_RW, offsetof(gic_state_t, distributor_ctrl), 0xFFFFFFFF, 0),
+    // Report: 1 CPU, 32 interrupt lines, no security extensions
+    REGMAP_REG("GICD_TYPER", 0x004, REGMAP_RO, REGMAP_NO_FIELD, 0, 0x0000001F),
+    REGMAP_REG("GICD_IIDR", 0x008, REGMAP_RO, REGMAP_NO_FIELD, 0, 0x0200143B),
+    REGMAP_HOOK("GICD_ISENABLER", 0x100, 8, REGMAP_RW, REGMAP_F_W1, gic_enable_read, gic_set_enable_write),
+    REGMAP_HOOK("GICD_ICENABLER", 0x180, 8, REGMAP_RW, REGMAP_F_W1, gic_enable_read, gic_clear_enable_write),
+    REGMAP_HOOK("GICD_ISPENDR", GICD_ISPENDR, 8, REGMAP_RW, REGMAP_F_W1, gic_pending_read, gic_set_pending_write),
+    REGMAP_HOOK("GICD_ICPENDR", GICD_ICPENDR, 8, REGMAP_RW, REGMAP_F_W1, gic_pending_read, gic_clear_pending_write),
+    // Um byte de prioridade por IRQ
+    REGMAP_ARRAY("GICD_IPRIORITYR", 0x400, 256, 1, REGMAP_RW, offsetof(gic_state_t, priorities), 0xFF),
+};
+
+static const regmap_reg_t gic_cpu_regs[] = {
+    REGMAP_REG("GICC_CTLR", 0x00, REGMAP_RW, offsetof(gic_state_t, cpu_ctrl), 0xFFFFFFFF, 0),
+    // PMR: qualquer valor é aceito, leitura permite todas as prioridades
+    REGMAP_REG("GICC_PMR", 0x04, REGMAP_RW, REGMAP_NO_FIELD, 0, 0xFF),
+    REGMAP_HOOK("GICC_IAR", 0x0C, 1, REGMAP_RO, REGMAP_F_VOLATILE, gic_iar_read, NULL),
+    REGMAP_HOOK("GICC_EOIR", 0x10, 1, REGMAP_WO, 0, NULL, gic_eoir_write),
+};
+
+regmap_t g_gic_dist_regmap = {
+    .name = "GIC DIST",
+    .base = GIC_DIST_BASE,
+    .size = 0x1000,
+    .state = &g_gic,
+    .regs = gic_dist_regs,
+    .nregs = REGMAP_COUNT(gic_dist_regs),
+};
+
+regmap_t g_gic_cpu_regmap = {
+    .name = "GIC CPU",
+    .base = GIC_CPU_BASE,
+    .size = 0x1000,
+    .state = &g_gic,
+    .regs = gic_cpu_regs,
+    .nregs = REGMAP_COUNT(gic_cpu_regs),
+};
+
+// Eventos do host mudam só um banco de pending: as duas palavras que o expõem
+static void gic_shadow_sync_pending(uint32_t reg_idx)
+{
+    regmap_shadow_sync_range(&g_gic_dist_regmap, GICD_ISPENDR + reg_idx * 4, 4);
+    regmap_shadow_sync_range(&g_gic_dist_regmap, GICD_ICPENDR + reg_idx * 4, 4);
+}
+
+device_access_result_t gic_handle_access(device_io_t* io)
+{
     // Determinar se é acesso ao Distributor ou CPU Interface
     if (io->address >= GIC_DIST_BASE && io->address < GIC_DIST_BASE + 0x1000) {
-        base_addr = GIC_DIST_BASE;
-        is_distributor = true;
+        return gic_handle_distributor_access(io);
     } else if (io->address >= GIC_CPU_BASE && io->address < GIC_CPU_BASE + 0x1000) {
-        base_addr = GIC_CPU_BASE;
-        is_distributor = false;
-    } else {
-        return DEVICE_ACCESS_IGNORE;
+        return gic_handle_cpu_access(io);
     }
     
-    uint64_t offset = io->address - base_addr;
-    
-    LOG_DEBUG("GIC %s access: offset=0x%llX, data=0x%llX, write=%d", 
-              is_distributor ? "DIST" : "CPU", offset, io->data, io->is_write);
-    
-    if (is_distributor) {
-        return gic_handle_distributor_access(offset, io);
-    } else {
-        return gic_handle_cpu_access(offset, io);
-    }
+    return DEVICE_ACCESS_IGNORE;
 }
 
-device_access_result_t gic_handle_distributor_access(uint64_t offset, const device_io_t* io)
+device_access_result_t gic_handle_distributor_access(device_io_t* io)
 {
-    switch (offset) {
-        case 0x000:  // GICD_CTLR - Distributor Control Register
-            if (io->is_write) {
-                g_gic.distributor_ctrl = (uint32_t)io->data;
-                LOG_DEBUG("GIC DIST CTRL write: 0x%X", g_gic.distributor_ctrl);
-            } else {
-                *(uint64_t*)&io->data = g_gic.distributor_ctrl;
-            }
-            break;
-            
-        case 0x004:  // GICD_TYPER - Interrupt Controller Type Register
-            if (!io->is_write) {
-                // Report: 1 CPU, 32 interrupt lines, no security extensions
-                *(uint64_t*)&io->data = 0x0000001F;  // 32 interrupts (ITLinesNumber = 0)
-                LOG_DEBUG("GIC DIST TYPER read: 0x%llX", io->data);
-            }
-            break;
-            
-        case 0x100:  // GICD_ISENABLER0 - Interrupt Set-Enable Register 0
-            if (io->is_write) {
-                g_gic.enabled_interrupts[0] |= (uint32_t)io->data;
-                LOG_DEBUG("GIC DIST Enable IRQs: 0x%X", (uint32_t)io->data);
-            } else {
-                *(uint64_t*)&io->data = g_gic.enabled_interrupts[0];
-            }
-            break;
-            
-        case 0x180:  // GICD_ICENABLER0 - Interrupt Clear-Enable Register 0
-            if (io->is_write) {
-                g_gic.enabled_interrupts[0] &= ~(uint32_t)io->data;
-                LOG_DEBUG("GIC DIST Disable IRQs: 0x%X", (uint32_t)io->data);
-            }
-            break;
-            
-        case 0x200:  // GICD_ISPENDR0 - Interrupt Set-Pending Register 0
-            if (io->is_write) {
-                g_gic.pending_interrupts[0] |= (uint32_t)io->data;
-                LOG_DEBUG("GIC DIST Set pending IRQs: 0x%X", (uint32_t)io->data);
-            } else {
-                *(uint64_t*)&io->data = g_gic.pending_interrupts[0];
-            }
-            break;
-            
-        case 0x280:  // GICD_ICPENDR0 - Interrupt Clear-Pending Register 0
-            if (io->is_write) {
-                g_gic.pending_interrupts[0] &= ~(uint32_t)io->data;
-                LOG_DEBUG("GIC DIST Clear pending IRQs: 0x%X", (uint32_t)io->data);
-            }
-            break;
-            
-        default:
-            // Handle priority registers (0x400-0x4FF)
-            if (offset >= 0x400 && offset < 0x500) {
-                uint32_t irq = offset - 0x400;
-                if (irq < 256) {
-                    if (io->is_write) {
-                        g_gic.priorities[irq] = (uint32_t)io->data & 0xFF;
-                        LOG_DEBUG("GIC DIST Priority[%d] = 0x%X", irq, g_gic.priorities[irq]);
-                    } else {
-                        *(uint64_t*)&io->data = g_gic.priorities[irq];
-                    }
-                    break;
-                }
-            }
-            
-            LOG_DEBUG("GIC DIST: Registro não implementado offset=0x%llX", offset);
-            return DEVICE_ACCESS_IGNORE;
-    }
-    
-    return DEVICE_ACCESS_OK;
+    return regmap_access(&g_gic_dist_regmap, io);
 }
 
-device_access_result_t gic_handle_cpu_access(uint64_t offset, const device_io_t* io)
+device_access_result_t gic_handle_cpu_access(device_io_t* io)
 {
-    switch (offset) {
-        case 0x00:  // GICC_CTLR - CPU Interface Control Register
-            if (io->is_write) {
-                g_gic.cpu_ctrl = (uint32_t)io->data;
-                LOG_DEBUG("GIC CPU CTRL write: 0x%X", g_gic.cpu_ctrl);
-            } else {
-                *(uint64_t*)&io->data = g_gic.cpu_ctrl;
-            }
-            break;
-            
-        case 0x04:  // GICC_PMR - Interrupt Priority Mask Register
-            if (io->is_write) {
-                LOG_DEBUG("GIC CPU PMR write: 0x%llX", io->data);
-                // Para simplificar, aceitar qualquer valor
-            } else {
-                *(uint64_t*)&io->data = 0xFF;  // Allow all priorities
-            }
-            break;
-            
-        case 0x0C:  // GICC_IAR - Interrupt Acknowledge Register
-            if (!io->is_write) {
-                uint32_t irq = gic_get_pending_interrupt();
-                *(uint64_t*)&io->data = irq;
-                if (irq != 1023) {  // 1023 = spurious interrupt
-                    LOG_DEBUG("GIC CPU IAR read: IRQ %d", irq);
-                    // Auto-acknowledge
-                    gic_ack_interrupt(irq);
-                }
-            }
-            break;
-            
-        case 0x10:  // GICC_EOIR - End of Interrupt Register
-            if (io->is_write) {
-                uint32_t irq = (uint32_t)io->data;
-                LOG_DEBUG("GIC CPU EOIR write: IRQ %d", irq);
-                // End of interrupt processing
-                gic_ack_interrupt(irq);
-            }
-            break;
-            
-        default:
-            LOG_DEBUG("GIC CPU: Registro não implementado offset=0x%llX", offset);
-            return DEVICE_ACCESS_IGNORE;
-    }
-    
-    return DEVICE_ACCESS_OK;
+    return regmap_access(&g_gic_cpu_regmap, io);
 }
 
 void gic_set_interrupt(uint32_t irq_num, bool pending)
@@ -160,6 +136,8 @@ void gic_set_interrupt(uint32_t irq_num, bool pending)
     uint32_t reg_idx = irq_num / 32;
     uint32_t bit_idx = irq_num % 32;
     
+    // Também chamado fora de handle_device_access (PMU, timers, hypercalls)
+    EnterCriticalSection(&g_device_lock);
     if (pending) {
         g_gic.pending_interrupts[reg_idx] |= (1U << bit_idx);
         LOG_DEBUG("GIC: Set IRQ %d pending", irq_num);
@@ -167,6 +145,30 @@ void gic_set_interrupt(uint32_t irq_num, bool pending)
         g_gic.pending_interrupts[reg_idx] &= ~(1U << bit_idx);
         LOG_DEBUG("GIC: Clear IRQ %d pending", irq_num);
     }
+    
+    gic_shadow_sync_pending(reg_idx);
+    LeaveCriticalSection(&g_device_lock);
+    devices_signal_change(DEVICE_ID_GIC);
+}
+
+// PPIs são por CPU no GIC real, mas aqui o pending é um bit só para todos os
+// vCPUs: cada vCPU registra o próprio nível e a linha é o OR deles. Um vCPU
+// que baixa o nível não limpa o pending enquanto outro o mantém alto.
+void gic_set_ppi_level(uint32_t ppi, uint32_t vcpu, bool level)
+{
+    if (ppi < 16 || ppi >= 32 || vcpu >= 32) return;
+    
+    EnterCriticalSection(&g_device_lock);
+    if (level) {
+        g_gic.ppi_level[ppi] |= 1U << vcpu;
+        gic_set_interrupt(ppi, true);
+    } else {
+        g_gic.ppi_level[ppi] &= ~(1U << vcpu);
+        if (!g_gic.ppi_level[ppi]) {
+            gic_set_interrupt(ppi, false);
+        }
+    }
+    LeaveCriticalSection(&g_device_lock);
 }
 
 uint32_t gic_get_pending_interrupt(void)
@@ -203,4 +205,6 @@ void gic_ack_interrupt(uint32_t irq_num)
     // Clear pending bit
     g_gic.pending_interrupts[reg_idx] &= ~(1U << bit_idx);
     LOG_DEBUG("GIC: Acknowledged IRQ %d", irq_num);
+    
+    gic_shadow_sync_pending(reg_idx);
 }
@@ -0,0 +1,77 @@
+/* Desenvolvido por: Escanearcpl */
+#include "devices.h"
+#include "vm.h"
+
+// Páginas sombra de MMIO.
+//
+// Uma janela de device cujos registradores legíveis não têm efeito
+// colateral (regmap_t.shadowable) é mapeada no guest como memória
+// somente-leitura, apoiada por uma página do host que o device mantém
+// atualizada com regmap_shadow_sync(). Leituras do guest completam sem
+// exit; escritas continuam gerando exit e passam por regmap_access().
+
+static regmap_t* const g_shadow_candidates[] = {
+    &g_uart_regmap,
+    &g_timer_regmap,
+    &g_gic_dist_regmap,
+    &g_gic_cpu_regmap,
+};
+
+#define SHADOW_CANDIDATES (sizeof(g_shadow_candidates) / sizeof(g_shadow_candidates[0]))
+
+int mmio_shadow_map(regmap_t* map)
+{
+    if (!map->shadowable) {
+        return -1;
+    }
+    
+    uint32_t* page = (uint32_t*)VirtualAlloc(NULL, map->size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!page) {
+        LOG_ERROR("%s: falha ao alocar página sombra", map->name);
+        return -1;
+    }
+    
+    map->shadow = page;
+    regmap_shadow_sync(map);
+    
+    if (vm_map_gpa_range(page, map->base, map->size, WHvMapGpaRangeFlagRead) != 0) {
+        map->shadow = NULL;
+        VirtualFree(page, 0, MEM_RELEASE);
+        return -1;
+    }
+    
+    return 0;
+}
+
+void mmio_shadow_unmap(regmap_t* map)
+{
+    if (!map->shadow) {
+        return;
+    }
+    
+    // O mapeamento some junto com a partição; aqui só liberar a página
+    VirtualFree(map->shadow, 0, MEM_RELEASE);
+    map->shadow = NULL;
+}
+
+int devices_map_shadow_pages(void)
+{
+    int mapped = 0;
+    
+    for (size_t i = 0; i < SHADOW_CANDIDATES; i++) {
+        regmap_t* map = g_shadow_candidates[i];
+        if (mmio_shadow_map(map) == 0) {
+            LOG_INFO("%s: leituras servidas por página sombra em 0x%llX", map->name, map->base);
+            mapped++;
+        }
+    }
+    
+    return mapped;
+}
+
+void devices_unmap_shadow_pages(void)
+{
+    for (size_t i = 0; i < SHADOW_CANDIDATES; i++) {
+        mmio_shadow_unmap(g_shadow_candidates[i]);
+    }
+}
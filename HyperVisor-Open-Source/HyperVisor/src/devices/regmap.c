@@ -0,0 +1,282 @@
+/* Desenvolvido por: Escanearcpl */
+#include "devices.h"
+
+static inline uint32_t* regmap_field(const regmap_t* map, const regmap_reg_t* reg)
+{
+    return (uint32_t*)((char*)map->state + reg->field);
+}
+
+int regmap_init(regmap_t* map)
+{
+    if (map->size > REGMAP_MAX_WINDOW || map->nregs >= 255) {
+        LOG_ERROR("regmap %s: janela ou tabela grande demais", map->name);
+        return -1;
+    }
+
+    memset(map->index, 0, sizeof(map->index));
+    map->shadowable = true;
+
+    for (uint32_t i = 0; i < map->nregs; i++) {
+        const regmap_reg_t* reg = &map->regs[i];
+        uint32_t first = reg->offset / 4;
+        uint32_t last = (reg->offset + reg->count * reg->width - 1) / 4;
+
+        if (reg->count == 0 || reg->width == 0 || reg->width > 4 || last >= map->size / 4) {
+            LOG_ERROR("regmap %s: descritor %s inválido", map->name, reg->name);
+            return -1;
+        }
+
+        for (uint32_t w = first; w <= last; w++) {
+            if (map->index[w]) {
+                LOG_ERROR("regmap %s: %s sobrepõe %s", map->name, reg->name,
+                          map->regs[map->index[w] - 1].name);
+                return -1;
+            }
+            map->index[w] = (uint8_t)(i + 1);
+        }
+        
+        if ((reg->access & REGMAP_RO) && (reg->flags & REGMAP_F_VOLATILE)) {
+            map->shadowable = false;
+        }
+    }
+
+    regmap_reset(map);
+    return 0;
+}
+
+void regmap_reset(regmap_t* map)
+{
+    for (uint32_t i = 0; i < map->nregs; i++) {
+        const regmap_reg_t* reg = &map->regs[i];
+        if (reg->field == REGMAP_NO_FIELD) {
+            continue;
+        }
+
+        uint32_t* field = regmap_field(map, reg);
+        for (uint32_t e = 0; e < reg->count; e++) {
+            field[e] = reg->reset;
+        }
+    }
+}
+
+const regmap_reg_t* regmap_lookup(const regmap_t* map, uint32_t offset)
+{
+    if (offset >= map->size) {
+        return NULL;
+    }
+
+    uint8_t idx = map->index[offset / 4];
+    return idx ? &map->regs[idx - 1] : NULL;
+}
+
+static uint64_t regmap_elem_read(const regmap_t* map, const regmap_reg_t* reg, uint32_t elem)
+{
+    if (!(reg->access & REGMAP_RO)) {
+        return 0;
+    }
+    if (reg->read) {
+        return reg->read(map->state, reg, elem);
+    }
+    if (reg->field != REGMAP_NO_FIELD) {
+        return regmap_field(map, reg)[elem];
+    }
+    return reg->reset;
+}
+
+bool regmap_read(const regmap_t* map, uint32_t offset, uint32_t size, uint64_t* data)
+{
+    const regmap_reg_t* reg = regmap_lookup(map, offset);
+    if (!reg) {
+        return false;
+    }
+
+    // Acessos mais largos que o elemento leem elementos consecutivos (ex.: bytes de prioridade)
+    uint32_t elem = (offset - reg->offset) / reg->width;
+    uint32_t lanes = size > reg->width ? size / reg->width : 1;
+    uint64_t value = 0;
+
+    for (uint32_t lane = 0; lane < lanes && elem + lane < reg->count; lane++) {
+        value |= regmap_elem_read(map, reg, elem + lane) << (lane * reg->width * 8);
+    }
+
+    // Acesso menor que o elemento (ex.: byte de um registrador de 32 bits):
+    // os bytes lidos começam no offset dentro do elemento
+    if (size < reg->width) {
+        value = (value >> (((offset - reg->offset) % reg->width) * 8)) & ((1ULL << (size * 8)) - 1);
+    }
+
+    *data = value;
+    LOG_TRACE("%s %s[%u] read: 0x%llX", map->name, reg->name, elem, value);
+    return true;
+}
+
+bool regmap_write(const regmap_t* map, uint32_t offset, uint32_t size, uint64_t data)
+{
+    const regmap_reg_t* reg = regmap_lookup(map, offset);
+    if (!reg) {
+        return false;
+    }
+
+    LOG_TRACE("%s %s write: 0x%llX", map->name, reg->name, data);
+
+    if (!(reg->access & REGMAP_WO)) {
+        return true;  // Escrita em registrador somente-leitura é ignorada
+    }
+
+    uint32_t elem = (offset - reg->offset) / reg->width;
+    uint32_t lanes = size > reg->width ? size / reg->width : 1;
+    uint64_t lane_mask = reg->width >= 8 ? ~0ULL : ((1ULL << (reg->width * 8)) - 1);
+
+    // Acesso menor que o elemento (ex.: byte 1 de GICD_ISENABLER): os bytes
+    // escritos vão para a posição do offset e o resto do elemento mantém o
+    // valor atual. Registradores de ação ou com leitura destrutiva recebem
+    // 0 no resto em vez de serem lidos.
+    if (size < reg->width) {
+        uint32_t shift = ((offset - reg->offset) % reg->width) * 8;
+        uint64_t mask = ((1ULL << (size * 8)) - 1) << shift;
+        uint64_t current = 0;
+
+        if (!(reg->flags & (REGMAP_F_W1 | REGMAP_F_VOLATILE))) {
+            current = regmap_elem_read(map, reg, elem);
+        }
+        data = (current & ~mask) | ((data << shift) & mask);
+    }
+
+    for (uint32_t lane = 0; lane < lanes && elem + lane < reg->count; lane++) {
+        uint64_t v = (data >> (lane * reg->width * 8)) & lane_mask;
+
+        if (reg->write) {
+            reg->write(map->state, reg, elem + lane, v);
+        } else if (reg->field != REGMAP_NO_FIELD) {
+            uint32_t* field = &regmap_field(map, reg)[elem + lane];
+            *field = (*field & ~reg->mask) | ((uint32_t)v & reg->mask);
+        }
+        // Sem campo nem hook: escrita aceita e descartada
+    }
+
+    return true;
+}
+
+// Página sombra após uma escrita: só os elementos escritos e, nos mesmos
+// índices, os registradores que leem o mesmo estado (mesmo hook de leitura ou
+// mesmo campo, como os pares set/clear do GIC). Efeitos em outros
+// registradores ficam a cargo do device (regmap_shadow_sync_range).
+static void regmap_shadow_sync_write(const regmap_t* map, uint32_t offset, uint32_t size)
+{
+    const regmap_reg_t* reg = regmap_lookup(map, offset);
+    uint32_t elem = (offset - reg->offset) / reg->width;
+    uint32_t lanes = size > reg->width ? size / reg->width : 1;
+
+    if (elem + lanes > reg->count) {
+        lanes = reg->count - elem;
+    }
+
+    for (uint32_t i = 0; i < map->nregs; i++) {
+        const regmap_reg_t* alias = &map->regs[i];
+        bool same = alias == reg ||
+                    (reg->read && alias->read == reg->read) ||
+                    (reg->field != REGMAP_NO_FIELD && alias->field == reg->field);
+
+        if (same && elem < alias->count) {
+            uint32_t n = elem + lanes <= alias->count ? lanes : alias->count - elem;
+            regmap_shadow_sync_range(map, alias->offset + elem * alias->width, n * alias->width);
+        }
+    }
+}
+
+device_access_result_t regmap_access(const regmap_t* map, device_io_t* io)
+{
+    uint32_t offset = (uint32_t)(io->address - map->base);
+    bool handled;
+
+    if (io->is_write) {
+        handled = regmap_write(map, offset, io->size, io->data);
+    } else {
+        handled = regmap_read(map, offset, io->size, &io->data);
+    }
+
+    if (!handled) {
+        LOG_DEBUG("%s: Registro não implementado offset=0x%X", map->name, offset);
+        return DEVICE_ACCESS_IGNORE;
+    }
+    
+    // Com página sombra apenas escritas chegam aqui; refletir o novo estado
+    if (io->is_write && map->shadow) {
+        regmap_shadow_sync_write(map, offset, io->size);
+    }
+
+    return DEVICE_ACCESS_OK;
+}
+
+void regmap_shadow_sync(const regmap_t* map)
+{
+    regmap_shadow_sync_range(map, 0, map->size);
+}
+
+void regmap_shadow_sync_range(const regmap_t* map, uint32_t offset, uint32_t size)
+{
+    if (!map->shadow || offset >= map->size) {
+        return;
+    }
+    
+    uint32_t end = offset + size < map->size ? offset + size : map->size;
+    
+    // Palavras sem registrador permanecem zero desde a alocação da página
+    for (uint32_t w = offset / 4; w < (end + 3) / 4; w++) {
+        uint64_t value;
+        if (map->index[w] && regmap_read(map, w * 4, 4, &value)) {
+            map->shadow[w] = (uint32_t)value;
+        }
+    }
+}
+
+uint32_t regmap_state_words(const regmap_t* map)
+{
+    uint32_t words = 0;
+    for (uint32_t i = 0; i < map->nregs; i++) {
+        if (map->regs[i].field != REGMAP_NO_FIELD) {
+            words += map->regs[i].count;
+        }
+    }
+    return words;
+}
+
+uint32_t regmap_save(const regmap_t* map, uint32_t* buffer, uint32_t max_words)
+{
+    uint32_t pos = 0;
+
+    for (uint32_t i = 0; i < map->nregs; i++) {
+        const regmap_reg_t* reg = &map->regs[i];
+        if (reg->field == REGMAP_NO_FIELD) {
+            continue;
+        }
+        if (pos + reg->count > max_words) {
+            return 0;
+        }
+
+        memcpy(&buffer[pos], regmap_field(map, reg), reg->count * sizeof(uint32_t));
+        pos += reg->count;
+    }
+
+    return pos;
+}
+
+uint32_t regmap_restore(const regmap_t* map, const uint32_t* buffer, uint32_t words)
+{
+    uint32_t pos = 0;
+
+    for (uint32_t i = 0; i < map->nregs; i++) {
+        const regmap_reg_t* reg = &map->regs[i];
+        if (reg->field == REGMAP_NO_FIELD) {
+            continue;
+        }
+        if (pos + reg->count > words) {
+            return 0;
+        }
+
+        memcpy(regmap_field(map, reg), &buffer[pos], reg->count * sizeof(uint32_t));
+        pos += reg->count;
+    }
+
+    return pos;
+}
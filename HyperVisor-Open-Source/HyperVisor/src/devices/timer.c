@@ -1,92 +1,101 @@
 /* Desenvolvido por: Escanearcpl */
 #include "devices.h"
 
-device_access_result_t timer_handle_access(const device_io_t* io)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Offsets dos registradores do timer
+#define TIMER_CTRL          0x00
+#define TIMER_COUNTER_LO    0x04
+#define TIMER_COUNTER_HI    0x08
+#define TIMER_COMPARE_LO    0x0C
+#define TIMER_COMPARE_HI    0x10
+#define TIMER_STATUS        0x14
+#define TIMER_INTCLR        0x18
+
+static void timer_ctrl_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
 {
-    uint64_t offset = io->address - TIMER_BASE;
+    timer_state_t* timer = (timer_state_t*)state;
+    (void)reg; (void)index;
     
-    LOG_DEBUG("Timer access: offset=0x%llX, data=0x%llX, write=%d", 
-              offset, io->data, io->is_write);
+    bool was_enabled = timer->control & 0x1;
+    timer->control = (uint32_t)value;
     
-    switch (offset) {
-        case 0x00:  // Timer Control Register
-            if (io->is_write) {
-                g_timer.control = (uint32_t)io->data;
-                LOG_DEBUG("Timer control write: 0x%X", g_timer.control);
-                
-                // Bit 0: Timer enabled
-                if (g_timer.control & 0x1) {
-                    LOG_INFO("Timer habilitado");
-                } else {
-                    LOG_INFO("Timer desabilitado");
-                }
-            } else {
-                *(uint64_t*)&io->data = g_timer.control;
-            }
-            break;
-            
-        case 0x04:  // Timer Counter Register (lower 32 bits)
-            if (io->is_write) {
-                g_timer.counter = (g_timer.counter & 0xFFFFFFFF00000000ULL) | (io->data & 0xFFFFFFFF);
-                LOG_DEBUG("Timer counter low write: 0x%llX", io->data);
-            } else {
-                *(uint64_t*)&io->data = g_timer.counter & 0xFFFFFFFF;
-            }
-            break;
-            
-        case 0x08:  // Timer Counter Register (upper 32 bits)
-            if (io->is_write) {
-                g_timer.counter = (g_timer.counter & 0x00000000FFFFFFFFULL) | ((io->data & 0xFFFFFFFF) << 32);
-                LOG_DEBUG("Timer counter high write: 0x%llX", io->data);
-            } else {
-                *(uint64_t*)&io->data = (g_timer.counter >> 32) & 0xFFFFFFFF;
-            }
-            break;
-            
-        case 0x0C:  // Timer Compare Register (lower 32 bits)
-            if (io->is_write) {
-                g_timer.compare_value = (g_timer.compare_value & 0xFFFFFFFF00000000ULL) | (io->data & 0xFFFFFFFF);
-                LOG_DEBUG("Timer compare low write: 0x%llX", io->data);
-            } else {
-                *(uint64_t*)&io->data = g_timer.compare_value & 0xFFFFFFFF;
-            }
-            break;
-            
-        case 0x10:  // Timer Compare Register (upper 32 bits)
-            if (io->is_write) {
-                g_timer.compare_value = (g_timer.compare_value & 0x00000000FFFFFFFFULL) | ((io->data & 0xFFFFFFFF) << 32);
-                LOG_DEBUG("Timer compare high write: 0x%llX", io->data);
-            } else {
-                *(uint64_t*)&io->data = (g_timer.compare_value >> 32) & 0xFFFFFFFF;
-            }
-            break;
-            
-        case 0x14:  // Timer Status Register
-            if (!io->is_write) {
-                uint32_t status = 0;
-                if (g_timer.interrupt_pending) {
-                    status |= 0x1;  // Interrupt pending bit
-                }
-                *(uint64_t*)&io->data = status;
-                LOG_DEBUG("Timer status read: 0x%X", status);
-            }
-            break;
-            
-        case 0x18:  // Timer Interrupt Clear Register
-            if (io->is_write) {
-                if (io->data & 0x1) {
-                    g_timer.interrupt_pending = false;
-                    LOG_DEBUG("Timer interrupt cleared");
-                }
-            }
-            break;
-            
-        default:
-            LOG_DEBUG("Timer: Registro não implementado offset=0x%llX", offset);
-            return DEVICE_ACCESS_IGNORE;
+    // Bit 0: Timer enabled
+    if ((timer->control & 0x1) != was_enabled) {
+        LOG_INFO("Timer %s", (timer->control & 0x1) ? "habilitado" : "desabilitado");
     }
+}
+
+// Registradores de 64 bits expostos como pares de 32 bits (index 0 = low, 1 = high)
+static uint64_t timer_counter_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)reg;
+    return (((timer_state_t*)state)->counter >> (index * 32)) & 0xFFFFFFFF;
+}
+
+static void timer_counter_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    timer_state_t* timer = (timer_state_t*)state;
+    (void)reg;
+    
+    uint64_t mask = 0xFFFFFFFFULL << (index * 32);
+    timer->counter = (timer->counter & ~mask) | ((value & 0xFFFFFFFF) << (index * 32));
+}
+
+static uint64_t timer_compare_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)reg;
+    return (((timer_state_t*)state)->compare_value >> (index * 32)) & 0xFFFFFFFF;
+}
+
+static void timer_compare_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    timer_state_t* timer = (timer_state_t*)state;
+    (void)reg;
     
-    return DEVICE_ACCESS_OK;
+    uint64_t mask = 0xFFFFFFFFULL << (index * 32);
+    timer->compare_value = (timer->compare_value & ~mask) | ((value & 0xFFFFFFFF) << (index * 32));
+}
+
+static uint64_t timer_status_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)reg; (void)index;
+    return ((timer_state_t*)state)->interrupt_pending ? 0x1 : 0x0;  // Interrupt pending bit
+}
+
+static void timer_intclr_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)reg; (void)index;
+    if (value & 0x1) {
+        ((timer_state_t*)state)->interrupt_pending = false;
+    }
+}
+
+static const regmap_reg_t timer_regs[] = {
+    { .name = "CTRL", .offset = TIMER_CTRL, .count = 1, .width = 4, .access = REGMAP_RW,
+      .field = offsetof(timer_state_t, control), .mask = 0xFFFFFFFF, .write = timer_ctrl_write },
+    REGMAP_HOOK("COUNTER", TIMER_COUNTER_LO, 2, REGMAP_RW, REGMAP_F_VOLATILE,
+                timer_counter_read, timer_counter_write),
+    REGMAP_HOOK("COMPARE", TIMER_COMPARE_LO, 2, REGMAP_RW, 0,
+                timer_compare_read, timer_compare_write),
+    REGMAP_HOOK("STATUS", TIMER_STATUS, 1, REGMAP_RO, REGMAP_F_VOLATILE, timer_status_read, NULL),
+    REGMAP_HOOK("INTCLR", TIMER_INTCLR, 1, REGMAP_WO, 0, NULL, timer_intclr_write),
+};
+
+regmap_t g_timer_regmap = {
+    .name = "Timer",
+    .base = TIMER_BASE,
+    .size = 0x1000,
+    .state = &g_timer,
+    .regs = timer_regs,
+    .nregs = REGMAP_COUNT(timer_regs),
+};
+
+device_access_result_t timer_handle_access(device_io_t* io)
+{
+    return regmap_access(&g_timer_regmap, io);
 }
 
 void timer_tick(void)
@@ -98,6 +107,7 @@ void timer_tick(void)
         // Verificar se atingiu valor de comparação
         if (g_timer.counter >= g_timer.compare_value) {
             g_timer.interrupt_pending = true;
+            devices_signal_change(DEVICE_ID_TIMER);
             LOG_DEBUG("Timer interrupt triggered at counter=0x%llX", g_timer.counter);
             
             // Trigger interrupt via GIC
@@ -116,3 +126,47 @@ void timer_clear_interrupt(void)
     g_timer.interrupt_pending = false;
     gic_set_interrupt(30, false);
 }
+
+uint64_t timer_get_host_counter(void)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (uint64_t)now.QuadPart;
+}
+
+uint64_t timer_ticks_to_ns(uint64_t ticks)
+{
+    // Dividir em partes inteira e fracionária para não estourar 64 bits
+    uint64_t freq = g_timer.host_frequency ? g_timer.host_frequency : 1;
+    return (ticks / freq) * 1000000000ULL + ((ticks % freq) * 1000000000ULL) / freq;
+}
+
+uint64_t timer_get_time_ns(void)
+{
+    return timer_ticks_to_ns(timer_get_host_counter());
+}
+
+// Contador genérico do ARM visto pelo host (CNTVCT_EL0, liberado em EL0 no
+// Windows). O CNTVCT_EL0 do guest é o mesmo contador menos outro offset
+uint64_t timer_get_arch_counter(void)
+{
+#if defined(_MSC_VER)
+    __isb(_ARM64_BARRIER_SY);
+    return (uint64_t)_ReadStatusReg(ARM64_SYSREG(3, 3, 14, 0, 2));
+#else
+    uint64_t value;
+    __asm__ volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(value) : : "memory");
+    return value;
+#endif
+}
+
+uint64_t timer_get_arch_frequency(void)
+{
+#if defined(_MSC_VER)
+    return (uint64_t)_ReadStatusReg(ARM64_SYSREG(3, 3, 14, 0, 0)) & 0xFFFFFFFF;
+#else
+    uint64_t value;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(value));
+    return value & 0xFFFFFFFF;
+#endif
+}
@@ -1,99 +1,81 @@
 /* Desenvolvido por: Escanearcpl */
 #include "devices.h"
 
-device_access_result_t uart_handle_access(const device_io_t* io)
+// Data Register: leitura consome um caractere, escrita transmite
+static uint64_t uart_dr_read(void* state, const regmap_reg_t* reg, uint32_t index)
 {
-    uint64_t offset = io->address - UART_BASE;
+    (void)state; (void)reg; (void)index;
+    return (uint64_t)(uint8_t)uart_read_char();
+}
+
+static void uart_dr_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)state; (void)reg; (void)index;
+    uart_write_char((char)(value & 0xFF));
+}
+
+// Flag Register: derivado do estado das FIFOs
+static uint64_t uart_fr_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    uart_state_t* uart = (uart_state_t*)state;
+    (void)reg; (void)index;
     
-    LOG_DEBUG("UART access: offset=0x%llX, data=0x%llX, write=%d", 
-              offset, io->data, io->is_write);
+    uint32_t flags = 0;
+    if (uart->tx_fifo_full) flags |= 0x20;    // TXFF
+    if (!uart->tx_fifo_full) flags |= 0x80;   // TXFE
+    if (uart->rx_fifo_empty) flags |= 0x10;   // RXFE
+    if (!uart->rx_fifo_empty) flags |= 0x40;  // RXFF
     
-    switch (offset) {
-        case UART_DR:  // Data Register
-            if (io->is_write) {
-                char c = (char)(io->data & 0xFF);
-                uart_write_char(c);
-                LOG_INFO("UART TX: '%c' (0x%02X)", c, c);
-            } else {
-                // Read - return received character
-                char c = uart_read_char();
-                *(uint64_t*)&io->data = (uint64_t)c;
-                LOG_DEBUG("UART RX: '%c' (0x%02X)", c, c);
-            }
-            break;
-            
-        case UART_FR:  // Flag Register
-            if (!io->is_write) {
-                uint32_t flags = 0;
-                if (g_uart.tx_fifo_full) flags |= 0x20;    // TXFF
-                if (!g_uart.tx_fifo_full) flags |= 0x80;   // TXFE  
-                if (g_uart.rx_fifo_empty) flags |= 0x10;   // RXFE
-                if (!g_uart.rx_fifo_empty) flags |= 0x40;  // RXFF
-                
-                g_uart.flag_reg = flags;
-                *(uint64_t*)&io->data = g_uart.flag_reg;
-                LOG_DEBUG("UART FR read: 0x%X", g_uart.flag_reg);
-            }
-            break;
-            
-        case UART_IBRD:  // Integer Baud Rate Divisor
-            if (io->is_write) {
-                // Ignore baud rate settings for simplicity
-                LOG_DEBUG("UART IBRD write: 0x%llX (ignored)", io->data);
-            } else {
-                *(uint64_t*)&io->data = 0x1;  // Default value
-            }
-            break;
-            
-        case UART_FBRD:  // Fractional Baud Rate Divisor
-            if (io->is_write) {
-                LOG_DEBUG("UART FBRD write: 0x%llX (ignored)", io->data);
-            } else {
-                *(uint64_t*)&io->data = 0x0;
-            }
-            break;
-            
-        case UART_LCR_H:  // Line Control Register
-            if (io->is_write) {
-                g_uart.line_control = (uint32_t)io->data;
-                LOG_DEBUG("UART LCR_H write: 0x%X", g_uart.line_control);
-            } else {
-                *(uint64_t*)&io->data = g_uart.line_control;
-            }
-            break;
-            
-        case UART_CR:  // Control Register
-            if (io->is_write) {
-                g_uart.control_reg = (uint32_t)io->data;
-                LOG_DEBUG("UART CR write: 0x%X", g_uart.control_reg);
-            } else {
-                *(uint64_t*)&io->data = g_uart.control_reg;
-            }
-            break;
-            
-        case UART_IMSC:  // Interrupt Mask Set/Clear
-            if (io->is_write) {
-                g_uart.interrupt_mask = (uint32_t)io->data;
-                LOG_DEBUG("UART IMSC write: 0x%X", g_uart.interrupt_mask);
-            } else {
-                *(uint64_t*)&io->data = g_uart.interrupt_mask;
-            }
-            break;
-            
-        case UART_ICR:  // Interrupt Clear Register
-            if (io->is_write) {
-                // Clear specified interrupts
-                LOG_DEBUG("UART ICR write: 0x%llX", io->data);
-                // For simplicity, clear all interrupts
-            }
-            break;
-            
-        default:
-            LOG_DEBUG("UART: Registro não implementado offset=0x%llX", offset);
-            return DEVICE_ACCESS_IGNORE;
+    uart->flag_reg = flags;
+    return flags;
+}
+
+// Identificação PL011: UARTPeriphID0-3 e UARTPCellID0-3 (0xFE0-0xFFC)
+static const uint8_t uart_id_values[8] = { 0x11, 0x10, 0x14, 0x00, 0x0D, 0xF0, 0x05, 0xB1 };
+
+static uint64_t uart_id_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)state; (void)reg;
+    return uart_id_values[index];
+}
+
+static const regmap_reg_t uart_regs[] = {
+    REGMAP_HOOK("DR", UART_DR, 1, REGMAP_RW, REGMAP_F_VOLATILE, uart_dr_read, uart_dr_write),
+    REGMAP_HOOK("FR", UART_FR, 1, REGMAP_RO, REGMAP_F_VOLATILE, uart_fr_read, NULL),
+    // Baud rate é ignorado: escritas descartadas, leitura retorna o valor padrão
+    REGMAP_REG("IBRD", UART_IBRD, REGMAP_RW, REGMAP_NO_FIELD, 0, 0x1),
+    REGMAP_REG("FBRD", UART_FBRD, REGMAP_RW, REGMAP_NO_FIELD, 0, 0x0),
+    REGMAP_REG("LCR_H", UART_LCR_H, REGMAP_RW, offsetof(uart_state_t, line_control), 0xFFFFFFFF, 0x70),
+    REGMAP_REG("CR", UART_CR, REGMAP_RW, offsetof(uart_state_t, control_reg), 0xFFFFFFFF, 0x300),
+    REGMAP_REG("IMSC", UART_IMSC, REGMAP_RW, offsetof(uart_state_t, interrupt_mask), 0xFFFFFFFF, 0),
+    REGMAP_REG("ICR", UART_ICR, REGMAP_WO, REGMAP_NO_FIELD, 0, 0),
+    REGMAP_HOOK("ID", UART_PERIPH_ID0, 8, REGMAP_RO, 0, uart_id_read, NULL),
+};
+
+regmap_t g_uart_regmap = {
+    .name = "UART",
+    .base = UART_BASE,
+    .size = 0x1000,
+    .state = &g_uart,
+    .regs = uart_regs,
+    .nregs = REGMAP_COUNT(uart_regs),
+};
+
+// Atualiza as FIFOs; uma mudança acorda vCPUs estacionados em spin-poll do FR
+static void uart_set_fifo_state(bool tx_full, bool rx_empty)
+{
+    if (g_uart.tx_fifo_full == tx_full && g_uart.rx_fifo_empty == rx_empty) {
+        return;
     }
     
-    return DEVICE_ACCESS_OK;
+    g_uart.tx_fifo_full = tx_full;
+    g_uart.rx_fifo_empty = rx_empty;
+    devices_signal_change(DEVICE_ID_UART);
+}
+
+device_access_result_t uart_handle_access(device_io_t* io)
+{
+    return regmap_access(&g_uart_regmap, io);
 }
 
 void uart_write_char(char c)
@@ -103,7 +85,16 @@ void uart_write_char(char c)
     fflush(stdout);
     
     // Simular UART TX
-    g_uart.tx_fifo_full = false;  // Always ready for next char
+    uart_set_fifo_state(false, g_uart.rx_fifo_empty);  // Always ready for next char
+}
+
+void uart_write_buffer(const char* buf, size_t len)
+{
+    // Uma única escrita no console host para o buffer inteiro
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+    
+    uart_set_fifo_state(false, g_uart.rx_fifo_empty);
 }
 
 char uart_read_char(void)
@@ -115,11 +106,11 @@ char uart_read_char(void)
     
     if (input_pos < strlen(demo_input)) {
         char c = demo_input[input_pos++];
-        g_uart.rx_fifo_empty = (input_pos >= strlen(demo_input));
+        uart_set_fifo_state(g_uart.tx_fifo_full, input_pos >= strlen(demo_input));
         return c;
     }
     
-    g_uart.rx_fifo_empty = true;
+    uart_set_fifo_state(g_uart.tx_fifo_full, true);
     return 0;
 }
 
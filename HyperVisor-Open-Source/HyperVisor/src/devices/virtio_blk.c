@@ -0,0 +1,1058 @@
+/* Desenvolvido por: Escanearcpl */
+#include "virtio.h"
+#include "disk_image.h"
+
+// virtio-blk (virtio 1.1, seção 5.2) sobre uma imagem raw ou HVDK do host.
+//
+// Multi-queue: cada virtqueue (uma por vCPU) tem contexto de I/O próprio -
+// handle do arquivo, porta de conclusão (IOCP), thread, lock e pool de
+// requests - e nada é compartilhado entre filas no caminho de dados. O vCPU
+// só registra o kick (QueueNotify) na porta da fila; a thread da fila retira
+// as cadeias do anel, combina requests adjacentes, submete leituras e
+// escritas overlapped e recebe as conclusões pela mesma porta. Requests
+// concluídos num lote geram no máximo uma interrupção por fila.
+//
+// O caminho de dados passa por disk_map(): cada trecho traduzido vira uma
+// operação no handle da fila para a camada da cadeia que contém os dados;
+// trechos que leem zero são preenchidos direto na RAM do guest. Imagens HVDK
+// anunciam DISCARD e WRITE_ZEROES, executados na thread da fila.
+//
+// Com limites de QoS (blk_qos.h) cada request retirado do anel passa pelo
+// admit antes de ser despachado; os retidos voltam liberados pela porta da
+// fila (BLK_KEY_QOS) e seguem o mesmo caminho de despacho.
+
+#define VIRTIO_BLK_F_SIZE_MAX       (1ULL << 1)
+#define VIRTIO_BLK_F_SEG_MAX        (1ULL << 2)
+#define VIRTIO_BLK_F_RO             (1ULL << 5)
+#define VIRTIO_BLK_F_BLK_SIZE       (1ULL << 6)
+#define VIRTIO_BLK_F_FLUSH          (1ULL << 9)
+#define VIRTIO_BLK_F_MQ             (1ULL << 12)
+#define VIRTIO_BLK_F_DISCARD        (1ULL << 13)
+#define VIRTIO_BLK_F_WRITE_ZEROES   (1ULL << 14)
+
+#define VIRTIO_BLK_T_IN             0
+#define VIRTIO_BLK_T_OUT            1
+#define VIRTIO_BLK_T_FLUSH          4
+#define VIRTIO_BLK_T_GET_ID         8
+#define VIRTIO_BLK_T_DISCARD        11
+#define VIRTIO_BLK_T_WRITE_ZEROES   13
+
+#define VIRTIO_BLK_WRITE_ZEROES_F_UNMAP 0x1
+
+#define VIRTIO_BLK_S_OK             0
+#define VIRTIO_BLK_S_IOERR          1
+#define VIRTIO_BLK_S_UNSUPP         2
+
+#define VIRTIO_BLK_SECTOR_SIZE      512
+#define VIRTIO_BLK_ID_BYTES         20
+
+// Segmento de até um cluster HVDK: cada segmento cruza no máximo uma
+// fronteira de cluster, e as operações de um request cabem em io[]
+#define BLK_SIZE_MAX                (1u << DISK_CLUSTER_BITS)
+#define BLK_MAX_OPS                 (2 * VIRTQ_MAX_IOV)
+
+// Discard/write-zeroes síncronos na thread da fila: limite por request
+#define BLK_DISCARD_MAX_SECTORS     (1u << 21)      // 1GB
+
+// Chaves de conclusão na porta de cada fila
+#define BLK_KEY_FILE                1
+#define BLK_KEY_KICK                2
+#define BLK_KEY_STOP                3
+#define BLK_KEY_QOS                 4       // Requests liberados pelo QoS
+
+#define BLK_BATCH                   64      // Entradas por GetQueuedCompletionStatusEx
+
+// Combinação de requests adjacentes: uma operação com buffer intermediário
+#define BLK_MERGE_MAX_REQS          32
+#define BLK_MERGE_MAX_BYTES         (128 * 1024)
+#define BLK_MERGE_SLOTS             8       // Operações combinadas em voo por fila
+
+typedef struct {
+    uint32_t type;
+    uint32_t ioprio;
+    uint64_t sector;
+} virtio_blk_outhdr_t;
+
+// Payload de DISCARD e WRITE_ZEROES
+typedef struct {
+    uint64_t sector;
+    uint32_t num_sectors;
+    uint32_t flags;
+} virtio_blk_discard_t;
+
+typedef struct {
+    uint64_t capacity;              // Setores de 512 bytes
+    uint32_t size_max;
+    uint32_t seg_max;
+    struct {
+        uint16_t cylinders;
+        uint8_t heads;
+        uint8_t sectors;
+    } geometry;
+    uint32_t blk_size;
+    uint8_t physical_block_exp;
+    uint8_t alignment_offset;
+    uint16_t min_io_size;
+    uint32_t opt_io_size;
+    uint8_t writeback;
+    uint8_t unused0;
+    uint16_t num_queues;            // VIRTIO_BLK_F_MQ
+    uint32_t max_discard_sectors;   // VIRTIO_BLK_F_DISCARD
+    uint32_t max_discard_seg;
+    uint32_t discard_sector_alignment;
+    uint32_t max_write_zeroes_sectors;  // VIRTIO_BLK_F_WRITE_ZEROES
+    uint32_t max_write_zeroes_seg;
+    uint8_t write_zeroes_may_unmap;
+    uint8_t unused1[3];
+} virtio_blk_config_t;
+
+typedef struct blk_req blk_req_t;
+typedef struct blk_merge blk_merge_t;
+typedef struct virtio_blk virtio_blk_t;
+
+// Uma operação overlapped: segmentos de um request contíguos no host, ou
+// vários requests combinados (merge != NULL)
+typedef struct {
+    OVERLAPPED ov;
+    blk_req_t* req;
+    blk_merge_t* merge;
+    uint32_t layer;             // Camada da cadeia (handle em files[])
+    uint32_t len;
+    uint64_t disk_offset;       // Início virtual do trecho (disk_commit())
+    disk_extent_t extent;       // Trecho com clusters pendentes (extent.pending)
+} blk_io_t;
+
+struct blk_req {
+    virtq_elem_t elem;
+    uint32_t type;
+    uint64_t sector;
+    uint32_t bytes;             // Dados de IN/OUT
+    uint32_t generation;        // Requests de antes de um reset não tocam o anel
+    uint32_t pending;           // Operações em voo
+    uint32_t in_len;            // Bytes escritos no guest (used.len)
+    uint8_t status;
+    blk_qos_item_t qos;         // Espera por tokens
+    blk_req_t* next_free;
+    blk_io_t io[BLK_MAX_OPS];
+};
+
+struct blk_merge {
+    blk_io_t io;
+    bool write;
+    uint32_t count;
+    blk_req_t* reqs[BLK_MERGE_MAX_REQS];
+    uint8_t* buffer;            // BLK_MERGE_MAX_BYTES
+    blk_merge_t* next_free;
+};
+
+// Requests adjacentes acumulados durante a drenagem do anel
+typedef struct {
+    blk_req_t* reqs[BLK_MERGE_MAX_REQS];
+    uint32_t count;
+    uint32_t bytes;
+} blk_batch_t;
+
+// Contexto de I/O de uma fila
+typedef struct {
+    virtio_blk_t* blk;
+    uint32_t index;
+    HANDLE files[DISK_MAX_CHAIN];   // Por camada; um handle só se associa a uma porta
+    HANDLE iocp;
+    HANDLE thread;
+
+    // Estado da fila: thread da fila x reset no vCPU
+    CRITICAL_SECTION lock;
+    uint32_t inflight;          // Operações overlapped ainda não concluídas
+    blk_req_t* pool;
+    blk_req_t* free_list;
+    blk_merge_t* merges;
+    blk_merge_t* free_merges;
+    bool completed;             // used novo no lote corrente
+    bool needs_reset;           // NEEDS_RESET a anunciar (interrupção de config)
+    bool starved;               // Pool esgotado com kicks desligados: drenar ao liberar
+    bool draining;              // Reset com operações em voo: Status ainda não lê 0
+    blk_qos_port_t qos_port;
+
+    volatile LONG kicked;       // Kick postado e ainda não consumido
+} blk_queue_t;
+
+struct virtio_blk {
+    virtio_dev_t dev;
+    virtio_blk_config_t config;
+    disk_t* disk;
+    blk_qos_flow_t qos;
+    char name[16];
+    char serial[VIRTIO_BLK_ID_BYTES];
+    bool read_only;
+
+    // Alterado com os locks de todas as filas; lido sob o lock de qualquer uma
+    uint32_t generation;
+
+    uint32_t num_queues;
+    blk_queue_t queues[VIRTIO_MAX_QUEUES];
+};
+
+static uint32_t g_blk_count;
+
+static inline virtqueue_t* blk_vq(blk_queue_t* q)
+{
+    return &q->blk->dev.queues[q->index];
+}
+
+static void blk_complete(blk_queue_t* q, blk_req_t* req)
+{
+    virtq_elem_t* elem = &req->elem;
+
+    if (req->generation == q->blk->generation) {
+        // Status no último byte gravável da cadeia
+        if (elem->in_num) {
+            virtq_iov_t* last = &elem->iov[elem->out_num + elem->in_num - 1];
+            ((uint8_t*)last->addr)[last->len - 1] = req->status;
+            req->in_len++;
+        }
+
+        virtq_push(blk_vq(q), elem->head, req->in_len);
+        q->completed = true;
+    }
+
+    req->next_free = q->free_list;
+    q->free_list = req;
+}
+
+static void blk_fail(blk_queue_t* q, blk_req_t* req, uint8_t status)
+{
+    req->status = status;
+    if (req->pending == 0) {
+        blk_complete(q, req);
+    }
+}
+
+// Escrita concluída (ou que não vai acontecer): as entradas da L2 dos
+// clusters alocados para ela só vão à imagem depois dos dados
+static bool blk_io_commit(blk_queue_t* q, blk_io_t* io, bool written)
+{
+    if (!io->extent.pending) {
+        return true;
+    }
+    bool ok = disk_commit(q->blk->disk, io->disk_offset, &io->extent, written) == 0;
+    io->extent.pending = 0;
+    return ok;
+}
+
+// Operação sobre um trecho traduzido de disk_map() a partir de disk_offset
+static bool blk_issue(blk_queue_t* q, blk_io_t* io, const disk_extent_t* extent, uint64_t disk_offset,
+                      void* addr, bool write)
+{
+    memset(&io->ov, 0, sizeof(io->ov));
+    io->ov.Offset = (DWORD)extent->host_offset;
+    io->ov.OffsetHigh = (DWORD)(extent->host_offset >> 32);
+    io->layer = extent->layer;
+    io->len = (uint32_t)extent->len;
+    io->disk_offset = disk_offset;
+    io->extent = *extent;
+
+    q->inflight++;
+
+    BOOL ok = write ? WriteFile(q->files[io->layer], addr, io->len, NULL, &io->ov)
+                    : ReadFile(q->files[io->layer], addr, io->len, NULL, &io->ov);
+
+    // Conclusão síncrona também chega pela porta; só falha imediata volta aqui
+    if (!ok && GetLastError() != ERROR_IO_PENDING) {
+        LOG_ERROR("%s: %s em 0x%llX falhou: %lu", q->blk->name, write ? "WriteFile" : "ReadFile",
+                  extent->host_offset, GetLastError());
+        q->inflight--;
+        blk_io_commit(q, io, false);
+        return false;
+    }
+    return true;
+}
+
+// Segmentos de dados do request: após o cabeçalho (OUT) ou antes do status (IN)
+static inline const virtq_iov_t* blk_data_iov(blk_req_t* req, uint32_t* count, size_t* skip)
+{
+    bool write = req->type == VIRTIO_BLK_T_OUT;
+    *count = write ? req->elem.out_num : req->elem.in_num;
+    *skip = write ? sizeof(virtio_blk_outhdr_t) : 0;
+    return write ? req->elem.iov : &req->elem.iov[req->elem.out_num];
+}
+
+static void blk_cancel(blk_queue_t* q)
+{
+    for (uint32_t i = 0; i < disk_layer_count(q->blk->disk); i++) {
+        CancelIoEx(q->files[i], NULL);
+    }
+}
+
+// Trecho contíguo na RAM do guest: uma operação por trecho traduzido
+static bool blk_rw_run(blk_queue_t* q, blk_req_t* req, uint8_t* addr, uint32_t len, uint64_t offset, bool write)
+{
+    while (len) {
+        disk_extent_t extent;
+
+        if (disk_map(q->blk->disk, offset, len, write, &extent) != 0) {
+            LOG_ERROR("%s: falha ao traduzir 0x%llX na imagem", q->blk->name, offset);
+            return false;
+        }
+
+        if (extent.kind == DISK_EXTENT_ZERO) {
+            memset(addr, 0, extent.len);    // Só em leitura: escrita sempre aloca
+        } else {
+            if (req->pending == BLK_MAX_OPS) {
+                LOG_ERROR("%s: request fragmentado demais na imagem", q->blk->name);
+                return false;
+            }
+
+            blk_io_t* io = &req->io[req->pending];
+            io->req = req;
+            io->merge = NULL;
+            if (!blk_issue(q, io, &extent, offset, addr, write)) {
+                return false;
+            }
+            req->pending++;
+        }
+
+        addr += extent.len;
+        offset += extent.len;
+        len -= (uint32_t)extent.len;
+    }
+    return true;
+}
+
+// Request isolado: direto entre a RAM do guest e o arquivo, sem cópia
+static void blk_rw(blk_queue_t* q, blk_req_t* req)
+{
+    bool write = req->type == VIRTIO_BLK_T_OUT;
+    uint32_t count;
+    size_t skip;
+    const virtq_iov_t* iov = blk_data_iov(req, &count, &skip);
+    uint64_t offset = req->sector * VIRTIO_BLK_SECTOR_SIZE;
+    uint64_t left = req->bytes;
+    uint8_t* run = NULL;
+    uint32_t run_len = 0;
+
+    for (uint32_t i = 0; i < count && left; i++) {
+        uint8_t* addr = (uint8_t*)iov[i].addr;
+        uint64_t len = iov[i].len;
+
+        if (skip >= len) {
+            skip -= len;
+            continue;
+        }
+        addr += skip;
+        len -= skip;
+        skip = 0;
+        if (len > left) {
+            len = left;
+        }
+        left -= len;
+
+        // Segmentos adjacentes na RAM do guest viram uma única operação
+        if (run && run + run_len == addr && (uint64_t)run_len + len <= 0xFFFFFFFF) {
+            run_len += (uint32_t)len;
+            continue;
+        }
+        if (run) {
+            if (!blk_rw_run(q, req, run, run_len, offset, write)) {
+                blk_fail(q, req, VIRTIO_BLK_S_IOERR);
+                return;
+            }
+            offset += run_len;
+        }
+        run = addr;
+        run_len = (uint32_t)len;
+    }
+
+    if (run && !blk_rw_run(q, req, run, run_len, offset, write)) {
+        blk_fail(q, req, VIRTIO_BLK_S_IOERR);
+        return;
+    }
+
+    if (!write) {
+        req->in_len = req->bytes;
+    }
+    if (req->pending == 0) {
+        blk_complete(q, req);
+    }
+}
+
+// Requests adjacentes numa única operação através do buffer da combinação;
+// false se não há combinação livre ou se o lote não é um trecho só na
+// imagem (o chamador submete um a um)
+static bool blk_rw_merged(blk_queue_t* q, const blk_batch_t* batch)
+{
+    bool write = batch->reqs[0]->type == VIRTIO_BLK_T_OUT;
+    uint64_t offset = batch->reqs[0]->sector * VIRTIO_BLK_SECTOR_SIZE;
+    disk_extent_t extent;
+
+    if (!q->free_merges || disk_map(q->blk->disk, offset, batch->bytes, write, &extent) != 0) {
+        return false;
+    }
+    if (extent.kind != DISK_EXTENT_DATA || extent.len != batch->bytes) {
+        // Um a um, cada request aloca de novo o que precisar
+        disk_commit(q->blk->disk, offset, &extent, false);
+        return false;
+    }
+
+    blk_merge_t* merge = q->free_merges;
+    q->free_merges = merge->next_free;
+
+    merge->write = write;
+    merge->count = batch->count;
+
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < batch->count; i++) {
+        blk_req_t* req = batch->reqs[i];
+        merge->reqs[i] = req;
+        req->pending++;
+
+        if (merge->write) {
+            virtq_iov_read(req->elem.iov, req->elem.out_num, sizeof(virtio_blk_outhdr_t),
+                           merge->buffer + pos, req->bytes);
+        }
+        pos += req->bytes;
+    }
+
+    merge->io.req = NULL;
+    merge->io.merge = merge;
+    if (blk_issue(q, &merge->io, &extent, offset, merge->buffer, merge->write)) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < merge->count; i++) {
+        merge->reqs[i]->pending--;
+        blk_fail(q, merge->reqs[i], VIRTIO_BLK_S_IOERR);
+    }
+    merge->next_free = q->free_merges;
+    q->free_merges = merge;
+    return true;
+}
+
+static void blk_flush_batch(blk_queue_t* q, blk_batch_t* batch)
+{
+    if (batch->count > 1 && blk_rw_merged(q, batch)) {
+        batch->count = 0;
+        batch->bytes = 0;
+        return;
+    }
+
+    for (uint32_t i = 0; i < batch->count; i++) {
+        blk_rw(q, batch->reqs[i]);
+    }
+    batch->count = 0;
+    batch->bytes = 0;
+}
+
+// Mesmo sentido e setor imediatamente seguinte ao último do lote
+static bool blk_batch_add(blk_batch_t* batch, blk_req_t* req)
+{
+    if (batch->count) {
+        blk_req_t* last = batch->reqs[batch->count - 1];
+        if (batch->count == BLK_MERGE_MAX_REQS || last->type != req->type ||
+            last->sector + last->bytes / VIRTIO_BLK_SECTOR_SIZE != req->sector ||
+            batch->bytes + req->bytes > BLK_MERGE_MAX_BYTES) {
+            return false;
+        }
+    }
+
+    batch->reqs[batch->count++] = req;
+    batch->bytes += req->bytes;
+    return true;
+}
+
+// Lê o cabeçalho e valida o request; false se ele já foi concluído com erro
+static bool blk_parse(blk_queue_t* q, blk_req_t* req)
+{
+    virtio_blk_t* blk = q->blk;
+    virtq_elem_t* elem = &req->elem;
+    virtio_blk_outhdr_t hdr;
+
+    req->generation = blk->generation;
+    req->pending = 0;
+    req->in_len = 0;
+    req->bytes = 0;
+    req->status = VIRTIO_BLK_S_OK;
+
+    if (elem->in_num == 0 ||
+        virtq_iov_read(elem->iov, elem->out_num, 0, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        LOG_ERROR("%s: request sem cabeçalho ou status", blk->name);
+        blk_fail(q, req, VIRTIO_BLK_S_IOERR);
+        return false;
+    }
+
+    req->type = hdr.type;
+    req->sector = hdr.sector;
+
+    if (blk->read_only && (req->type == VIRTIO_BLK_T_OUT || req->type == VIRTIO_BLK_T_DISCARD ||
+                           req->type == VIRTIO_BLK_T_WRITE_ZEROES)) {
+        blk_fail(q, req, VIRTIO_BLK_S_IOERR);
+        return false;
+    }
+    if (req->type != VIRTIO_BLK_T_IN && req->type != VIRTIO_BLK_T_OUT) {
+        return true;
+    }
+
+    uint32_t count;
+    size_t skip;
+    const virtq_iov_t* iov = blk_data_iov(req, &count, &skip);
+    uint64_t total = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        total += iov[i].len;
+    }
+    skip += req->type == VIRTIO_BLK_T_IN ? 1 : 0;     // Byte de status
+    total = total > skip ? total - skip : 0;
+
+    if (total % VIRTIO_BLK_SECTOR_SIZE || total > 0xFFFFFFFF || req->sector > blk->config.capacity ||
+        total / VIRTIO_BLK_SECTOR_SIZE > blk->config.capacity - req->sector) {
+        blk_fail(q, req, VIRTIO_BLK_S_IOERR);
+        return false;
+    }
+
+    req->bytes = (uint32_t)total;
+    return true;
+}
+
+// Segmentos de DISCARD/WRITE_ZEROES, um a um sobre a imagem
+static uint8_t blk_discard(virtio_blk_t* blk, blk_req_t* req)
+{
+    virtq_elem_t* elem = &req->elem;
+    bool discard = req->type == VIRTIO_BLK_T_DISCARD;
+    uint64_t feature = discard ? VIRTIO_BLK_F_DISCARD : VIRTIO_BLK_F_WRITE_ZEROES;
+    size_t pos = sizeof(virtio_blk_outhdr_t);
+    virtio_blk_discard_t seg;
+    uint32_t count = 0;
+
+    if (!virtio_has_feature(&blk->dev, feature)) {
+        return VIRTIO_BLK_S_UNSUPP;
+    }
+
+    while (virtq_iov_read(elem->iov, elem->out_num, pos, &seg, sizeof(seg)) == sizeof(seg)) {
+        pos += sizeof(seg);
+
+        if (++count > 1 || seg.num_sectors > BLK_DISCARD_MAX_SECTORS ||
+            (seg.flags & ~VIRTIO_BLK_WRITE_ZEROES_F_UNMAP) || (discard && seg.flags) ||
+            seg.sector > blk->config.capacity || seg.num_sectors > blk->config.capacity - seg.sector) {
+            return VIRTIO_BLK_S_UNSUPP;
+        }
+
+        uint64_t offset = seg.sector * VIRTIO_BLK_SECTOR_SIZE;
+        uint64_t len = (uint64_t)seg.num_sectors * VIRTIO_BLK_SECTOR_SIZE;
+        int result = discard ? disk_discard(blk->disk, offset, len)
+                             : disk_write_zeroes(blk->disk, offset, len, seg.flags & VIRTIO_BLK_WRITE_ZEROES_F_UNMAP);
+        if (result != 0) {
+            return VIRTIO_BLK_S_IOERR;
+        }
+    }
+
+    return count ? VIRTIO_BLK_S_OK : VIRTIO_BLK_S_IOERR;
+}
+
+// FLUSH, GET_ID, DISCARD, WRITE_ZEROES e tipos desconhecidos: concluídos na hora
+static void blk_submit_other(blk_queue_t* q, blk_req_t* req)
+{
+    virtio_blk_t* blk = q->blk;
+    virtq_elem_t* elem = &req->elem;
+
+    switch (req->type) {
+        case VIRTIO_BLK_T_FLUSH:
+            // Escritas já concluídas ao guest estão no cache do host; levá-las ao disco
+            if (disk_flush(blk->disk) != 0) {
+                req->status = VIRTIO_BLK_S_IOERR;
+            }
+            break;
+
+        case VIRTIO_BLK_T_DISCARD:
+        case VIRTIO_BLK_T_WRITE_ZEROES:
+            req->status = blk_discard(blk, req);
+            break;
+
+        case VIRTIO_BLK_T_GET_ID: {
+            virtq_iov_t* in = &elem->iov[elem->out_num];
+            size_t room = 0;
+            for (uint32_t i = 0; i < elem->in_num; i++) {
+                room += in[i].len;
+            }
+            room = room > 0 ? room - 1 : 0;
+            req->in_len = (uint32_t)virtq_iov_write(in, elem->in_num, 0, blk->serial,
+                                                    room < VIRTIO_BLK_ID_BYTES ? room : VIRTIO_BLK_ID_BYTES);
+            break;
+        }
+
+        default:
+            req->status = VIRTIO_BLK_S_UNSUPP;
+            break;
+    }
+
+    blk_complete(q, req);
+}
+
+// Request admitido: combinado com os adjacentes ou concluído na hora
+static void blk_dispatch(blk_queue_t* q, blk_batch_t* batch, blk_req_t* req)
+{
+    if (req->type != VIRTIO_BLK_T_IN && req->type != VIRTIO_BLK_T_OUT) {
+        blk_flush_batch(q, batch);
+        blk_submit_other(q, req);
+    } else if (!blk_batch_add(batch, req)) {
+        blk_flush_batch(q, batch);
+        blk_batch_add(batch, req);
+    }
+}
+
+static void blk_process_queue(blk_queue_t* q)
+{
+    virtio_blk_t* blk = q->blk;
+    virtqueue_t* vq = blk_vq(q);
+    blk_batch_t batch;
+
+    batch.count = 0;
+    batch.bytes = 0;
+
+    // Kicks desligados enquanto a fila é drenada; religados e rechecados ao final
+    do {
+        virtq_disable_notify(&blk->dev, vq);
+
+        while (q->free_list) {
+            blk_req_t* req = q->free_list;
+            int popped = virtq_pop(&blk->dev, vq, &req->elem);
+
+            if (popped == 0) {
+                break;
+            }
+            if (popped < 0) {
+                // Driver com defeito: fila parada até o reset
+                blk->dev.status |= VIRTIO_STATUS_NEEDS_RESET;
+                q->needs_reset = true;
+                vq->ready = 0;
+                break;
+            }
+
+            q->free_list = req->next_free;
+            if (!blk_parse(q, req)) {
+                continue;
+            }
+
+            // GET_ID não passa pelo QoS; retidos voltam por BLK_KEY_QOS
+            if (req->type == VIRTIO_BLK_T_GET_ID ||
+                blk_qos_admit(&blk->qos, &q->qos_port, &req->qos, req->bytes)) {
+                blk_dispatch(q, &batch, req);
+            }
+        }
+    } while (q->free_list && !q->needs_reset && virtq_enable_notify(&blk->dev, vq));
+
+    // Sem request livre os kicks ficam desligados: a fila volta a ser
+    // drenada pela thread quando uma conclusão devolver um request ao pool
+    q->starved = !q->free_list && !q->needs_reset;
+    blk_flush_batch(q, &batch);
+}
+
+static void blk_process_granted(blk_queue_t* q)
+{
+    blk_batch_t batch;
+    blk_qos_item_t* next;
+
+    batch.count = 0;
+    batch.bytes = 0;
+
+    for (blk_qos_item_t* item = blk_qos_take(&q->qos_port); item; item = next) {
+        next = item->next;
+        blk_dispatch(q, &batch, CONTAINING_RECORD(item, blk_req_t, qos));
+    }
+    blk_flush_batch(q, &batch);
+}
+
+static void blk_merge_done(blk_queue_t* q, blk_merge_t* merge, bool ok)
+{
+    uint32_t pos = 0;
+
+    for (uint32_t i = 0; i < merge->count; i++) {
+        blk_req_t* req = merge->reqs[i];
+
+        if (!ok) {
+            req->status = VIRTIO_BLK_S_IOERR;
+        } else if (!merge->write && req->generation == q->blk->generation) {
+            virtq_iov_write(&req->elem.iov[req->elem.out_num], req->elem.in_num, 0,
+                            merge->buffer + pos, req->bytes);
+            req->in_len = req->bytes;
+        }
+        pos += req->bytes;
+
+        if (--req->pending == 0) {
+            blk_complete(q, req);
+        }
+    }
+
+    merge->next_free = q->free_merges;
+    q->free_merges = merge;
+}
+
+static void blk_io_done(blk_queue_t* q, OVERLAPPED* ov)
+{
+    blk_io_t* io = CONTAINING_RECORD(ov, blk_io_t, ov);
+    DWORD bytes = 0;
+    bool ok = GetOverlappedResult(q->files[io->layer], ov, &bytes, FALSE) && bytes == io->len;
+
+    if (!ok) {
+        LOG_DEBUG("%s: I/O de %u bytes na fila %u concluiu com %lu (erro %lu)", q->blk->name,
+                  io->len, q->index, bytes, GetLastError());
+    }
+
+    q->inflight--;
+    if (!blk_io_commit(q, io, ok)) {
+        ok = false;
+    }
+
+    if (io->merge) {
+        blk_merge_done(q, io->merge, ok);
+        return;
+    }
+
+    if (!ok) {
+        io->req->status = VIRTIO_BLK_S_IOERR;
+    }
+    if (--io->req->pending == 0) {
+        blk_complete(q, io->req);
+    }
+}
+
+static DWORD WINAPI blk_io_thread(LPVOID param)
+{
+    blk_queue_t* q = (blk_queue_t*)param;
+    virtio_blk_t* blk = q->blk;
+    OVERLAPPED_ENTRY entries[BLK_BATCH];
+    bool stopping = false;
+
+    // Ao parar, esperar as operações canceladas: elas ainda escrevem no pool
+    while (!stopping || q->inflight) {
+        ULONG count = 0;
+        bool raise = false;
+        bool broken;
+        bool drained = false;
+
+        if (!GetQueuedCompletionStatusEx(q->iocp, entries, BLK_BATCH, &count, INFINITE, FALSE)) {
+            LOG_ERROR("%s: GetQueuedCompletionStatusEx falhou na fila %u: %lu", blk->name, q->index,
+                      GetLastError());
+            break;
+        }
+
+        EnterCriticalSection(&q->lock);
+
+        for (ULONG i = 0; i < count; i++) {
+            switch (entries[i].lpCompletionKey) {
+                case BLK_KEY_FILE:
+                    blk_io_done(q, entries[i].lpOverlapped);
+                    break;
+
+                case BLK_KEY_KICK:
+                    InterlockedExchange(&q->kicked, 0);
+                    blk_process_queue(q);
+                    break;
+
+                case BLK_KEY_QOS:
+                    blk_process_granted(q);
+                    break;
+
+                case BLK_KEY_STOP:
+                    stopping = true;
+                    blk_cancel(q);
+                    break;
+            }
+        }
+
+        if (q->starved && q->free_list && !stopping) {
+            blk_process_queue(q);
+        }
+
+        // Uma decisão de interrupção por lote de conclusões
+        if (q->completed) {
+            raise = virtq_should_notify(&blk->dev, blk_vq(q));
+            q->completed = false;
+        }
+        broken = q->needs_reset;
+        q->needs_reset = false;
+        if (q->draining && !q->inflight) {
+            q->draining = false;
+            drained = true;
+        }
+
+        LeaveCriticalSection(&q->lock);
+
+        // Fora do lock da fila: gic_set_interrupt toma g_device_lock
+        if (raise) {
+            virtio_raise_irq(&blk->dev, VIRTIO_INT_USED_RING);
+        }
+        if (broken) {
+            virtio_notify_config(&blk->dev);
+        }
+        // Driver relendo Status depois do reset (e talvez estacionado nele)
+        if (drained) {
+            devices_signal_change(DEVICE_ID_VIRTIO);
+        }
+    }
+
+    return 0;
+}
+
+static void blk_qos_wake(void* ctx)
+{
+    blk_queue_t* q = (blk_queue_t*)ctx;
+    PostQueuedCompletionStatus(q->iocp, 0, BLK_KEY_QOS, NULL);
+}
+
+static void virtio_blk_notify(virtio_dev_t* dev, uint32_t queue)
+{
+    blk_queue_t* q = &((virtio_blk_t*)dev)->queues[queue];
+
+    // Um pacote por rajada de kicks: a thread zera o flag ao consumi-lo
+    if (InterlockedExchange(&q->kicked, 1) == 0) {
+        PostQueuedCompletionStatus(q->iocp, 0, BLK_KEY_KICK, NULL);
+    }
+}
+
+static void virtio_blk_reset(virtio_dev_t* dev)
+{
+    virtio_blk_t* blk = (virtio_blk_t*)dev;
+
+    // Todas as filas paradas ao mesmo tempo (ordem crescente de índice).
+    // Operações em voo são canceladas e não tocam mais o anel, mas uma
+    // leitura direta ainda pode gravar nos buffers do guest: o reset só
+    // termina (Status lê 0, virtio_blk_reset_busy) quando elas concluem. Não
+    // se espera por elas aqui: a thread de uma fila pode estar aguardando
+    // g_device_lock para levantar a interrupção.
+    for (uint32_t i = 0; i < blk->num_queues; i++) {
+        EnterCriticalSection(&blk->queues[i].lock);
+    }
+
+    blk->generation++;
+    for (uint32_t i = 0; i < blk->num_queues; i++) {
+        blk_queue_t* q = &blk->queues[i];
+        q->completed = false;
+        q->needs_reset = false;
+        q->starved = false;
+        InterlockedExchange(&q->kicked, 0);
+        if (q->inflight) {
+            q->draining = true;
+            blk_cancel(q);
+        }
+
+        // Retidos pelo QoS nunca foram despachados: voltam direto ao pool
+        blk_qos_item_t* next;
+        for (blk_qos_item_t* item = blk_qos_cancel(&blk->qos, &q->qos_port); item; item = next) {
+            blk_req_t* req = CONTAINING_RECORD(item, blk_req_t, qos);
+            next = item->next;
+            req->next_free = q->free_list;
+            q->free_list = req;
+        }
+    }
+    virtio_queues_reset(dev);
+
+    for (uint32_t i = blk->num_queues; i-- > 0;) {
+        LeaveCriticalSection(&blk->queues[i].lock);
+    }
+}
+
+static bool virtio_blk_reset_busy(virtio_dev_t* dev)
+{
+    virtio_blk_t* blk = (virtio_blk_t*)dev;
+    bool busy = false;
+
+    for (uint32_t i = 0; i < blk->num_queues && !busy; i++) {
+        blk_queue_t* q = &blk->queues[i];
+        EnterCriticalSection(&q->lock);
+        busy = q->draining;
+        LeaveCriticalSection(&q->lock);
+    }
+    return busy;
+}
+
+static void virtio_blk_destroy(virtio_dev_t* dev)
+{
+    virtio_blk_t* blk = (virtio_blk_t*)dev;
+    blk_qos_stats_t stats;
+
+    // Sem novas liberações nem wakes para as filas que vão parar
+    blk_qos_flow_unregister(&blk->qos);
+    if (blk->qos.limited) {
+        blk_qos_get_stats(&blk->qos, &stats);
+        LOG_INFO("%s: QoS: %llu requests, %llu retidos, espera média %llu us, máxima %llu us",
+                 blk->name, stats.requests, stats.throttled,
+                 stats.throttled ? stats.wait_ns / stats.throttled / 1000 : 0, stats.max_wait_ns / 1000);
+    }
+
+    for (uint32_t i = 0; i < blk->num_queues; i++) {
+        blk_queue_t* q = &blk->queues[i];
+
+        if (q->thread) {
+            PostQueuedCompletionStatus(q->iocp, 0, BLK_KEY_STOP, NULL);
+            WaitForSingleObject(q->thread, INFINITE);
+            CloseHandle(q->thread);
+        }
+        if (q->iocp) {
+            CloseHandle(q->iocp);
+        }
+        for (uint32_t l = 0; l < DISK_MAX_CHAIN; l++) {
+            if (q->files[l] != INVALID_HANDLE_VALUE) {
+                CloseHandle(q->files[l]);
+            }
+        }
+        if (q->merges) {
+            for (uint32_t m = 0; m < BLK_MERGE_SLOTS; m++) {
+                free(q->merges[m].buffer);
+            }
+        }
+        free(q->merges);
+        free(q->pool);
+        DeleteCriticalSection(&q->lock);
+    }
+    if (blk->disk) {
+        disk_close(blk->disk);
+    }
+    free(blk);
+}
+
+static const virtio_dev_ops_t virtio_blk_ops = {
+    .notify = virtio_blk_notify,
+    .reset = virtio_blk_reset,
+    .reset_busy = virtio_blk_reset_busy,
+    .destroy = virtio_blk_destroy,
+};
+
+static int blk_queue_init(virtio_blk_t* blk, blk_queue_t* q)
+{
+    // Todas as camadas da cadeia na mesma porta; só o topo é gravável
+    for (uint32_t l = 0; l < disk_layer_count(blk->disk); l++) {
+        const char* path = disk_layer_path(blk->disk, l);
+        bool writable = l == 0 && !blk->read_only;
+
+        q->files[l] = CreateFileA(path, GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+        if (q->files[l] == INVALID_HANDLE_VALUE) {
+            LOG_ERROR("%s: falha ao abrir %s: %lu", blk->name, path, GetLastError());
+            return -1;
+        }
+
+        // Conclusões só pela porta; o evento do arquivo nunca é usado
+        HANDLE port = CreateIoCompletionPort(q->files[l], q->iocp, BLK_KEY_FILE, 1);
+        if (!port) {
+            LOG_ERROR("%s: CreateIoCompletionPort falhou: %lu", blk->name, GetLastError());
+            return -1;
+        }
+        q->iocp = port;
+        SetFileCompletionNotificationModes(q->files[l], FILE_SKIP_SET_EVENT_ON_HANDLE);
+    }
+
+    // Um request por entrada de anel: o pool nunca esgota com um driver correto
+    q->pool = (blk_req_t*)calloc(VIRTQ_MAX_SIZE, sizeof(blk_req_t));
+    q->merges = (blk_merge_t*)calloc(BLK_MERGE_SLOTS, sizeof(blk_merge_t));
+    if (!q->pool || !q->merges) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < VIRTQ_MAX_SIZE; i++) {
+        q->pool[i].next_free = q->free_list;
+        q->free_list = &q->pool[i];
+    }
+    for (uint32_t i = 0; i < BLK_MERGE_SLOTS; i++) {
+        q->merges[i].buffer = (uint8_t*)malloc(BLK_MERGE_MAX_BYTES);
+        if (!q->merges[i].buffer) {
+            return -1;
+        }
+        q->merges[i].next_free = q->free_merges;
+        q->free_merges = &q->merges[i];
+    }
+
+    q->thread = CreateThread(NULL, 0, blk_io_thread, q, 0, NULL);
+    if (!q->thread) {
+        LOG_ERROR("%s: falha ao criar thread de I/O: %lu", blk->name, GetLastError());
+        return -1;
+    }
+    return 0;
+}
+
+int virtio_blk_create(const char* path, bool read_only, uint32_t num_queues,
+                      const blk_qos_limits_t* limits, uint32_t weight)
+{
+    virtio_blk_t* blk = (virtio_blk_t*)calloc(1, sizeof(virtio_blk_t));
+    if (!blk) {
+        return -1;
+    }
+
+    if (num_queues == 0) {
+        num_queues = 1;
+    } else if (num_queues > VIRTIO_MAX_QUEUES) {
+        num_queues = VIRTIO_MAX_QUEUES;
+    }
+
+    blk->read_only = read_only;
+    blk->num_queues = num_queues;
+    snprintf(blk->name, sizeof(blk->name), "virtio-blk%u", g_blk_count);
+    // Serial sem terminador quando ocupa os 20 bytes (GET_ID)
+    strncpy(blk->serial, blk->name, sizeof(blk->serial));
+
+    for (uint32_t i = 0; i < num_queues; i++) {
+        blk->queues[i].blk = blk;
+        blk->queues[i].index = i;
+        blk->queues[i].qos_port.wake = blk_qos_wake;
+        blk->queues[i].qos_port.ctx = &blk->queues[i];
+        for (uint32_t l = 0; l < DISK_MAX_CHAIN; l++) {
+            blk->queues[i].files[l] = INVALID_HANDLE_VALUE;
+        }
+        InitializeCriticalSection(&blk->queues[i].lock);
+    }
+
+    if (blk_qos_flow_register(&blk->qos, blk->name, limits, weight) != 0) {
+        virtio_blk_destroy(&blk->dev);
+        return -1;
+    }
+
+    if (disk_open(path, read_only, &blk->disk) != 0 || disk_size(blk->disk) < VIRTIO_BLK_SECTOR_SIZE) {
+        LOG_ERROR("%s: imagem %s vazia ou ilegível", blk->name, path);
+        virtio_blk_destroy(&blk->dev);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < num_queues; i++) {
+        if (blk_queue_init(blk, &blk->queues[i]) != 0) {
+            virtio_blk_destroy(&blk->dev);
+            return -1;
+        }
+    }
+
+    bool sparse = disk_is_sparse(blk->disk);
+
+    blk->config.capacity = disk_size(blk->disk) / VIRTIO_BLK_SECTOR_SIZE;
+    blk->config.size_max = BLK_SIZE_MAX;
+    blk->config.seg_max = VIRTQ_MAX_IOV - 2;   // Cabeçalho e status
+    blk->config.blk_size = VIRTIO_BLK_SECTOR_SIZE;
+    blk->config.num_queues = (uint16_t)num_queues;
+    if (sparse) {
+        // Só clusters inteiros liberam espaço: alinhamento de um cluster
+        blk->config.max_discard_sectors = BLK_DISCARD_MAX_SECTORS;
+        blk->config.max_discard_seg = 1;
+        blk->config.discard_sector_alignment = BLK_SIZE_MAX / VIRTIO_BLK_SECTOR_SIZE;
+        blk->config.max_write_zeroes_sectors = BLK_DISCARD_MAX_SECTORS;
+        blk->config.max_write_zeroes_seg = 1;
+        blk->config.write_zeroes_may_unmap = 1;
+    }
+
+    blk->dev.name = blk->name;
+    blk->dev.device_id = VIRTIO_ID_BLOCK;
+    blk->dev.host_features = VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_BLK_SIZE |
+                             VIRTIO_BLK_F_FLUSH | VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_RING_F_EVENT_IDX |
+                             (read_only ? VIRTIO_BLK_F_RO : 0) |
+                             (num_queues > 1 ? VIRTIO_BLK_F_MQ : 0) |
+                             (sparse && !read_only ? VIRTIO_BLK_F_DISCARD | VIRTIO_BLK_F_WRITE_ZEROES : 0);
+    blk->dev.ops = &virtio_blk_ops;
+    blk->dev.config = &blk->config;
+    blk->dev.config_size = sizeof(blk->config);
+    blk->dev.num_queues = num_queues;
+
+    if (virtio_mmio_register(&blk->dev) != 0) {
+        virtio_blk_destroy(&blk->dev);
+        return -1;
+    }
+
+    g_blk_count++;
+    LOG_INFO("%s: %s (%llu setores, %u fila(s), %s, %u camada(s)%s)", blk->name, path,
+             blk->config.capacity, num_queues, sparse ? "HVDK" : "raw", disk_layer_count(blk->disk),
+             read_only ? ", somente leitura" : "");
+    return 0;
+}
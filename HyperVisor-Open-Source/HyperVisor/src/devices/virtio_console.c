@@ -0,0 +1,434 @@
+/* Desenvolvido por: Escanearcpl */
+#include "virtio.h"
+
+// virtio-console (virtio 1.1, seção 5.3) com multiport.
+//
+// O guest entrega buffers inteiros na fila de transmissão de cada porta e
+// notifica uma vez; o host drena todas as cadeias disponíveis para um buffer
+// de staging e escreve no backend da porta numa única operação. Em vez de
+// um exit por byte no PL011 (UART_DR) ou por hypercall, um log volumoso
+// custa um exit por lote. O PL011 fica para o boot inicial, antes do driver
+// virtio subir; EMERG_WRITE cobre o intervalo entre os dois.
+//
+// Todo o processamento acontece no hook de notify, no vCPU e sob
+// g_device_lock: o trabalho por notificação é uma cópia e uma escrita no
+// host, e não há thread nem lock próprio. Não há fonte de entrada no host,
+// então as filas de recepção só guardam os buffers do driver.
+
+#define VIRTIO_CONSOLE_F_SIZE           (1ULL << 0)
+#define VIRTIO_CONSOLE_F_MULTIPORT      (1ULL << 1)
+#define VIRTIO_CONSOLE_F_EMERG_WRITE    (1ULL << 2)
+
+// Mensagens de controle (c_ivq: device -> driver, c_ovq: driver -> device)
+#define VIRTIO_CONSOLE_DEVICE_READY     0
+#define VIRTIO_CONSOLE_DEVICE_ADD       1
+#define VIRTIO_CONSOLE_DEVICE_REMOVE    2
+#define VIRTIO_CONSOLE_PORT_READY       3
+#define VIRTIO_CONSOLE_CONSOLE_PORT     4
+#define VIRTIO_CONSOLE_RESIZE           5
+#define VIRTIO_CONSOLE_PORT_OPEN        6
+#define VIRTIO_CONSOLE_PORT_NAME        7
+
+// Filas: receiveq0, transmitq0, c_ivq, c_ovq, depois rx/tx das portas 1..N
+#define CON_QUEUE_CTRL_RX               2
+#define CON_QUEUE_CTRL_TX               3
+#define CON_MAX_PORTS                   ((VIRTIO_MAX_QUEUES - 2) / 2)
+
+#define CON_NAME_MAX                    32
+#define CON_CTRL_PENDING                64      // Mensagens à espera de buffer no c_ivq
+#define CON_STAGING_SIZE                (64 * 1024)
+
+typedef struct {
+    uint16_t cols;
+    uint16_t rows;
+    uint32_t max_nr_ports;          // VIRTIO_CONSOLE_F_MULTIPORT
+    uint32_t emerg_wr;              // VIRTIO_CONSOLE_F_EMERG_WRITE
+} virtio_console_config_t;
+
+typedef struct {
+    uint32_t id;
+    uint16_t event;
+    uint16_t value;
+} virtio_console_control_t;
+
+typedef struct {
+    char name[CON_NAME_MAX];        // "" = sem PORT_NAME
+    FILE* out;                      // NULL = descarta
+    bool owns_out;
+    bool ready;                     // PORT_READY do driver
+    bool guest_open;                // PORT_OPEN do driver
+    uint64_t bytes;
+    uint64_t writes;                // Escritas no backend
+} con_port_t;
+
+typedef struct {
+    virtio_console_control_t msg;
+    uint32_t extra_len;             // Nome depois da mensagem (PORT_NAME)
+    char extra[CON_NAME_MAX];
+} con_ctrl_t;
+
+typedef struct {
+    virtio_dev_t dev;
+    virtio_console_config_t config;
+    char name[16];
+
+    uint32_t num_ports;
+    con_port_t ports[CON_MAX_PORTS];
+
+    con_ctrl_t pending[CON_CTRL_PENDING];
+    uint32_t pending_head;
+    uint32_t pending_count;
+
+    virtq_elem_t elem;
+    uint8_t* staging;
+} virtio_console_t;
+
+static inline uint32_t con_port_of_queue(uint32_t queue)
+{
+    return queue < 2 ? 0 : (queue - 2) / 2;
+}
+
+static inline uint32_t con_tx_queue(uint32_t port)
+{
+    return port == 0 ? 1 : 2 * port + 3;
+}
+
+static void con_port_write(con_port_t* port, const void* buf, size_t len)
+{
+    if (!len) {
+        return;
+    }
+
+    port->bytes += len;
+    port->writes++;
+    if (port->out) {
+        fwrite(buf, 1, len, port->out);
+        fflush(port->out);
+    }
+}
+
+static void con_broken(virtio_console_t* con, virtqueue_t* vq)
+{
+    // Driver com defeito: fila parada até o reset
+    con->dev.status |= VIRTIO_STATUS_NEEDS_RESET;
+    vq->ready = 0;
+    virtio_notify_config(&con->dev);
+}
+
+static void con_signal(virtio_console_t* con, virtqueue_t* vq)
+{
+    if (virtq_should_notify(&con->dev, vq)) {
+        virtio_raise_irq(&con->dev, VIRTIO_INT_USED_RING);
+    }
+}
+
+// Todas as cadeias da fila de transmissão numa escrita só (ou mais, se o
+// staging encher)
+static void con_drain_tx(virtio_console_t* con, uint32_t queue)
+{
+    con_port_t* port = &con->ports[con_port_of_queue(queue)];
+    virtqueue_t* vq = &con->dev.queues[queue];
+    virtq_elem_t* elem = &con->elem;
+    size_t staged = 0;
+    bool pushed = false;
+    int popped;
+
+    do {
+        virtq_disable_notify(&con->dev, vq);
+
+        while ((popped = virtq_pop(&con->dev, vq, elem)) > 0) {
+            for (uint32_t i = 0; i < elem->out_num; i++) {
+                const virtq_iov_t* iov = &elem->iov[i];
+
+                if (staged + iov->len > CON_STAGING_SIZE) {
+                    con_port_write(port, con->staging, staged);
+                    staged = 0;
+                }
+                if (iov->len > CON_STAGING_SIZE) {
+                    con_port_write(port, iov->addr, iov->len);
+                } else {
+                    memcpy(con->staging + staged, iov->addr, iov->len);
+                    staged += iov->len;
+                }
+            }
+
+            // Dados já copiados: o buffer volta ao guest antes da escrita
+            virtq_push(vq, elem->head, 0);
+            pushed = true;
+        }
+
+        if (popped < 0) {
+            con_broken(con, vq);
+            break;
+        }
+    } while (virtq_enable_notify(&con->dev, vq));
+
+    con_port_write(port, con->staging, staged);
+    if (pushed) {
+        con_signal(con, vq);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Controle (multiport)
+// ---------------------------------------------------------------------------
+
+static void con_flush_ctrl(virtio_console_t* con)
+{
+    virtqueue_t* vq = &con->dev.queues[CON_QUEUE_CTRL_RX];
+    virtq_elem_t* elem = &con->elem;
+    bool pushed = false;
+
+    while (con->pending_count) {
+        int popped = virtq_pop(&con->dev, vq, elem);
+        if (popped == 0) {
+            break;      // Sem buffer: esperar o driver repor o c_ivq
+        }
+        if (popped < 0) {
+            con_broken(con, vq);
+            return;
+        }
+
+        con_ctrl_t* ctrl = &con->pending[con->pending_head];
+        virtq_iov_t* in = &elem->iov[elem->out_num];
+        size_t len = virtq_iov_write(in, elem->in_num, 0, &ctrl->msg, sizeof(ctrl->msg));
+        len += virtq_iov_write(in, elem->in_num, sizeof(ctrl->msg), ctrl->extra, ctrl->extra_len);
+
+        virtq_push(vq, elem->head, (uint32_t)len);
+        pushed = true;
+        con->pending_head = (con->pending_head + 1) % CON_CTRL_PENDING;
+        con->pending_count--;
+    }
+
+    if (pushed) {
+        con_signal(con, vq);
+    }
+}
+
+static void con_send_ctrl(virtio_console_t* con, uint32_t id, uint16_t event, uint16_t value, const char* extra)
+{
+    if (con->pending_count == CON_CTRL_PENDING) {
+        LOG_ERROR("%s: fila de controle cheia, evento %u da porta %u descartado", con->name, event, id);
+        return;
+    }
+
+    con_ctrl_t* ctrl = &con->pending[(con->pending_head + con->pending_count++) % CON_CTRL_PENDING];
+    ctrl->msg.id = id;
+    ctrl->msg.event = event;
+    ctrl->msg.value = value;
+    ctrl->extra_len = extra ? (uint32_t)strlen(extra) : 0;
+    memcpy(ctrl->extra, extra ? extra : "", ctrl->extra_len);
+}
+
+static void con_handle_ctrl(virtio_console_t* con, const virtio_console_control_t* msg)
+{
+    con_port_t* port = msg->id < con->num_ports ? &con->ports[msg->id] : NULL;
+
+    switch (msg->event) {
+        case VIRTIO_CONSOLE_DEVICE_READY:
+            if (msg->value != 1) {
+                LOG_ERROR("%s: driver falhou ao iniciar", con->name);
+                break;
+            }
+            for (uint32_t i = 0; i < con->num_ports; i++) {
+                con_send_ctrl(con, i, VIRTIO_CONSOLE_DEVICE_ADD, 0, NULL);
+            }
+            break;
+
+        case VIRTIO_CONSOLE_PORT_READY:
+            if (!port || msg->value != 1) {
+                LOG_DEBUG("%s: porta %u recusada pelo driver", con->name, msg->id);
+                break;
+            }
+            port->ready = true;
+            if (msg->id == 0) {
+                con_send_ctrl(con, 0, VIRTIO_CONSOLE_CONSOLE_PORT, 1, NULL);
+            }
+            if (port->name[0]) {
+                con_send_ctrl(con, msg->id, VIRTIO_CONSOLE_PORT_NAME, 1, port->name);
+            }
+            // O lado do host está sempre aberto
+            con_send_ctrl(con, msg->id, VIRTIO_CONSOLE_PORT_OPEN, 1, NULL);
+            break;
+
+        case VIRTIO_CONSOLE_PORT_OPEN:
+            if (port) {
+                port->guest_open = msg->value != 0;
+            }
+            break;
+
+        default:
+            LOG_DEBUG("%s: evento de controle %u ignorado", con->name, msg->event);
+            break;
+    }
+}
+
+static void con_drain_ctrl(virtio_console_t* con)
+{
+    virtqueue_t* vq = &con->dev.queues[CON_QUEUE_CTRL_TX];
+    virtq_elem_t* elem = &con->elem;
+    bool pushed = false;
+    int popped;
+
+    while ((popped = virtq_pop(&con->dev, vq, elem)) > 0) {
+        virtio_console_control_t msg;
+
+        if (virtq_iov_read(elem->iov, elem->out_num, 0, &msg, sizeof(msg)) == sizeof(msg)) {
+            con_handle_ctrl(con, &msg);
+        }
+        virtq_push(vq, elem->head, 0);
+        pushed = true;
+    }
+
+    if (popped < 0) {
+        con_broken(con, vq);
+    }
+    if (pushed) {
+        con_signal(con, vq);
+    }
+    con_flush_ctrl(con);
+}
+
+// ---------------------------------------------------------------------------
+// Hooks do transporte
+// ---------------------------------------------------------------------------
+
+static void virtio_console_notify(virtio_dev_t* dev, uint32_t queue)
+{
+    virtio_console_t* con = (virtio_console_t*)dev;
+
+    if (queue == CON_QUEUE_CTRL_RX) {
+        con_flush_ctrl(con);            // Driver repôs buffers de controle
+    } else if (queue == CON_QUEUE_CTRL_TX) {
+        con_drain_ctrl(con);
+    } else if (queue & 1) {
+        con_drain_tx(con, queue);
+    }
+    // receiveq: buffers ficam no anel até haver entrada
+}
+
+static void virtio_console_reset(virtio_dev_t* dev)
+{
+    virtio_console_t* con = (virtio_console_t*)dev;
+
+    con->pending_head = 0;
+    con->pending_count = 0;
+    for (uint32_t i = 0; i < con->num_ports; i++) {
+        con->ports[i].ready = false;
+        con->ports[i].guest_open = false;
+    }
+    virtio_queues_reset(dev);
+}
+
+// emerg_wr: um caractere para a porta 0 sem filas (antes de DRIVER_OK)
+static void virtio_console_config_write(virtio_dev_t* dev, uint32_t offset, uint64_t value, uint32_t size)
+{
+    virtio_console_t* con = (virtio_console_t*)dev;
+    char c = (char)(value & 0xFF);
+
+    // Escrita que não cabe no campo de 32 bits toca outros campos: ignorada
+    if (offset == offsetof(virtio_console_config_t, emerg_wr) && size <= sizeof(uint32_t)) {
+        con_port_write(&con->ports[0], &c, 1);
+    }
+}
+
+static void virtio_console_destroy(virtio_dev_t* dev)
+{
+    virtio_console_t* con = (virtio_console_t*)dev;
+
+    for (uint32_t i = 0; i < con->num_ports; i++) {
+        con_port_t* port = &con->ports[i];
+
+        LOG_DEBUG("%s: porta %u: %llu bytes em %llu escritas", con->name, i, port->bytes, port->writes);
+        if (port->owns_out) {
+            fclose(port->out);
+        }
+    }
+    free(con->staging);
+    free(con);
+}
+
+static const virtio_dev_ops_t virtio_console_ops = {
+    .notify = virtio_console_notify,
+    .reset = virtio_console_reset,
+    .config_write = virtio_console_config_write,
+    .destroy = virtio_console_destroy,
+};
+
+// "<destino>[,name=<nome>]": destino stdout, null ou caminho de arquivo
+static int con_port_init(virtio_console_t* con, con_port_t* port, const char* spec)
+{
+    const char* comma = strchr(spec, ',');
+    char target[MAX_PATH];
+
+    snprintf(target, sizeof(target), "%.*s", comma ? (int)(comma - spec) : (int)strlen(spec), spec);
+
+    if (comma) {
+        if (strncmp(comma + 1, "name=", 5) != 0 || strlen(comma + 6) >= CON_NAME_MAX) {
+            LOG_ERROR("%s: opção de porta inválida '%s' (name=<até %u caracteres>)", con->name, comma + 1,
+                      CON_NAME_MAX - 1);
+            return -1;
+        }
+        snprintf(port->name, sizeof(port->name), "%s", comma + 6);
+    }
+
+    if (strcmp(target, "stdout") == 0) {
+        port->out = stdout;
+    } else if (strcmp(target, "null") != 0) {
+        port->out = fopen(target, "ab");
+        if (!port->out) {
+            LOG_ERROR("%s: falha ao abrir %s", con->name, target);
+            return -1;
+        }
+        port->owns_out = true;
+    }
+    return 0;
+}
+
+int virtio_console_create(const char* const* ports, uint32_t count)
+{
+    if (count == 0 || count > CON_MAX_PORTS) {
+        LOG_ERROR("virtio-console: de 1 a %u portas (%u pedidas)", CON_MAX_PORTS, count);
+        return -1;
+    }
+
+    virtio_console_t* con = (virtio_console_t*)calloc(1, sizeof(virtio_console_t));
+    if (!con) {
+        return -1;
+    }
+    snprintf(con->name, sizeof(con->name), "virtio-console");
+
+    con->staging = (uint8_t*)malloc(CON_STAGING_SIZE);
+    if (!con->staging) {
+        virtio_console_destroy(&con->dev);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        con->num_ports++;
+        if (con_port_init(con, &con->ports[i], ports[i]) != 0) {
+            virtio_console_destroy(&con->dev);
+            return -1;
+        }
+    }
+
+    con->config.max_nr_ports = count;
+
+    con->dev.name = con->name;
+    con->dev.device_id = VIRTIO_ID_CONSOLE;
+    con->dev.host_features = VIRTIO_CONSOLE_F_MULTIPORT | VIRTIO_CONSOLE_F_EMERG_WRITE |
+                             VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_RING_F_EVENT_IDX;
+    con->dev.ops = &virtio_console_ops;
+    con->dev.config = &con->config;
+    con->dev.config_size = sizeof(con->config);
+    // Com MULTIPORT as filas de controle existem mesmo com uma porta só
+    con->dev.num_queues = count > 1 ? con_tx_queue(count - 1) + 1 : CON_QUEUE_CTRL_TX + 1;
+
+    if (virtio_mmio_register(&con->dev) != 0) {
+        virtio_console_destroy(&con->dev);
+        return -1;
+    }
+
+    LOG_INFO("%s: %u porta(s), %u filas", con->name, count, con->dev.num_queues);
+    return 0;
+}
@@ -0,0 +1,1768 @@
+/* Desenvolvido por: Escanearcpl */
+#include "virtio.h"
+#include "vm.h"
+#include "fuse_proto.h"
+
+// virtio-fs (virtio 1.2, seção 5.11): um diretório do host exportado ao
+// guest pelo protocolo FUSE. O driver monta com "mount -t virtiofs <tag>".
+//
+// Cada request chega numa cadeia com fuse_in_header e argumentos nos
+// buffers de saída e o espaço da resposta nos de entrada. READ e WRITE
+// vão direto entre os buffers do guest e o arquivo, sem cópia no meio.
+// Uma thread atende a fila hiprio (FORGET) e a de requests em lote, com
+// uma interrupção por volta.
+//
+// Nodes são identificados pelo índice do arquivo no volume: a mesma entrada
+// vista por dois caminhos (hard link) é o mesmo node. Cada node guarda pai
+// e nome, e o caminho é montado na hora; um rename só reaponta o node.
+//
+// Janela DAX: a região de memória compartilhada 0 é um range de GPAs acima
+// da RAM. FUSE_SETUPMAPPING mapeia um trecho do arquivo (view de
+// MapViewOfFile) direto nesse range, e o guest passa a ler e executar o
+// arquivo como memória comum, sem request e sem exit. O alinhamento pedido
+// ao guest é o de MapViewOfFile (64KB). Redimensionar um arquivo mapeado
+// refaz as views dele; durante a troca, acessos do guest à janela são
+// repetidos pelo exit handler.
+
+#define VIRTIO_FS_TAG_MAX       36
+#define VIRTIO_FS_SHMCAP_CACHE  0
+#define FS_QUEUE_HIPRIO         0
+#define FS_QUEUE_REQUEST        1
+
+#define FS_NODE_BUCKETS         4096            // Potência de 2
+#define FS_MAX_HANDLES          1024
+#define FS_ARG_MAX              8192            // Argumentos além do payload de WRITE
+#define FS_PATH_MAX             32768           // WCHARs, com o prefixo "\\?\"
+#define FS_NAME_MAX             1024            // Bytes UTF-8 por componente
+#define FS_MAX_PAGES            256             // READ/WRITE de até 1MB
+#define FS_READDIR_MAX          (64 * 1024)
+#define FS_DIR_BUF              (64 * 1024)
+#define FS_DAX_SHIFT            16              // Granularidade de MapViewOfFile
+#define FS_DAX_ALIGN            (1ULL << FS_DAX_SHIFT)
+#define FS_DAX_DEFAULT_MB       1024
+#define FS_ATTR_VALID_S         1
+
+// FILETIME (100ns desde 1601) -> tempo Unix
+#define FS_EPOCH_DIFF           116444736000000000ULL
+
+typedef struct {
+    char tag[VIRTIO_FS_TAG_MAX];
+    uint32_t num_request_queues;
+} virtio_fs_config_t;
+
+typedef struct fs_node {
+    uint64_t nodeid;
+    uint64_t file_id;           // Índice do arquivo no volume (ino do guest)
+    uint64_t nlookup;           // Referências do guest (LOOKUP - FORGET)
+    uint32_t refs;              // Filhos, handles e views que apontam para o node
+    uint32_t dax_views;
+    struct fs_node* parent;
+    char* name;                 // UTF-8; raiz = ""
+    struct fs_node* next_id;    // Hash por nodeid
+    struct fs_node* next_file;  // Hash por file_id
+} fs_node_t;
+
+typedef struct {
+    bool used;
+    bool is_dir;
+    HANDLE file;
+    fs_node_t* node;
+
+    // Diretório: lote corrente de FileIdBothDirectoryInfo
+    uint8_t* dir_buf;
+    uint32_t dir_pos;           // Offset da próxima entrada no lote (UINT32_MAX = buscar outro)
+    uint64_t dir_index;         // Ordinal da próxima entrada (offset do READDIR)
+    bool dir_eof;
+} fs_handle_t;
+
+// Trecho de arquivo mapeado na janela; indexado pelo granulo inicial
+typedef struct {
+    fs_node_t* node;            // NULL = livre
+    uint64_t foffset;
+    uint64_t len;               // Pedido pelo guest
+    uint64_t mapped;            // Mapeado no guest (o arquivo pode acabar antes)
+    bool writable;
+    void* view;
+} fs_dax_map_t;
+
+typedef struct {
+    virtio_dev_t dev;
+    virtio_fs_config_t config;
+    char name[32];
+    bool read_only;
+
+    CRITICAL_SECTION lock;      // Nodes, handles e janela; a thread de I/O processa
+    HANDLE thread;
+    HANDLE kick;
+    volatile bool stop;
+
+    WCHAR* root;                // "\\?\C:\..." sem barra final
+    size_t root_len;
+    fs_node_t root_node;
+    fs_node_t* by_id[FS_NODE_BUCKETS];
+    fs_node_t* by_file[FS_NODE_BUCKETS];
+    uint64_t next_nodeid;
+    uint32_t minor;             // Versão negociada no INIT
+
+    fs_handle_t handles[FS_MAX_HANDLES];
+
+    fs_dax_map_t* dax;          // Um por granulo da janela
+    uint32_t* dax_owner;        // Granulo -> granulo inicial + 1 (0 = livre)
+    uint32_t dax_granules;
+
+    virtq_elem_t elem;
+    fuse_in_header_t in;
+    uint8_t args[FS_ARG_MAX + 1];
+    uint8_t* reply;             // FS_READDIR_MAX
+    bool reply_direct;          // Payload já escrito nos buffers do guest (READ)
+    WCHAR path[2][FS_PATH_MAX];
+    uint64_t requests;
+    uint64_t dax_setups;
+} virtio_fs_t;
+
+typedef struct {
+    uint32_t in_size;           // Argumentos fixos mínimos
+    int (*handler)(virtio_fs_t* fs, uint32_t arg_len);  // Bytes da resposta, ou -errno
+    bool writes;                // Recusado em compartilhamento somente-leitura
+} fs_op_t;
+
+static uint32_t g_fs_count;
+
+// ---------------------------------------------------------------------------
+// Host
+// ---------------------------------------------------------------------------
+
+static int fs_errno(DWORD error)
+{
+    switch (error) {
+        case ERROR_FILE_NOT_FOUND:
+        case ERROR_PATH_NOT_FOUND:
+        case ERROR_INVALID_NAME:
+        case ERROR_BAD_PATHNAME:        return -FUSE_ENOENT;
+        case ERROR_ACCESS_DENIED:
+        case ERROR_PRIVILEGE_NOT_HELD:  return -FUSE_EACCES;
+        case ERROR_FILE_EXISTS:
+        case ERROR_ALREADY_EXISTS:      return -FUSE_EEXIST;
+        case ERROR_DIR_NOT_EMPTY:       return -FUSE_ENOTEMPTY;
+        case ERROR_DIRECTORY:           return -FUSE_ENOTDIR;
+        case ERROR_SHARING_VIOLATION:
+        case ERROR_LOCK_VIOLATION:
+        case ERROR_USER_MAPPED_FILE:    return -FUSE_EBUSY;
+        case ERROR_DISK_FULL:
+        case ERROR_HANDLE_DISK_FULL:    return -FUSE_ENOSPC;
+        case ERROR_NOT_SAME_DEVICE:     return -FUSE_EXDEV;
+        case ERROR_FILENAME_EXCED_RANGE: return -FUSE_ENAMETOOLONG;
+        case ERROR_WRITE_PROTECT:       return -FUSE_EROFS;
+        case ERROR_NOT_ENOUGH_MEMORY:
+        case ERROR_OUTOFMEMORY:         return -FUSE_ENOMEM;
+        default:                        return -FUSE_EIO;
+    }
+}
+
+// Componente vindo do guest: um nome, nunca um caminho ou stream NTFS
+static int fs_check_name(const char* name)
+{
+    size_t len = strlen(name);
+
+    if (len == 0 || (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.')))) {
+        return -FUSE_ENOENT;
+    }
+    if (len > FS_NAME_MAX) {
+        return -FUSE_ENAMETOOLONG;
+    }
+    if (strpbrk(name, "/\\:")) {
+        return -FUSE_EINVAL;
+    }
+    return 0;
+}
+
+static int fs_path_append(WCHAR* out, size_t* pos, const char* component)
+{
+    if (*pos + 2 >= FS_PATH_MAX) {
+        return -FUSE_ENAMETOOLONG;
+    }
+    out[(*pos)++] = L'\\';
+
+    int n = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, component, -1, out + *pos,
+                                (int)(FS_PATH_MAX - *pos));
+    if (n <= 0) {
+        return GetLastError() == ERROR_INSUFFICIENT_BUFFER ? -FUSE_ENAMETOOLONG : -FUSE_EINVAL;
+    }
+    *pos += (size_t)n - 1;
+    return 0;
+}
+
+// Caminho do host de 'node' (mais 'name', se dado) em 'out'
+static int fs_path(virtio_fs_t* fs, const fs_node_t* node, const char* name, WCHAR* out)
+{
+    const fs_node_t* chain[256];
+    uint32_t depth = 0;
+    size_t pos = fs->root_len;
+    int err;
+
+    for (const fs_node_t* n = node; n->parent; n = n->parent) {
+        if (depth == sizeof(chain) / sizeof(chain[0])) {
+            return -FUSE_ENAMETOOLONG;
+        }
+        chain[depth++] = n;
+    }
+
+    memcpy(out, fs->root, fs->root_len * sizeof(WCHAR));
+    out[pos] = L'\0';
+    while (depth > 0) {
+        if ((err = fs_path_append(out, &pos, chain[--depth]->name)) != 0) {
+            return err;
+        }
+    }
+    return name ? fs_path_append(out, &pos, name) : 0;
+}
+
+static HANDLE fs_open(const WCHAR* path, DWORD access, DWORD disposition)
+{
+    // BACKUP_SEMANTICS abre diretórios; SHARE_DELETE deixa o guest apagar e
+    // renomear arquivos abertos
+    return CreateFileW(path, access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                       disposition, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+}
+
+static void fs_filetime(FILETIME ft, uint64_t* sec, uint32_t* nsec)
+{
+    uint64_t t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    t = t > FS_EPOCH_DIFF ? t - FS_EPOCH_DIFF : 0;
+    *sec = t / 10000000;
+    *nsec = (uint32_t)(t % 10000000) * 100;
+}
+
+static FILETIME fs_unix_filetime(uint64_t sec, uint32_t nsec)
+{
+    uint64_t t = sec * 10000000 + nsec / 100 + FS_EPOCH_DIFF;
+    FILETIME ft = { (DWORD)t, (DWORD)(t >> 32) };
+    return ft;
+}
+
+static int fs_stat(virtio_fs_t* fs, HANDLE file, fuse_attr_t* attr)
+{
+    BY_HANDLE_FILE_INFORMATION info;
+
+    if (!GetFileInformationByHandle(file, &info)) {
+        return fs_errno(GetLastError());
+    }
+
+    memset(attr, 0, sizeof(*attr));
+    attr->ino = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    attr->size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    attr->blocks = (attr->size + 511) / 512;
+    attr->nlink = info.nNumberOfLinks;
+    attr->blksize = 4096;
+    fs_filetime(info.ftLastAccessTime, &attr->atime, &attr->atimensec);
+    fs_filetime(info.ftLastWriteTime, &attr->mtime, &attr->mtimensec);
+    fs_filetime(info.ftLastWriteTime, &attr->ctime, &attr->ctimensec);
+
+    // Sem donos no host: tudo do root, legível por todos
+    if (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        attr->mode = FUSE_S_IFDIR | 0755;
+    } else {
+        attr->mode = FUSE_S_IFREG | 0755;
+    }
+    if (fs->read_only || (info.dwFileAttributes & FILE_ATTRIBUTE_READONLY)) {
+        attr->mode &= ~0222u;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Nodes
+// ---------------------------------------------------------------------------
+
+static uint32_t fs_bucket(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    return (uint32_t)key & (FS_NODE_BUCKETS - 1);
+}
+
+static fs_node_t* fs_node_get(virtio_fs_t* fs, uint64_t nodeid)
+{
+    if (nodeid == FUSE_ROOT_ID) {
+        return &fs->root_node;
+    }
+    for (fs_node_t* n = fs->by_id[fs_bucket(nodeid)]; n; n = n->next_id) {
+        if (n->nodeid == nodeid) {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+static fs_node_t* fs_node_by_file(virtio_fs_t* fs, uint64_t file_id)
+{
+    if (file_id == fs->root_node.file_id) {
+        return &fs->root_node;
+    }
+    for (fs_node_t* n = fs->by_file[fs_bucket(file_id)]; n; n = n->next_file) {
+        if (n->file_id == file_id) {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+static void fs_unlink_list(fs_node_t** head, fs_node_t* node, bool by_id)
+{
+    for (fs_node_t** p = head; *p; p = by_id ? &(*p)->next_id : &(*p)->next_file) {
+        if (*p == node) {
+            *p = by_id ? node->next_id : node->next_file;
+            return;
+        }
+    }
+}
+
+// Libera o node sem referências, e o pai se ele era o último filho
+static void fs_node_put(virtio_fs_t* fs, fs_node_t* node)
+{
+    while (node && node != &fs->root_node && node->nlookup == 0 && node->refs == 0) {
+        fs_node_t* parent = node->parent;
+
+        fs_unlink_list(&fs->by_id[fs_bucket(node->nodeid)], node, true);
+        fs_unlink_list(&fs->by_file[fs_bucket(node->file_id)], node, false);
+        free(node->name);
+        free(node);
+
+        parent->refs--;
+        node = parent;
+    }
+}
+
+static void fs_node_move(virtio_fs_t* fs, fs_node_t* node, fs_node_t* parent, char* name)
+{
+    fs_node_t* old = node->parent;
+
+    free(node->name);
+    node->name = name;
+    if (old != parent) {
+        parent->refs++;
+        node->parent = parent;
+        old->refs--;
+        fs_node_put(fs, old);
+    }
+}
+
+// Entrada encontrada em 'parent': node existente (mesmo arquivo) ou novo
+static fs_node_t* fs_node_add(virtio_fs_t* fs, fs_node_t* parent, const char* name, uint64_t file_id)
+{
+    fs_node_t* node = fs_node_by_file(fs, file_id);
+    if (node) {
+        node->nlookup++;
+        return node;
+    }
+
+    node = (fs_node_t*)calloc(1, sizeof(fs_node_t));
+    if (!node || !(node->name = _strdup(name))) {
+        free(node);
+        return NULL;
+    }
+    node->nodeid = fs->next_nodeid++;
+    node->file_id = file_id;
+    node->nlookup = 1;
+    node->parent = parent;
+    parent->refs++;
+
+    uint32_t b = fs_bucket(node->nodeid);
+    node->next_id = fs->by_id[b];
+    fs->by_id[b] = node;
+    b = fs_bucket(file_id);
+    node->next_file = fs->by_file[b];
+    fs->by_file[b] = node;
+    return node;
+}
+
+static int fs_entry(virtio_fs_t* fs, fs_node_t* parent, const char* name, HANDLE file, fuse_entry_out_t* out)
+{
+    memset(out, 0, sizeof(*out));
+    int err = fs_stat(fs, file, &out->attr);
+    if (err) {
+        return err;
+    }
+
+    fs_node_t* node = fs_node_add(fs, parent, name, out->attr.ino);
+    if (!node) {
+        return -FUSE_ENOMEM;
+    }
+    out->nodeid = node->nodeid;
+    out->entry_valid = FS_ATTR_VALID_S;
+    out->attr_valid = FS_ATTR_VALID_S;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Janela DAX
+// ---------------------------------------------------------------------------
+
+static uint64_t fs_dax_gpa(virtio_fs_t* fs, uint32_t granule)
+{
+    return fs->dev.shm[0].base + ((uint64_t)granule << FS_DAX_SHIFT);
+}
+
+static void fs_dax_unmap_view(virtio_fs_t* fs, uint32_t granule)
+{
+    fs_dax_map_t* map = &fs->dax[granule];
+
+    if (map->view) {
+        vm_unmap_gpa_view(fs_dax_gpa(fs, granule), (map->mapped + ARM64_PAGE_MASK) & ~(uint64_t)ARM64_PAGE_MASK);
+        UnmapViewOfFile(map->view);
+        map->view = NULL;
+        map->mapped = 0;
+    }
+}
+
+// Mapeia o trecho que o arquivo tem hoje; além do fim fica sem mapeamento
+static int fs_dax_map_view(virtio_fs_t* fs, uint32_t granule)
+{
+    fs_dax_map_t* map = &fs->dax[granule];
+    LARGE_INTEGER size;
+    int err = fs_path(fs, map->node, NULL, fs->path[1]);
+
+    if (err) {
+        return err;
+    }
+
+    HANDLE file = fs_open(fs->path[1], GENERIC_READ | (map->writable ? GENERIC_WRITE : 0), OPEN_EXISTING);
+    if (file == INVALID_HANDLE_VALUE) {
+        return fs_errno(GetLastError());
+    }
+    if (!GetFileSizeEx(file, &size)) {
+        err = fs_errno(GetLastError());
+        CloseHandle(file);
+        return err;
+    }
+    if ((uint64_t)size.QuadPart <= map->foffset) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    uint64_t len = (uint64_t)size.QuadPart - map->foffset < map->len ? (uint64_t)size.QuadPart - map->foffset
+                                                                       : map->len;
+    HANDLE section = CreateFileMappingW(file, NULL, map->writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!section) {
+        return fs_errno(GetLastError());
+    }
+
+    // A view mantém a seção viva
+    map->view = MapViewOfFile(section, map->writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                              (DWORD)(map->foffset >> 32), (DWORD)map->foffset, (SIZE_T)len);
+    err = map->view ? 0 : fs_errno(GetLastError());
+    CloseHandle(section);
+    if (err) {
+        return err;
+    }
+
+    // Última página parcial: a view cobre a página inteira (zeros após o fim)
+    uint64_t gpa_len = (len + ARM64_PAGE_MASK) & ~(uint64_t)ARM64_PAGE_MASK;
+    WHV_MAP_GPA_RANGE_FLAGS flags = WHvMapGpaRangeFlagRead | WHvMapGpaRangeFlagExecute |
+                                    (map->writable ? WHvMapGpaRangeFlagWrite : WHvMapGpaRangeFlagNone);
+    if (vm_map_gpa_view(map->view, fs_dax_gpa(fs, granule), gpa_len, flags) != 0) {
+        UnmapViewOfFile(map->view);
+        map->view = NULL;
+        return -FUSE_EIO;
+    }
+    map->mapped = len;
+    return 0;
+}
+
+static void fs_dax_remove(virtio_fs_t* fs, uint32_t granule)
+{
+    fs_dax_map_t* map = &fs->dax[granule];
+    uint32_t count = (uint32_t)(map->len >> FS_DAX_SHIFT);
+
+    fs_dax_unmap_view(fs, granule);
+    for (uint32_t g = granule; g < granule + count; g++) {
+        fs->dax_owner[g] = 0;
+    }
+
+    fs_node_t* node = map->node;
+    map->node = NULL;
+    node->dax_views--;
+    node->refs--;
+    fs_node_put(fs, node);
+}
+
+// Granulos [first, first + count): desfazer todo mapeamento que os toque
+static void fs_dax_clear(virtio_fs_t* fs, uint32_t first, uint32_t count)
+{
+    for (uint32_t g = first; g < first + count; g++) {
+        if (fs->dax_owner[g]) {
+            fs_dax_remove(fs, fs->dax_owner[g] - 1);
+        }
+    }
+}
+
+// Tamanho do arquivo mudou: views do node refeitas com o tamanho novo.
+// 'unmap_only' desfaz sem refazer (antes de truncar: o Windows não encolhe
+// arquivo com view aberta)
+static void fs_dax_refresh(virtio_fs_t* fs, fs_node_t* node, bool unmap_only)
+{
+    if (!node->dax_views) {
+        return;
+    }
+    for (uint32_t g = 0; g < fs->dax_granules; g++) {
+        if (fs->dax[g].node == node) {
+            fs_dax_unmap_view(fs, g);
+            if (!unmap_only) {
+                fs_dax_map_view(fs, g);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Handles
+// ---------------------------------------------------------------------------
+
+static int fs_handle_alloc(virtio_fs_t* fs, fs_node_t* node, HANDLE file, bool is_dir, uint64_t* fh)
+{
+    for (uint32_t i = 0; i < FS_MAX_HANDLES; i++) {
+        fs_handle_t* h = &fs->handles[i];
+        if (h->used) {
+            continue;
+        }
+
+        memset(h, 0, sizeof(*h));
+        if (is_dir && !(h->dir_buf = (uint8_t*)malloc(FS_DIR_BUF))) {
+            return -FUSE_ENOMEM;
+        }
+        h->used = true;
+        h->is_dir = is_dir;
+        h->file = file;
+        h->node = node;
+        h->dir_pos = UINT32_MAX;
+        node->refs++;
+        *fh = i;
+        return 0;
+    }
+    return -FUSE_ENOMEM;
+}
+
+static fs_handle_t* fs_handle_get(virtio_fs_t* fs, uint64_t fh, bool is_dir)
+{
+    if (fh >= FS_MAX_HANDLES || !fs->handles[fh].used || fs->handles[fh].is_dir != is_dir) {
+        return NULL;
+    }
+    return &fs->handles[fh];
+}
+
+static void fs_handle_free(virtio_fs_t* fs, fs_handle_t* h)
+{
+    fs_node_t* node = h->node;
+
+    CloseHandle(h->file);
+    free(h->dir_buf);
+    memset(h, 0, sizeof(*h));
+    node->refs--;
+    fs_node_put(fs, node);
+}
+
+// Sessão FUSE encerrada (DESTROY ou reset): o guest esqueceu tudo
+static void fs_drop_all(virtio_fs_t* fs)
+{
+    for (uint32_t g = 0; g < fs->dax_granules; g++) {
+        if (fs->dax[g].node) {
+            fs_dax_remove(fs, g);
+        }
+    }
+    for (uint32_t i = 0; i < FS_MAX_HANDLES; i++) {
+        if (fs->handles[i].used) {
+            fs_handle_free(fs, &fs->handles[i]);
+        }
+    }
+
+    // Folhas primeiro. Liberar um node pode liberar o pai, em qualquer
+    // bucket: a varredura recomeça a cada node
+    bool freed = true;
+    while (freed) {
+        freed = false;
+        for (uint32_t b = 0; b < FS_NODE_BUCKETS; b++) {
+            for (fs_node_t* n = fs->by_id[b]; n; n = n->next_id) {
+                if (n->refs == 0) {
+                    n->nlookup = 0;
+                    fs_node_put(fs, n);
+                    freed = true;
+                    break;
+                }
+            }
+        }
+    }
+    fs->minor = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Requests
+// ---------------------------------------------------------------------------
+
+// Nome terminado em '\0' nos argumentos, a partir de 'offset'
+static const char* fs_arg_name(virtio_fs_t* fs, uint32_t arg_len, uint32_t offset, uint32_t* next)
+{
+    const char* name = (const char*)fs->args + offset;
+    size_t max = arg_len > offset ? arg_len - offset : 0;
+    size_t len = strnlen(name, max);
+
+    if (len == max) {
+        return NULL;
+    }
+    if (next) {
+        *next = offset + (uint32_t)len + 1;
+    }
+    return name;
+}
+
+// Resposta de tamanho fixo: copiada para depois do fuse_out_header
+static int fs_reply_data(virtio_fs_t* fs, const void* data, uint32_t len)
+{
+    if (len > FS_READDIR_MAX) {
+        return -FUSE_EIO;
+    }
+    memcpy(fs->reply, data, len);
+    return (int)len;
+}
+
+static int fs_op_init(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_init_in_t* in = (const fuse_init_in_t*)fs->args;
+    fuse_init_out_t out;
+    (void)arg_len;
+
+    memset(&out, 0, sizeof(out));
+    out.major = FUSE_KERNEL_VERSION;
+    out.minor = FUSE_KERNEL_MINOR_VERSION;
+    if (in->major < FUSE_KERNEL_VERSION) {
+        return -FUSE_EPROTO;
+    }
+    if (in->major > FUSE_KERNEL_VERSION) {
+        // O guest refaz o INIT com a nossa versão
+        return fs_reply_data(fs, &out, 8);
+    }
+
+    fs_drop_all(fs);
+    fs->minor = in->minor < FUSE_KERNEL_MINOR_VERSION ? in->minor : FUSE_KERNEL_MINOR_VERSION;
+
+    out.max_readahead = in->max_readahead;
+    out.flags = in->flags & (FUSE_ASYNC_READ | FUSE_BIG_WRITES | FUSE_AUTO_INVAL_DATA | FUSE_MAX_PAGES |
+                             (fs->dax_granules ? FUSE_MAP_ALIGNMENT : 0));
+    out.max_background = 64;
+    out.congestion_threshold = 48;
+    out.max_write = FS_MAX_PAGES * 4096;
+    out.time_gran = 100;        // FILETIME
+    out.max_pages = FS_MAX_PAGES;
+    out.map_alignment = FS_DAX_SHIFT;
+
+    LOG_INFO("%s: sessão FUSE %u.%u (flags 0x%X)", fs->name, FUSE_KERNEL_VERSION, fs->minor, out.flags);
+    return fs_reply_data(fs, &out, fs->minor < 23 ? 24 : sizeof(out));
+}
+
+static int fs_op_destroy(virtio_fs_t* fs, uint32_t arg_len)
+{
+    (void)arg_len;
+
+    fs_drop_all(fs);
+    return 0;
+}
+
+static void fs_forget(virtio_fs_t* fs, uint64_t nodeid, uint64_t nlookup)
+{
+    fs_node_t* node = fs_node_get(fs, nodeid);
+
+    if (node && node != &fs->root_node) {
+        node->nlookup = nlookup < node->nlookup ? node->nlookup - nlookup : 0;
+        fs_node_put(fs, node);
+    }
+}
+
+static int fs_op_forget(virtio_fs_t* fs, uint32_t arg_len)
+{
+    (void)arg_len;
+
+    fs_forget(fs, fs->in.nodeid, ((const fuse_forget_in_t*)fs->args)->nlookup);
+    return 0;
+}
+
+static int fs_op_batch_forget(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_batch_forget_in_t* in = (const fuse_batch_forget_in_t*)fs->args;
+    size_t offset = sizeof(fuse_in_header_t) + sizeof(*in);
+    (void)arg_len;
+
+    // A lista pode passar de FS_ARG_MAX: lida direto da cadeia
+    for (uint32_t i = 0; i < in->count; i++) {
+        fuse_forget_one_t one;
+        if (virtq_iov_read(fs->elem.iov, fs->elem.out_num, offset, &one, sizeof(one)) != sizeof(one)) {
+            break;
+        }
+        fs_forget(fs, one.nodeid, one.nlookup);
+        offset += sizeof(one);
+    }
+    return 0;
+}
+
+static int fs_op_lookup(virtio_fs_t* fs, uint32_t arg_len)
+{
+    fs_node_t* parent = fs_node_get(fs, fs->in.nodeid);
+    const char* name = fs_arg_name(fs, arg_len, 0, NULL);
+    fuse_entry_out_t out;
+    int err;
+
+    if (!parent || !name) {
+        return parent ? -FUSE_EINVAL : -FUSE_ENOENT;
+    }
+    if ((err = fs_check_name(name)) != 0 || (err = fs_path(fs, parent, name, fs->path[0])) != 0) {
+        return err;
+    }
+
+    HANDLE file = fs_open(fs->path[0], FILE_READ_ATTRIBUTES, OPEN_EXISTING);
+    if (file == INVALID_HANDLE_VALUE) {
+        return fs_errno(GetLastError());
+    }
+    err = fs_entry(fs, parent, name, file, &out);
+    CloseHandle(file);
+    return err ? err : fs_reply_data(fs, &out, sizeof(out));
+}
+
+static int fs_attr_reply(virtio_fs_t* fs, HANDLE file)
+{
+    fuse_attr_out_t out;
+
+    memset(&out, 0, sizeof(out));
+    int err = fs_stat(fs, file, &out.attr);
+    out.attr_valid = FS_ATTR_VALID_S;
+    return err ? err : fs_reply_data(fs, &out, sizeof(out));
+}
+
+static int fs_op_getattr(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_getattr_in_t* in = (const fuse_getattr_in_t*)fs->args;
+    fs_node_t* node = fs_node_get(fs, fs->in.nodeid);
+    int err;
+    (void)arg_len;
+
+    if (!node) {
+        return -FUSE_ENOENT;
+    }
+    if (in->getattr_flags & FUSE_GETATTR_FH) {
+        fs_handle_t* h = fs_handle_get(fs, in->fh, false);
+        if (h) {
+            return fs_attr_reply(fs, h->file);
+        }
+    }
+
+    if ((err = fs_path(fs, node, NULL, fs->path[0])) != 0) {
+        return err;
+    }
+    HANDLE file = fs_open(fs->path[0], FILE_READ_ATTRIBUTES, OPEN_EXISTING);
+    if (file == INVALID_HANDLE_VALUE) {
+        return fs_errno(GetLastError());
+    }
+    err = fs_attr_reply(fs, file);
+    CloseHandle(file);
+    return err;
+}
+
+static int fs_op_setattr(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_setattr_in_t* in = (const fuse_setattr_in_t*)fs->args;
+    fs_node_t* node = fs_node_get(fs, fs->in.nodeid);
+    int err = 0;
+    (void)arg_len;
+
+    if (!node) {
+        return -FUSE_ENOENT;
+    }
+    if ((err = fs_path(fs, node, NULL, fs->path[0])) != 0) {
+        return err;
+    }
+
+    HANDLE file = fs_open(fs->path[0], FILE_READ_ATTRIBUTES | FILE_WRITE_ATTRIBUTES |
+                                       ((in->valid & FATTR_SIZE) ? GENERIC_WRITE : 0), OPEN_EXISTING);
+    if (file == INVALID_HANDLE_VALUE) {
+        return fs_errno(GetLastError());
+    }
+
+    if (in->valid & FATTR_SIZE) {
+        FILE_END_OF_FILE_INFO eof;
+        eof.EndOfFile.QuadPart = (LONGLONG)in->size;
+
+        fs_dax_refresh(fs, node, true);
+        if (!SetFileInformationByHandle(file, FileEndOfFileInfo, &eof, sizeof(eof))) {
+            err = fs_errno(GetLastError());
+        }
+        fs_dax_refresh(fs, node, false);
+    }
+
+    if (!err && (in->valid & (FATTR_ATIME | FATTR_MTIME))) {
+        FILETIME now, atime, mtime;
+        GetSystemTimeAsFileTime(&now);
+        atime = (in->valid & FATTR_ATIME_NOW) ? now : fs_unix_filetime(in->atime, in->atimensec);
+        mtime = (in->valid & FATTR_MTIME_NOW) ? now : fs_unix_filetime(in->mtime, in->mtimensec);
+        if (!SetFileTime(file, NULL, (in->valid & FATTR_ATIME) ? &atime : NULL,
+                         (in->valid & FATTR_MTIME) ? &mtime : NULL)) {
+            err = fs_errno(GetLastError());
+        }
+    }
+
+    // FATTR_MODE, uid e gid: sem equivalente no host, aceitos sem efeito
+    if (!err) {
+        err = fs_attr_reply(fs, file);
+    }
+    CloseHandle(file);
+    return err;
+}
+
+static DWORD fs_open_access(uint32_t flags)
+{
+    // Leitura sempre: SETUPMAPPING de um arquivo aberto só para escrita
+    switch (flags & FUSE_O_ACCMODE) {
+        case FUSE_O_RDONLY: return GENERIC_READ;
+        default:            return GENERIC_READ | GENERIC_WRITE;
+    }
+}
+
+static int fs_op_open(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_open_in_t* in = (const fuse_open_in_t*)fs->args;
+    fs_node_t* node = fs_node_get(fs, fs->in.nodeid);
+    fuse_open_out_t out;
+    int err;
+    (void)arg_len;
+
+    if (!node) {
+        return -FUSE_ENOENT;
+    }
+    if (fs->read_only && ((in->flags & FUSE_O_ACCMODE) != FUSE_O_RDONLY || (in->flags & FUSE_O_TRUNC))) {
+        return -FUSE_EROFS;
+    }
+    if ((err = fs_path(fs, node, NULL, fs->path[0])) != 0) {
+        return err;
+    }
+
+    bool truncate = (in->flags & FUSE_O_TRUNC) != 0;
+    if (truncate) {
+        fs_dax_refresh(fs, node, true);
+    }
+    HANDLE file = fs_open(fs->path[0], fs_open_access(in->flags), truncate ? TRUNCATE_EXISTING : OPEN_EXISTING);
+    if (truncate) {
+        fs_dax_refresh(fs, node, false);
+    }
+    if (file == INVALID_HANDLE_VALUE) {
+        return fs_errno(GetLastError());
+    }
+
+    memset(&out, 0, sizeof(out));
+    if ((err = fs_handle_alloc(fs, node, file, false, &out.fh)) != 0) {
+        CloseHandle(file);
+        return err;
+    }
+    return fs_reply_data(fs, &out, sizeof(out));
+}
+
+static int fs_op_create(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_create_in_t* in = (const fuse_create_in_t*)fs->args;
+    fs_node_t* parent = fs_node_get(fs, fs->in.nodeid);
+    const char* name = fs_arg_name(fs, arg_len, sizeof(*in), NULL);
+    struct {
+        fuse_entry_out_t entry;
+        fuse_open_out_t open;
+    } out;
+    DWORD disposition;
+    int err;
+
+    if (!parent || !name) {
+        return parent ? -FUSE_EINVAL : -FUSE_ENOENT;
+    }
+    if ((err = fs_check_name(name)) != 0 || (err = fs_path(fs, parent, name, fs->path[0])) != 0) {
+        return err;
+    }
+
+    if (in->flags & FUSE_O_EXCL) {
+        disposition = CREATE_NEW;
+    } else {
+        disposition = (in->flags & FUSE_O_TRUNC) ? CREATE_ALWAYS : OPEN_ALWAYS;
+    }
+    HANDLE file = fs_open(fs->path[0], fs_open_access(in->flags), disposition);
+    if (file == INVALID_HANDLE_VALUE) {
+        return fs_errno(GetLastError());
+    }
+
+    memset(&out, 0, sizeof(out));
+    if ((err = fs_entry(fs, parent, name, file, &out.entry)) != 0) {
+        CloseHandle(file);
+        return err;
+    }
+
+    fs_node_t* node = fs_node_get(fs, out.entry.nodeid);
+    if ((err = fs_handle_alloc(fs, node, file, false, &out.open.fh)) != 0) {
+        CloseHandle(file);
+        fs_forget(fs, node->nodeid, 1);
+        return err;
+    }
+    return fs_reply_data(fs, &out, sizeof(out));
+}
+
+static int fs_op_mkdir(virtio_fs_t* fs, uint32_t arg_len)
+{
+    fs_node_t* parent = fs_node_get(fs, fs->in.nodeid);
+    const char* name = fs_arg_name(fs, arg_len, sizeof(fuse_mkdir_in_t), NULL);
+    fuse_entry_out_t out;
+    int err;
+
+    if (!parent || !name) {
+        return parent ? -FUSE_EINVAL : -FUSE_ENOENT;
+    }
+    if ((err = fs_check_name(name)) != 0 || (err = fs_path(fs, parent, name, fs->path[0])) != 0) {
+        return err;
+    }
+    if (!CreateDirectoryW(fs->path[0], NULL)) {
+        return fs_errno(GetLastError());
+    }
+
+    HANDLE file = fs_open(fs->path[0], FILE_READ_ATTRIBUTES, OPEN_EXISTING);
+    if (file == INVALID_HANDLE_VALUE) {
+        return fs_errno(GetLastError());
+    }
+    err = fs_entry(fs, parent, name, file, &out);
+    CloseHandle(file);
+    return err ? err : fs_reply_data(fs, &out, sizeof(out));
+}
+
+// unlink/rmdir com semântica POSIX: o nome some já, mesmo com o arquivo
+// aberto (por handles do guest ou views DAX)
+static int fs_remove(virtio_fs_t* fs, uint32_t arg_len, bool is_dir)
+{
+    fs_node_t* parent = fs_node_get(fs, fs->in.nodeid);
+    const char* name = fs_arg_name(fs, arg_len, 0, NULL);
+    BY_HANDLE_FILE_INFORMATION info;
+    int err = 0;
+
+    if (!parent || !name) {
+        return parent ? -FUSE_EINVAL : -FUSE_ENOENT;
+    }
+    if ((err = fs_check_name(name)) != 0 || (err = fs_path(fs, parent, name, fs->path[0])) != 0) {
+        return err;
+    }
+
+    HANDLE file = fs_open(fs->path[0], DELETE | FILE_READ_ATTRIBUTES, OPEN_EXISTING);
+    if (file == INVALID_HANDLE_VALUE) {
+        return fs_errno(GetLastError());
+    }
+
+    if (!GetFileInformationByHandle(file, &info)) {
+        err = fs_errno(GetLastError());
+    } else if (is_dir != ((info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)) {
+        err = is_dir ? -FUSE_ENOTDIR : -FUSE_EISDIR;
+    } else {
+        FILE_DISPOSITION_INFO_EX posix = {
+            FILE_DISPOSITION_FLAG_DELETE | FILE_DISPOSITION_FLAG_POSIX_SEMANTICS |
+            FILE_DISPOSITION_FLAG_IGNORE_READONLY_ATTRIBUTE
+        };
+        FILE_DISPOSITION_INFO legacy = { TRUE };
+
+        // Sem POSIX (FAT, Windows antigo): apagado no último close
+        if (!SetFileInformationByHandle(file, FileDispositionInfoEx, &posix, sizeof(posix)) &&
+            !SetFileInformationByHandle(file, FileDispositionInfo, &legacy, sizeof(legacy))) {
+            err = fs_errno(GetLastError());
+        }
+    }
+    CloseHandle(file);
+    return err;
+}
+
+static int fs_op_unlink(virtio_fs_t* fs, uint32_t arg_len)
+{
+    return fs_remove(fs, arg_len, false);
+}
+
+static int fs_op_rmdir(virtio_fs_t* fs, uint32_t arg_len)
+{
+    return fs_remove(fs, arg_len, true);
+}
+
+static int fs_op_rename(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_rename_in_t* in = (const fuse_rename_in_t*)fs->args;
+    fs_node_t* parent = fs_node_get(fs, fs->in.nodeid);
+    fs_node_t* new_parent = fs_node_get(fs, in->newdir);
+    uint32_t next;
+    const char* name = fs_arg_name(fs, arg_len, sizeof(*in), &next);
+    const char* new_name = name ? fs_arg_name(fs, arg_len, next, NULL) : NULL;
+    BY_HANDLE_FILE_INFORMATION info;
+    int err;
+
+    if (!parent || !new_parent || !name || !new_name) {
+        return parent && new_parent ? -FUSE_EINVAL : -FUSE_ENOENT;
+    }
+    if ((err = fs_check_name(name)) != 0 || (err = fs_check_name(new_name)) != 0 ||
+        (err = fs_path(fs, parent, name, fs->path[0])) != 0 ||
+        (err = fs_path(fs, new_parent, new_name, fs->path[1])) != 0) {
+        return err;
+    }
+    if (!MoveFileExW(fs->path[0], fs->path[1], MOVEFILE_REPLACE_EXISTING)) {
+        return fs_errno(GetLastError());
+    }
+
+    // O node do arquivo (se o guest o conhece) passa a apontar o nome novo
+    HANDLE file = fs_open(fs->path[1], FILE_READ_ATTRIBUTES, OPEN_EXISTING);
+    if (file != INVALID_HANDLE_VALUE) {
+        if (GetFileInformationByHandle(file, &info)) {
+            fs_node_t* node = fs_node_by_file(fs, ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow);
+            char* copy = node ? _strdup(new_name) : NULL;
+            if (copy) {
+                fs_node_move(fs, node, new_parent, copy);
+            }
+        }
+        CloseHandle(file);
+    }
+    return 0;
+}
+
+static int fs_op_read(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_read_in_t* in = (const fuse_read_in_t*)fs->args;
+    fs_handle_t* h = fs_handle_get(fs, in->fh, false);
+    const virtq_iov_t* iov = &fs->elem.iov[fs->elem.out_num];
+    size_t skip = sizeof(fuse_out_header_t);
+    uint64_t offset = in->offset;
+    uint32_t left = in->size;
+    uint32_t total = 0;
+    (void)arg_len;
+
+    if (!h) {
+        return -FUSE_EBADF;
+    }
+
+    // Direto do arquivo para os buffers do guest, depois do cabeçalho
+    for (uint32_t i = 0; i < fs->elem.in_num && left; i++) {
+        if (skip >= iov[i].len) {
+            skip -= iov[i].len;
+            continue;
+        }
+
+        DWORD chunk = (DWORD)(iov[i].len - skip < left ? iov[i].len - skip : left);
+        DWORD got = 0;
+        OVERLAPPED ov;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+
+        if (!ReadFile(h->file, (uint8_t*)iov[i].addr + skip, chunk, &got, &ov)) {
+            DWORD error = GetLastError();
+            if (error != ERROR_HANDLE_EOF) {
+                if (!total) {
+                    return fs_errno(error);
+                }
+                break;
+            }
+        }
+        total += got;
+        offset += got;
+        left -= got;
+        skip = 0;
+        if (got < chunk) {
+            break;
+        }
+    }
+
+    fs->reply_direct = true;
+    return (int)total;
+}
+
+static int fs_op_write(virtio_fs_t* fs, uint32_t arg_len)
+{
+    (void)arg_len;
+
+    const fuse_write_in_t* in = (const fuse_write_in_t*)fs->args;
+    fs_handle_t* h = fs_handle_get(fs, in->fh, false);
+    const virtq_iov_t* iov = fs->elem.iov;
+    size_t skip = sizeof(fuse_in_header_t) + sizeof(*in);
+    uint64_t offset = in->offset;
+    uint32_t left = in->size;
+    fuse_write_out_t out;
+    LARGE_INTEGER size = { 0 };
+
+    if (!h) {
+        return -FUSE_EBADF;
+    }
+    if (in->size > FS_MAX_PAGES * 4096 || fs->in.len < skip + in->size) {
+        return -FUSE_EINVAL;
+    }
+    if (h->node->dax_views) {
+        GetFileSizeEx(h->file, &size);
+    }
+
+    memset(&out, 0, sizeof(out));
+    for (uint32_t i = 0; i < fs->elem.out_num && left; i++) {
+        if (skip >= iov[i].len) {
+            skip -= iov[i].len;
+            continue;
+        }
+
+        DWORD chunk = (DWORD)(iov[i].len - skip < left ? iov[i].len - skip : left);
+        DWORD put = 0;
+        OVERLAPPED ov;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+
+        if (!WriteFile(h->file, (const uint8_t*)iov[i].addr + skip, chunk, &put, &ov)) {
+            if (!out.size) {
+                return fs_errno(GetLastError());
+            }
+            break;
+        }
+        out.size += put;
+        offset += put;
+        left -= put;
+        skip = 0;
+    }
+
+    // Arquivo cresceu: views que acabavam no fim antigo passam a cobrir mais
+    if (h->node->dax_views && offset > (uint64_t)size.QuadPart) {
+        fs_dax_refresh(fs, h->node, false);
+    }
+    return fs_reply_data(fs, &out, sizeof(out));
+}
+
+static int fs_op_statfs(virtio_fs_t* fs, uint32_t arg_len)
+{
+    ULARGE_INTEGER avail, total, free_bytes;
+    fuse_kstatfs_t out;
+    (void)arg_len;
+
+    memset(&out, 0, sizeof(out));
+    if (!GetDiskFreeSpaceExW(fs->root, &avail, &total, &free_bytes)) {
+        return fs_errno(GetLastError());
+    }
+    out.bsize = 4096;
+    out.frsize = 4096;
+    out.blocks = total.QuadPart / 4096;
+    out.bfree = free_bytes.QuadPart / 4096;
+    out.bavail = avail.QuadPart / 4096;
+    out.files = UINT32_MAX;
+    out.ffree = UINT32_MAX;
+    out.namelen = 255;
+    return fs_reply_data(fs, &out, sizeof(out));
+}
+
+static int fs_op_release(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_release_in_t* in = (const fuse_release_in_t*)fs->args;
+    fs_handle_t* h = fs_handle_get(fs, in->fh, fs->in.opcode == FUSE_RELEASEDIR);
+    (void)arg_len;
+
+    if (!h) {
+        return -FUSE_EBADF;
+    }
+    fs_handle_free(fs, h);
+    return 0;
+}
+
+static int fs_op_flush(virtio_fs_t* fs, uint32_t arg_len)
+{
+    (void)fs;
+    (void)arg_len;
+
+    // Escritas já estão no arquivo; nada retido aqui
+    return 0;
+}
+
+static int fs_op_fsync(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_fsync_in_t* in = (const fuse_fsync_in_t*)fs->args;
+    fs_handle_t* h = fs_handle_get(fs, in->fh, fs->in.opcode == FUSE_FSYNCDIR);
+    (void)arg_len;
+
+    if (!h) {
+        return -FUSE_EBADF;
+    }
+    if (h->is_dir) {
+        return 0;
+    }
+
+    // Páginas escritas pelo guest na janela DAX vão junto
+    if (h->node->dax_views) {
+        for (uint32_t g = 0; g < fs->dax_granules; g++) {
+            if (fs->dax[g].node == h->node && fs->dax[g].view && fs->dax[g].writable) {
+                FlushViewOfFile(fs->dax[g].view, 0);
+            }
+        }
+    }
+    return FlushFileBuffers(h->file) ? 0 : fs_errno(GetLastError());
+}
+
+static int fs_op_opendir(virtio_fs_t* fs, uint32_t arg_len)
+{
+    fs_node_t* node = fs_node_get(fs, fs->in.nodeid);
+    fuse_open_out_t out;
+    int err;
+    (void)arg_len;
+
+    if (!node) {
+        return -FUSE_ENOENT;
+    }
+    if ((err = fs_path(fs, node, NULL, fs->path[0])) != 0) {
+        return err;
+    }
+
+    HANDLE file = fs_open(fs->path[0], FILE_LIST_DIRECTORY | FILE_READ_ATTRIBUTES, OPEN_EXISTING);
+    if (file == INVALID_HANDLE_VALUE) {
+        return fs_errno(GetLastError());
+    }
+
+    memset(&out, 0, sizeof(out));
+    if ((err = fs_handle_alloc(fs, node, file, true, &out.fh)) != 0) {
+        CloseHandle(file);
+        return err;
+    }
+    return fs_reply_data(fs, &out, sizeof(out));
+}
+
+// Próxima entrada do host (sem "." e ".."); NULL no fim
+static const FILE_ID_BOTH_DIR_INFO* fs_dir_next(fs_handle_t* h, bool restart)
+{
+    for (;;) {
+        if (h->dir_pos == UINT32_MAX) {
+            if (h->dir_eof && !restart) {
+                return NULL;
+            }
+            if (!GetFileInformationByHandleEx(h->file, restart ? FileIdBothDirectoryRestartInfo
+                                                               : FileIdBothDirectoryInfo,
+                                              h->dir_buf, FS_DIR_BUF)) {
+                h->dir_eof = true;
+                return NULL;
+            }
+            h->dir_eof = false;
+            h->dir_pos = 0;
+            restart = false;
+        }
+
+        const FILE_ID_BOTH_DIR_INFO* entry = (const FILE_ID_BOTH_DIR_INFO*)(h->dir_buf + h->dir_pos);
+        h->dir_pos = entry->NextEntryOffset ? h->dir_pos + entry->NextEntryOffset : UINT32_MAX;
+
+        bool dot = entry->FileNameLength == 2 && entry->FileName[0] == L'.';
+        bool dotdot = entry->FileNameLength == 4 && entry->FileName[0] == L'.' && entry->FileName[1] == L'.';
+        if (!dot && !dotdot) {
+            return entry;
+        }
+    }
+}
+
+static int fs_op_readdir(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_read_in_t* in = (const fuse_read_in_t*)fs->args;
+    fs_handle_t* h = fs_handle_get(fs, in->fh, true);
+    uint32_t limit = in->size < FS_READDIR_MAX ? in->size : FS_READDIR_MAX;
+    uint32_t used = 0;
+    (void)arg_len;
+
+    if (!h) {
+        return -FUSE_EBADF;
+    }
+
+    // Offsets são ordinais: 0 = ".", 1 = "..", depois as entradas do host.
+    // Fora de sequência (seekdir), a enumeração recomeça e pula até lá
+    if (in->offset != h->dir_index) {
+        h->dir_pos = UINT32_MAX;
+        h->dir_index = 0;
+        h->dir_eof = false;
+        if (in->offset > 2) {
+            fs_dir_next(h, true);
+            h->dir_index = 3;
+            while (h->dir_index < in->offset && fs_dir_next(h, false)) {
+                h->dir_index++;
+            }
+            if (h->dir_index < in->offset) {
+                return 0;
+            }
+        } else {
+            h->dir_index = in->offset;
+        }
+    }
+
+    for (;;) {
+        char name[FS_NAME_MAX + 1];
+        uint64_t ino;
+        uint32_t type = FUSE_DT_DIR;
+        int len;
+        uint32_t saved_pos = h->dir_pos;
+
+        if (h->dir_index < 2) {
+            const fs_node_t* n = h->dir_index == 0 || !h->node->parent ? h->node : h->node->parent;
+            ino = n->file_id;
+            len = (int)h->dir_index + 1;
+            memcpy(name, "..", (size_t)len);
+        } else {
+            const FILE_ID_BOTH_DIR_INFO* entry = fs_dir_next(h, h->dir_index == 2);
+            if (!entry) {
+                break;
+            }
+            len = WideCharToMultiByte(CP_UTF8, 0, entry->FileName, (int)(entry->FileNameLength / sizeof(WCHAR)),
+                                      name, FS_NAME_MAX, NULL, NULL);
+            if (len <= 0) {
+                h->dir_index++;     // Nome sem representação: omitido
+                continue;
+            }
+            ino = (uint64_t)entry->FileId.QuadPart;
+            type = (entry->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? FUSE_DT_DIR : FUSE_DT_REG;
+        }
+
+        size_t size = FUSE_DIRENT_SIZE((size_t)len);
+        if (used + size > limit) {
+            // Não coube: a entrada fica para o próximo READDIR
+            if (h->dir_index >= 2) {
+                h->dir_pos = saved_pos;
+                if (saved_pos == UINT32_MAX) {
+                    // Era a primeira do lote: recomeçar a partir do ordinal
+                    h->dir_index = UINT64_MAX;
+                }
+            }
+            break;
+        }
+
+        fuse_dirent_t* dirent = (fuse_dirent_t*)(fs->reply + used);
+        memset(dirent, 0, size);
+        dirent->ino = ino;
+        dirent->off = h->dir_index + 1;
+        dirent->namelen = (uint32_t)len;
+        dirent->type = type;
+        memcpy(dirent->name, name, (size_t)len);
+        used += (uint32_t)size;
+        h->dir_index++;
+    }
+    return (int)used;
+}
+
+static int fs_op_setupmapping(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_setupmapping_in_t* in = (const fuse_setupmapping_in_t*)fs->args;
+    fs_node_t* node = fs_node_get(fs, fs->in.nodeid);
+    uint64_t window = (uint64_t)fs->dax_granules << FS_DAX_SHIFT;
+    bool writable = (in->flags & FUSE_SETUPMAPPING_FLAG_WRITE) != 0;
+    (void)arg_len;
+
+    if (!node) {
+        return -FUSE_ENOENT;
+    }
+    if (!fs->dax_granules) {
+        return -FUSE_ENOSYS;
+    }
+    if (writable && fs->read_only) {
+        return -FUSE_EROFS;
+    }
+    if (((in->moffset | in->foffset | in->len) & (FS_DAX_ALIGN - 1)) || in->len == 0 ||
+        in->moffset >= window || in->len > window - in->moffset) {
+        return -FUSE_EINVAL;
+    }
+
+    uint32_t granule = (uint32_t)(in->moffset >> FS_DAX_SHIFT);
+    uint32_t count = (uint32_t)(in->len >> FS_DAX_SHIFT);
+    fs_dax_map_t* map = &fs->dax[granule];
+
+    // O guest reaproveita trechos da janela sem remover antes
+    fs_dax_clear(fs, granule, count);
+
+    map->node = node;
+    map->foffset = in->foffset;
+    map->len = in->len;
+    map->writable = writable;
+    node->refs++;
+    node->dax_views++;
+    for (uint32_t g = granule; g < granule + count; g++) {
+        fs->dax_owner[g] = granule + 1;
+    }
+
+    int err = fs_dax_map_view(fs, granule);
+    if (err) {
+        fs_dax_remove(fs, granule);
+        return err;
+    }
+    fs->dax_setups++;
+    return 0;
+}
+
+static int fs_op_removemapping(virtio_fs_t* fs, uint32_t arg_len)
+{
+    const fuse_removemapping_in_t* in = (const fuse_removemapping_in_t*)fs->args;
+    size_t offset = sizeof(fuse_in_header_t) + sizeof(*in);
+    uint64_t window = (uint64_t)fs->dax_granules << FS_DAX_SHIFT;
+    (void)arg_len;
+
+    for (uint32_t i = 0; i < in->count; i++) {
+        fuse_removemapping_one_t one;
+        if (virtq_iov_read(fs->elem.iov, fs->elem.out_num, offset, &one, sizeof(one)) != sizeof(one)) {
+            return -FUSE_EINVAL;
+        }
+        offset += sizeof(one);
+
+        if (one.moffset >= window || one.len > window - one.moffset) {
+            return -FUSE_EINVAL;
+        }
+        uint64_t end = (one.moffset + one.len + FS_DAX_ALIGN - 1) >> FS_DAX_SHIFT;
+        uint32_t first = (uint32_t)(one.moffset >> FS_DAX_SHIFT);
+        fs_dax_clear(fs, first, (uint32_t)end - first);
+    }
+    return 0;
+}
+
+static const fs_op_t g_fs_ops[] = {
+    [FUSE_LOOKUP]        = { 0, fs_op_lookup, false },
+    [FUSE_FORGET]        = { sizeof(fuse_forget_in_t), fs_op_forget, false },
+    [FUSE_GETATTR]       = { sizeof(fuse_getattr_in_t), fs_op_getattr, false },
+    [FUSE_SETATTR]       = { sizeof(fuse_setattr_in_t), fs_op_setattr, true },
+    [FUSE_MKDIR]         = { sizeof(fuse_mkdir_in_t), fs_op_mkdir, true },
+    [FUSE_UNLINK]        = { 0, fs_op_unlink, true },
+    [FUSE_RMDIR]         = { 0, fs_op_rmdir, true },
+    [FUSE_RENAME]        = { sizeof(fuse_rename_in_t), fs_op_rename, true },
+    [FUSE_OPEN]          = { sizeof(fuse_open_in_t), fs_op_open, false },
+    [FUSE_READ]          = { sizeof(fuse_read_in_t), fs_op_read, false },
+    [FUSE_WRITE]         = { sizeof(fuse_write_in_t), fs_op_write, true },
+    [FUSE_STATFS]        = { 0, fs_op_statfs, false },
+    [FUSE_RELEASE]       = { sizeof(fuse_release_in_t), fs_op_release, false },
+    [FUSE_FSYNC]         = { sizeof(fuse_fsync_in_t), fs_op_fsync, false },
+    [FUSE_FLUSH]         = { 0, fs_op_flush, false },
+    [FUSE_INIT]          = { sizeof(fuse_init_in_t), fs_op_init, false },
+    [FUSE_OPENDIR]       = { sizeof(fuse_open_in_t), fs_op_opendir, false },
+    [FUSE_READDIR]       = { sizeof(fuse_read_in_t), fs_op_readdir, false },
+    [FUSE_RELEASEDIR]    = { sizeof(fuse_release_in_t), fs_op_release, false },
+    [FUSE_FSYNCDIR]      = { sizeof(fuse_fsync_in_t), fs_op_fsync, false },
+    [FUSE_CREATE]        = { sizeof(fuse_create_in_t), fs_op_create, true },
+    [FUSE_DESTROY]       = { 0, fs_op_destroy, false },
+    [FUSE_BATCH_FORGET]  = { sizeof(fuse_batch_forget_in_t), fs_op_batch_forget, false },
+    [FUSE_SETUPMAPPING]  = { sizeof(fuse_setupmapping_in_t), fs_op_setupmapping, false },
+    [FUSE_REMOVEMAPPING] = { sizeof(fuse_removemapping_in_t), fs_op_removemapping, false },
+};
+
+// Uma cadeia: executa e escreve a resposta; retorna o len para o used ring
+static uint32_t fs_process_request(virtio_fs_t* fs)
+{
+    virtq_elem_t* elem = &fs->elem;
+    size_t out_len = 0;
+    uint32_t arg_len;
+    int result;
+
+    for (uint32_t i = 0; i < elem->out_num; i++) {
+        out_len += elem->iov[i].len;
+    }
+    if (virtq_iov_read(elem->iov, elem->out_num, 0, &fs->in, sizeof(fs->in)) != sizeof(fs->in) ||
+        fs->in.len < sizeof(fs->in) || fs->in.len > out_len) {
+        return 0;
+    }
+
+    // WRITE: só os argumentos fixos; o payload é lido direto da cadeia
+    uint32_t opcode = fs->in.opcode;
+    arg_len = fs->in.len - (uint32_t)sizeof(fs->in);
+    if (opcode == FUSE_WRITE && arg_len > sizeof(fuse_write_in_t)) {
+        arg_len = sizeof(fuse_write_in_t);
+    }
+    if (arg_len > FS_ARG_MAX) {
+        arg_len = FS_ARG_MAX;
+    }
+    virtq_iov_read(elem->iov, elem->out_num, sizeof(fs->in), fs->args, arg_len);
+    fs->args[arg_len] = '\0';
+    fs->reply_direct = false;
+    fs->requests++;
+
+    const fs_op_t* op = opcode < sizeof(g_fs_ops) / sizeof(g_fs_ops[0]) ? &g_fs_ops[opcode] : NULL;
+    if (!op || !op->handler) {
+        LOG_DEBUG("%s: opcode FUSE %u não suportado", fs->name, opcode);
+        result = -FUSE_ENOSYS;
+    } else if (arg_len < op->in_size) {
+        result = -FUSE_EINVAL;
+    } else if (opcode != FUSE_INIT && !fs->minor) {
+        result = -FUSE_EIO;         // Antes do INIT
+    } else if (op->writes && fs->read_only) {
+        result = -FUSE_EROFS;
+    } else {
+        result = op->handler(fs, arg_len);
+    }
+
+    // FORGET e BATCH_FORGET não têm resposta
+    if (opcode == FUSE_FORGET || opcode == FUSE_BATCH_FORGET) {
+        return 0;
+    }
+
+    fuse_out_header_t out = { sizeof(out), 0, fs->in.unique };
+    const virtq_iov_t* in_iov = &elem->iov[elem->out_num];
+    size_t room = 0;
+    for (uint32_t i = 0; i < elem->in_num; i++) {
+        room += in_iov[i].len;
+    }
+
+    if (result < 0) {
+        out.error = result;
+    } else if (fs->reply_direct) {
+        out.len += (uint32_t)result;
+    } else if (sizeof(out) + (size_t)result > room) {
+        out.error = -FUSE_EIO;
+    } else {
+        out.len += (uint32_t)result;
+        virtq_iov_write(in_iov, elem->in_num, sizeof(out), fs->reply, (size_t)result);
+    }
+
+    if (virtq_iov_write(in_iov, elem->in_num, 0, &out, sizeof(out)) != sizeof(out)) {
+        return 0;
+    }
+    return out.len;
+}
+
+// ---------------------------------------------------------------------------
+// Filas
+// ---------------------------------------------------------------------------
+
+static bool fs_process_queue(virtio_fs_t* fs, uint32_t queue)
+{
+    virtqueue_t* vq = &fs->dev.queues[queue];
+    bool pushed = false;
+    int popped;
+
+    if (!vq->ready) {
+        return false;
+    }
+
+    do {
+        virtq_disable_notify(&fs->dev, vq);
+
+        while ((popped = virtq_pop(&fs->dev, vq, &fs->elem)) > 0) {
+            virtq_push(vq, fs->elem.head, fs_process_request(fs));
+            pushed = true;
+        }
+
+        if (popped < 0) {
+            fs->dev.status |= VIRTIO_STATUS_NEEDS_RESET;
+            vq->ready = 0;
+            break;
+        }
+    } while (virtq_enable_notify(&fs->dev, vq));
+
+    return pushed && virtq_should_notify(&fs->dev, vq);
+}
+
+static DWORD WINAPI fs_io_thread(LPVOID param)
+{
+    virtio_fs_t* fs = (virtio_fs_t*)param;
+
+    for (;;) {
+        WaitForSingleObject(fs->kick, INFINITE);
+        if (fs->stop) {
+            break;
+        }
+
+        bool raise = false;
+
+        EnterCriticalSection(&fs->lock);
+        if (fs->dev.status & VIRTIO_STATUS_DRIVER_OK) {
+            // FORGET primeiro: libera nodes antes de requests que criam outros
+            raise |= fs_process_queue(fs, FS_QUEUE_HIPRIO);
+            raise |= fs_process_queue(fs, FS_QUEUE_REQUEST);
+        }
+        LeaveCriticalSection(&fs->lock);
+
+        // Fora do lock do device: a SPI toma g_device_lock
+        if (raise) {
+            virtio_raise_irq(&fs->dev, VIRTIO_INT_USED_RING);
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Hooks do transporte
+// ---------------------------------------------------------------------------
+
+static void virtio_fs_notify(virtio_dev_t* dev, uint32_t queue)
+{
+    (void)queue;
+    SetEvent(((virtio_fs_t*)dev)->kick);
+}
+
+static void virtio_fs_reset(virtio_dev_t* dev)
+{
+    virtio_fs_t* fs = (virtio_fs_t*)dev;
+
+    // Espera o request em andamento; a sessão FUSE morre com o driver
+    EnterCriticalSection(&fs->lock);
+    fs_drop_all(fs);
+    virtio_queues_reset(dev);
+    LeaveCriticalSection(&fs->lock);
+}
+
+static void virtio_fs_destroy(virtio_dev_t* dev)
+{
+    virtio_fs_t* fs = (virtio_fs_t*)dev;
+
+    if (fs->thread) {
+        fs->stop = true;
+        SetEvent(fs->kick);
+        WaitForSingleObject(fs->thread, INFINITE);
+        CloseHandle(fs->thread);
+        DeleteCriticalSection(&fs->lock);
+        LOG_DEBUG("%s: %llu requests, %llu mapeamentos DAX", fs->name, fs->requests, fs->dax_setups);
+    }
+    fs_drop_all(fs);
+    if (fs->kick) {
+        CloseHandle(fs->kick);
+    }
+    free(fs->dax);
+    free(fs->dax_owner);
+    free(fs->reply);
+    free(fs->root);
+    free(fs);
+}
+
+static const virtio_dev_ops_t virtio_fs_ops = {
+    .notify = virtio_fs_notify,
+    .reset = virtio_fs_reset,
+    .destroy = virtio_fs_destroy,
+};
+
+// Diretório exportado: caminho absoluto com prefixo "\\?\" (sem MAX_PATH)
+static int fs_open_root(virtio_fs_t* fs, const char* dir)
+{
+    WCHAR wide[FS_PATH_MAX];
+    WCHAR full[FS_PATH_MAX];
+    fuse_attr_t attr;
+
+    if (MultiByteToWideChar(CP_UTF8, 0, dir, -1, wide, FS_PATH_MAX) <= 0) {
+        return -1;
+    }
+    DWORD len = GetFullPathNameW(wide, FS_PATH_MAX - 8, full, NULL);
+    if (len == 0 || len >= FS_PATH_MAX - 8) {
+        return -1;
+    }
+    while (len > 0 && full[len - 1] == L'\\') {
+        full[--len] = L'\0';
+    }
+
+    bool prefixed = wcsncmp(full, L"\\\\?\\", 4) == 0;
+    fs->root = (WCHAR*)malloc((len + 5) * sizeof(WCHAR));
+    if (!fs->root) {
+        return -1;
+    }
+    swprintf(fs->root, len + 5, L"%ls%ls", prefixed ? L"" : L"\\\\?\\", full);
+    fs->root_len = wcslen(fs->root);
+
+    HANDLE file = fs_open(fs->root, FILE_READ_ATTRIBUTES, OPEN_EXISTING);
+    if (file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    int err = fs_stat(fs, file, &attr);
+    CloseHandle(file);
+    if (err || !(attr.mode & FUSE_S_IFDIR)) {
+        return -1;
+    }
+
+    fs->root_node.nodeid = FUSE_ROOT_ID;
+    fs->root_node.file_id = attr.ino;
+    fs->root_node.name = "";
+    fs->next_nodeid = FUSE_ROOT_ID + 1;
+    return 0;
+}
+
+int virtio_fs_create(const char* spec)
+{
+    char dir[MAX_PATH];
+    char tag[VIRTIO_FS_TAG_MAX + 1];
+    bool read_only = false;
+    uint64_t dax_mb = FS_DAX_DEFAULT_MB;
+    const char* comma = strchr(spec, ',');
+    size_t dir_len = comma ? (size_t)(comma - spec) : strlen(spec);
+
+    if (dir_len == 0 || dir_len >= sizeof(dir)) {
+        LOG_ERROR("virtio-fs: diretório inválido em '%s'", spec);
+        return -1;
+    }
+    memcpy(dir, spec, dir_len);
+    dir[dir_len] = '\0';
+    snprintf(tag, sizeof(tag), "hostfs%u", g_fs_count);
+
+    // Opções: tag=<nome>, ro, dax=<MB>
+    for (const char* opt = comma; opt; opt = strchr(opt, ',')) {
+        opt++;
+        size_t len = strcspn(opt, ",");
+        if (len > 4 && strncmp(opt, "tag=", 4) == 0 && len - 4 < sizeof(tag)) {
+            memcpy(tag, opt + 4, len - 4);
+            tag[len - 4] = '\0';
+        } else if (len == 2 && strncmp(opt, "ro", 2) == 0) {
+            read_only = true;
+        } else if (len > 4 && strncmp(opt, "dax=", 4) == 0) {
+            dax_mb = strtoull(opt + 4, NULL, 0);
+        } else {
+            LOG_ERROR("virtio-fs: opção inválida '%.*s'", (int)len, opt);
+            return -1;
+        }
+    }
+
+    // A janela fica em granulos de 2MB (alinhamento das regiões)
+    uint64_t window = dax_mb << 20;
+    if ((window & (VIRTIO_SHM_ALIGN - 1)) || dax_mb > 64 * 1024) {
+        LOG_ERROR("virtio-fs: janela DAX deve ser múltiplo de 2MB e até 64GB (%llu MB)", dax_mb);
+        return -1;
+    }
+
+    virtio_fs_t* fs = (virtio_fs_t*)calloc(1, sizeof(virtio_fs_t));
+    if (!fs) {
+        return -1;
+    }
+    snprintf(fs->name, sizeof(fs->name), "virtio-fs%u", g_fs_count);
+    memcpy(fs->config.tag, tag, strlen(tag));    // Sem terminador se ocupar os 36 bytes
+    fs->config.num_request_queues = 1;
+    fs->read_only = read_only;
+
+    fs->reply = (uint8_t*)malloc(FS_READDIR_MAX);
+    fs->kick = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (!fs->reply || !fs->kick) {
+        virtio_fs_destroy(&fs->dev);
+        return -1;
+    }
+    if (fs_open_root(fs, dir) != 0) {
+        LOG_ERROR("%s: %s não é um diretório acessível", fs->name, dir);
+        virtio_fs_destroy(&fs->dev);
+        return -1;
+    }
+
+    if (window) {
+        fs->dax_granules = (uint32_t)(window >> FS_DAX_SHIFT);
+        fs->dax = (fs_dax_map_t*)calloc(fs->dax_granules, sizeof(fs_dax_map_t));
+        fs->dax_owner = (uint32_t*)calloc(fs->dax_granules, sizeof(uint32_t));
+        if (!fs->dax || !fs->dax_owner) {
+            virtio_fs_destroy(&fs->dev);
+            return -1;
+        }
+        fs->dev.shm[0].id = VIRTIO_FS_SHMCAP_CACHE;
+        fs->dev.shm[0].size = window;
+        fs->dev.num_shm = 1;
+    }
+
+    fs->dev.name = fs->name;
+    fs->dev.device_id = VIRTIO_ID_FS;
+    fs->dev.host_features = VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_RING_F_EVENT_IDX;
+    fs->dev.ops = &virtio_fs_ops;
+    fs->dev.config = &fs->config;
+    fs->dev.config_size = sizeof(fs->config);
+    fs->dev.num_queues = 2;
+
+    InitializeCriticalSection(&fs->lock);
+    fs->thread = CreateThread(NULL, 0, fs_io_thread, fs, 0, NULL);
+    if (!fs->thread) {
+        DeleteCriticalSection(&fs->lock);
+        virtio_fs_destroy(&fs->dev);
+        return -1;
+    }
+
+    if (virtio_mmio_register(&fs->dev) != 0) {
+        virtio_fs_destroy(&fs->dev);
+        return -1;
+    }
+
+    g_fs_count++;
+    LOG_INFO("%s: %s como tag '%s'%s, janela DAX de %llu MB", fs->name, dir, tag,
+             read_only ? " (somente leitura)" : "", dax_mb);
+    return 0;
+}
@@ -0,0 +1,432 @@
+/* Desenvolvido por: Escanearcpl */
+#include "virtio.h"
+#include "vm.h"
+
+// Devices registrados por slot (NULL = slot livre)
+static virtio_dev_t* g_virtio_devs[VIRTIO_MMIO_SLOTS];
+static uint32_t g_virtio_count;
+
+// Próximo GPA livre para memória de devices (0 = nenhuma reserva ainda)
+static uint64_t g_virtio_gpa_next;
+
+bool virtio_has_feature(const virtio_dev_t* dev, uint64_t feature)
+{
+    return (dev->driver_features & feature) != 0;
+}
+
+static inline virtqueue_t* virtio_selected_queue(virtio_dev_t* dev)
+{
+    return dev->queue_sel < dev->num_queues ? &dev->queues[dev->queue_sel] : NULL;
+}
+
+// Features de 64 bits expostas em janelas de 32 bits (FeaturesSel)
+static uint64_t virtio_device_features_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    virtio_dev_t* dev = (virtio_dev_t*)state;
+    (void)reg; (void)index;
+    return dev->device_features_sel < 2 ? (dev->host_features >> (dev->device_features_sel * 32)) & 0xFFFFFFFF : 0;
+}
+
+static void virtio_driver_features_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    virtio_dev_t* dev = (virtio_dev_t*)state;
+    (void)reg; (void)index;
+
+    // Negociação encerrada em FEATURES_OK
+    if (dev->driver_features_sel >= 2 || (dev->status & VIRTIO_STATUS_FEATURES_OK)) {
+        return;
+    }
+
+    uint32_t shift = dev->driver_features_sel * 32;
+    dev->driver_features = (dev->driver_features & ~(0xFFFFFFFFULL << shift)) | ((value & 0xFFFFFFFF) << shift);
+}
+
+static uint64_t virtio_queue_num_max_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)reg; (void)index;
+    return virtio_selected_queue((virtio_dev_t*)state) ? VIRTQ_MAX_SIZE : 0;
+}
+
+static void virtio_queue_num_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    virtqueue_t* vq = virtio_selected_queue((virtio_dev_t*)state);
+    (void)reg; (void)index;
+
+    if (vq && !vq->ready) {
+        vq->num = (uint32_t)value;
+    }
+}
+
+// Traduz os três anéis e liga a fila; falha deixa QueueReady em 0
+static bool virtio_queue_enable(virtio_dev_t* dev, virtqueue_t* vq)
+{
+    uint32_t num = vq->num;
+
+    if (num == 0 || num > VIRTQ_MAX_SIZE || (num & (num - 1))) {
+        LOG_ERROR("%s: tamanho de fila inválido (%u)", dev->name, num);
+        return false;
+    }
+
+    // +2 bytes em avail/used para used_event/avail_event (EVENT_IDX)
+    vq->desc = (virtq_desc_t*)vm_gpa_to_hva(vq->desc_gpa, sizeof(virtq_desc_t) * num);
+    vq->avail = (virtq_avail_t*)vm_gpa_to_hva(vq->driver_gpa, sizeof(virtq_avail_t) + sizeof(uint16_t) * (num + 1));
+    vq->used = (virtq_used_t*)vm_gpa_to_hva(vq->device_gpa, sizeof(virtq_used_t) + sizeof(virtq_used_elem_t) * num + sizeof(uint16_t));
+
+    if (!vq->desc || !vq->avail || !vq->used ||
+        (vq->desc_gpa & 15) || (vq->driver_gpa & 1) || (vq->device_gpa & 3)) {
+        LOG_ERROR("%s: anéis fora da RAM ou desalinhados (desc=0x%llX avail=0x%llX used=0x%llX)",
+                  dev->name, vq->desc_gpa, vq->driver_gpa, vq->device_gpa);
+        return false;
+    }
+
+    vq->last_avail = 0;
+    vq->used_idx = 0;
+    vq->signalled_valid = false;
+
+    // Anéis visíveis antes de ready para a thread do device
+    MemoryBarrier();
+    return true;
+}
+
+static uint64_t virtio_queue_ready_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    virtqueue_t* vq = virtio_selected_queue((virtio_dev_t*)state);
+    (void)reg; (void)index;
+    return vq ? vq->ready : 0;
+}
+
+static void virtio_queue_ready_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    virtio_dev_t* dev = (virtio_dev_t*)state;
+    virtqueue_t* vq = virtio_selected_queue(dev);
+    (void)reg; (void)index;
+
+    if (!vq) {
+        return;
+    }
+
+    if (!(value & 1)) {
+        vq->ready = 0;
+    } else if (!vq->ready && virtio_queue_enable(dev, vq)) {
+        vq->ready = 1;
+    }
+}
+
+// Endereços de 64 bits como pares low/high (index 0 = low, 1 = high)
+static void virtio_queue_addr_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    virtqueue_t* vq = virtio_selected_queue((virtio_dev_t*)state);
+    uint64_t* gpa;
+
+    if (!vq || vq->ready) {
+        return;
+    }
+
+    switch (reg->offset) {
+        case VIRTIO_MMIO_QUEUE_DESC_LOW:    gpa = &vq->desc_gpa; break;
+        case VIRTIO_MMIO_QUEUE_DRIVER_LOW:  gpa = &vq->driver_gpa; break;
+        default:                            gpa = &vq->device_gpa; break;
+    }
+
+    uint64_t mask = 0xFFFFFFFFULL << (index * 32);
+    *gpa = (*gpa & ~mask) | ((value & 0xFFFFFFFF) << (index * 32));
+}
+
+static void virtio_queue_notify_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    virtio_dev_t* dev = (virtio_dev_t*)state;
+    uint32_t queue = (uint32_t)(value & 0xFFFF);
+    (void)reg; (void)index;
+
+    if (queue < dev->num_queues && (dev->status & VIRTIO_STATUS_DRIVER_OK)) {
+        dev->ops->notify(dev, queue);
+    }
+}
+
+static uint64_t virtio_isr_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)reg; (void)index;
+    return (uint32_t)((virtio_dev_t*)state)->isr;
+}
+
+static void virtio_isr_ack_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    virtio_dev_t* dev = (virtio_dev_t*)state;
+    (void)reg; (void)index;
+
+    if ((InterlockedAnd(&dev->isr, ~(LONG)value) & ~(LONG)value) == 0) {
+        gic_set_interrupt(dev->irq, false);
+
+        // Uma causa levantada entre o AND e a descida da linha não se perde
+        if (dev->isr) {
+            gic_set_interrupt(dev->irq, true);
+        }
+    }
+}
+
+void virtio_queues_reset(virtio_dev_t* dev)
+{
+    memset(dev->queues, 0, sizeof(dev->queues));
+}
+
+static void virtio_dev_reset(virtio_dev_t* dev)
+{
+    dev->ops->reset(dev);
+
+    dev->status = 0;
+    dev->driver_features = 0;
+    dev->device_features_sel = 0;
+    dev->driver_features_sel = 0;
+    dev->queue_sel = 0;
+    InterlockedExchange(&dev->isr, 0);
+    gic_set_interrupt(dev->irq, false);
+}
+
+static uint64_t virtio_status_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    virtio_dev_t* dev = (virtio_dev_t*)state;
+    (void)reg; (void)index;
+
+    // Reset ainda drenando: qualquer valor diferente de 0 segura o driver
+    if (dev->status == 0 && dev->ops->reset_busy && dev->ops->reset_busy(dev)) {
+        return VIRTIO_STATUS_NEEDS_RESET;
+    }
+    return dev->status;
+}
+
+static void virtio_status_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    virtio_dev_t* dev = (virtio_dev_t*)state;
+    uint32_t status = (uint32_t)value & 0xFF;
+    (void)reg; (void)index;
+
+    if (status == 0) {
+        virtio_dev_reset(dev);
+        return;
+    }
+
+    // FEATURES_OK só é aceito para um subconjunto do oferecido com VERSION_1;
+    // o driver relê Status e desiste se o bit não ficou
+    if ((status & VIRTIO_STATUS_FEATURES_OK) && !(dev->status & VIRTIO_STATUS_FEATURES_OK) &&
+        ((dev->driver_features & ~dev->host_features) || !(dev->driver_features & VIRTIO_F_VERSION_1))) {
+        LOG_ERROR("%s: features recusadas 0x%llX (oferecidas 0x%llX)",
+                  dev->name, dev->driver_features, dev->host_features);
+        status &= ~VIRTIO_STATUS_FEATURES_OK;
+    }
+
+    bool starting = (status & VIRTIO_STATUS_DRIVER_OK) && !(dev->status & VIRTIO_STATUS_DRIVER_OK);
+    dev->status = status | (dev->status & VIRTIO_STATUS_NEEDS_RESET);
+
+    if (starting) {
+        LOG_INFO("%s: driver ativo (features 0x%llX)", dev->name, dev->driver_features);
+        if (dev->ops->start) {
+            dev->ops->start(dev);
+        }
+    }
+}
+
+// Região selecionada por SHMSel; inexistente lê como ~0 (len e base)
+static uint64_t virtio_shm_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    virtio_dev_t* dev = (virtio_dev_t*)state;
+
+    for (uint32_t i = 0; i < dev->num_shm; i++) {
+        if (dev->shm[i].id == dev->shm_sel) {
+            uint64_t value = reg->offset == VIRTIO_MMIO_SHM_LEN_LOW ? dev->shm[i].size : dev->shm[i].base;
+            return (value >> (index * 32)) & 0xFFFFFFFF;
+        }
+    }
+    return 0xFFFFFFFF;
+}
+
+static uint64_t virtio_config_generation_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)reg; (void)index;
+    return (uint32_t)((virtio_dev_t*)state)->config_generation;
+}
+
+static const regmap_reg_t virtio_mmio_regs[] = {
+    REGMAP_REG("MagicValue", VIRTIO_MMIO_MAGIC_VALUE, REGMAP_RO, REGMAP_NO_FIELD, 0, VIRTIO_MMIO_MAGIC),
+    REGMAP_REG("Version", VIRTIO_MMIO_VERSION, REGMAP_RO, REGMAP_NO_FIELD, 0, VIRTIO_MMIO_VERSION_MODERN),
+    REGMAP_REG("DeviceID", VIRTIO_MMIO_DEVICE_ID, REGMAP_RO, offsetof(virtio_dev_t, device_id), 0, 0),
+    REGMAP_REG("VendorID", VIRTIO_MMIO_VENDOR_ID, REGMAP_RO, REGMAP_NO_FIELD, 0, VIRTIO_MMIO_VENDOR),
+    REGMAP_HOOK("DeviceFeatures", VIRTIO_MMIO_DEVICE_FEATURES, 1, REGMAP_RO, 0, virtio_device_features_read, NULL),
+    REGMAP_REG("DeviceFeaturesSel", VIRTIO_MMIO_DEVICE_FEATURES_SEL, REGMAP_WO,
+               offsetof(virtio_dev_t, device_features_sel), 0xFFFFFFFF, 0),
+    REGMAP_HOOK("DriverFeatures", VIRTIO_MMIO_DRIVER_FEATURES, 1, REGMAP_WO, 0, NULL, virtio_driver_features_write),
+    REGMAP_REG("DriverFeaturesSel", VIRTIO_MMIO_DRIVER_FEATURES_SEL, REGMAP_WO,
+               offsetof(virtio_dev_t, driver_features_sel), 0xFFFFFFFF, 0),
+    REGMAP_REG("QueueSel", VIRTIO_MMIO_QUEUE_SEL, REGMAP_WO, offsetof(virtio_dev_t, queue_sel), 0xFFFFFFFF, 0),
+    REGMAP_HOOK("QueueNumMax", VIRTIO_MMIO_QUEUE_NUM_MAX, 1, REGMAP_RO, 0, virtio_queue_num_max_read, NULL),
+    REGMAP_HOOK("QueueNum", VIRTIO_MMIO_QUEUE_NUM, 1, REGMAP_WO, 0, NULL, virtio_queue_num_write),
+    REGMAP_HOOK("QueueReady", VIRTIO_MMIO_QUEUE_READY, 1, REGMAP_RW, 0, virtio_queue_ready_read, virtio_queue_ready_write),
+    REGMAP_HOOK("QueueNotify", VIRTIO_MMIO_QUEUE_NOTIFY, 1, REGMAP_WO, 0, NULL, virtio_queue_notify_write),
+    REGMAP_HOOK("InterruptStatus", VIRTIO_MMIO_INTERRUPT_STATUS, 1, REGMAP_RO, REGMAP_F_VOLATILE, virtio_isr_read, NULL),
+    REGMAP_HOOK("InterruptACK", VIRTIO_MMIO_INTERRUPT_ACK, 1, REGMAP_WO, 0, NULL, virtio_isr_ack_write),
+    REGMAP_HOOK("Status", VIRTIO_MMIO_STATUS, 1, REGMAP_RW, REGMAP_F_VOLATILE, virtio_status_read, virtio_status_write),
+    REGMAP_HOOK("QueueDesc", VIRTIO_MMIO_QUEUE_DESC_LOW, 2, REGMAP_WO, 0, NULL, virtio_queue_addr_write),
+    REGMAP_HOOK("QueueDriver", VIRTIO_MMIO_QUEUE_DRIVER_LOW, 2, REGMAP_WO, 0, NULL, virtio_queue_addr_write),
+    REGMAP_HOOK("QueueDevice", VIRTIO_MMIO_QUEUE_DEVICE_LOW, 2, REGMAP_WO, 0, NULL, virtio_queue_addr_write),
+    REGMAP_REG("SHMSel", VIRTIO_MMIO_SHM_SEL, REGMAP_WO, offsetof(virtio_dev_t, shm_sel), 0xFFFFFFFF, 0),
+    REGMAP_HOOK("SHMLen", VIRTIO_MMIO_SHM_LEN_LOW, 2, REGMAP_RO, 0, virtio_shm_read, NULL),
+    REGMAP_HOOK("SHMBase", VIRTIO_MMIO_SHM_BASE_LOW, 2, REGMAP_RO, 0, virtio_shm_read, NULL),
+    REGMAP_HOOK("ConfigGeneration", VIRTIO_MMIO_CONFIG_GENERATION, 1, REGMAP_RO, REGMAP_F_VOLATILE,
+                virtio_config_generation_read, NULL),
+};
+
+int virtio_mmio_register(virtio_dev_t* dev)
+{
+    if (g_virtio_count >= VIRTIO_MMIO_SLOTS) {
+        LOG_ERROR("virtio-mmio: sem slots livres para %s", dev->name);
+        return -1;
+    }
+
+    dev->slot = g_virtio_count;
+    dev->irq = VIRTIO_IRQ_BASE + dev->slot;
+    dev->host_features |= VIRTIO_F_VERSION_1;
+
+    for (uint32_t i = 0; i < dev->num_shm; i++) {
+        dev->shm[i].base = virtio_alloc_gpa(dev->shm[i].size, VIRTIO_SHM_ALIGN);
+        if (!dev->shm[i].base) {
+            LOG_ERROR("virtio-mmio: %s: região %u de %llu MB não cabe no IPA de %u bits",
+                      dev->name, dev->shm[i].id, dev->shm[i].size >> 20, g_guest_pa_bits);
+            return -1;
+        }
+    }
+
+    dev->regmap = (regmap_t){
+        .name = dev->name,
+        .base = VIRTIO_MMIO_BASE + (uint64_t)dev->slot * VIRTIO_MMIO_SLOT_SIZE,
+        .size = VIRTIO_MMIO_CONFIG,
+        .state = dev,
+        .regs = virtio_mmio_regs,
+        .nregs = REGMAP_COUNT(virtio_mmio_regs),
+    };
+
+    // regmap_init aplica os resets: DeviceID só depois
+    uint32_t device_id = dev->device_id;
+    if (regmap_init(&dev->regmap) != 0) {
+        return -1;
+    }
+    dev->device_id = device_id;
+
+    g_virtio_devs[g_virtio_count++] = dev;
+    LOG_INFO("virtio-mmio: %s (ID %u) em 0x%llX, IRQ %u, %u fila(s)", dev->name, dev->device_id,
+             dev->regmap.base, dev->irq, dev->num_queues);
+    for (uint32_t i = 0; i < dev->num_shm; i++) {
+        LOG_INFO("virtio-mmio: %s: região %u em 0x%llX (%llu MB)", dev->name, dev->shm[i].id,
+                 dev->shm[i].base, dev->shm[i].size >> 20);
+    }
+    return 0;
+}
+
+uint64_t virtio_alloc_gpa(uint64_t size, uint64_t align)
+{
+    uint64_t limit = 1ULL << g_guest_pa_bits;
+
+    // Com IPA que não alcança VIRTIO_SHM_BASE (36 bits = 64GB), as regiões
+    // começam na metade superior do espaço, acima da RAM
+    if (!g_virtio_gpa_next) {
+        g_virtio_gpa_next = VIRTIO_SHM_BASE < limit / 2 ? VIRTIO_SHM_BASE : limit / 2;
+    }
+
+    uint64_t base = (g_virtio_gpa_next + align - 1) & ~(align - 1);
+    uint64_t end = base + ((size + VIRTIO_SHM_ALIGN - 1) & ~(VIRTIO_SHM_ALIGN - 1));
+    if (end > limit || end < base) {
+        return 0;
+    }
+
+    g_virtio_gpa_next = end;
+    return base;
+}
+
+int virtio_mmio_map_memory(void)
+{
+    for (uint32_t i = 0; i < g_virtio_count; i++) {
+        virtio_dev_t* dev = g_virtio_devs[i];
+        if (dev->ops->map_memory && dev->ops->map_memory(dev) != 0) {
+            LOG_ERROR("virtio-mmio: %s: falha ao mapear memória do device", dev->name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+bool virtio_shm_contains(uint64_t gpa)
+{
+    for (uint32_t i = 0; i < g_virtio_count; i++) {
+        virtio_dev_t* dev = g_virtio_devs[i];
+        for (uint32_t j = 0; j < dev->num_shm; j++) {
+            if (gpa >= dev->shm[j].base && gpa - dev->shm[j].base < dev->shm[j].size) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Espaço de configuração: acessos de 1/2/4/8 bytes em qualquer offset
+static device_access_result_t virtio_config_access(virtio_dev_t* dev, uint32_t offset, device_io_t* io)
+{
+    if (io->is_write) {
+        if (dev->ops->config_write && offset + io->size <= dev->config_size) {
+            dev->ops->config_write(dev, offset, io->data, io->size);
+        }
+        return DEVICE_ACCESS_OK;
+    }
+
+    io->data = 0;
+    if (offset < dev->config_size) {
+        uint32_t len = dev->config_size - offset < io->size ? dev->config_size - offset : io->size;
+        memcpy(&io->data, (uint8_t*)dev->config + offset, len);
+    }
+    return DEVICE_ACCESS_OK;
+}
+
+device_access_result_t virtio_mmio_handle_access(device_io_t* io)
+{
+    uint64_t offset = io->address - VIRTIO_MMIO_BASE;
+    uint32_t slot = (uint32_t)(offset / VIRTIO_MMIO_SLOT_SIZE);
+    uint32_t reg = (uint32_t)(offset % VIRTIO_MMIO_SLOT_SIZE);
+    virtio_dev_t* dev = slot < VIRTIO_MMIO_SLOTS ? g_virtio_devs[slot] : NULL;
+
+    if (!dev) {
+        LOG_DEBUG("virtio-mmio: acesso a slot vazio 0x%llX", io->address);
+        return DEVICE_ACCESS_IGNORE;
+    }
+
+    if (reg >= VIRTIO_MMIO_CONFIG) {
+        return virtio_config_access(dev, reg - VIRTIO_MMIO_CONFIG, io);
+    }
+    return regmap_access(&dev->regmap, io);
+}
+
+void virtio_raise_irq(virtio_dev_t* dev, uint32_t cause)
+{
+    // Conclusões atrasadas de antes de um reset não reabrem a linha
+    if (!(dev->status & VIRTIO_STATUS_DRIVER_OK)) {
+        return;
+    }
+
+    InterlockedOr(&dev->isr, (LONG)cause);
+    gic_set_interrupt(dev->irq, true);
+    devices_signal_change(DEVICE_ID_VIRTIO);
+}
+
+void virtio_notify_config(virtio_dev_t* dev)
+{
+    InterlockedIncrement(&dev->config_generation);
+    virtio_raise_irq(dev, VIRTIO_INT_CONFIG);
+}
+
+void virtio_mmio_cleanup(void)
+{
+    // Devices param de tocar a RAM do guest aqui; chamado antes de vm_destroy()
+    for (uint32_t i = 0; i < g_virtio_count; i++) {
+        virtio_dev_t* dev = g_virtio_devs[i];
+        g_virtio_devs[i] = NULL;
+        dev->ops->destroy(dev);
+    }
+    g_virtio_count = 0;
+    g_virtio_gpa_next = 0;
+}
@@ -0,0 +1,540 @@
+/* Desenvolvido por: Escanearcpl */
+#include "vswitch.h"
+
+// virtio-net (virtio 1.1, seção 5.1) ligado ao switch L2 do processo.
+//
+// Cada placa é uma porta de vswitch.c. O TX drena a fila de transmissão no
+// hook de notify e entrega cada frame ao switch, que copia os bytes dos
+// buffers de TX direto para os buffers de RX do destino (uma cópia, sem
+// buffer intermediário) ou, sem RX livre, retém uma cópia no pool até o
+// driver de destino repor a fila de recepção. Nenhum frame sai para a rede
+// do host: as placas só falam entre si.
+//
+// Offloads: com CSUM/HOST_TSO* o guest entrega checksum parcial e
+// segmentos TCP de até 64KB; com GUEST_CSUM/GUEST_TSO* o destino os recebe
+// assim, sem segmentar nem somar nada por pacote. Só entre um lado com
+// offload e outro sem o switch completa o trabalho em software. Com
+// MRG_RXBUF um frame grande ocupa vários buffers de RX (num_buffers).
+//
+// Multiqueue: um par rx/tx por vCPU e a fila de controle depois dos pares.
+// O RX escolhe a fila pelo hash do fluxo (IPs e portas), então um fluxo
+// fica sempre na mesma fila e em ordem. Como no virtio-console, tudo roda
+// no vCPU sob g_device_lock; o lock do switch protege tabela e filas.
+
+#define VIRTIO_NET_F_CSUM               (1ULL << 0)
+#define VIRTIO_NET_F_GUEST_CSUM         (1ULL << 1)
+#define VIRTIO_NET_F_MTU                (1ULL << 3)
+#define VIRTIO_NET_F_MAC                (1ULL << 5)
+#define VIRTIO_NET_F_GUEST_TSO4         (1ULL << 7)
+#define VIRTIO_NET_F_GUEST_TSO6         (1ULL << 8)
+#define VIRTIO_NET_F_GUEST_ECN          (1ULL << 9)
+#define VIRTIO_NET_F_HOST_TSO4          (1ULL << 11)
+#define VIRTIO_NET_F_HOST_TSO6          (1ULL << 12)
+#define VIRTIO_NET_F_HOST_ECN           (1ULL << 13)
+#define VIRTIO_NET_F_MRG_RXBUF          (1ULL << 15)
+#define VIRTIO_NET_F_STATUS             (1ULL << 16)
+#define VIRTIO_NET_F_CTRL_VQ            (1ULL << 17)
+#define VIRTIO_NET_F_MQ                 (1ULL << 22)
+
+#define VIRTIO_NET_S_LINK_UP            1
+
+// Fila de controle
+#define VIRTIO_NET_CTRL_MQ              4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+#define VIRTIO_NET_OK                   0
+#define VIRTIO_NET_ERR                  1
+
+#define NET_MAX_PAIRS                   ((VIRTIO_MAX_QUEUES - 1) / 2)
+#define NET_RX_MAX_BUFS                 64      // Buffers por frame com MRG_RXBUF
+#define NET_MTU                         1500
+
+// Cabeçalho de cada buffer (com VERSION_1 sempre inclui num_buffers);
+// flags e gso_type têm os valores de VSWITCH_CSUM_* e VSWITCH_GSO_*
+typedef struct {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t num_buffers;
+} virtio_net_hdr_t;
+
+#pragma pack(push, 1)
+typedef struct {
+    uint8_t mac[6];
+    uint16_t status;
+    uint16_t max_virtqueue_pairs;
+    uint16_t mtu;
+} virtio_net_config_t;
+#pragma pack(pop)
+
+typedef struct {
+    uint16_t head;
+    uint32_t len;
+} net_rx_used_t;
+
+typedef struct {
+    virtio_dev_t dev;
+    virtio_net_config_t config;
+    char name[16];
+
+    uint32_t max_pairs;
+    uint32_t curr_pairs;            // VQ_PAIRS_SET do driver
+    uint32_t rx_dirty;              // Filas de RX com entregas desde o signal
+
+    vswitch_port_t port;
+    bool registered;
+    uint64_t tx_invalid;            // Offloads não negociados
+
+    virtq_elem_t tx_elem;
+    virtq_elem_t rx_elem[2];        // Primeira cadeia do frame e as seguintes
+    net_rx_used_t rx_used[NET_RX_MAX_BUFS];
+} virtio_net_t;
+
+static uint32_t g_net_count;
+
+static inline uint32_t net_ctrl_queue(virtio_net_t* net)
+{
+    return virtio_has_feature(&net->dev, VIRTIO_NET_F_MQ) ? 2 * net->max_pairs : 2;
+}
+
+static void net_broken(virtio_net_t* net, virtqueue_t* vq)
+{
+    // Driver com defeito: fila parada até o reset
+    net->dev.status |= VIRTIO_STATUS_NEEDS_RESET;
+    vq->ready = 0;
+    virtio_notify_config(&net->dev);
+}
+
+// Par de filas do fluxo: hash de endereços e portas L3/L4
+static uint32_t net_rx_pair(virtio_net_t* net, const vswitch_frame_t* frame)
+{
+    uint8_t pkt[64];
+    uint32_t hash = 2166136261u;
+
+    if (net->curr_pairs == 1) {
+        return 0;
+    }
+
+    size_t len = vswitch_frame_read(frame, 0, pkt, sizeof(pkt));
+    uint32_t l3 = len >= 18 && pkt[12] == 0x81 && pkt[13] == 0x00 ? 18 : 14;
+    uint32_t addr = 0, addr_len = 0, l4 = 0;
+    uint8_t proto = 0;
+
+    if (len >= l3 + 20 && pkt[l3 - 2] == 0x08 && pkt[l3 - 1] == 0x00) {
+        addr = l3 + 12;
+        addr_len = 8;
+        proto = pkt[l3 + 9];
+        // Fragmentos só pelos endereços: as portas estão no primeiro
+        if (!(pkt[l3 + 6] & 0x3F) && !pkt[l3 + 7]) {
+            l4 = l3 + (pkt[l3] & 0xF) * 4u;
+        }
+    } else if (len >= l3 + 40 && pkt[l3 - 2] == 0x86 && pkt[l3 - 1] == 0xDD) {
+        addr = l3 + 8;
+        addr_len = 32;
+        proto = pkt[l3 + 6];
+        l4 = l3 + 40;
+    } else {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < addr_len; i++) {
+        hash = (hash ^ pkt[addr + i]) * 16777619u;
+    }
+    if ((proto == 6 || proto == 17) && l4 && l4 + 4 <= len) {
+        for (uint32_t i = 0; i < 4; i++) {
+            hash = (hash ^ pkt[l4 + i]) * 16777619u;
+        }
+    }
+    // Bits baixos do FNV mal misturados: avalanche antes do módulo
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    return hash % net->curr_pairs;
+}
+
+static int net_rx_pop(virtio_net_t* net, virtqueue_t* vq, virtq_elem_t* elem)
+{
+    int popped = virtq_pop(&net->dev, vq, elem);
+
+    if (popped == 0 && virtq_enable_notify(&net->dev, vq)) {
+        // O driver repôs buffers entre o pop e a reabilitação do kick
+        popped = virtq_pop(&net->dev, vq, elem);
+    }
+    return popped;
+}
+
+// Entrega de um frame do switch no anel de RX (lock do switch tomado)
+static int net_deliver(vswitch_port_t* port, const vswitch_frame_t* frame)
+{
+    virtio_net_t* net = (virtio_net_t*)port->ctx;
+    uint32_t pair = net_rx_pair(net, frame);
+    virtqueue_t* vq = &net->dev.queues[2 * pair];
+    uint16_t max_bufs = virtio_has_feature(&net->dev, VIRTIO_NET_F_MRG_RXBUF) ? NET_RX_MAX_BUFS : 1;
+    virtio_net_hdr_t hdr = {
+        .flags = frame->off.flags,
+        .gso_type = frame->off.gso_type,
+        .hdr_len = frame->off.hdr_len,
+        .gso_size = frame->off.gso_size,
+        .csum_start = frame->off.csum_start,
+        .csum_offset = frame->off.csum_offset,
+    };
+    uint32_t done = 0;
+    uint16_t count = 0;
+
+    if (!(net->dev.status & VIRTIO_STATUS_DRIVER_OK) || !vq->ready) {
+        return VSWITCH_DROPPED;     // Link do guest ainda não subiu
+    }
+
+    // Cadeias até caber o frame; o cabeçalho vai no início da primeira
+    while (done < frame->len || count == 0) {
+        virtq_elem_t* elem = &net->rx_elem[count ? 1 : 0];
+
+        if (count == max_bufs) {
+            // Sem MRG_RXBUF o driver dá buffers de um frame inteiro
+            virtq_unpop(vq, count);
+            return VSWITCH_DROPPED;
+        }
+
+        int popped = net_rx_pop(net, vq, elem);
+        if (popped <= 0) {
+            virtq_unpop(vq, count);
+            if (popped < 0) {
+                net_broken(net, vq);
+                return VSWITCH_DROPPED;
+            }
+            return VSWITCH_NO_BUFFER;
+        }
+
+        virtq_iov_t* in = &elem->iov[elem->out_num];
+        size_t room = 0;
+        for (uint32_t i = 0; i < elem->in_num; i++) {
+            room += in[i].len;
+        }
+
+        size_t skip = count ? 0 : sizeof(hdr);
+        if (room < skip) {
+            virtq_unpop(vq, count + 1);
+            return VSWITCH_DROPPED;
+        }
+
+        uint32_t chunk = (uint32_t)(room - skip < frame->len - done ? room - skip : frame->len - done);
+        vswitch_frame_t part = *frame;
+        part.offset += done;
+        part.len = chunk;
+        vswitch_frame_copy(&part, in, elem->in_num, skip);
+
+        net->rx_used[count].head = elem->head;
+        net->rx_used[count].len = (uint32_t)skip + chunk;
+        count++;
+        done += chunk;
+    }
+
+    hdr.num_buffers = count;
+    virtq_iov_write(&net->rx_elem[0].iov[net->rx_elem[0].out_num], net->rx_elem[0].in_num, 0, &hdr, sizeof(hdr));
+
+    // Todas as cadeias do frame publicadas juntas
+    for (uint16_t i = 0; i < count; i++) {
+        virtq_fill(vq, net->rx_used[i].head, net->rx_used[i].len, i);
+    }
+    virtq_flush(vq, count);
+    net->rx_dirty |= 1u << pair;
+    return VSWITCH_DELIVERED;
+}
+
+static void net_signal(vswitch_port_t* port)
+{
+    virtio_net_t* net = (virtio_net_t*)port->ctx;
+    bool raise = false;
+
+    for (uint32_t pair = 0; pair < net->max_pairs; pair++) {
+        if (net->rx_dirty & (1u << pair)) {
+            raise |= virtq_should_notify(&net->dev, &net->dev.queues[2 * pair]);
+        }
+    }
+    net->rx_dirty = 0;
+
+    if (raise) {
+        virtio_raise_irq(&net->dev, VIRTIO_INT_USED_RING);
+    }
+}
+
+static const vswitch_port_ops_t net_port_ops = {
+    .deliver = net_deliver,
+    .signal = net_signal,
+};
+
+// Offloads do cabeçalho de TX só com os features correspondentes
+static bool net_tx_offload(virtio_net_t* net, const virtio_net_hdr_t* hdr, vswitch_offload_t* off)
+{
+    uint8_t gso = hdr->gso_type & ~VSWITCH_GSO_ECN;
+
+    if ((hdr->flags & VSWITCH_CSUM_PARTIAL) && !virtio_has_feature(&net->dev, VIRTIO_NET_F_CSUM)) {
+        return false;
+    }
+    if ((gso == VSWITCH_GSO_TCPV4 && !virtio_has_feature(&net->dev, VIRTIO_NET_F_HOST_TSO4)) ||
+        (gso == VSWITCH_GSO_TCPV6 && !virtio_has_feature(&net->dev, VIRTIO_NET_F_HOST_TSO6)) ||
+        (gso != VSWITCH_GSO_NONE && gso != VSWITCH_GSO_TCPV4 && gso != VSWITCH_GSO_TCPV6) ||
+        ((hdr->gso_type & VSWITCH_GSO_ECN) && !virtio_has_feature(&net->dev, VIRTIO_NET_F_HOST_ECN))) {
+        return false;
+    }
+
+    off->flags = hdr->flags & VSWITCH_CSUM_PARTIAL;
+    off->gso_type = hdr->gso_type;
+    off->hdr_len = hdr->hdr_len;
+    off->gso_size = hdr->gso_size;
+    off->csum_start = hdr->csum_start;
+    off->csum_offset = hdr->csum_offset;
+    return true;
+}
+
+static void net_drain_tx(virtio_net_t* net, uint32_t queue)
+{
+    virtqueue_t* vq = &net->dev.queues[queue];
+    virtq_elem_t* elem = &net->tx_elem;
+    bool pushed = false;
+    int popped;
+
+    do {
+        virtq_disable_notify(&net->dev, vq);
+
+        while ((popped = virtq_pop(&net->dev, vq, elem)) > 0) {
+            virtio_net_hdr_t hdr;
+            size_t total = 0;
+            for (uint32_t i = 0; i < elem->out_num; i++) {
+                total += elem->iov[i].len;
+            }
+
+            // O frame começa depois do cabeçalho, no mesmo segmento ou não
+            if (total > sizeof(hdr) && virtq_iov_read(elem->iov, elem->out_num, 0, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+                vswitch_frame_t frame = {
+                    .iov = elem->iov,
+                    .iov_count = elem->out_num,
+                    .offset = sizeof(hdr),
+                    .len = (uint32_t)(total - sizeof(hdr)),
+                };
+                if (net_tx_offload(net, &hdr, &frame.off)) {
+                    vswitch_send(&net->port, &frame);
+                } else {
+                    net->tx_invalid++;
+                }
+            }
+
+            virtq_push(vq, elem->head, 0);
+            pushed = true;
+        }
+
+        if (popped < 0) {
+            net_broken(net, vq);
+            break;
+        }
+    } while (virtq_enable_notify(&net->dev, vq));
+
+    // Interrupções dos destinos primeiro, uma por placa no lote inteiro
+    vswitch_flush();
+    if (pushed && virtq_should_notify(&net->dev, vq)) {
+        virtio_raise_irq(&net->dev, VIRTIO_INT_USED_RING);
+    }
+}
+
+static uint8_t net_ctrl_command(virtio_net_t* net, const virtq_elem_t* elem)
+{
+    uint8_t cmd[2];
+    uint16_t pairs;
+
+    if (virtq_iov_read(elem->iov, elem->out_num, 0, cmd, sizeof(cmd)) != sizeof(cmd)) {
+        return VIRTIO_NET_ERR;
+    }
+
+    if (cmd[0] == VIRTIO_NET_CTRL_MQ && cmd[1] == VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET &&
+        virtq_iov_read(elem->iov, elem->out_num, sizeof(cmd), &pairs, sizeof(pairs)) == sizeof(pairs) &&
+        pairs >= 1 && pairs <= net->max_pairs) {
+        net->curr_pairs = pairs;
+        LOG_DEBUG("%s: %u par(es) de filas ativos", net->name, pairs);
+        return VIRTIO_NET_OK;
+    }
+
+    LOG_DEBUG("%s: comando de controle %u/%u recusado", net->name, cmd[0], cmd[1]);
+    return VIRTIO_NET_ERR;
+}
+
+static void net_drain_ctrl(virtio_net_t* net, uint32_t queue)
+{
+    virtqueue_t* vq = &net->dev.queues[queue];
+    virtq_elem_t* elem = &net->tx_elem;
+    bool pushed = false;
+    int popped;
+
+    while ((popped = virtq_pop(&net->dev, vq, elem)) > 0) {
+        uint8_t ack = net_ctrl_command(net, elem);
+
+        // ack é o último byte gravável da cadeia
+        size_t room = 0;
+        for (uint32_t i = 0; i < elem->in_num; i++) {
+            room += elem->iov[elem->out_num + i].len;
+        }
+        if (room) {
+            virtq_iov_write(&elem->iov[elem->out_num], elem->in_num, room - 1, &ack, 1);
+        }
+        virtq_push(vq, elem->head, room ? 1 : 0);
+        pushed = true;
+    }
+
+    if (popped < 0) {
+        net_broken(net, vq);
+    }
+    if (pushed && virtq_should_notify(&net->dev, vq)) {
+        virtio_raise_irq(&net->dev, VIRTIO_INT_USED_RING);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Hooks do transporte
+// ---------------------------------------------------------------------------
+
+static void virtio_net_notify(virtio_dev_t* dev, uint32_t queue)
+{
+    virtio_net_t* net = (virtio_net_t*)dev;
+
+    if (net->max_pairs > 1 && queue == net_ctrl_queue(net)) {
+        net_drain_ctrl(net, queue);
+    } else if (queue & 1) {
+        net_drain_tx(net, queue);
+    } else {
+        // Buffers de RX novos: frames retidos no switch primeiro
+        vswitch_port_drain(&net->port);
+        vswitch_flush();
+    }
+}
+
+// Offloads que o guest aceita no RX viram capacidades da porta
+static void virtio_net_start(virtio_dev_t* dev)
+{
+    virtio_net_t* net = (virtio_net_t*)dev;
+    uint32_t caps = 0;
+
+    if (virtio_has_feature(dev, VIRTIO_NET_F_GUEST_CSUM)) {
+        caps |= VSWITCH_CAP_CSUM;
+        if (virtio_has_feature(dev, VIRTIO_NET_F_GUEST_TSO4)) {
+            caps |= VSWITCH_CAP_TSO4;
+        }
+        if (virtio_has_feature(dev, VIRTIO_NET_F_GUEST_TSO6)) {
+            caps |= VSWITCH_CAP_TSO6;
+        }
+        if (virtio_has_feature(dev, VIRTIO_NET_F_GUEST_ECN)) {
+            caps |= VSWITCH_CAP_TSO_ECN;
+        }
+    }
+    vswitch_port_set_caps(&net->port, caps);
+}
+
+static void virtio_net_reset(virtio_dev_t* dev)
+{
+    virtio_net_t* net = (virtio_net_t*)dev;
+
+    vswitch_port_reset(&net->port);
+    net->curr_pairs = 1;
+    net->rx_dirty = 0;
+    virtio_queues_reset(dev);
+}
+
+static void virtio_net_destroy(virtio_dev_t* dev)
+{
+    virtio_net_t* net = (virtio_net_t*)dev;
+
+    if (net->registered) {
+        vswitch_port_remove(&net->port);
+    }
+    if (net->tx_invalid) {
+        LOG_DEBUG("%s: %llu frames com offload não negociado descartados", net->name, net->tx_invalid);
+    }
+    free(net);
+}
+
+static const virtio_dev_ops_t virtio_net_ops = {
+    .notify = virtio_net_notify,
+    .reset = virtio_net_reset,
+    .start = virtio_net_start,
+    .destroy = virtio_net_destroy,
+};
+
+static int net_parse_mac(const char* text, uint8_t* mac)
+{
+    unsigned int b[6];
+    char end;
+
+    if (sscanf(text, "%x:%x:%x:%x:%x:%x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &end) != 6) {
+        return -1;
+    }
+    for (int i = 0; i < 6; i++) {
+        if (b[i] > 0xFF) {
+            return -1;
+        }
+        mac[i] = (uint8_t)b[i];
+    }
+    // Endereço de grupo não pode ser de uma placa
+    return (mac[0] & 1) ? -1 : 0;
+}
+
+int virtio_net_create(const char* options, uint32_t num_pairs)
+{
+    virtio_net_t* net = (virtio_net_t*)calloc(1, sizeof(virtio_net_t));
+    if (!net) {
+        return -1;
+    }
+    snprintf(net->name, sizeof(net->name), "virtio-net%u", g_net_count);
+
+    // MAC localmente administrado, distinto por placa
+    const uint8_t default_mac[6] = { 0x02, 0x48, 0x56, 0x00, 0x00, (uint8_t)(g_net_count + 1) };
+    memcpy(net->config.mac, default_mac, sizeof(default_mac));
+
+    if (options && options[0]) {
+        if (strncmp(options, "mac=", 4) != 0 || net_parse_mac(options + 4, net->config.mac) != 0) {
+            LOG_ERROR("%s: opção inválida '%s' (mac=xx:xx:xx:xx:xx:xx, unicast)", net->name, options);
+            free(net);
+            return -1;
+        }
+    }
+
+    net->max_pairs = num_pairs < 1 ? 1 : num_pairs > NET_MAX_PAIRS ? NET_MAX_PAIRS : num_pairs;
+    net->curr_pairs = 1;
+
+    net->config.status = VIRTIO_NET_S_LINK_UP;
+    net->config.max_virtqueue_pairs = (uint16_t)net->max_pairs;
+    net->config.mtu = NET_MTU;
+
+    net->dev.name = net->name;
+    net->dev.device_id = VIRTIO_ID_NET;
+    net->dev.host_features = VIRTIO_NET_F_MAC | VIRTIO_NET_F_STATUS | VIRTIO_NET_F_MTU |
+                             VIRTIO_NET_F_CSUM | VIRTIO_NET_F_HOST_TSO4 | VIRTIO_NET_F_HOST_TSO6 |
+                             VIRTIO_NET_F_HOST_ECN | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_GUEST_TSO4 |
+                             VIRTIO_NET_F_GUEST_TSO6 | VIRTIO_NET_F_GUEST_ECN | VIRTIO_NET_F_MRG_RXBUF |
+                             VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_RING_F_EVENT_IDX;
+    net->dev.ops = &virtio_net_ops;
+    net->dev.config = &net->config;
+    net->dev.config_size = sizeof(net->config);
+    net->dev.num_queues = 2;
+
+    if (net->max_pairs > 1) {
+        net->dev.host_features |= VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ;
+        net->dev.num_queues = 2 * net->max_pairs + 1;
+    }
+
+    if (vswitch_port_add(&net->port, net->name, &net_port_ops, net) != 0) {
+        free(net);
+        return -1;
+    }
+    net->registered = true;
+
+    if (virtio_mmio_register(&net->dev) != 0) {
+        virtio_net_destroy(&net->dev);
+        return -1;
+    }
+
+    g_net_count++;
+    LOG_INFO("%s: MAC %02x:%02x:%02x:%02x:%02x:%02x na porta %u do switch, %u par(es) de filas", net->name,
+             net->config.mac[0], net->config.mac[1], net->config.mac[2], net->config.mac[3],
+             net->config.mac[4], net->config.mac[5], net->port.id, net->max_pairs);
+    return 0;
+}
@@ -0,0 +1,316 @@
+/* Desenvolvido por: Escanearcpl */
+#include "virtio.h"
+#include "vm.h"
+
+// virtio-pmem (virtio 1.2, seção 5.19): um arquivo do host aparece no
+// guest como memória persistente num range de GPAs fora da RAM. O guest
+// usa o range com DAX (ext4/xfs -o dax) e lê e escreve o arquivo como
+// memória, sem page cache próprio e sem exits.
+//
+// O range é uma view de MapViewOfFile registrada como slot de memória
+// (vm_map_gpa_range), então os devices também alcançam páginas do pmem
+// usadas como buffers. As páginas são as do cache do Windows para o
+// arquivo: várias VMs com a mesma imagem somente-leitura dividem uma cópia
+// só. Somente-leitura usa uma view copy-on-write, de modo que uma escrita
+// do guest vira cópia privada da página em vez de falha, e o arquivo
+// nunca muda.
+//
+// A única request é FLUSH, que vira FlushViewOfFile + FlushFileBuffers
+// (msync + fsync). Flushes enfileirados juntos são atendidos por uma
+// única passada: todos foram pedidos antes dela começar.
+
+#define VIRTIO_PMEM_REQ_TYPE_FLUSH  0
+#define PMEM_QUEUE_REQUEST          0
+#define PMEM_ALIGN                  (2ULL * 1024 * 1024)
+#define PMEM_GPA_ALIGN              (1ULL << 30)        // Seções de memória do guest e blocos de 1GB
+
+typedef struct {
+    uint64_t start;
+    uint64_t size;
+} virtio_pmem_config_t;
+
+typedef struct {
+    uint32_t type;
+} virtio_pmem_req_t;
+
+typedef struct {
+    uint32_t ret;                   // 0 = sucesso
+} virtio_pmem_resp_t;
+
+typedef struct {
+    uint16_t head;
+    virtio_pmem_resp_t* resp;       // NULL = cadeia malformada (sem resposta)
+} pmem_pending_t;
+
+typedef struct {
+    virtio_dev_t dev;
+    virtio_pmem_config_t config;
+    char name[32];
+    bool read_only;
+
+    HANDLE file;
+    void* view;
+    bool mapped;
+
+    CRITICAL_SECTION lock;          // Fila de requests; a thread de flush processa
+    HANDLE thread;
+    HANDLE kick;
+    volatile bool stop;
+
+    virtq_elem_t elem;
+    pmem_pending_t pending[VIRTQ_MAX_SIZE];
+    uint64_t flushes;
+    uint64_t requests;
+} virtio_pmem_t;
+
+static uint32_t g_pmem_count;
+
+static bool pmem_flush(virtio_pmem_t* pm)
+{
+    // Copy-on-write: nada do guest chega ao arquivo
+    if (pm->read_only) {
+        return true;
+    }
+
+    pm->flushes++;
+    if (!FlushViewOfFile(pm->view, 0) || !FlushFileBuffers(pm->file)) {
+        LOG_ERROR("%s: flush falhou: %lu", pm->name, GetLastError());
+        return false;
+    }
+    return true;
+}
+
+// Retira todas as requests pendentes, faz um flush e responde a todas
+static bool pmem_process(virtio_pmem_t* pm)
+{
+    virtqueue_t* vq = &pm->dev.queues[PMEM_QUEUE_REQUEST];
+    bool pushed = false;
+    int popped = 0;
+
+    if (!vq->ready) {
+        return false;
+    }
+
+    do {
+        uint32_t count = 0;
+        bool flush = false;
+
+        virtq_disable_notify(&pm->dev, vq);
+
+        while (count < VIRTQ_MAX_SIZE && (popped = virtq_pop(&pm->dev, vq, &pm->elem)) > 0) {
+            virtio_pmem_req_t req;
+            pmem_pending_t* p = &pm->pending[count++];
+            const virtq_iov_t* in = &pm->elem.iov[pm->elem.out_num];
+
+            p->head = pm->elem.head;
+            p->resp = NULL;
+            if (virtq_iov_read(pm->elem.iov, pm->elem.out_num, 0, &req, sizeof(req)) == sizeof(req) &&
+                pm->elem.in_num > 0 && in->len >= sizeof(virtio_pmem_resp_t)) {
+                p->resp = (virtio_pmem_resp_t*)in->addr;
+                p->resp->ret = req.type == VIRTIO_PMEM_REQ_TYPE_FLUSH ? 0 : 1;
+                flush |= req.type == VIRTIO_PMEM_REQ_TYPE_FLUSH;
+            }
+        }
+
+        bool ok = !flush || pmem_flush(pm);
+        for (uint32_t i = 0; i < count; i++) {
+            pmem_pending_t* p = &pm->pending[i];
+            if (p->resp && !ok) {
+                p->resp->ret = 1;
+            }
+            virtq_push(vq, p->head, p->resp ? sizeof(virtio_pmem_resp_t) : 0);
+        }
+        pm->requests += count;
+        pushed |= count > 0;
+
+        if (popped < 0) {
+            pm->dev.status |= VIRTIO_STATUS_NEEDS_RESET;
+            vq->ready = 0;
+            break;
+        }
+    } while (virtq_enable_notify(&pm->dev, vq));
+
+    return pushed && virtq_should_notify(&pm->dev, vq);
+}
+
+static DWORD WINAPI pmem_flush_thread(LPVOID param)
+{
+    virtio_pmem_t* pm = (virtio_pmem_t*)param;
+
+    for (;;) {
+        WaitForSingleObject(pm->kick, INFINITE);
+        if (pm->stop) {
+            break;
+        }
+
+        bool raise = false;
+
+        EnterCriticalSection(&pm->lock);
+        if (pm->dev.status & VIRTIO_STATUS_DRIVER_OK) {
+            raise = pmem_process(pm);
+        }
+        LeaveCriticalSection(&pm->lock);
+
+        // Fora do lock do device: a SPI toma g_device_lock
+        if (raise) {
+            virtio_raise_irq(&pm->dev, VIRTIO_INT_USED_RING);
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Hooks do transporte
+// ---------------------------------------------------------------------------
+
+static void virtio_pmem_notify(virtio_dev_t* dev, uint32_t queue)
+{
+    (void)queue;
+    SetEvent(((virtio_pmem_t*)dev)->kick);
+}
+
+static void virtio_pmem_reset(virtio_dev_t* dev)
+{
+    virtio_pmem_t* pm = (virtio_pmem_t*)dev;
+
+    // Espera o flush em andamento; o conteúdo do pmem não muda com o reset
+    EnterCriticalSection(&pm->lock);
+    virtio_queues_reset(dev);
+    LeaveCriticalSection(&pm->lock);
+}
+
+static int virtio_pmem_map_memory(virtio_dev_t* dev)
+{
+    virtio_pmem_t* pm = (virtio_pmem_t*)dev;
+
+    // Escrita também em somente-leitura: vai para a cópia privada
+    if (vm_map_gpa_range(pm->view, pm->config.start, pm->config.size,
+                         WHvMapGpaRangeFlagRead | WHvMapGpaRangeFlagWrite | WHvMapGpaRangeFlagExecute) != 0) {
+        return -1;
+    }
+    pm->mapped = true;
+    return 0;
+}
+
+static void virtio_pmem_destroy(virtio_dev_t* dev)
+{
+    virtio_pmem_t* pm = (virtio_pmem_t*)dev;
+
+    if (pm->thread) {
+        pm->stop = true;
+        SetEvent(pm->kick);
+        WaitForSingleObject(pm->thread, INFINITE);
+        CloseHandle(pm->thread);
+        DeleteCriticalSection(&pm->lock);
+        LOG_DEBUG("%s: %llu requests, %llu flushes", pm->name, pm->requests, pm->flushes);
+    }
+    if (pm->mapped) {
+        vm_unmap_gpa_range(pm->config.start, pm->config.size);
+    }
+    if (pm->view) {
+        // Escritas do guest desde o último flush ainda vão para o arquivo
+        UnmapViewOfFile(pm->view);
+    }
+    if (pm->file && pm->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(pm->file);
+    }
+    if (pm->kick) {
+        CloseHandle(pm->kick);
+    }
+    free(pm);
+}
+
+static const virtio_dev_ops_t virtio_pmem_ops = {
+    .notify = virtio_pmem_notify,
+    .reset = virtio_pmem_reset,
+    .map_memory = virtio_pmem_map_memory,
+    .destroy = virtio_pmem_destroy,
+};
+
+static int pmem_open(virtio_pmem_t* pm, const char* path)
+{
+    LARGE_INTEGER size;
+
+    // Somente-leitura divide o arquivo com outras VMs; escrita é exclusiva
+    pm->file = CreateFileA(path, GENERIC_READ | (pm->read_only ? 0 : GENERIC_WRITE), FILE_SHARE_READ,
+                           NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (pm->file == INVALID_HANDLE_VALUE) {
+        LOG_ERROR("%s: falha ao abrir %s: %lu", pm->name, path, GetLastError());
+        return -1;
+    }
+    if (!GetFileSizeEx(pm->file, &size)) {
+        LOG_ERROR("%s: falha ao ler o tamanho de %s: %lu", pm->name, path, GetLastError());
+        return -1;
+    }
+    if (size.QuadPart <= 0 || ((uint64_t)size.QuadPart & (PMEM_ALIGN - 1))) {
+        LOG_ERROR("%s: %s deve ter tamanho múltiplo de 2MB (%lld bytes)", pm->name, path, size.QuadPart);
+        return -1;
+    }
+
+    HANDLE section = CreateFileMappingA(pm->file, NULL, pm->read_only ? PAGE_READONLY : PAGE_READWRITE,
+                                        0, 0, NULL);
+    if (!section) {
+        LOG_ERROR("%s: CreateFileMapping falhou: %lu", pm->name, GetLastError());
+        return -1;
+    }
+
+    // A view mantém a seção viva
+    pm->view = MapViewOfFile(section, pm->read_only ? FILE_MAP_COPY : FILE_MAP_WRITE, 0, 0, 0);
+    CloseHandle(section);
+    if (!pm->view) {
+        LOG_ERROR("%s: MapViewOfFile falhou: %lu", pm->name, GetLastError());
+        return -1;
+    }
+
+    pm->config.size = (uint64_t)size.QuadPart;
+    return 0;
+}
+
+int virtio_pmem_create(const char* path, bool read_only)
+{
+    virtio_pmem_t* pm = (virtio_pmem_t*)calloc(1, sizeof(virtio_pmem_t));
+    if (!pm) {
+        return -1;
+    }
+    snprintf(pm->name, sizeof(pm->name), "virtio-pmem%u", g_pmem_count);
+    pm->read_only = read_only;
+
+    pm->kick = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (!pm->kick || pmem_open(pm, path) != 0) {
+        virtio_pmem_destroy(&pm->dev);
+        return -1;
+    }
+    pm->config.start = virtio_alloc_gpa(pm->config.size, PMEM_GPA_ALIGN);
+    if (!pm->config.start) {
+        LOG_ERROR("%s: %s (%llu MB) não cabe no IPA de %u bits", pm->name, path,
+                  pm->config.size >> 20, g_guest_pa_bits);
+        virtio_pmem_destroy(&pm->dev);
+        return -1;
+    }
+
+    pm->dev.name = pm->name;
+    pm->dev.device_id = VIRTIO_ID_PMEM;
+    pm->dev.host_features = VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_RING_F_EVENT_IDX;
+    pm->dev.ops = &virtio_pmem_ops;
+    pm->dev.config = &pm->config;
+    pm->dev.config_size = sizeof(pm->config);
+    pm->dev.num_queues = 1;
+
+    InitializeCriticalSection(&pm->lock);
+    pm->thread = CreateThread(NULL, 0, pmem_flush_thread, pm, 0, NULL);
+    if (!pm->thread) {
+        DeleteCriticalSection(&pm->lock);
+        virtio_pmem_destroy(&pm->dev);
+        return -1;
+    }
+
+    if (virtio_mmio_register(&pm->dev) != 0) {
+        virtio_pmem_destroy(&pm->dev);
+        return -1;
+    }
+
+    g_pmem_count++;
+    LOG_INFO("%s: %s (%llu MB%s) em 0x%llX", pm->name, path, pm->config.size >> 20,
+             read_only ? ", somente leitura" : "", pm->config.start);
+    return 0;
+}
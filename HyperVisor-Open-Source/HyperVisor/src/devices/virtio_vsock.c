@@ -0,0 +1,932 @@
+/* Desenvolvido por: Escanearcpl */
+#include <winsock2.h>
+#include <afunix.h>
+#include "virtio.h"
+
+// virtio-vsock (virtio 1.1, seção 5.10) com o lado do host em sockets
+// AF_UNIX, no modelo do Firecracker:
+//
+// - O guest conecta na porta P do host (CID 2): o device conecta em
+//   "<caminho>_<P>", onde o serviço do host escuta.
+// - O host conecta em "<caminho>" e escreve "CONNECT <P>\n": o device abre
+//   a conexão com a porta P do guest e responde "OK <porta local>\n".
+//
+// Depois do handshake os bytes passam crus nos dois sentidos. O controle
+// de fluxo é por crédito: o guest só envia até buf_alloc bytes além do que
+// já foi escrito no socket (fwd_cnt), e o host só lê do socket o que cabe
+// no crédito anunciado pelo guest. Os dados do host são lidos direto para
+// os buffers de RX do guest, sem cópia intermediária.
+//
+// O notify só acorda a thread de I/O; ela drena a fila de TX inteira,
+// escreve nos sockets, enche a fila de RX com o que estiver pronto e decide
+// uma interrupção por volta. Conexões são limitadas pelos eventos de
+// WSAWaitForMultipleEvents (64, menos o kick e o socket de escuta).
+
+#define VSOCK_HOST_CID          2
+#define VSOCK_BUF_ALLOC         (256 * 1024)    // Crédito dado ao guest por conexão
+#define VSOCK_MAX_PKT           (64 * 1024)     // Payload máximo por pacote de RX
+#define VSOCK_MAX_CONNS         (WSA_MAXIMUM_WAIT_EVENTS - 2)
+#define VSOCK_RST_PENDING       32
+#define VSOCK_LINE_MAX          32
+#define VSOCK_EPHEMERAL_BASE    49152
+
+#define VSOCK_QUEUE_RX          0
+#define VSOCK_QUEUE_TX          1
+#define VSOCK_QUEUE_EVENT       2
+
+#define VIRTIO_VSOCK_TYPE_STREAM        1
+
+#define VIRTIO_VSOCK_OP_REQUEST         1
+#define VIRTIO_VSOCK_OP_RESPONSE        2
+#define VIRTIO_VSOCK_OP_RST             3
+#define VIRTIO_VSOCK_OP_SHUTDOWN        4
+#define VIRTIO_VSOCK_OP_RW              5
+#define VIRTIO_VSOCK_OP_CREDIT_UPDATE   6
+#define VIRTIO_VSOCK_OP_CREDIT_REQUEST  7
+
+#define VIRTIO_VSOCK_SHUTDOWN_RCV       1
+#define VIRTIO_VSOCK_SHUTDOWN_SEND      2
+
+// Pacotes de controle devidos ao guest, por conexão
+#define VSOCK_CTRL_REQUEST      (1u << 0)
+#define VSOCK_CTRL_RESPONSE     (1u << 1)
+#define VSOCK_CTRL_CREDIT       (1u << 2)
+#define VSOCK_CTRL_SHUTDOWN     (1u << 3)
+#define VSOCK_CTRL_RST          (1u << 4)       // Último: a conexão é liberada depois
+
+#pragma pack(push, 1)
+typedef struct {
+    uint64_t src_cid;
+    uint64_t dst_cid;
+    uint32_t src_port;
+    uint32_t dst_port;
+    uint32_t len;
+    uint16_t type;
+    uint16_t op;
+    uint32_t flags;
+    uint32_t buf_alloc;
+    uint32_t fwd_cnt;
+} virtio_vsock_hdr_t;
+#pragma pack(pop)
+
+typedef struct {
+    uint64_t guest_cid;
+} virtio_vsock_config_t;
+
+typedef enum {
+    VSOCK_CONN_FREE = 0,
+    VSOCK_CONN_HANDSHAKE,       // Host conectou, esperando "CONNECT <porta>"
+    VSOCK_CONN_CONNECTING,      // REQUEST enviado ao guest
+    VSOCK_CONN_ESTABLISHED,
+    VSOCK_CONN_CLOSING,         // Guest fechou: esvaziar pending e mandar RST
+} vsock_conn_state_t;
+
+typedef struct {
+    vsock_conn_state_t state;
+    SOCKET sock;
+    WSAEVENT event;             // Do slot, vive até o destroy
+    uint32_t guest_port;
+    uint32_t host_port;
+
+    // Crédito do guest para dados do host
+    uint32_t peer_buf_alloc;
+    uint32_t peer_fwd_cnt;
+    uint32_t tx_cnt;
+
+    // Dados do guest: escritos no socket (fwd_cnt) ou esperando nele
+    uint32_t fwd_cnt;
+    uint32_t fwd_cnt_sent;      // Último fwd_cnt anunciado ao guest
+    uint8_t* pending;
+    uint32_t pending_len;
+
+    uint32_t ctrl;              // VSOCK_CTRL_*
+    bool readable;
+    bool host_eof;
+    bool guest_shut_send;
+
+    char line[VSOCK_LINE_MAX];
+    uint32_t line_len;
+} vsock_conn_t;
+
+typedef struct {
+    uint32_t guest_port;
+    uint32_t host_port;
+} vsock_rst_t;
+
+typedef struct {
+    virtio_dev_t dev;
+    virtio_vsock_config_t config;
+    char name[16];
+    char path[UNIX_PATH_MAX];
+
+    CRITICAL_SECTION lock;      // Conexões e filas; a thread de I/O é a única a processar
+    HANDLE thread;
+    WSAEVENT kick;
+    volatile bool stop;
+    bool wsa_started;
+
+    SOCKET listener;
+    WSAEVENT listener_event;
+
+    vsock_conn_t conns[VSOCK_MAX_CONNS];
+    uint32_t rr_next;           // Próxima conexão a servir no RX
+    uint32_t next_port;
+
+    vsock_rst_t rst[VSOCK_RST_PENDING];
+    uint32_t rst_count;
+
+    virtq_elem_t elem;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+} virtio_vsock_t;
+
+// ---------------------------------------------------------------------------
+// Conexões
+// ---------------------------------------------------------------------------
+
+static vsock_conn_t* vsock_find(virtio_vsock_t* vs, uint32_t guest_port, uint32_t host_port)
+{
+    for (uint32_t i = 0; i < VSOCK_MAX_CONNS; i++) {
+        vsock_conn_t* conn = &vs->conns[i];
+        if (conn->state != VSOCK_CONN_FREE && conn->state != VSOCK_CONN_HANDSHAKE &&
+            conn->guest_port == guest_port && conn->host_port == host_port) {
+            return conn;
+        }
+    }
+    return NULL;
+}
+
+static vsock_conn_t* vsock_conn_alloc(virtio_vsock_t* vs, SOCKET sock)
+{
+    for (uint32_t i = 0; i < VSOCK_MAX_CONNS; i++) {
+        vsock_conn_t* conn = &vs->conns[i];
+        if (conn->state != VSOCK_CONN_FREE) {
+            continue;
+        }
+
+        // Também deixa o socket não bloqueante
+        WSAResetEvent(conn->event);
+        conn->pending = (uint8_t*)malloc(VSOCK_BUF_ALLOC);
+        if (!conn->pending || WSAEventSelect(sock, conn->event, FD_READ | FD_WRITE | FD_CLOSE) != 0) {
+            free(conn->pending);
+            conn->pending = NULL;
+            return NULL;
+        }
+        conn->sock = sock;
+        conn->state = VSOCK_CONN_HANDSHAKE;
+        return conn;
+    }
+
+    LOG_ERROR("%s: limite de %u conexões", vs->name, VSOCK_MAX_CONNS);
+    return NULL;
+}
+
+// O evento fica: a thread de I/O pode estar esperando nele (reset)
+static void vsock_conn_free(vsock_conn_t* conn)
+{
+    WSAEVENT event = conn->event;
+
+    closesocket(conn->sock);
+    free(conn->pending);
+    memset(conn, 0, sizeof(*conn));
+    conn->event = event;
+}
+
+static void vsock_reply_rst(virtio_vsock_t* vs, uint32_t guest_port, uint32_t host_port)
+{
+    if (vs->rst_count < VSOCK_RST_PENDING) {
+        vs->rst[vs->rst_count].guest_port = guest_port;
+        vs->rst[vs->rst_count].host_port = host_port;
+        vs->rst_count++;
+    }
+}
+
+// Bytes do guest escritos no socket: crédito devolvido em lotes
+static void vsock_forwarded(vsock_conn_t* conn, uint32_t bytes)
+{
+    conn->fwd_cnt += bytes;
+    if (conn->fwd_cnt - conn->fwd_cnt_sent >= VSOCK_BUF_ALLOC / 2) {
+        conn->ctrl |= VSOCK_CTRL_CREDIT;
+    }
+}
+
+static void vsock_flush_pending(vsock_conn_t* conn)
+{
+    if (conn->pending_len) {
+        int sent = send(conn->sock, (const char*)conn->pending, (int)conn->pending_len, 0);
+        if (sent == SOCKET_ERROR) {
+            if (WSAGetLastError() != WSAEWOULDBLOCK) {
+                conn->ctrl |= VSOCK_CTRL_RST;
+            }
+            return;
+        }
+        memmove(conn->pending, conn->pending + sent, conn->pending_len - (uint32_t)sent);
+        conn->pending_len -= (uint32_t)sent;
+        vsock_forwarded(conn, (uint32_t)sent);
+    }
+
+    if (!conn->pending_len) {
+        if (conn->state == VSOCK_CONN_CLOSING) {
+            conn->ctrl |= VSOCK_CTRL_RST;
+        } else if (conn->guest_shut_send) {
+            shutdown(conn->sock, SD_SEND);
+            conn->guest_shut_send = false;
+        }
+    }
+}
+
+// Segmentos [offset, offset + len) de uma cadeia como WSABUF
+static DWORD vsock_wsabufs(const virtq_iov_t* iov, uint32_t count, size_t offset, size_t len, WSABUF* bufs)
+{
+    DWORD n = 0;
+
+    for (uint32_t i = 0; i < count && len; i++) {
+        if (offset >= iov[i].len) {
+            offset -= iov[i].len;
+            continue;
+        }
+
+        size_t chunk = iov[i].len - offset < len ? iov[i].len - offset : len;
+        bufs[n].buf = (char*)iov[i].addr + offset;
+        bufs[n].len = (ULONG)chunk;
+        n++;
+        len -= chunk;
+        offset = 0;
+    }
+    return n;
+}
+
+// Conexão do guest com a porta 'host_port' do host: "<caminho>_<porta>"
+static vsock_conn_t* vsock_connect_host(virtio_vsock_t* vs, uint32_t guest_port, uint32_t host_port)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    SOCKET sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    vsock_conn_t* conn = NULL;
+
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s_%u", vs->path, host_port);
+
+    // AF_UNIX local: connect bloqueante termina na hora
+    if (sock != INVALID_SOCKET && connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        conn = vsock_conn_alloc(vs, sock);
+    }
+    if (!conn) {
+        LOG_DEBUG("%s: porta %u do host indisponível (%s)", vs->name, host_port, addr.sun_path);
+        if (sock != INVALID_SOCKET) {
+            closesocket(sock);
+        }
+        vsock_reply_rst(vs, guest_port, host_port);
+        return NULL;
+    }
+
+    conn->guest_port = guest_port;
+    conn->host_port = host_port;
+    conn->state = VSOCK_CONN_ESTABLISHED;
+    conn->ctrl |= VSOCK_CTRL_RESPONSE;
+    return conn;
+}
+
+// "CONNECT <porta>\n" do host: abrir a conexão com o guest
+static void vsock_handshake(virtio_vsock_t* vs, vsock_conn_t* conn)
+{
+    int got = recv(conn->sock, conn->line + conn->line_len, VSOCK_LINE_MAX - 1 - conn->line_len, 0);
+    unsigned int port;
+
+    if (got == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK) {
+        conn->readable = false;
+        return;
+    }
+    if (got <= 0) {
+        vsock_conn_free(conn);
+        return;
+    }
+
+    conn->line_len += (uint32_t)got;
+    conn->line[conn->line_len] = '\0';
+
+    char* end = strchr(conn->line, '\n');
+    if (!end) {
+        if (conn->line_len == VSOCK_LINE_MAX - 1) {
+            vsock_conn_free(conn);
+        }
+        return;
+    }
+    // O host só envia dados depois do "OK"
+    if (end[1] != '\0' || sscanf(conn->line, "CONNECT %u", &port) != 1) {
+        LOG_DEBUG("%s: handshake inválido do host", vs->name);
+        vsock_conn_free(conn);
+        return;
+    }
+
+    conn->guest_port = port;
+    do {
+        conn->host_port = vs->next_port++;
+        if (vs->next_port < VSOCK_EPHEMERAL_BASE) {
+            vs->next_port = VSOCK_EPHEMERAL_BASE;
+        }
+    } while (vsock_find(vs, conn->guest_port, conn->host_port));
+    conn->state = VSOCK_CONN_CONNECTING;
+    conn->ctrl |= VSOCK_CTRL_REQUEST;
+    conn->readable = false;
+}
+
+static void vsock_accept(virtio_vsock_t* vs)
+{
+    SOCKET sock;
+
+    while ((sock = accept(vs->listener, NULL, NULL)) != INVALID_SOCKET) {
+        if (!vsock_conn_alloc(vs, sock)) {
+            closesocket(sock);
+        }
+    }
+}
+
+static void vsock_poll_sockets(virtio_vsock_t* vs)
+{
+    WSANETWORKEVENTS ne;
+
+    if (vs->listener != INVALID_SOCKET && WSAEnumNetworkEvents(vs->listener, vs->listener_event, &ne) == 0 &&
+        (ne.lNetworkEvents & FD_ACCEPT)) {
+        vsock_accept(vs);
+    }
+
+    for (uint32_t i = 0; i < VSOCK_MAX_CONNS; i++) {
+        vsock_conn_t* conn = &vs->conns[i];
+
+        if (conn->state == VSOCK_CONN_FREE || WSAEnumNetworkEvents(conn->sock, conn->event, &ne) != 0) {
+            continue;
+        }
+        // FD_CLOSE: ainda pode haver dados; o EOF aparece no recv
+        if (ne.lNetworkEvents & (FD_READ | FD_CLOSE)) {
+            conn->readable = true;
+        }
+        if (conn->state == VSOCK_CONN_HANDSHAKE && conn->readable) {
+            vsock_handshake(vs, conn);
+            continue;
+        }
+        if (ne.lNetworkEvents & FD_WRITE) {
+            vsock_flush_pending(conn);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TX: pacotes do guest
+// ---------------------------------------------------------------------------
+
+static void vsock_guest_data(virtio_vsock_t* vs, vsock_conn_t* conn, const virtq_elem_t* elem, uint32_t len)
+{
+    uint32_t sent = 0;
+
+    if (len > VSOCK_BUF_ALLOC - conn->pending_len) {
+        LOG_DEBUG("%s: guest excedeu o crédito na porta %u", vs->name, conn->guest_port);
+        conn->ctrl |= VSOCK_CTRL_RST;
+        return;
+    }
+
+    // Direto dos buffers do guest para o socket; o resto espera em pending
+    if (!conn->pending_len) {
+        WSABUF bufs[VIRTQ_MAX_IOV];
+        DWORD count = vsock_wsabufs(elem->iov, elem->out_num, sizeof(virtio_vsock_hdr_t), len, bufs);
+        DWORD bytes = 0;
+
+        if (WSASend(conn->sock, bufs, count, &bytes, 0, NULL, NULL) == 0) {
+            sent = (uint32_t)bytes;
+        } else if (WSAGetLastError() != WSAEWOULDBLOCK) {
+            conn->ctrl |= VSOCK_CTRL_RST;
+            return;
+        }
+    }
+
+    if (sent < len) {
+        virtq_iov_read(elem->iov, elem->out_num, sizeof(virtio_vsock_hdr_t) + sent,
+                       conn->pending + conn->pending_len, len - sent);
+        conn->pending_len += len - sent;
+    }
+    vs->tx_bytes += len;
+    vsock_forwarded(conn, sent);
+}
+
+static void vsock_guest_packet(virtio_vsock_t* vs, const virtq_elem_t* elem)
+{
+    virtio_vsock_hdr_t hdr;
+    size_t total = 0;
+
+    for (uint32_t i = 0; i < elem->out_num; i++) {
+        total += elem->iov[i].len;
+    }
+    if (virtq_iov_read(elem->iov, elem->out_num, 0, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        hdr.src_cid != vs->config.guest_cid || hdr.dst_cid != VSOCK_HOST_CID) {
+        return;
+    }
+    if (hdr.type != VIRTIO_VSOCK_TYPE_STREAM) {
+        if (hdr.op != VIRTIO_VSOCK_OP_RST) {
+            vsock_reply_rst(vs, hdr.src_port, hdr.dst_port);
+        }
+        return;
+    }
+
+    vsock_conn_t* conn = vsock_find(vs, hdr.src_port, hdr.dst_port);
+    if (!conn && hdr.op == VIRTIO_VSOCK_OP_REQUEST) {
+        conn = vsock_connect_host(vs, hdr.src_port, hdr.dst_port);
+    } else if (!conn) {
+        if (hdr.op != VIRTIO_VSOCK_OP_RST) {
+            vsock_reply_rst(vs, hdr.src_port, hdr.dst_port);
+        }
+        return;
+    }
+    if (!conn) {
+        return;
+    }
+
+    // Todo pacote do guest atualiza o crédito que ele dá ao host
+    conn->peer_buf_alloc = hdr.buf_alloc;
+    conn->peer_fwd_cnt = hdr.fwd_cnt;
+
+    switch (hdr.op) {
+        case VIRTIO_VSOCK_OP_REQUEST:
+            break;      // Nova (RESPONSE pendente) ou repetida
+        case VIRTIO_VSOCK_OP_RESPONSE:
+            if (conn->state == VSOCK_CONN_CONNECTING) {
+                int len = snprintf((char*)conn->pending, VSOCK_LINE_MAX, "OK %u\n", conn->host_port);
+                conn->pending_len = (uint32_t)len;
+                conn->state = VSOCK_CONN_ESTABLISHED;
+                // A linha não é dado do guest: não conta no fwd_cnt
+                conn->fwd_cnt -= (uint32_t)len;
+                conn->fwd_cnt_sent = conn->fwd_cnt;
+                vsock_flush_pending(conn);
+                conn->readable = true;
+            }
+            break;
+
+        case VIRTIO_VSOCK_OP_RST:
+            vsock_conn_free(conn);
+            break;
+
+        case VIRTIO_VSOCK_OP_SHUTDOWN:
+            if ((hdr.flags & (VIRTIO_VSOCK_SHUTDOWN_RCV | VIRTIO_VSOCK_SHUTDOWN_SEND)) ==
+                (VIRTIO_VSOCK_SHUTDOWN_RCV | VIRTIO_VSOCK_SHUTDOWN_SEND)) {
+                conn->state = VSOCK_CONN_CLOSING;
+            } else if (hdr.flags & VIRTIO_VSOCK_SHUTDOWN_SEND) {
+                conn->guest_shut_send = true;
+            }
+            vsock_flush_pending(conn);
+            break;
+
+        case VIRTIO_VSOCK_OP_RW:
+            if (conn->state != VSOCK_CONN_ESTABLISHED) {
+                conn->ctrl |= VSOCK_CTRL_RST;
+            } else if (hdr.len) {
+                uint32_t len = total - sizeof(hdr) < hdr.len ? (uint32_t)(total - sizeof(hdr)) : hdr.len;
+                vsock_guest_data(vs, conn, elem, len);
+            }
+            break;
+
+        case VIRTIO_VSOCK_OP_CREDIT_REQUEST:
+            conn->ctrl |= VSOCK_CTRL_CREDIT;
+            break;
+
+        case VIRTIO_VSOCK_OP_CREDIT_UPDATE:
+            break;      // Crédito já atualizado; o RX tenta ler de novo
+
+        default:
+            conn->ctrl |= VSOCK_CTRL_RST;
+            break;
+    }
+}
+
+static bool vsock_process_tx(virtio_vsock_t* vs)
+{
+    virtqueue_t* vq = &vs->dev.queues[VSOCK_QUEUE_TX];
+    bool pushed = false;
+    int popped;
+
+    do {
+        virtq_disable_notify(&vs->dev, vq);
+
+        while ((popped = virtq_pop(&vs->dev, vq, &vs->elem)) > 0) {
+            vsock_guest_packet(vs, &vs->elem);
+            virtq_push(vq, vs->elem.head, 0);
+            pushed = true;
+        }
+
+        if (popped < 0) {
+            vs->dev.status |= VIRTIO_STATUS_NEEDS_RESET;
+            vq->ready = 0;
+            break;
+        }
+    } while (virtq_enable_notify(&vs->dev, vq));
+
+    return pushed && virtq_should_notify(&vs->dev, vq);
+}
+
+// ---------------------------------------------------------------------------
+// RX: pacotes para o guest
+// ---------------------------------------------------------------------------
+
+static void vsock_fill_hdr(virtio_vsock_t* vs, virtio_vsock_hdr_t* hdr, uint32_t guest_port, uint32_t host_port,
+                           uint16_t op)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->src_cid = VSOCK_HOST_CID;
+    hdr->dst_cid = vs->config.guest_cid;
+    hdr->src_port = host_port;
+    hdr->dst_port = guest_port;
+    hdr->type = VIRTIO_VSOCK_TYPE_STREAM;
+    hdr->op = op;
+    hdr->buf_alloc = VSOCK_BUF_ALLOC;
+}
+
+// Pacote sem payload num buffer de RX; false = sem buffer
+static bool vsock_send_ctrl(virtio_vsock_t* vs, const virtio_vsock_hdr_t* hdr)
+{
+    virtqueue_t* vq = &vs->dev.queues[VSOCK_QUEUE_RX];
+    virtq_elem_t* elem = &vs->elem;
+
+    if (virtq_pop(&vs->dev, vq, elem) <= 0) {
+        return false;
+    }
+    size_t len = virtq_iov_write(&elem->iov[elem->out_num], elem->in_num, 0, hdr, sizeof(*hdr));
+    virtq_push(vq, elem->head, (uint32_t)len);
+    return true;
+}
+
+static bool vsock_conn_ctrl(virtio_vsock_t* vs, vsock_conn_t* conn)
+{
+    static const struct {
+        uint32_t bit;
+        uint16_t op;
+    } order[] = {
+        { VSOCK_CTRL_REQUEST, VIRTIO_VSOCK_OP_REQUEST },
+        { VSOCK_CTRL_RESPONSE, VIRTIO_VSOCK_OP_RESPONSE },
+        { VSOCK_CTRL_CREDIT, VIRTIO_VSOCK_OP_CREDIT_UPDATE },
+        { VSOCK_CTRL_SHUTDOWN, VIRTIO_VSOCK_OP_SHUTDOWN },
+        { VSOCK_CTRL_RST, VIRTIO_VSOCK_OP_RST },
+    };
+
+    for (uint32_t i = 0; i < sizeof(order) / sizeof(order[0]) && conn->ctrl; i++) {
+        virtio_vsock_hdr_t hdr;
+
+        if (!(conn->ctrl & order[i].bit)) {
+            continue;
+        }
+        vsock_fill_hdr(vs, &hdr, conn->guest_port, conn->host_port, order[i].op);
+        hdr.fwd_cnt = conn->fwd_cnt;
+        if (order[i].op == VIRTIO_VSOCK_OP_SHUTDOWN) {
+            hdr.flags = VIRTIO_VSOCK_SHUTDOWN_RCV | VIRTIO_VSOCK_SHUTDOWN_SEND;
+        }
+        if (!vsock_send_ctrl(vs, &hdr)) {
+            return false;
+        }
+
+        conn->ctrl &= ~order[i].bit;
+        conn->fwd_cnt_sent = conn->fwd_cnt;
+        if (order[i].op == VIRTIO_VSOCK_OP_RST) {
+            vsock_conn_free(conn);
+            break;
+        }
+    }
+    return true;
+}
+
+// Um pacote de dados do socket: lido direto para o buffer do guest.
+// false = nada enviado (sem dado, sem crédito ou sem buffer)
+static bool vsock_conn_data(virtio_vsock_t* vs, vsock_conn_t* conn, bool* no_buffer)
+{
+    virtqueue_t* vq = &vs->dev.queues[VSOCK_QUEUE_RX];
+    virtq_elem_t* elem = &vs->elem;
+    uint32_t credit = conn->peer_buf_alloc - (conn->tx_cnt - conn->peer_fwd_cnt);
+
+    if (conn->state != VSOCK_CONN_ESTABLISHED || !conn->readable || conn->host_eof || conn->ctrl ||
+        credit == 0 || credit > conn->peer_buf_alloc) {
+        return false;
+    }
+
+    int popped = virtq_pop(&vs->dev, vq, elem);
+    if (popped <= 0) {
+        *no_buffer = true;
+        return false;
+    }
+
+    virtq_iov_t* in = &elem->iov[elem->out_num];
+    size_t room = 0;
+    for (uint32_t i = 0; i < elem->in_num; i++) {
+        room += in[i].len;
+    }
+    if (room <= sizeof(virtio_vsock_hdr_t)) {
+        virtq_push(vq, elem->head, 0);
+        return true;
+    }
+
+    size_t want = room - sizeof(virtio_vsock_hdr_t);
+    want = want < credit ? want : credit;
+    want = want < VSOCK_MAX_PKT ? want : VSOCK_MAX_PKT;
+
+    WSABUF bufs[VIRTQ_MAX_IOV];
+    DWORD count = vsock_wsabufs(in, elem->in_num, sizeof(virtio_vsock_hdr_t), want, bufs);
+    DWORD bytes = 0;
+    DWORD flags = 0;
+
+    if (WSARecv(conn->sock, bufs, count, &bytes, &flags, NULL, NULL) != 0) {
+        virtq_unpop(vq, 1);
+        if (WSAGetLastError() == WSAEWOULDBLOCK) {
+            conn->readable = false;     // FD_READ volta a sinalizar
+        } else {
+            conn->ctrl |= VSOCK_CTRL_RST;
+        }
+        return false;
+    }
+    if (bytes == 0) {
+        // Host fechou: o guest recebe SHUTDOWN e responde com RST
+        virtq_unpop(vq, 1);
+        conn->host_eof = true;
+        conn->ctrl |= VSOCK_CTRL_SHUTDOWN;
+        return false;
+    }
+
+    virtio_vsock_hdr_t hdr;
+    vsock_fill_hdr(vs, &hdr, conn->guest_port, conn->host_port, VIRTIO_VSOCK_OP_RW);
+    hdr.len = (uint32_t)bytes;
+    hdr.fwd_cnt = conn->fwd_cnt;
+    virtq_iov_write(in, elem->in_num, 0, &hdr, sizeof(hdr));
+    virtq_push(vq, elem->head, (uint32_t)(sizeof(hdr) + bytes));
+
+    conn->tx_cnt += (uint32_t)bytes;
+    conn->fwd_cnt_sent = conn->fwd_cnt;
+    vs->rx_bytes += bytes;
+    return true;
+}
+
+static bool vsock_process_rx(virtio_vsock_t* vs)
+{
+    virtqueue_t* vq = &vs->dev.queues[VSOCK_QUEUE_RX];
+    uint16_t start = vq->used_idx;
+    bool no_buffer = false;
+
+    // Controle primeiro: RSTs avulsos, depois o de cada conexão
+    while (vs->rst_count) {
+        virtio_vsock_hdr_t hdr;
+        vsock_rst_t* rst = &vs->rst[vs->rst_count - 1];
+
+        vsock_fill_hdr(vs, &hdr, rst->guest_port, rst->host_port, VIRTIO_VSOCK_OP_RST);
+        if (!vsock_send_ctrl(vs, &hdr)) {
+            no_buffer = true;
+            break;
+        }
+        vs->rst_count--;
+    }
+    for (uint32_t i = 0; i < VSOCK_MAX_CONNS && !no_buffer; i++) {
+        vsock_conn_t* conn = &vs->conns[i];
+        if (conn->state != VSOCK_CONN_FREE && conn->state != VSOCK_CONN_HANDSHAKE && conn->ctrl) {
+            no_buffer = !vsock_conn_ctrl(vs, conn);
+        }
+    }
+
+    // Dados em rodízio, um pacote por conexão por volta
+    bool progress = true;
+    while (!no_buffer && progress) {
+        progress = false;
+        for (uint32_t n = 0; n < VSOCK_MAX_CONNS && !no_buffer; n++) {
+            vsock_conn_t* conn = &vs->conns[(vs->rr_next + n) % VSOCK_MAX_CONNS];
+
+            if (vsock_conn_data(vs, conn, &no_buffer)) {
+                progress = true;
+            } else if (conn->ctrl && conn->state != VSOCK_CONN_FREE) {
+                // EOF ou erro descoberto na leitura
+                no_buffer = !vsock_conn_ctrl(vs, conn);
+            }
+        }
+        vs->rr_next = (vs->rr_next + 1) % VSOCK_MAX_CONNS;
+    }
+
+    if (no_buffer) {
+        virtq_enable_notify(&vs->dev, vq);
+    }
+    return vq->used_idx != start && virtq_should_notify(&vs->dev, vq);
+}
+
+// ---------------------------------------------------------------------------
+// Thread de I/O
+// ---------------------------------------------------------------------------
+
+static DWORD WINAPI vsock_io_thread(LPVOID param)
+{
+    virtio_vsock_t* vs = (virtio_vsock_t*)param;
+    WSAEVENT events[WSA_MAXIMUM_WAIT_EVENTS];
+
+    while (!vs->stop) {
+        DWORD count = 0;
+
+        EnterCriticalSection(&vs->lock);
+        events[count++] = vs->kick;
+        if (vs->listener != INVALID_SOCKET) {
+            events[count++] = vs->listener_event;
+        }
+        for (uint32_t i = 0; i < VSOCK_MAX_CONNS; i++) {
+            if (vs->conns[i].state != VSOCK_CONN_FREE) {
+                events[count++] = vs->conns[i].event;
+            }
+        }
+        LeaveCriticalSection(&vs->lock);
+
+        if (WSAWaitForMultipleEvents(count, events, FALSE, WSA_INFINITE, FALSE) == WSA_WAIT_FAILED) {
+            LOG_ERROR("%s: WSAWaitForMultipleEvents falhou: %d", vs->name, WSAGetLastError());
+            break;
+        }
+        if (vs->stop) {
+            break;
+        }
+
+        bool raise = false;
+
+        EnterCriticalSection(&vs->lock);
+        WSAResetEvent(vs->kick);
+        vsock_poll_sockets(vs);
+        if (vs->dev.status & VIRTIO_STATUS_DRIVER_OK) {
+            raise |= vsock_process_tx(vs);
+            for (uint32_t i = 0; i < VSOCK_MAX_CONNS; i++) {
+                if (vs->conns[i].pending_len) {
+                    vsock_flush_pending(&vs->conns[i]);
+                }
+            }
+            raise |= vsock_process_rx(vs);
+        }
+        LeaveCriticalSection(&vs->lock);
+
+        // Fora do lock do device: a SPI toma g_device_lock
+        if (raise) {
+            virtio_raise_irq(&vs->dev, VIRTIO_INT_USED_RING);
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Hooks do transporte
+// ---------------------------------------------------------------------------
+
+static void virtio_vsock_notify(virtio_dev_t* dev, uint32_t queue)
+{
+    virtio_vsock_t* vs = (virtio_vsock_t*)dev;
+
+    // eventq: buffers ficam no anel (sem eventos de transporte)
+    if (queue != VSOCK_QUEUE_EVENT) {
+        WSASetEvent(vs->kick);
+    }
+}
+
+static void virtio_vsock_start(virtio_dev_t* dev)
+{
+    virtio_vsock_t* vs = (virtio_vsock_t*)dev;
+
+    // Conexões do host aceitas antes do driver subir
+    WSASetEvent(vs->kick);
+}
+
+static void virtio_vsock_reset(virtio_dev_t* dev)
+{
+    virtio_vsock_t* vs = (virtio_vsock_t*)dev;
+
+    // Sockets não bloqueiam: o lock é curto mesmo com a thread ativa
+    EnterCriticalSection(&vs->lock);
+    for (uint32_t i = 0; i < VSOCK_MAX_CONNS; i++) {
+        if (vs->conns[i].state != VSOCK_CONN_FREE) {
+            vsock_conn_free(&vs->conns[i]);
+        }
+    }
+    vs->rst_count = 0;
+    virtio_queues_reset(dev);
+    LeaveCriticalSection(&vs->lock);
+
+    // Refazer a lista de eventos da espera
+    WSASetEvent(vs->kick);
+}
+
+static void virtio_vsock_destroy(virtio_dev_t* dev)
+{
+    virtio_vsock_t* vs = (virtio_vsock_t*)dev;
+
+    if (vs->thread) {
+        vs->stop = true;
+        WSASetEvent(vs->kick);
+        WaitForSingleObject(vs->thread, INFINITE);
+        CloseHandle(vs->thread);
+        DeleteCriticalSection(&vs->lock);
+    }
+    for (uint32_t i = 0; i < VSOCK_MAX_CONNS; i++) {
+        if (vs->conns[i].state != VSOCK_CONN_FREE) {
+            vsock_conn_free(&vs->conns[i]);
+        }
+        if (vs->conns[i].event != WSA_INVALID_EVENT) {
+            WSACloseEvent(vs->conns[i].event);
+        }
+    }
+    if (vs->listener != INVALID_SOCKET) {
+        closesocket(vs->listener);
+        DeleteFileA(vs->path);
+    }
+    if (vs->listener_event != WSA_INVALID_EVENT) {
+        WSACloseEvent(vs->listener_event);
+    }
+    if (vs->kick != WSA_INVALID_EVENT) {
+        WSACloseEvent(vs->kick);
+    }
+    if (vs->wsa_started) {
+        LOG_DEBUG("%s: %llu bytes do guest, %llu para o guest", vs->name, vs->tx_bytes, vs->rx_bytes);
+        WSACleanup();
+    }
+    free(vs);
+}
+
+static const virtio_dev_ops_t virtio_vsock_ops = {
+    .notify = virtio_vsock_notify,
+    .reset = virtio_vsock_reset,
+    .start = virtio_vsock_start,
+    .destroy = virtio_vsock_destroy,
+};
+
+static int vsock_listen(virtio_vsock_t* vs)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", vs->path);
+    DeleteFileA(vs->path);      // Socket de uma execução anterior
+
+    vs->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    vs->listener_event = WSACreateEvent();
+    if (vs->listener == INVALID_SOCKET || vs->listener_event == WSA_INVALID_EVENT ||
+        bind(vs->listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(vs->listener, 16) != 0 ||
+        WSAEventSelect(vs->listener, vs->listener_event, FD_ACCEPT) != 0) {
+        LOG_ERROR("%s: falha ao escutar em %s: %d", vs->name, vs->path, WSAGetLastError());
+        return -1;
+    }
+    return 0;
+}
+
+int virtio_vsock_create(uint64_t guest_cid, const char* path)
+{
+    WSADATA wsa;
+
+    // CIDs 0-2 são reservados (hypervisor, local, host)
+    if (guest_cid < 3 || guest_cid > 0xFFFFFFFEULL) {
+        LOG_ERROR("virtio-vsock: CID do guest inválido (%llu)", guest_cid);
+        return -1;
+    }
+    // Sufixo "_<porta>" precisa caber no caminho
+    if (strlen(path) + 12 > UNIX_PATH_MAX - 1) {
+        LOG_ERROR("virtio-vsock: caminho longo demais para AF_UNIX (%s)", path);
+        return -1;
+    }
+
+    virtio_vsock_t* vs = (virtio_vsock_t*)calloc(1, sizeof(virtio_vsock_t));
+    if (!vs) {
+        return -1;
+    }
+    snprintf(vs->name, sizeof(vs->name), "virtio-vsock");
+    snprintf(vs->path, sizeof(vs->path), "%s", path);
+    vs->listener = INVALID_SOCKET;
+    vs->listener_event = WSA_INVALID_EVENT;
+    vs->kick = WSA_INVALID_EVENT;
+    vs->next_port = VSOCK_EPHEMERAL_BASE;
+    vs->config.guest_cid = guest_cid;
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        LOG_ERROR("%s: WSAStartup falhou", vs->name);
+        free(vs);
+        return -1;
+    }
+    vs->wsa_started = true;
+
+    bool events_ok = (vs->kick = WSACreateEvent()) != WSA_INVALID_EVENT;
+    for (uint32_t i = 0; i < VSOCK_MAX_CONNS; i++) {
+        vs->conns[i].event = WSACreateEvent();
+        events_ok &= vs->conns[i].event != WSA_INVALID_EVENT;
+    }
+    if (!events_ok || vsock_listen(vs) != 0) {
+        virtio_vsock_destroy(&vs->dev);
+        return -1;
+    }
+
+    vs->dev.name = vs->name;
+    vs->dev.device_id = VIRTIO_ID_VSOCK;
+    vs->dev.host_features = VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_RING_F_EVENT_IDX;
+    vs->dev.ops = &virtio_vsock_ops;
+    vs->dev.config = &vs->config;
+    vs->dev.config_size = sizeof(vs->config);
+    vs->dev.num_queues = 3;
+
+    InitializeCriticalSection(&vs->lock);
+    vs->thread = CreateThread(NULL, 0, vsock_io_thread, vs, 0, NULL);
+    if (!vs->thread) {
+        DeleteCriticalSection(&vs->lock);
+        virtio_vsock_destroy(&vs->dev);
+        return -1;
+    }
+
+    if (virtio_mmio_register(&vs->dev) != 0) {
+        virtio_vsock_destroy(&vs->dev);
+        return -1;
+    }
+
+    LOG_INFO("%s: CID %llu, host em %s (guest -> host: %s_<porta>)", vs->name, guest_cid, path, path);
+    return 0;
+}
@@ -0,0 +1,213 @@
+/* Desenvolvido por: Escanearcpl */
+#include "virtio.h"
+#include "vm.h"
+
+// Campos escritos pelo outro lado do anel: sempre relidos da memória
+#define VIRTQ_READ16(p)         (*(volatile uint16_t*)&(p))
+#define VIRTQ_WRITE16(p, v)     (*(volatile uint16_t*)&(p) = (uint16_t)(v))
+
+// EVENT_IDX: used_event no fim do avail, avail_event no fim do used
+#define VIRTQ_USED_EVENT(vq)    ((vq)->avail->ring[(vq)->num])
+#define VIRTQ_AVAIL_EVENT(vq)   (*(uint16_t*)&(vq)->used->ring[(vq)->num])
+
+int virtq_pop(virtio_dev_t* dev, virtqueue_t* vq, virtq_elem_t* elem)
+{
+    if (!vq->ready) {
+        return 0;
+    }
+
+    uint16_t avail_idx = VIRTQ_READ16(vq->avail->idx);
+    if (avail_idx == vq->last_avail) {
+        return 0;
+    }
+    if ((uint16_t)(avail_idx - vq->last_avail) > vq->num) {
+        LOG_ERROR("%s: avail->idx %u inconsistente (último %u)", dev->name, avail_idx, vq->last_avail);
+        return -1;
+    }
+
+    // Entrada do anel lida só depois de avail->idx
+    MemoryBarrier();
+
+    uint16_t head = VIRTQ_READ16(vq->avail->ring[vq->last_avail % vq->num]);
+    vq->last_avail++;
+
+    const virtq_desc_t* table = vq->desc;
+    uint32_t table_size = vq->num;
+    uint32_t seen = 0;
+    uint16_t i = head;
+
+    elem->head = head;
+    elem->out_num = 0;
+    elem->in_num = 0;
+
+    if (head >= vq->num) {
+        goto invalid;
+    }
+
+    for (;;) {
+        virtq_desc_t desc = table[i];
+
+        if (desc.flags & VIRTQ_DESC_F_INDIRECT) {
+            // Tabela indireta: só no descritor do anel principal e sem NEXT
+            if (table != vq->desc || !virtio_has_feature(dev, VIRTIO_RING_F_INDIRECT_DESC) ||
+                desc.len == 0 || desc.len % sizeof(virtq_desc_t) || (desc.flags & VIRTQ_DESC_F_NEXT)) {
+                goto invalid;
+            }
+            table = (const virtq_desc_t*)vm_gpa_to_hva(desc.addr, desc.len);
+            table_size = desc.len / sizeof(virtq_desc_t);
+            if (!table) {
+                goto invalid;
+            }
+            seen = 0;
+            i = 0;
+            continue;
+        }
+
+        // Limite de descritores da tabela detecta cadeias em laço
+        if (++seen > table_size || elem->out_num + elem->in_num >= VIRTQ_MAX_IOV) {
+            goto invalid;
+        }
+
+        void* hva = vm_gpa_to_hva(desc.addr, desc.len);
+        if (!hva) {
+            goto invalid;
+        }
+
+        virtq_iov_t* iov = &elem->iov[elem->out_num + elem->in_num];
+        iov->addr = hva;
+        iov->len = desc.len;
+
+        if (desc.flags & VIRTQ_DESC_F_WRITE) {
+            elem->in_num++;
+        } else if (elem->in_num) {
+            goto invalid;   // Segmento de leitura depois de um de escrita
+        } else {
+            elem->out_num++;
+        }
+
+        if (!(desc.flags & VIRTQ_DESC_F_NEXT)) {
+            return 1;
+        }
+
+        i = desc.next;
+        if (i >= table_size) {
+            goto invalid;
+        }
+    }
+
+invalid:
+    LOG_ERROR("%s: cadeia de descritores inválida (head %u)", dev->name, head);
+    return -1;
+}
+
+void virtq_unpop(virtqueue_t* vq, uint16_t count)
+{
+    vq->last_avail -= count;
+}
+
+void virtq_fill(virtqueue_t* vq, uint16_t head, uint32_t len, uint16_t offset)
+{
+    virtq_used_elem_t* used = &vq->used->ring[(uint16_t)(vq->used_idx + offset) % vq->num];
+
+    used->id = head;
+    used->len = len;
+}
+
+void virtq_flush(virtqueue_t* vq, uint16_t count)
+{
+    vq->used_idx += count;
+
+    // Elementos visíveis antes do novo used->idx
+    MemoryBarrier();
+    VIRTQ_WRITE16(vq->used->idx, vq->used_idx);
+}
+
+void virtq_push(virtqueue_t* vq, uint16_t head, uint32_t len)
+{
+    virtq_fill(vq, head, len, 0);
+    virtq_flush(vq, 1);
+}
+
+bool virtq_should_notify(virtio_dev_t* dev, virtqueue_t* vq)
+{
+    // used->idx publicado antes de ler a supressão escrita pelo driver
+    MemoryBarrier();
+
+    if (!virtio_has_feature(dev, VIRTIO_RING_F_EVENT_IDX)) {
+        return !(VIRTQ_READ16(vq->avail->flags) & VIRTQ_AVAIL_F_NO_INTERRUPT);
+    }
+
+    uint16_t old = vq->signalled_used;
+    uint16_t now = vq->used_idx;
+    bool valid = vq->signalled_valid;
+
+    vq->signalled_used = now;
+    vq->signalled_valid = true;
+
+    // vring_need_event(): notificar se used_event está em (old, now]
+    uint16_t event = VIRTQ_READ16(VIRTQ_USED_EVENT(vq));
+    return !valid || (uint16_t)(now - event - 1) < (uint16_t)(now - old);
+}
+
+void virtq_disable_notify(virtio_dev_t* dev, virtqueue_t* vq)
+{
+    // Com EVENT_IDX basta não avançar avail_event
+    if (!virtio_has_feature(dev, VIRTIO_RING_F_EVENT_IDX)) {
+        VIRTQ_WRITE16(vq->used->flags, VIRTQ_USED_F_NO_NOTIFY);
+    }
+}
+
+bool virtq_enable_notify(virtio_dev_t* dev, virtqueue_t* vq)
+{
+    if (virtio_has_feature(dev, VIRTIO_RING_F_EVENT_IDX)) {
+        VIRTQ_WRITE16(VIRTQ_AVAIL_EVENT(vq), vq->last_avail);
+    } else {
+        VIRTQ_WRITE16(vq->used->flags, 0);
+    }
+
+    // Reabilitar antes de reler avail->idx: um kick não se perde entre os dois
+    MemoryBarrier();
+    return vq->ready && VIRTQ_READ16(vq->avail->idx) != vq->last_avail;
+}
+
+size_t virtq_iov_read(const virtq_iov_t* iov, uint32_t count, size_t offset, void* buf, size_t len)
+{
+    size_t done = 0;
+
+    for (uint32_t i = 0; i < count && done < len; i++) {
+        if (offset >= iov[i].len) {
+            offset -= iov[i].len;
+            continue;
+        }
+
+        size_t chunk = iov[i].len - offset;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        memcpy((uint8_t*)buf + done, (uint8_t*)iov[i].addr + offset, chunk);
+        done += chunk;
+        offset = 0;
+    }
+    return done;
+}
+
+size_t virtq_iov_write(const virtq_iov_t* iov, uint32_t count, size_t offset, const void* buf, size_t len)
+{
+    size_t done = 0;
+
+    for (uint32_t i = 0; i < count && done < len; i++) {
+        if (offset >= iov[i].len) {
+            offset -= iov[i].len;
+            continue;
+        }
+
+        size_t chunk = iov[i].len - offset;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        memcpy((uint8_t*)iov[i].addr + offset, (const uint8_t*)buf + done, chunk);
+        done += chunk;
+        offset = 0;
+    }
+    return done;
+}
@@ -0,0 +1,587 @@
+/* Desenvolvido por: Escanearcpl */
+#include "vswitch.h"
+
+#define SW_MAC_PROBE            4       // Slots examinados por MAC
+#define SW_POOL_TOTAL           (VSWITCH_POOL_BUFS + VSWITCH_POOL_GSO_BUFS)
+
+#define ETH_P_8021Q             0x8100
+#define IPPROTO_TCP_NUM         6
+#define TCP_FLAG_FIN            0x01
+#define TCP_FLAG_PSH            0x08
+#define TCP_FLAG_CWR            0x80
+
+typedef struct {
+    uint8_t mac[6];
+    bool valid;
+    uint32_t port;
+    uint64_t seen_ms;
+} sw_mac_entry_t;
+
+static struct {
+    CRITICAL_SECTION lock;      // Portas, tabela de MACs, pool, filas
+    bool initialized;
+    vswitch_port_t* ports[VSWITCH_PORTS_MAX];
+    uint32_t num_ports;
+    sw_mac_entry_t macs[VSWITCH_MAC_TABLE];
+
+    vswitch_buf_t* pool;        // Descritores dos buffers
+    uint8_t* slab;              // Dados: pequenos seguidos dos de GSO
+    vswitch_buf_t* free_small;
+    vswitch_buf_t* free_gso;
+
+    uint8_t* linear;            // Frame de origem inteiro (fallback de offload)
+    uint8_t* segment;           // Segmento gerado em software
+
+    uint64_t floods;
+} g_sw;
+
+static inline uint64_t sw_now_ms(void)
+{
+    return timer_get_time_ns() / 1000000ULL;
+}
+
+size_t vswitch_frame_read(const vswitch_frame_t* frame, size_t offset, void* buf, size_t len)
+{
+    return virtq_iov_read(frame->iov, frame->iov_count, frame->offset + offset, buf, len);
+}
+
+size_t vswitch_frame_copy(const vswitch_frame_t* frame, const virtq_iov_t* dst, uint32_t count, size_t offset)
+{
+    size_t skip = frame->offset;
+    size_t done = 0;
+
+    // Segmento a segmento da origem direto para os buffers de destino
+    for (uint32_t i = 0; i < frame->iov_count && done < frame->len; i++) {
+        const virtq_iov_t* seg = &frame->iov[i];
+
+        if (skip >= seg->len) {
+            skip -= seg->len;
+            continue;
+        }
+
+        size_t chunk = seg->len - skip;
+        if (chunk > frame->len - done) {
+            chunk = frame->len - done;
+        }
+        size_t copied = virtq_iov_write(dst, count, offset + done, (const uint8_t*)seg->addr + skip, chunk);
+        done += copied;
+        if (copied < chunk) {
+            break;
+        }
+        skip = 0;
+    }
+    return done;
+}
+
+// ---------------------------------------------------------------------------
+// Tabela de MACs
+// ---------------------------------------------------------------------------
+
+static inline uint32_t sw_mac_hash(const uint8_t* mac)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        h = (h ^ mac[i]) * 16777619u;
+    }
+    return h;
+}
+
+static sw_mac_entry_t* sw_mac_find(const uint8_t* mac, uint64_t now)
+{
+    uint32_t h = sw_mac_hash(mac);
+
+    for (uint32_t i = 0; i < SW_MAC_PROBE; i++) {
+        sw_mac_entry_t* e = &g_sw.macs[(h + i) & (VSWITCH_MAC_TABLE - 1)];
+        if (e->valid && memcmp(e->mac, mac, 6) == 0) {
+            return now - e->seen_ms < VSWITCH_MAC_AGE_MS ? e : NULL;
+        }
+    }
+    return NULL;
+}
+
+static void sw_mac_learn(const uint8_t* mac, uint32_t port, uint64_t now)
+{
+    uint32_t h = sw_mac_hash(mac);
+    sw_mac_entry_t* victim = NULL;
+
+    for (uint32_t i = 0; i < SW_MAC_PROBE; i++) {
+        sw_mac_entry_t* e = &g_sw.macs[(h + i) & (VSWITCH_MAC_TABLE - 1)];
+
+        if (e->valid && memcmp(e->mac, mac, 6) == 0) {
+            victim = e;
+            break;
+        }
+        // Livre, senão o mais antigo
+        if (!victim || (victim->valid && (!e->valid || e->seen_ms < victim->seen_ms))) {
+            victim = e;
+        }
+    }
+
+    if (victim->valid && memcmp(victim->mac, mac, 6) == 0 && victim->port != port) {
+        LOG_DEBUG("vswitch: %02x:%02x:%02x:%02x:%02x:%02x mudou para a porta %u",
+                  mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], port);
+    }
+    memcpy(victim->mac, mac, 6);
+    victim->valid = true;
+    victim->port = port;
+    victim->seen_ms = now;
+}
+
+// ---------------------------------------------------------------------------
+// Pool e filas das portas (lock do switch tomado)
+// ---------------------------------------------------------------------------
+
+static void sw_buf_free(vswitch_buf_t* buf)
+{
+    vswitch_buf_t** list = buf->size > VSWITCH_FRAME_MAX ? &g_sw.free_gso : &g_sw.free_small;
+
+    buf->next = *list;
+    *list = buf;
+}
+
+// Frames pequenos usam um buffer de GSO só se os pequenos acabaram
+static vswitch_buf_t* sw_buf_alloc(uint32_t len)
+{
+    vswitch_buf_t** list = len <= VSWITCH_FRAME_MAX && g_sw.free_small ? &g_sw.free_small : &g_sw.free_gso;
+    vswitch_buf_t* buf = *list;
+
+    if (buf) {
+        *list = buf->next;
+    }
+    return buf;
+}
+
+static void sw_enqueue(vswitch_port_t* port, const vswitch_frame_t* frame)
+{
+    vswitch_buf_t* buf = port->queue_len < VSWITCH_PORT_QUEUE ? sw_buf_alloc(frame->len) : NULL;
+
+    if (!buf) {
+        port->stats.rx_dropped++;
+        return;
+    }
+
+    buf->len = (uint32_t)vswitch_frame_read(frame, 0, buf->data, frame->len);
+    buf->off = frame->off;
+    buf->next = NULL;
+    if (port->queue_tail) {
+        port->queue_tail->next = buf;
+    } else {
+        port->queue_head = buf;
+    }
+    port->queue_tail = buf;
+    port->queue_len++;
+    port->stats.rx_queued++;
+}
+
+static void sw_delivered(vswitch_port_t* port, int result, uint32_t len)
+{
+    if (result == VSWITCH_DELIVERED) {
+        port->dirty = true;
+        port->stats.rx_packets++;
+        port->stats.rx_bytes += len;
+    } else {
+        port->stats.rx_dropped++;
+    }
+}
+
+static void sw_deliver_one(vswitch_port_t* port, const vswitch_frame_t* frame)
+{
+    // Com frames retidos, os novos entram atrás para manter a ordem
+    if (!port->queue_head) {
+        int result = port->ops->deliver(port, frame);
+        if (result != VSWITCH_NO_BUFFER) {
+            sw_delivered(port, result, frame->len);
+            return;
+        }
+    }
+    sw_enqueue(port, frame);
+}
+
+// ---------------------------------------------------------------------------
+// Offloads em software (porta de destino sem a capacidade)
+// ---------------------------------------------------------------------------
+
+static inline uint16_t sw_get16(const uint8_t* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void sw_put16(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint64_t sw_csum_add(uint64_t sum, const uint8_t* p, size_t len)
+{
+    for (; len > 1; p += 2, len -= 2) {
+        sum += sw_get16(p);
+    }
+    if (len) {
+        sum += (uint32_t)p[0] << 8;
+    }
+    return sum;
+}
+
+static uint16_t sw_csum_fold(uint64_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+// Frame entregue pelo fallback: checksum recém-calculado
+static void sw_deliver_linear(vswitch_port_t* port, const uint8_t* data, uint32_t len)
+{
+    virtq_iov_t iov = { (void*)data, len };
+    vswitch_frame_t frame = { .iov = &iov, .iov_count = 1, .len = len };
+
+    frame.off.flags = (port->caps & VSWITCH_CAP_CSUM) ? VSWITCH_CSUM_VALID : 0;
+    sw_deliver_one(port, &frame);
+}
+
+// CSUM_PARTIAL: o campo já tem a soma do pseudo-cabeçalho; falta somar de
+// csum_start ao fim do frame
+static void sw_soft_csum(vswitch_port_t* port, const vswitch_frame_t* frame)
+{
+    uint8_t* pkt = g_sw.linear;
+    uint32_t len = (uint32_t)vswitch_frame_read(frame, 0, pkt, frame->len);
+    uint32_t start = frame->off.csum_start;
+    uint32_t field = start + frame->off.csum_offset;
+
+    uint16_t csum = sw_csum_fold(sw_csum_add(0, pkt + start, len - start));
+    // UDP: zero significa "sem checksum"
+    sw_put16(pkt + field, csum == 0 && frame->off.csum_offset == 6 ? 0xFFFF : csum);
+
+    port->stats.rx_soft_csum++;
+    sw_deliver_linear(port, pkt, len);
+}
+
+// TSO em software: segmentos de gso_size bytes de payload com cabeçalhos
+// IP/TCP ajustados e checksums completos
+static void sw_soft_segment(vswitch_port_t* port, const vswitch_frame_t* frame)
+{
+    uint8_t* pkt = g_sw.linear;
+    uint32_t len = (uint32_t)vswitch_frame_read(frame, 0, pkt, frame->len);
+    bool v4 = (frame->off.gso_type & ~VSWITCH_GSO_ECN) == VSWITCH_GSO_TCPV4;
+    uint32_t l3 = sw_get16(pkt + 12) == ETH_P_8021Q ? 18 : 14;
+    uint32_t l4 = frame->off.csum_start;
+    uint32_t mss = frame->off.gso_size;
+
+    // Cabeçalhos coerentes com o tipo de GSO, senão o frame não segue
+    uint32_t l3_len = v4 ? (pkt[l3] & 0xF) * 4u : 40u;
+    if (l4 + 20 > len || l4 < l3 + l3_len || (pkt[l3] >> 4) != (v4 ? 4 : 6) ||
+        (v4 ? pkt[l3 + 9] : pkt[l3 + 6]) != IPPROTO_TCP_NUM) {
+        port->stats.rx_dropped++;
+        return;
+    }
+    uint32_t hdrs = l4 + (pkt[l4 + 12] >> 4) * 4u;
+    if (hdrs > len) {
+        port->stats.rx_dropped++;
+        return;
+    }
+
+    uint32_t seq = ((uint32_t)sw_get16(pkt + l4 + 4) << 16) | sw_get16(pkt + l4 + 6);
+    uint16_t ip_id = v4 ? sw_get16(pkt + l3 + 4) : 0;
+    uint8_t tcp_flags = pkt[l4 + 13];
+    uint8_t* seg = g_sw.segment;
+
+    for (uint32_t pos = hdrs, n = 0; pos < len; pos += mss, n++) {
+        uint32_t chunk = len - pos < mss ? len - pos : mss;
+        uint32_t seg_len = hdrs + chunk;
+        uint32_t seg_seq = seq + (pos - hdrs);
+        bool last = pos + chunk >= len;
+
+        memcpy(seg, pkt, hdrs);
+        memcpy(seg + hdrs, pkt + pos, chunk);
+
+        uint64_t pseudo;
+        if (v4) {
+            sw_put16(seg + l3 + 2, seg_len - l3);
+            sw_put16(seg + l3 + 4, (uint16_t)(ip_id + n));
+            sw_put16(seg + l3 + 10, 0);
+            sw_put16(seg + l3 + 10, sw_csum_fold(sw_csum_add(0, seg + l3, l3_len)));
+            pseudo = sw_csum_add(0, seg + l3 + 12, 8);
+        } else {
+            sw_put16(seg + l3 + 4, seg_len - l3 - 40);
+            pseudo = sw_csum_add(0, seg + l3 + 8, 32);
+        }
+
+        sw_put16(seg + l4 + 4, seg_seq >> 16);
+        sw_put16(seg + l4 + 6, seg_seq);
+        // FIN/PSH só no último segmento, CWR só no primeiro
+        seg[l4 + 13] = tcp_flags & (uint8_t)~((last ? 0 : TCP_FLAG_FIN | TCP_FLAG_PSH) | (n ? TCP_FLAG_CWR : 0));
+        sw_put16(seg + l4 + 16, 0);
+        pseudo += IPPROTO_TCP_NUM + (seg_len - l4);
+        sw_put16(seg + l4 + 16, sw_csum_fold(sw_csum_add(pseudo, seg + l4, seg_len - l4)));
+
+        port->stats.rx_soft_segments++;
+        sw_deliver_linear(port, seg, seg_len);
+    }
+}
+
+static bool sw_port_takes_gso(const vswitch_port_t* port, const vswitch_offload_t* off)
+{
+    uint32_t need = VSWITCH_CAP_CSUM;
+
+    need |= (off->gso_type & ~VSWITCH_GSO_ECN) == VSWITCH_GSO_TCPV4 ? VSWITCH_CAP_TSO4 : VSWITCH_CAP_TSO6;
+    if (off->gso_type & VSWITCH_GSO_ECN) {
+        need |= VSWITCH_CAP_TSO_ECN;
+    }
+    return (port->caps & need) == need;
+}
+
+static void sw_deliver(vswitch_port_t* port, const vswitch_frame_t* frame)
+{
+    if (frame->off.gso_type != VSWITCH_GSO_NONE && !sw_port_takes_gso(port, &frame->off)) {
+        sw_soft_segment(port, frame);
+    } else if ((frame->off.flags & VSWITCH_CSUM_PARTIAL) && !(port->caps & VSWITCH_CAP_CSUM)) {
+        sw_soft_csum(port, frame);
+    } else {
+        sw_deliver_one(port, frame);
+    }
+}
+
+static void sw_queue_purge(vswitch_port_t* port)
+{
+    while (port->queue_head) {
+        vswitch_buf_t* buf = port->queue_head;
+        port->queue_head = buf->next;
+        sw_buf_free(buf);
+    }
+    port->queue_tail = NULL;
+    port->queue_len = 0;
+    port->dirty = false;
+}
+
+// Offloads coerentes com os features que o device aceita do guest
+static bool sw_frame_valid(const vswitch_frame_t* frame)
+{
+    const vswitch_offload_t* off = &frame->off;
+    uint8_t gso = off->gso_type & ~VSWITCH_GSO_ECN;
+
+    if (frame->len < 14) {
+        return false;
+    }
+    if ((off->flags & VSWITCH_CSUM_PARTIAL) &&
+        (uint32_t)off->csum_start + off->csum_offset + 2 > frame->len) {
+        return false;
+    }
+    if (off->gso_type == VSWITCH_GSO_NONE) {
+        return frame->len <= VSWITCH_FRAME_MAX;
+    }
+    // GSO exige checksum parcial a partir do cabeçalho TCP
+    return (gso == VSWITCH_GSO_TCPV4 || gso == VSWITCH_GSO_TCPV6) && off->gso_size &&
+           (off->flags & VSWITCH_CSUM_PARTIAL) && frame->len <= VSWITCH_GSO_FRAME_MAX;
+}
+
+// ---------------------------------------------------------------------------
+// API
+// ---------------------------------------------------------------------------
+
+static int sw_init(void)
+{
+    size_t slab_size = (size_t)VSWITCH_POOL_BUFS * VSWITCH_FRAME_MAX +
+                       (size_t)VSWITCH_POOL_GSO_BUFS * VSWITCH_GSO_FRAME_MAX;
+
+    g_sw.pool = (vswitch_buf_t*)calloc(SW_POOL_TOTAL, sizeof(vswitch_buf_t));
+    g_sw.slab = (uint8_t*)malloc(slab_size);
+    g_sw.linear = (uint8_t*)malloc(VSWITCH_GSO_FRAME_MAX);
+    g_sw.segment = (uint8_t*)malloc(VSWITCH_GSO_FRAME_MAX);
+    if (!g_sw.pool || !g_sw.slab || !g_sw.linear || !g_sw.segment) {
+        LOG_ERROR("vswitch: falha ao alocar o pool de buffers (%zu bytes)", slab_size);
+        free(g_sw.pool);
+        free(g_sw.slab);
+        free(g_sw.linear);
+        free(g_sw.segment);
+        memset(&g_sw, 0, sizeof(g_sw));
+        return -1;
+    }
+
+    uint8_t* data = g_sw.slab;
+    for (uint32_t i = 0; i < SW_POOL_TOTAL; i++) {
+        vswitch_buf_t* buf = &g_sw.pool[i];
+        buf->size = i < VSWITCH_POOL_BUFS ? VSWITCH_FRAME_MAX : VSWITCH_GSO_FRAME_MAX;
+        buf->data = data;
+        data += buf->size;
+        sw_buf_free(buf);
+    }
+
+    InitializeCriticalSection(&g_sw.lock);
+    g_sw.initialized = true;
+    return 0;
+}
+
+int vswitch_port_add(vswitch_port_t* port, const char* name, const vswitch_port_ops_t* ops, void* ctx)
+{
+    if (!g_sw.initialized && sw_init() != 0) {
+        return -1;
+    }
+
+    EnterCriticalSection(&g_sw.lock);
+
+    uint32_t id = 0;
+    while (id < VSWITCH_PORTS_MAX && g_sw.ports[id]) {
+        id++;
+    }
+    if (id == VSWITCH_PORTS_MAX) {
+        LeaveCriticalSection(&g_sw.lock);
+        LOG_ERROR("vswitch: limite de %u portas", VSWITCH_PORTS_MAX);
+        return -1;
+    }
+
+    memset(port, 0, sizeof(*port));
+    port->name = name;
+    port->ops = ops;
+    port->ctx = ctx;
+    port->id = id;
+    g_sw.ports[id] = port;
+    g_sw.num_ports++;
+
+    LeaveCriticalSection(&g_sw.lock);
+    return 0;
+}
+
+void vswitch_port_remove(vswitch_port_t* port)
+{
+    if (!g_sw.initialized || g_sw.ports[port->id] != port) {
+        return;
+    }
+
+    EnterCriticalSection(&g_sw.lock);
+    sw_queue_purge(port);
+    for (uint32_t i = 0; i < VSWITCH_MAC_TABLE; i++) {
+        if (g_sw.macs[i].valid && g_sw.macs[i].port == port->id) {
+            g_sw.macs[i].valid = false;
+        }
+    }
+    g_sw.ports[port->id] = NULL;
+    g_sw.num_ports--;
+    LeaveCriticalSection(&g_sw.lock);
+
+    LOG_DEBUG("vswitch: porta %u (%s): tx %llu frames/%llu bytes, rx %llu frames/%llu bytes, "
+              "%llu pelo pool, %llu checksums e %llu segmentos em software, %llu descartados",
+              port->id, port->name, port->stats.tx_packets, port->stats.tx_bytes, port->stats.rx_packets,
+              port->stats.rx_bytes, port->stats.rx_queued, port->stats.rx_soft_csum, port->stats.rx_soft_segments,
+              port->stats.rx_dropped + port->stats.tx_dropped);
+}
+
+void vswitch_send(vswitch_port_t* port, const vswitch_frame_t* frame)
+{
+    uint8_t eth[12];    // Destino e origem
+
+    EnterCriticalSection(&g_sw.lock);
+
+    if (!sw_frame_valid(frame) || vswitch_frame_read(frame, 0, eth, sizeof(eth)) != sizeof(eth)) {
+        port->stats.tx_dropped++;
+        LeaveCriticalSection(&g_sw.lock);
+        return;
+    }
+    port->stats.tx_packets++;
+    port->stats.tx_bytes += frame->len;
+
+    uint64_t now = sw_now_ms();
+    if (!(eth[6] & 1)) {
+        sw_mac_learn(&eth[6], port->id, now);
+    }
+
+    // Bit de grupo: broadcast e multicast sempre inundam
+    sw_mac_entry_t* entry = (eth[0] & 1) ? NULL : sw_mac_find(eth, now);
+    if (entry) {
+        if (entry->port != port->id) {
+            sw_deliver(g_sw.ports[entry->port], frame);
+        }
+    } else {
+        g_sw.floods++;
+        for (uint32_t i = 0; i < VSWITCH_PORTS_MAX; i++) {
+            if (g_sw.ports[i] && g_sw.ports[i] != port) {
+                sw_deliver(g_sw.ports[i], frame);
+            }
+        }
+    }
+
+    LeaveCriticalSection(&g_sw.lock);
+}
+
+void vswitch_port_drain(vswitch_port_t* port)
+{
+    EnterCriticalSection(&g_sw.lock);
+
+    while (port->queue_head) {
+        vswitch_buf_t* buf = port->queue_head;
+        virtq_iov_t iov = { buf->data, buf->len };
+        vswitch_frame_t frame = { &iov, 1, 0, buf->len, buf->off };
+
+        int result = port->ops->deliver(port, &frame);
+        if (result == VSWITCH_NO_BUFFER) {
+            break;
+        }
+        sw_delivered(port, result, buf->len);
+
+        port->queue_head = buf->next;
+        if (!port->queue_head) {
+            port->queue_tail = NULL;
+        }
+        port->queue_len--;
+        sw_buf_free(buf);
+    }
+
+    LeaveCriticalSection(&g_sw.lock);
+}
+
+void vswitch_port_reset(vswitch_port_t* port)
+{
+    if (!g_sw.initialized) {
+        return;
+    }
+
+    EnterCriticalSection(&g_sw.lock);
+    sw_queue_purge(port);
+    port->caps = 0;
+    LeaveCriticalSection(&g_sw.lock);
+}
+
+void vswitch_port_set_caps(vswitch_port_t* port, uint32_t caps)
+{
+    EnterCriticalSection(&g_sw.lock);
+    port->caps = caps;
+    LeaveCriticalSection(&g_sw.lock);
+}
+
+void vswitch_flush(void)
+{
+    vswitch_port_t* dirty[VSWITCH_PORTS_MAX];
+    uint32_t count = 0;
+
+    EnterCriticalSection(&g_sw.lock);
+    for (uint32_t i = 0; i < VSWITCH_PORTS_MAX; i++) {
+        vswitch_port_t* port = g_sw.ports[i];
+        if (port && port->dirty) {
+            port->dirty = false;
+            dirty[count++] = port;
+        }
+    }
+    LeaveCriticalSection(&g_sw.lock);
+
+    for (uint32_t i = 0; i < count; i++) {
+        dirty[i]->ops->signal(dirty[i]);
+    }
+}
+
+void vswitch_cleanup(void)
+{
+    if (!g_sw.initialized) {
+        return;
+    }
+
+    if (g_sw.floods) {
+        LOG_DEBUG("vswitch: %llu frames inundados", g_sw.floods);
+    }
+    DeleteCriticalSection(&g_sw.lock);
+    free(g_sw.pool);
+    free(g_sw.slab);
+    free(g_sw.linear);
+    free(g_sw.segment);
+    memset(&g_sw, 0, sizeof(g_sw));
+}
@@ -3,9 +3,23 @@
 #include "vm.h"
 #include "devices.h"
 #include "asm_functions.h"
+#include "hypercall.h"
 
-// Buffer global para contexto do guest
-guest_context_t guest_context_buffer = {0};
+// Frames de contexto do guest por pCPU (TPIDR_EL2 aponta para o frame local)
+guest_context_t g_cpu_context[EL2_MAX_CPUS];
+
+// Acesso ao registrador Rt do guest; Rt=31 é XZR em loads/stores
+static inline uint64_t guest_reg_read(const guest_context_t* ctx, uint32_t rt)
+{
+    return rt < 31 ? ctx->x[rt] : 0;
+}
+
+static inline void guest_reg_write(guest_context_t* ctx, uint32_t rt, uint64_t value)
+{
+    if (rt < 31) {
+        ctx->x[rt] = value;
+    }
+}
 
 // Handlers de exceção do hypervisor
 void handle_hypervisor_exception(uint32_t exception_type)
@@ -43,15 +57,66 @@ void handle_hypervisor_exception(uint32_t exception_type)
     }
 }
 
-// Handlers de exceção do guest
-void handle_guest_exception(uint32_t exception_type, uint64_t esr, uint64_t far, uint64_t elr)
+// Escreve no UART os caracteres enfileirados pelo fast path de putchar e
+// desarma o prazo de drenagem que o primeiro deles armou
+void fastpath_console_drain(guest_context_t* ctx)
+{
+    fastpath_console_t* con = &ctx->console;
+    uint32_t head = con->head;
+    
+    if (con->tail == head) {
+        return;
+    }
+    el2_console_timer_disarm();
+    
+    while (con->tail != head) {
+        uint32_t start = con->tail % FASTPATH_CONSOLE_SIZE;
+        uint32_t len = head - con->tail;
+        if (len > FASTPATH_CONSOLE_SIZE - start) {
+            len = FASTPATH_CONSOLE_SIZE - start;  // Até o fim do buffer circular
+        }
+        uart_write_buffer(&con->buf[start], len);
+        con->tail += len;
+        
+        // Cada caractere do ring é um HC_PUTCHAR que não passou pelo despacho
+        hypercall_account(HC_PUTCHAR, len);
+    }
+}
+
+// HVC putchar que o vetor desviou para cá (limite de retenção atingido ou
+// imediato != 0): entra no mesmo ring, para que o custo de saída seja o
+// mesmo nos dois caminhos, e drena ao atingir o limite. O vetor nunca deixa
+// o ring chegar a FASTPATH_CONSOLE_FLUSH, então sempre há espaço.
+static bool fastpath_console_putchar(guest_context_t* ctx, uint32_t exception_type)
+{
+    fastpath_console_t* con = &ctx->console;
+    
+    if (exception_type != 8 || ESR_EC(ctx->esr_el2) != 0x16 || ctx->x[0] != HC_PUTCHAR) {
+        return false;
+    }
+    
+    char c = (char)(ctx->x[1] & 0xFF);
+    con->buf[con->head % FASTPATH_CONSOLE_SIZE] = c;
+    con->head++;
+    ctx->x[0] = HC_SUCCESS;
+    
+    if (c == '\n' || con->head - con->tail >= FASTPATH_CONSOLE_FLUSH) {
+        fastpath_console_drain(ctx);
+    } else if (con->head - con->tail == 1) {
+        el2_console_timer_arm(ctx->console_drain_ticks);  // Como o vetor
+    }
+    return true;
+}
+
+// Despacho pelo tipo de exceção (número do vetor em entry.s)
+static void handle_guest_exception_type(guest_context_t* ctx, uint32_t exception_type)
 {
-    LOG_DEBUG("Exceção do guest: tipo=%d, ESR=0x%llX, FAR=0x%llX, ELR=0x%llX", 
-              exception_type, esr, far, elr);
+    LOG_TRACE("Exceção do guest: tipo=%d, ESR=0x%llX, FAR=0x%llX, ELR=0x%llX", 
+              exception_type, ctx->esr_el2, ctx->far_el2, ctx->elr_el2);
     
     switch (exception_type) {
         case 8: // Sync exception from guest (AArch64)
-            handle_guest_sync_exception(esr, far, elr);
+            handle_guest_sync_exception(ctx);
             break;
         case 9: // IRQ from guest (AArch64)
             handle_guest_irq();
@@ -60,10 +125,10 @@ void handle_guest_exception(uint32_t exception_type, uint64_t esr, uint64_t far,
             handle_guest_fiq();
             break;
         case 11: // SError from guest (AArch64)
-            handle_guest_serror(esr, far);
+            handle_guest_serror(ctx);
             break;
         case 12: // Sync exception from AArch32 guest
-            handle_guest_sync_exception_aarch32(esr, far, elr);
+            handle_guest_sync_exception_aarch32(ctx);
             break;
         case 13: // IRQ from AArch32 guest
             handle_guest_irq();
@@ -72,7 +137,7 @@ void handle_guest_exception(uint32_t exception_type, uint64_t esr, uint64_t far,
             handle_guest_fiq();
             break;
         case 15: // SError from AArch32 guest
-            handle_guest_serror(esr, far);
+            handle_guest_serror(ctx);
             break;
         default:
             LOG_ERROR("Tipo de exceção do guest desconhecido: %d", exception_type);
@@ -80,104 +145,109 @@ void handle_guest_exception(uint32_t exception_type, uint64_t esr, uint64_t far,
     }
 }
 
+// Handlers de exceção do guest
+void handle_guest_exception(guest_context_t* ctx, uint32_t exception_type)
+{
+    if (!fastpath_console_putchar(ctx, exception_type)) {
+        // Preservar a ordem da saída: o que o fast path enfileirou vem antes
+        fastpath_console_drain(ctx);
+        handle_guest_exception_type(ctx, exception_type);
+    }
+    
+    // Deadlines de timer vencidos enquanto o guest rodava
+    el2_guest_t* guest = el2_current_guest(ctx);
+    if (guest) {
+        sysreg_timer_poll(&guest->sysregs);
+    }
+    
+    ctx->irq_pending = (gic_get_pending_interrupt() != 1023);
+}
+
 // Handler para exceções síncronas do guest
-void handle_guest_sync_exception(uint64_t esr, uint64_t far, uint64_t elr)
+void handle_guest_sync_exception(guest_context_t* ctx)
 {
-    uint32_t ec = (esr >> 26) & 0x3F;  // Exception Class
-    uint32_t iss = esr & 0x1FFFFFF;    // Instruction Specific Syndrome
+    uint32_t ec = ESR_EC(ctx->esr_el2);    // Exception Class
+    uint32_t iss = ESR_ISS(ctx->esr_el2);  // Instruction Specific Syndrome
     
-    LOG_DEBUG("Guest sync exception: EC=0x%X, ISS=0x%X", ec, iss);
+    LOG_TRACE("Guest sync exception: EC=0x%X, ISS=0x%X", ec, iss);
     
     switch (ec) {
         case 0x16: // HVC instruction (AArch64)
-            handle_guest_hvc(iss, elr);
+            handle_guest_hvc(ctx, iss);
             break;
         case 0x24: // Data Abort from lower EL
-            handle_guest_data_abort(iss, far, elr);
+            handle_guest_data_abort(ctx, iss);
             break;
         case 0x20: // Instruction Abort from lower EL
-            handle_guest_instruction_abort(iss, far, elr);
+            handle_guest_instruction_abort(ctx, iss);
             break;
         case 0x18: // MSR/MRS/System instruction trap
-            handle_guest_system_register_trap(iss, elr);
+            handle_guest_system_register_trap(ctx, iss);
             break;
         case 0x01: // WFI/WFE instruction
-            handle_guest_wfi_wfe(iss, elr);
+            handle_guest_wfi_wfe(ctx, iss);
+            break;
+        case 0x07: // SIMD/FP trapped by CPTR_EL2.TFP
+            handle_guest_fpsimd_trap(ctx);
             break;
         default:
             LOG_ERROR("Exception Class não tratada: 0x%X", ec);
             // Injetar exceção no guest
-            inject_exception_to_guest(esr, far);
+            inject_exception_to_guest(ctx->esr_el2, ctx->far_el2);
             break;
     }
 }
 
 // Handler para HVC (Hypervisor Call)
-void handle_guest_hvc(uint32_t iss, uint64_t elr)
+void handle_guest_hvc(guest_context_t* ctx, uint32_t iss)
 {
-    uint16_t hvc_num = iss & 0xFFFF;
-    LOG_INFO("Guest HVC #%d", hvc_num);
-    
-    // Simular hypercall context para compatibilidade
-    WHV_HYPERCALL_CONTEXT hypercall = {0};
+    (void)iss;  // Imediato do HVC não é usado; o número vem de x0
     
-    // Ler registradores do guest para obter parâmetros
-    guest_context_t* ctx = &guest_context_buffer;
-    save_guest_context(ctx);
+    hypercall_args_t call;
+    call.nr = hypercall_decode_nr(ctx->x[0]);  // x0 = hypercall number
+    call.args[0] = ctx->x[1];      // x1 = parameter 1
+    call.args[1] = ctx->x[2];      // x2 = parameter 2
+    call.args[2] = ctx->x[3];      // x3 = parameter 3
+    call.vcpu = 0;
     
-    hypercall.Rax = ctx->x[0];  // x0 = hypercall number
-    hypercall.Rbx = ctx->x[1];  // x1 = parameter 1
-    hypercall.Rcx = ctx->x[2];  // x2 = parameter 2
-    hypercall.Rdx = ctx->x[3];  // x3 = parameter 3
+    ctx->x[0] = (uint64_t)hypercall_dispatch(&call);
     
-    // Chamar handler existente
-    handle_hypercall(&hypercall);
-    
-    // Avançar PC
-    ctx->elr_el2 = elr + 4;  // HVC é instrução de 4 bytes
-    restore_guest_context(ctx);
+    // ELR_EL2 de um HVC já aponta para a instrução seguinte
 }
 
 // Handler para Data Abort
-void handle_guest_data_abort(uint32_t iss, uint64_t far, uint64_t elr)
+void handle_guest_data_abort(guest_context_t* ctx, uint32_t iss)
 {
+    uint64_t far = ctx->far_el2;
+    bool isv = (iss >> 24) & 1;      // Syndrome válido (SAS/SRT/SF preenchidos)
     bool is_write = (iss >> 6) & 1;
     uint32_t sas = (iss >> 22) & 3;  // Size Access Size
+    uint32_t srt = (iss >> 16) & 31; // Registrador de origem/destino
     uint32_t size = 1 << sas;
     
-    LOG_DEBUG("Guest data abort: FAR=0x%llX, write=%d, size=%d", far, is_write, size);
+    LOG_TRACE("Guest data abort: FAR=0x%llX, write=%d, size=%d, rt=x%d", far, is_write, size, srt);
     
     // Verificar se é acesso a device
-    if (far >= DEVICE_BASE && far < DEVICE_BASE + 0x100000) {
-        uint64_t data = 0;
-        
-        if (is_write) {
-            // Para writes, extrair dados do registrador
-            guest_context_t* ctx = &guest_context_buffer;
-            save_guest_context(ctx);
-            
-            // Determinar qual registrador baseado na instrução
-            // Para simplificar, usar x0
-            data = ctx->x[0];
-        }
+    if (isv && far >= DEVICE_BASE && far < DEVICE_BASE + 0x100000) {
+        uint64_t data = is_write ? guest_reg_read(ctx, srt) : 0;
         
         device_access_result_t result = handle_device_access(far, &data, size, is_write);
         
         if (result == DEVICE_ACCESS_OK) {
             if (!is_write) {
-                // Para reads, colocar dados no registrador
-                guest_context_t* ctx = &guest_context_buffer;
-                save_guest_context(ctx);
-                ctx->x[0] = data;  // Simplificado
-                restore_guest_context(ctx);
+                if (size < 8) {
+                    data &= (1ULL << (size * 8)) - 1;
+                    if (((iss >> 21) & 1) && (data >> (size * 8 - 1)) & 1) {  // SSE
+                        data |= ~0ULL << (size * 8);
+                    }
+                }
+                if (!((iss >> 15) & 1)) {  // SF=0: destino é Wt
+                    data &= 0xFFFFFFFF;
+                }
+                guest_reg_write(ctx, srt, data);
             }
             
-            // Avançar PC
-            guest_context_t* ctx = &guest_context_buffer;
-            save_guest_context(ctx);
-            ctx->elr_el2 = elr + 4;  // Assumir instrução de 4 bytes
-            restore_guest_context(ctx);
-            
+            ctx->elr_el2 += 4;  // Pular a instrução de load/store
             return;
         }
     }
@@ -187,14 +257,14 @@ void handle_guest_data_abort(uint32_t iss, uint64_t far, uint64_t elr)
 }
 
 // Handler para Instruction Abort
-void handle_guest_instruction_abort(uint32_t iss, uint64_t far, uint64_t elr)
+void handle_guest_instruction_abort(guest_context_t* ctx, uint32_t iss)
 {
-    LOG_ERROR("Guest instruction abort: FAR=0x%llX, ISS=0x%X", far, iss);
-    inject_exception_to_guest(0x86000000 | iss, far);  // Instruction abort ESR
+    LOG_ERROR("Guest instruction abort: FAR=0x%llX, ISS=0x%X", ctx->far_el2, iss);
+    inject_exception_to_guest(0x86000000 | iss, ctx->far_el2);  // Instruction abort ESR
 }
 
 // Handler para System Register Trap
-void handle_guest_system_register_trap(uint32_t iss, uint64_t elr)
+void handle_guest_system_register_trap(guest_context_t* ctx, uint32_t iss)
 {
     uint32_t op0 = (iss >> 20) & 3;
     uint32_t op2 = (iss >> 17) & 7;
@@ -204,27 +274,40 @@ void handle_guest_system_register_trap(uint32_t iss, uint64_t elr)
     uint32_t crm = (iss >> 1) & 15;
     uint32_t dir = iss & 1;  // 0=write, 1=read
     
-    LOG_DEBUG("System register trap: op0=%d, op1=%d, crn=%d, crm=%d, op2=%d, rt=%d, dir=%d",
+    LOG_TRACE("System register trap: op0=%d, op1=%d, crn=%d, crm=%d, op2=%d, rt=%d, dir=%d",
               op0, op1, crn, crm, op2, rt, dir);
     
-    // Para demo, apenas avançar PC
-    guest_context_t* ctx = &guest_context_buffer;
-    save_guest_context(ctx);
-    ctx->elr_el2 = elr + 4;
-    restore_guest_context(ctx);
+    el2_guest_t* guest = el2_current_guest(ctx);
+    if (!guest) {
+        inject_exception_to_guest(ctx->esr_el2, 0);
+        return;
+    }
+    
+    uint64_t value = dir ? 0 : guest_reg_read(ctx, rt);
+    if (sysreg_access(&guest->sysregs, SYSREG_ENC(op0, op1, crn, crm, op2), dir, &value) != SYSREG_OK) {
+        inject_exception_to_guest(1 << 25, 0);  // EC 0 (Unknown) + IL: UNDEFINED
+        return;
+    }
+    
+    if (dir) {
+        guest_reg_write(ctx, rt, value);
+    }
+    ctx->elr_el2 += 4;
 }
 
 // Handler para WFI/WFE
-void handle_guest_wfi_wfe(uint32_t iss, uint64_t elr)
+void handle_guest_wfi_wfe(guest_context_t* ctx, uint32_t iss)
 {
-    LOG_DEBUG("Guest WFI/WFE: ISS=0x%X", iss);
-    
-    // Para WFI, podemos implementar yield
-    // Para demo, apenas avançar PC
-    guest_context_t* ctx = &guest_context_buffer;
-    save_guest_context(ctx);
-    ctx->elr_el2 = elr + 4;
-    restore_guest_context(ctx);
+    bool wfe = (iss & 1) != 0;          // ISS.TI: 0 = WFI, 1 = WFE
+    
+    LOG_TRACE("Guest %s", wfe ? "WFE" : "WFI");
+    
+    // WFI espera interrupt: repassar o que os devices já têm pendente para o
+    // guest acordar com ele. WFE é dica de spin-lock; apenas avançar PC
+    if (!wfe) {
+        handle_guest_irq();
+    }
+    ctx->elr_el2 += 4;
 }
 
 // Handler para IRQ do guest
@@ -254,19 +337,19 @@ void handle_guest_fiq(void)
 }
 
 // Handler para SError do guest
-void handle_guest_serror(uint64_t esr, uint64_t far)
+void handle_guest_serror(guest_context_t* ctx)
 {
-    LOG_ERROR("Guest SError: ESR=0x%llX, FAR=0x%llX", esr, far);
+    LOG_ERROR("Guest SError: ESR=0x%llX, FAR=0x%llX", ctx->esr_el2, ctx->far_el2);
     // SError é crítico - pode terminar o guest
     g_vm.running = false;
 }
 
 // Handler para exceções AArch32 (compatibilidade)
-void handle_guest_sync_exception_aarch32(uint64_t esr, uint64_t far, uint64_t elr)
+void handle_guest_sync_exception_aarch32(guest_context_t* ctx)
 {
-    LOG_DEBUG("Guest AArch32 sync exception: ESR=0x%llX, FAR=0x%llX", esr, far);
+    LOG_DEBUG("Guest AArch32 sync exception: ESR=0x%llX, FAR=0x%llX", ctx->esr_el2, ctx->far_el2);
     // Para demo, tratar similar ao AArch64
-    handle_guest_sync_exception(esr, far, elr);
+    handle_guest_sync_exception(ctx);
 }
 
 // Função para injetar exceção no guest
@@ -297,20 +380,53 @@ int hypervisor_main(void)
         return -1;
     }
     
+    hypercall_init();
+    sysreg_init();
+    
+    // Frame de contexto do CPU de boot
+    guest_context_t* ctx = &g_cpu_context[0];
+    ctx->console_drain_ticks = (uint32_t)(timer_get_arch_frequency() *
+                                          FASTPATH_CONSOLE_DRAIN_US / 1000000);
+    el2_set_cpu_context(ctx);
+    
+    // Tradução stage-2 da RAM do guest, com VMID próprio
+    static el2_guest_t guest;
+    if (el2_vmid_init() != 0 || el2_guest_init(&guest) != 0) {
+        devices_cleanup();
+        return -1;
+    }
+    el2_guest_switch(&guest, 0);
+    el2_enable_stage2(g_hyp_context.vtcr_el2);
+    
+    // Timers emulados pela tabela de sysreg; sem ECV o timer virtual fica
+    // com o hardware (ID_AA64MMFR0_EL1.ECV em [63:60])
+    bool ecv = ((el2_read_mmfr0() >> 60) & 0xF) != 0;
+    el2_timer_traps(ecv);
+    if (!ecv) {
+        LOG_INFO("Sem FEAT_ECV: CNTV_*/CNTVCT não são interceptados");
+    }
+    
     // Para demo, simular execução do guest
     LOG_INFO("Simulando execução do guest...");
     
-    // Simular alguns VM-exits
+    // Simular alguns VM-exits preenchendo o frame como os vetores fariam
     for (int i = 0; i < 5; i++) {
         LOG_INFO("Simulando VM-exit #%d", i + 1);
         
-        // Simular HVC
-        handle_guest_hvc(0, 0x40001000 + i * 4);
+        // Simular HVC #0 com x0 = HC_HELLO
+        ctx->x[0] = HC_HELLO;
+        ctx->elr_el2 = 0x40001000 + i * 4;
+        ctx->esr_el2 = (uint64_t)0x16 << 26;
+        handle_guest_sync_exception(ctx);
         
-        // Simular data abort para device
-        handle_guest_data_abort(0x40, UART_BASE, 0x40001000 + i * 4);
+        // Simular data abort para device: STR w0 com syndrome válido
+        ctx->x[0] = 'A' + i;
+        ctx->far_el2 = UART_BASE;
+        ctx->esr_el2 = ((uint64_t)0x24 << 26) | (1 << 24) | (2 << 22) | (1 << 6);
+        handle_guest_sync_exception(ctx);
     }
     
+    fastpath_console_drain(ctx);
     LOG_INFO("Demo do hypervisor concluída");
     devices_cleanup();
     return 0;
@@ -1,12 +1,15 @@
 /* Desenvolvido por: Escanearcpl */
 #include "vm.h"
 #include "devices.h"
+#include "virtio.h"
+#include "hypercall.h"
 
 // Forward declarations
 int handle_hypercall(const WHV_HYPERCALL_CONTEXT* hypercall);
 int handle_memory_access(const WHV_MEMORY_ACCESS_CONTEXT* memory_access);
 int handle_io_port_access(const WHV_X64_IO_PORT_ACCESS_CONTEXT* io_port);
 int handle_exception(const WHV_VP_EXCEPTION_CONTEXT* exception);
+int handle_sysreg_trap(uint32_t iss);
 
 int handle_vm_exit(const WHV_RUN_VP_EXIT_CONTEXT* exit_context)
 {
@@ -17,6 +20,12 @@ int handle_vm_exit(const WHV_RUN_VP_EXIT_CONTEXT* exit_context)
     
     LOG_DEBUG("VM-Exit: Reason=%d", exit_context->ExitReason);
     
+    // Spin-poll é só uma sequência ininterrupta de leituras MMIO: qualquer
+    // outro exit indica que o guest fez outra coisa entre as leituras
+    if (exit_context->ExitReason != WHvRunVpExitReasonMemoryAccess) {
+        poll_detect_reset(&vcpu_current()->poll);
+    }
+    
     switch (exit_context->ExitReason) {
         case WHvRunVpExitReasonHypercall:
             return handle_hypercall(&exit_context->Hypercall);
@@ -46,44 +55,27 @@ int handle_vm_exit(const WHV_RUN_VP_EXIT_CONTEXT* exit_context)
 
 int handle_hypercall(const WHV_HYPERCALL_CONTEXT* hypercall)
 {
-    LOG_INFO("Hypercall capturada: Input=0x%llX", hypercall->Rax);
-    
     // Para ARM64, os hypercalls normalmente usam a instrução HVC
     // O número do hypercall vem do registrador X0
-    uint64_t hypercall_num = hypercall->Rax & 0xFFFF;
-    
-    switch (hypercall_num) {
-        case 0:  // Hypercall 0 - Hello from guest
-            LOG_INFO("Guest disse: Hello Hypervisor!");
-            uart_write_char('H');
-            uart_write_char('\n');
-            break;
-            
-        case 1:  // Hypercall 1 - Request shutdown
-            LOG_INFO("Guest solicitou shutdown");
-            g_vm.running = false;
-            break;
-            
-        case 2:  // Hypercall 2 - Print character
-            {
-                char c = (char)(hypercall->Rbx & 0xFF);
-                LOG_INFO("Guest print: '%c' (0x%02X)", c, c);
-                uart_write_char(c);
-            }
-            break;
-            
-        default:
-            LOG_INFO("Hypercall desconhecido: %llu", hypercall_num);
-            break;
-    }
-    
-    // Avançar PC após a instrução HVC
-    uint64_t pc;
-    if (vcpu_get_pc(&pc) == 0) {
-        vcpu_set_pc(pc + 4);  // HVC é uma instrução de 4 bytes
+    hypercall_args_t call;
+    call.nr = hypercall_decode_nr(hypercall->Rax);
+    call.args[0] = hypercall->Rbx;
+    call.args[1] = hypercall->Rcx;
+    call.args[2] = hypercall->Rdx;
+    call.vcpu = vcpu_current()->index;
+    
+    int64_t result = hypercall_dispatch(&call);
+    
+    // Devolver resultado em X0 e avançar PC após a instrução HVC
+    WHV_REGISTER_NAME reg_names[2] = { WHvArm64RegisterX0, WHvArm64RegisterPc };
+    WHV_REGISTER_VALUE reg_values[2];
+    if (vcpu_get_registers(reg_names, reg_values, 2) != 0) {
+        return -1;
     }
     
-    return 0;
+    reg_values[0].Reg64 = (uint64_t)result;
+    reg_values[1].Reg64 += 4;  // HVC é uma instrução de 4 bytes
+    return vcpu_set_registers(reg_names, reg_values, 2);
 }
 
 int handle_memory_access(const WHV_MEMORY_ACCESS_CONTEXT* memory_access)
@@ -92,7 +84,7 @@ int handle_memory_access(const WHV_MEMORY_ACCESS_CONTEXT* memory_access)
     uint8_t instruction_bytes[16];
     uint32_t instruction_byte_count = memory_access->InstructionByteCount;
     
-    LOG_DEBUG("Memory Access: GPA=0x%llX, Size=%d, Write=%d", 
+    LOG_TRACE("Memory Access: GPA=0x%llX, Size=%d, Write=%d", 
               gpa, memory_access->AccessInfo.AccessSize,
               memory_access->AccessInfo.IsWrite);
     
@@ -101,37 +93,61 @@ int handle_memory_access(const WHV_MEMORY_ACCESS_CONTEXT* memory_access)
         uint64_t data = 0;
         bool is_write = memory_access->AccessInfo.IsWrite;
         uint32_t size = 1 << memory_access->AccessInfo.AccessSize;  // 0=1byte, 1=2bytes, 2=4bytes, 3=8bytes
+        device_id_t device = device_id_from_address(gpa);
+        uint64_t generation = 0;
         
         if (is_write) {
             // Para writes, obter dados dos registradores
             // Isso requer decodificação da instrução
             data = memory_access->Rax;  // Simplificado - normalmente seria decodificado
+        } else if (device != DEVICE_ID_NONE) {
+            // Capturada antes da leitura: uma mudança concorrente impede o estacionamento
+            generation = devices_change_generation(device);
         }
         
         device_access_result_t result = handle_device_access(gpa, &data, size, is_write);
         
         if (result == DEVICE_ACCESS_OK) {
-            if (!is_write) {
-                // Para reads, colocar dados no registrador apropriado
-                WHV_REGISTER_NAME reg_name = WHvArm64RegisterX0;  // Simplificado
-                WHV_REGISTER_VALUE reg_value;
-                reg_value.Reg64 = data;
-                vcpu_set_registers(&reg_name, &reg_value, 1);
+            // X0 (leitura) e PC num único acesso aos registradores
+            WHV_REGISTER_NAME reg_names[2] = { WHvArm64RegisterPc, WHvArm64RegisterX0 };  // X0 simplificado
+            WHV_REGISTER_VALUE reg_values[2];
+            uint32_t reg_count = is_write ? 1 : 2;
+            
+            if (vcpu_get_registers(reg_names, reg_values, 1) != 0) {
+                return -1;
             }
+            uint64_t pc = reg_values[0].Reg64;
+            vcpu_state_t* vcpu = vcpu_current();
             
-            // Avançar PC
-            uint64_t pc;
-            if (vcpu_get_pc(&pc) == 0) {
-                vcpu_set_pc(pc + 4);  // Assumir instrução de 4 bytes
+            if (is_write || device == DEVICE_ID_NONE) {
+                // Uma escrita entre as leituras (FR e depois DR no loop de TX
+                // da UART) é progresso, não espera
+                poll_detect_reset(&vcpu->poll);
+            } else if (poll_detect_observe(&vcpu->poll, pc, gpa, data, generation)) {
+                // Spin-poll: esperar o device mudar antes de devolver a leitura
+                steal_time_wait(vcpu);
+                poll_detect_park(&vcpu->poll);
+                InterlockedIncrement64(&g_vm.metrics.poll_parks);
             }
             
-            return 0;
+            reg_values[0].Reg64 = pc + 4;  // Assumir instrução de 4 bytes
+            reg_values[1].Reg64 = data;
+            return vcpu_set_registers(reg_names, reg_values, reg_count);
         } else if (result == DEVICE_ACCESS_ERROR) {
             LOG_ERROR("Erro no acesso ao device");
             return -1;
         }
     }
     
+    // Janela DAX com o mapeamento sendo refeito (arquivo redimensionado
+    // pelo device): repetir a instrução até o range voltar
+    if (virtio_shm_contains(gpa)) {
+        poll_detect_reset(&vcpu_current()->poll);
+        steal_time_wait(vcpu_current());
+        SwitchToThread();
+        return 0;
+    }
+    
     LOG_ERROR("Acesso de memória não tratado: GPA=0x%llX", gpa);
     return -1;
 }
@@ -181,8 +197,8 @@ int handle_exception(const WHV_VP_EXCEPTION_CONTEXT* exception)
             break;
             
         case WHvArm64ExceptionTypeSystemRegisterTrap:
-            LOG_INFO("System Register Trap");
-            break;
+            // ErrorCode carrega o ISS de EC 0x18; o handler avança o PC
+            return handle_sysreg_trap(exception->ErrorCode);
             
         default:
             LOG_ERROR("Exception não tratada: %d", exception->ExceptionType);
@@ -197,3 +213,33 @@ int handle_exception(const WHV_VP_EXCEPTION_CONTEXT* exception)
     
     return 0;
 }
+
+int handle_sysreg_trap(uint32_t iss)
+{
+    uint32_t rt = SYSREG_ISS_RT(iss);
+    bool is_read = SYSREG_ISS_IS_READ(iss);
+    vcpu_state_t* vcpu = vcpu_current();
+    
+    // PC e Rt lidos e gravados num único acesso (Rt=31 é XZR)
+    WHV_REGISTER_NAME reg_names[2] = { WHvArm64RegisterPc, (WHV_REGISTER_NAME)(WHvArm64RegisterX0 + rt) };
+    WHV_REGISTER_VALUE reg_values[2];
+    uint32_t reg_count = rt < 31 ? 2 : 1;
+    
+    if (vcpu_get_registers(reg_names, reg_values, reg_count) != 0) {
+        return -1;
+    }
+    
+    uint64_t value = (!is_read && rt < 31) ? reg_values[1].Reg64 : 0;
+    if (sysreg_access(&vcpu->sysregs, SYSREG_ISS_ENC(iss), is_read, &value) != SYSREG_OK) {
+        // Como no hardware: o guest recebe UNDEFINED e sonda o próximo
+        LOG_DEBUG("Acesso a registrador de sistema não suportado (ISS=0x%X)", iss);
+        return vcpu_inject_undef();
+    }
+    
+    reg_values[0].Reg64 += 4;
+    if (!is_read) {
+        reg_count = 1;  // Só o PC muda
+    }
+    reg_values[1].Reg64 = value;
+    return vcpu_set_registers(reg_names, reg_values, reg_count);
+}
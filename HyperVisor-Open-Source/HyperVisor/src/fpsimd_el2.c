@@ -0,0 +1,60 @@
+/* Desenvolvido por: Escanearcpl */
+#include "hypervisor.h"
+#include "asm_functions.h"
+
+// Troca preguiçosa de FP/SIMD no modo EL2.
+//
+// Depois de carregado, o estado do guest fica nos registradores V
+// (ctx->fpsimd_live) através dos exits. A entrada do caminho C em entry.s
+// apenas arma CPTR_EL2.TFP, que também pega EL2: se o código C (memset,
+// printf, SIMD gerado pelo compilador) usar os registradores, o EC 0x07 de
+// EL2 salva o estado em ctx->fpsimd_guest e desarma. Na saída, estado ainda
+// vivo volta ao guest com TFP desarmado; estado salvo deixa TFP armado e o
+// primeiro uso de FP/SIMD pelo guest gera EC 0x07, tratado no próprio vetor
+// (fastpath_fpsimd), que restaura o estado e reexecuta a instrução. Exits
+// cujo código C não toca nos registradores V não salvam nem recarregam nada.
+
+void el2_fpsimd_guest_enter(el2_guest_t* guest, uint32_t cpu)
+{
+    if (cpu >= EL2_MAX_CPUS) {
+        return;
+    }
+    
+    // Estado do guest anterior ainda nos registradores V deste pCPU
+    guest_context_t* ctx = &g_cpu_context[cpu];
+    if (ctx->fpsimd_live) {
+        el2_fpsimd_trap(0);
+        el2_fpsimd_save(ctx->fpsimd_guest);
+        ctx->fpsimd_live = 0;
+    }
+    
+    ctx->fpsimd_guest = &guest->fpsimd;
+    el2_fpsimd_trap(1);
+}
+
+// Guest destruído: nenhum CPU pode restaurar nem salvar estado nele depois
+void el2_fpsimd_guest_release(el2_guest_t* guest)
+{
+    for (uint32_t cpu = 0; cpu < EL2_MAX_CPUS; cpu++) {
+        if (g_cpu_context[cpu].fpsimd_guest == &guest->fpsimd) {
+            g_cpu_context[cpu].fpsimd_guest = NULL;
+            g_cpu_context[cpu].fpsimd_live = 0;     // Saída volta a armar TFP
+        }
+    }
+}
+
+// EC 0x07 que o vetor não tratou: pCPU sem estado FP/SIMD associado
+void handle_guest_fpsimd_trap(guest_context_t* ctx)
+{
+    el2_guest_t* guest = el2_current_guest(ctx);
+    
+    if (!guest) {
+        LOG_ERROR("Trap de FP/SIMD sem guest ativo");
+        inject_exception_to_guest(ctx->esr_el2, 0);
+        return;
+    }
+    
+    // ELR aponta para a instrução que gerou o trap: ela é reexecutada, gera
+    // outro trap (a saída rearma TFP) e o vetor carrega o estado
+    ctx->fpsimd_guest = &guest->fpsimd;
+}
@@ -0,0 +1,218 @@
+/* Desenvolvido por: Escanearcpl */
+#include "hypercall.h"
+#include "psci.h"
+#include "vm.h"
+#include "devices.h"
+
+// Tabela de despacho indexada pelo número do hypercall
+static hypercall_entry_t g_hypercall_table[HYPERCALL_MAX];
+
+// Handlers embutidos
+static int64_t hc_hello(const hypercall_args_t* call)
+{
+    (void)call;
+    LOG_INFO("Guest disse: Hello Hypervisor!");
+    uart_write_char('H');
+    uart_write_char('\n');
+    return HC_SUCCESS;
+}
+
+static int64_t hc_shutdown(const hypercall_args_t* call)
+{
+    (void)call;
+    LOG_INFO("Guest solicitou shutdown");
+    vm_request_stop();
+    return HC_SUCCESS;
+}
+
+static int64_t hc_putchar(const hypercall_args_t* call)
+{
+    uart_write_char((char)(call->args[0] & 0xFF));
+    return HC_SUCCESS;
+}
+
+static int64_t hc_console_write(const hypercall_args_t* call)
+{
+    uint64_t gpa = call->args[0];
+    uint64_t len = call->args[1];
+
+    if (len == 0) {
+        return 0;
+    }
+    if (len > HC_CONSOLE_WRITE_MAX) {
+        len = HC_CONSOLE_WRITE_MAX;
+    }
+
+    const char* buf = (const char*)vm_gpa_to_hva(gpa, len);
+    if (!buf) {
+        return HC_ERR_INVALID;
+    }
+
+    uart_write_buffer(buf, (size_t)len);
+    return (int64_t)len;
+}
+
+static int64_t hc_signal_irq(const hypercall_args_t* call)
+{
+    if (call->args[0] >= 256) {
+        return HC_ERR_INVALID;
+    }
+    gic_set_interrupt((uint32_t)call->args[0], true);
+    return HC_SUCCESS;
+}
+
+static int64_t hc_clock_read(const hypercall_args_t* call)
+{
+    (void)call;
+    return (int64_t)timer_get_time_ns();
+}
+
+// Resultado de benchmark medido pelo guest (custo de exit por caso)
+static int64_t hc_bench_report(const hypercall_args_t* call)
+{
+    static const char* const cases[] = { "hvc fast path", "hvc caminho C" };
+    uint64_t which = call->args[0];
+    uint64_t ticks = call->args[1];
+    uint64_t iterations = call->args[2];
+
+    if (iterations == 0) {
+        return HC_ERR_INVALID;
+    }
+
+    LOG_INFO("Benchmark %s: %llu ticks / %llu iterações = %llu ticks por exit",
+             which < 2 ? cases[which] : "?", ticks, iterations, ticks / iterations);
+    return HC_SUCCESS;
+}
+
+// Processa todas as entradas pendentes do ring; retorna quantas foram executadas
+static int64_t hc_batch(const hypercall_args_t* call)
+{
+    uint64_t ring_gpa = call->args[0];
+
+    hypercall_ring_t* ring = (hypercall_ring_t*)vm_gpa_to_hva(ring_gpa, sizeof(hypercall_ring_t));
+    if (!ring) {
+        return HC_ERR_INVALID;
+    }
+
+    uint32_t size = ring->size;
+    if (size == 0 || size > HC_RING_MAX_ENTRIES || (size & (size - 1)) != 0) {
+        return HC_ERR_INVALID;
+    }
+
+    hypercall_batch_entry_t* entries = (hypercall_batch_entry_t*)vm_gpa_to_hva(
+        ring_gpa + sizeof(hypercall_ring_t), (uint64_t)size * sizeof(hypercall_batch_entry_t));
+    if (!entries) {
+        return HC_ERR_INVALID;
+    }
+
+    uint32_t head = ring->head;
+    uint32_t tail = ring->tail;
+    MemoryBarrier();  // Ler entradas somente depois de observar head
+
+    // Um guest mal-comportado não pode fazer o host processar mais que um ring
+    if (head - tail > size) {
+        return HC_ERR_INVALID;
+    }
+
+    int64_t processed = 0;
+    while (tail != head) {
+        hypercall_batch_entry_t* slot = &entries[tail & (size - 1)];
+
+        // Copiar a requisição antes de validar (o guest pode alterá-la em paralelo)
+        hypercall_args_t req;
+        req.nr = slot->nr;
+        req.args[0] = slot->args[0];
+        req.args[1] = slot->args[1];
+        req.args[2] = slot->args[2];
+        req.vcpu = call->vcpu;
+
+        int64_t result = HC_ERR_NOT_SUPPORTED;
+        if (req.nr < HYPERCALL_MAX &&
+            !(g_hypercall_table[req.nr].flags & HC_FLAG_NO_BATCH)) {
+            result = hypercall_dispatch(&req);
+        }
+
+        slot->result = result;
+        tail++;
+        processed++;
+    }
+
+    MemoryBarrier();  // Resultados visíveis antes de publicar tail
+    ring->tail = tail;
+
+    LOG_TRACE("Batch de hypercalls: %lld entradas", processed);
+    return processed;
+}
+
+int hypercall_init(void)
+{
+    memset(g_hypercall_table, 0, sizeof(g_hypercall_table));
+
+    hypercall_register(HC_HELLO, hc_hello, "hello", 0);
+    hypercall_register(HC_SHUTDOWN, hc_shutdown, "shutdown", 0);
+    hypercall_register(HC_PUTCHAR, hc_putchar, "putchar", 0);
+    hypercall_register(HC_BATCH, hc_batch, "batch", HC_FLAG_NO_BATCH);
+    hypercall_register(HC_CONSOLE_WRITE, hc_console_write, "console_write", 0);
+    hypercall_register(HC_SIGNAL_IRQ, hc_signal_irq, "signal_irq", 0);
+    hypercall_register(HC_CLOCK_READ, hc_clock_read, "clock_read", 0);
+    hypercall_register(HC_BENCH_REPORT, hc_bench_report, "bench_report", HC_FLAG_NO_BATCH);
+
+    LOG_INFO("Tabela de hypercalls inicializada");
+    return 0;
+}
+
+int hypercall_register(uint32_t nr, hypercall_handler_t handler, const char* name, uint32_t flags)
+{
+    if (nr >= HYPERCALL_MAX || !handler) {
+        LOG_ERROR("Registro de hypercall inválido: %u", nr);
+        return -1;
+    }
+
+    if (g_hypercall_table[nr].handler) {
+        LOG_ERROR("Hypercall %u já registrado (%s)", nr, g_hypercall_table[nr].name);
+        return -1;
+    }
+
+    g_hypercall_table[nr].handler = handler;
+    g_hypercall_table[nr].name = name;
+    g_hypercall_table[nr].flags = flags;
+    g_hypercall_table[nr].count = 0;
+    return 0;
+}
+
+void hypercall_unregister(uint32_t nr)
+{
+    if (nr < HYPERCALL_MAX) {
+        memset(&g_hypercall_table[nr], 0, sizeof(g_hypercall_table[nr]));
+    }
+}
+
+void hypercall_account(uint32_t nr, uint64_t calls)
+{
+    if (nr < HYPERCALL_MAX) {
+        g_hypercall_table[nr].count += calls;
+    }
+}
+
+int64_t hypercall_dispatch(const hypercall_args_t* call)
+{
+    if (call->nr & HC_SMCCC_FAST_CALL) {
+        return psci_dispatch(call);
+    }
+
+    if (call->nr >= HYPERCALL_MAX) {
+        LOG_TRACE("Hypercall fora da tabela: %llu", call->nr);
+        return HC_ERR_NOT_SUPPORTED;
+    }
+
+    hypercall_entry_t* entry = &g_hypercall_table[call->nr];
+    if (!entry->handler) {
+        LOG_TRACE("Hypercall desconhecido: %llu", call->nr);
+        return HC_ERR_NOT_SUPPORTED;
+    }
+
+    entry->count++;
+    LOG_TRACE("Hypercall %s(0x%llX, 0x%llX, 0x%llX)", entry->name,
+              call->args[0], call->args[1], call->args[2]);
+    return entry->handler(call);
+}
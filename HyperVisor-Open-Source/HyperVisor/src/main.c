@@ -2,11 +2,75 @@
 #include "hypervisor.h"
 #include "vm.h"
 #include "devices.h"
+#include "hypercall.h"
+#include "pvclock.h"
+#include "cpu_model.h"
+#include "virtio.h"
+#include "disk_image.h"
+#include "blk_qos.h"
+
+// Constantes de SDKs mais novos que o mínimo suportado
+#ifndef PF_ARM_SHA3_INSTRUCTIONS_AVAILABLE
+#define PF_ARM_SHA3_INSTRUCTIONS_AVAILABLE          64
+#endif
+#ifndef PF_ARM_SHA512_INSTRUCTIONS_AVAILABLE
+#define PF_ARM_SHA512_INSTRUCTIONS_AVAILABLE        65
+#endif
+#ifndef PF_ARM_V82_FP16_INSTRUCTIONS_AVAILABLE
+#define PF_ARM_V82_FP16_INSTRUCTIONS_AVAILABLE      67
+#endif
+
+// Features do host, preenchidas uma vez em hypervisor_init()
+cpu_host_t g_host_cpu;
+uint32_t g_guest_pa_bits = GUEST_PA_BITS_FALLBACK;
+
+static void print_cpu_models(void)
+{
+    const char* description;
+    LOG_INFO("Modelos de CPU disponíveis (--cpu=<modelo>):");
+    for (uint32_t i = 0; cpu_model_name(i, &description); i++) {
+        LOG_INFO("  %-12s %s", cpu_model_name(i, NULL), description);
+    }
+}
 
 int main(int argc, char* argv[])
 {
     LOG_INFO("ARM64 Hypervisor Monitor iniciando...");
     
+    const char* cpu_model = CPU_MODEL_DEFAULT;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--cpu=", 6) == 0) {
+            cpu_model = argv[i] + 6;
+        }
+    }
+    if (strcmp(cpu_model, "help") == 0) {
+        print_cpu_models();
+        return EXIT_SUCCESS;
+    }
+    
+    // Provisionamento de imagens HVDK, sem criar VM: --disk-create=<imagem>,<MB>
+    // ou --disk-overlay=<imagem>,<base> (tamanho herdado da base)
+    for (int i = 1; i < argc; i++) {
+        bool overlay = strncmp(argv[i], "--disk-overlay=", 15) == 0;
+        if (!overlay && strncmp(argv[i], "--disk-create=", 14) != 0) {
+            continue;
+        }
+
+        const char* spec = strchr(argv[i], '=') + 1;
+        const char* comma = strchr(spec, ',');
+        char image[MAX_PATH];
+
+        if (!comma || comma == spec || comma[1] == '\0' || comma - spec >= MAX_PATH) {
+            LOG_ERROR("Uso: --disk-create=<imagem>,<MB> ou --disk-overlay=<imagem>,<base>");
+            return EXIT_INIT_FAILED;
+        }
+        snprintf(image, sizeof(image), "%.*s", (int)(comma - spec), spec);
+
+        int result = overlay ? disk_create(image, 0, comma + 1)
+                             : disk_create(image, strtoull(comma + 1, NULL, 10) << 20, NULL);
+        return result == 0 ? EXIT_SUCCESS : EXIT_INIT_FAILED;
+    }
+    
     // Verificar se está rodando como Administrator
     BOOL is_admin = FALSE;
     SID_IDENTIFIER_AUTHORITY ntAuthority = SECURITY_NT_AUTHORITY;
@@ -35,6 +99,131 @@ int main(int argc, char* argv[])
         return EXIT_INIT_FAILED;
     }
     
+    hypercall_init();
+    pvclock_init();
+    steal_time_init();
+    sysreg_init();
+    pmu_init();
+    
+    if (vm_set_cpu_model(cpu_model) != 0) {
+        print_cpu_models();
+        devices_cleanup();
+        hypervisor_cleanup();
+        return EXIT_INIT_FAILED;
+    }
+    
+    // Limites de I/O de bloco da VM inteira: --io-limit=iops=N,bw=MB,...
+    for (int i = 1; i < argc; i++) {
+        blk_qos_limits_t limits;
+        if (strncmp(argv[i], "--io-limit=", 11) != 0) {
+            continue;
+        }
+        if (blk_qos_parse(argv[i] + 11, &limits, NULL) != 0) {
+            devices_cleanup();
+            hypervisor_cleanup();
+            return EXIT_INIT_FAILED;
+        }
+        blk_qos_set_vm_limits(&limits);
+    }
+    
+    // Discos virtio-blk: --disk=<imagem>[,<qos>] (leitura e escrita) ou
+    // --disk-ro=<imagem>[,<qos>], com uma fila por vCPU; <qos> são os limites
+    // e o peso do disco (iops=N,bw=MB,weight=N,...)
+    for (int i = 1; i < argc; i++) {
+        bool read_only = strncmp(argv[i], "--disk-ro=", 10) == 0;
+        if (!read_only && strncmp(argv[i], "--disk=", 7) != 0) {
+            continue;
+        }
+        
+        const char* spec = strchr(argv[i], '=') + 1;
+        const char* comma = strchr(spec, ',');
+        char path[MAX_PATH];
+        blk_qos_limits_t limits;
+        uint32_t weight;
+        
+        snprintf(path, sizeof(path), "%.*s", comma ? (int)(comma - spec) : (int)strlen(spec), spec);
+        if (blk_qos_parse(comma ? comma + 1 : "", &limits, &weight) != 0 ||
+            virtio_blk_create(path, read_only, VM_DEFAULT_VCPUS, &limits, weight) != 0) {
+            devices_cleanup();
+            hypervisor_cleanup();
+            return EXIT_INIT_FAILED;
+        }
+    }
+    
+    // Console virtio: --vconsole=<stdout|null|arquivo>[,name=<nome>], uma
+    // porta por opção; o PL011 continua disponível para o boot inicial
+    const char* console_ports[VIRTIO_MAX_QUEUES];
+    uint32_t console_count = 0;
+    for (int i = 1; i < argc && console_count < VIRTIO_MAX_QUEUES; i++) {
+        if (strncmp(argv[i], "--vconsole=", 11) == 0) {
+            console_ports[console_count++] = argv[i] + 11;
+        }
+    }
+    if (console_count && virtio_console_create(console_ports, console_count) != 0) {
+        devices_cleanup();
+        hypervisor_cleanup();
+        return EXIT_INIT_FAILED;
+    }
+    
+    // Placas de rede: --net ou --net=mac=<MAC>, uma por opção, todas no
+    // switch L2 interno (sem acesso à rede do host), um par de filas por vCPU
+    for (int i = 1; i < argc; i++) {
+        bool plain = strcmp(argv[i], "--net") == 0;
+        if (!plain && strncmp(argv[i], "--net=", 6) != 0) {
+            continue;
+        }
+        if (virtio_net_create(plain ? "" : argv[i] + 6, VM_DEFAULT_VCPUS) != 0) {
+            devices_cleanup();
+            hypervisor_cleanup();
+            return EXIT_INIT_FAILED;
+        }
+    }
+    
+    // Sockets host-guest (um device por VM): --vsock=<cid>,<caminho>; o host conecta no socket
+    // Unix <caminho>, e o guest alcança os serviços em <caminho>_<porta>
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--vsock=", 8) != 0) {
+            continue;
+        }
+        
+        char* comma;
+        uint64_t cid = strtoull(argv[i] + 8, &comma, 10);
+        if (*comma != ',' || virtio_vsock_create(cid, comma + 1) != 0) {
+            LOG_ERROR("Opção inválida: %s (esperado --vsock=<cid>,<caminho>)", argv[i]);
+            devices_cleanup();
+            hypervisor_cleanup();
+            return EXIT_INIT_FAILED;
+        }
+        break;
+    }
+    
+    // Diretórios do host: --fs=<dir>[,tag=<tag>][,ro][,dax=<MB>], um device por opção;
+    // no guest, "mount -t virtiofs <tag> <ponto>"
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--fs=", 5) != 0) {
+            continue;
+        }
+        if (virtio_fs_create(argv[i] + 5) != 0) {
+            devices_cleanup();
+            hypervisor_cleanup();
+            return EXIT_INIT_FAILED;
+        }
+    }
+    
+    // Memória persistente: --pmem=<arquivo> ou --pmem-ro=<arquivo> (o arquivo não
+    // muda; imagens compartilhadas entre VMs usam as mesmas páginas do cache)
+    for (int i = 1; i < argc; i++) {
+        bool read_only = strncmp(argv[i], "--pmem-ro=", 10) == 0;
+        if (!read_only && strncmp(argv[i], "--pmem=", 7) != 0) {
+            continue;
+        }
+        if (virtio_pmem_create(argv[i] + (read_only ? 10 : 7), read_only) != 0) {
+            devices_cleanup();
+            hypervisor_cleanup();
+            return EXIT_INIT_FAILED;
+        }
+    }
+    
     if (vm_create() != 0) {
         LOG_ERROR("Falha na criação da VM");
         devices_cleanup();
@@ -42,12 +231,25 @@ int main(int argc, char* argv[])
         return EXIT_VM_FAILED;
     }
     
+    // Memória dos devices (pmem) entra na partição recém-criada
+    if (virtio_mmio_map_memory() != 0) {
+        virtio_mmio_cleanup();
+        vm_destroy();
+        devices_cleanup();
+        hypervisor_cleanup();
+        return EXIT_VM_FAILED;
+    }
+    
+    // Registradores somente-leitura servidos sem exit
+    devices_map_shadow_pages();
+    
     LOG_INFO("Sistema inicializado com sucesso. Iniciando guest...");
     
     // Executar o guest
     int result = run_guest();
     
-    // Cleanup
+    // Cleanup (threads de I/O param antes da RAM do guest ser liberada)
+    virtio_mmio_cleanup();
     vm_destroy();
     devices_cleanup();
     hypervisor_cleanup();
@@ -89,6 +291,41 @@ int hypervisor_init(void)
         LOG_ERROR("Falha ao verificar recursos do processador: 0x%08X", hr);
         return -1;
     }
+    g_host_cpu.hv_features = capability.ProcessorFeatures.AsUINT64;
+    
+    // Espaço de IPA: as janelas de devices virtio ficam no alto dele
+    hr = WHvGetCapability(WHvCapabilityCodePhysicalAddressWidth,
+                         &capability, sizeof(capability), &written_size);
+    if (SUCCEEDED(hr) && capability.PhysicalAddressWidth) {
+        g_guest_pa_bits = capability.PhysicalAddressWidth;
+    } else {
+        LOG_INFO("Largura de PA não informada pelo WHP; assumindo %u bits", g_guest_pa_bits);
+    }
+    
+    // Features do host (Windows só reporta o que o kernel também habilita)
+    static const struct { DWORD pf; cpu_features_t features; } host_features[] = {
+        { PF_ARM_V8_INSTRUCTIONS_AVAILABLE,          CPU_FEAT_V80 },
+        { PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE,   CPU_FEAT_CRYPTO },
+        { PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE,    CPU_FEAT_CRC32 },
+        // RDM é obrigatório em ARMv8.1, junto com LSE
+        { PF_ARM_V81_ATOMIC_INSTRUCTIONS_AVAILABLE,  CPU_FEAT_ATOMICS | CPU_FEAT_RDM },
+        { PF_ARM_V82_DP_INSTRUCTIONS_AVAILABLE,      CPU_FEAT_DOTPROD },
+        { PF_ARM_V82_FP16_INSTRUCTIONS_AVAILABLE,    CPU_FEAT_FP16 },
+        { PF_ARM_V83_JSCVT_INSTRUCTIONS_AVAILABLE,   CPU_FEAT_JSCVT },
+        { PF_ARM_V83_LRCPC_INSTRUCTIONS_AVAILABLE,   CPU_FEAT_LRCPC },
+        { PF_ARM_SHA512_INSTRUCTIONS_AVAILABLE,      CPU_FEAT_SHA512 },
+        { PF_ARM_SHA3_INSTRUCTIONS_AVAILABLE,        CPU_FEAT_SHA3 },
+    };
+    
+    g_host_cpu.features = 0;
+    for (size_t i = 0; i < sizeof(host_features) / sizeof(host_features[0]); i++) {
+        if (IsProcessorFeaturePresent(host_features[i].pf)) {
+            g_host_cpu.features |= host_features[i].features;
+        }
+    }
+    g_host_cpu.features = cpu_features_normalize(g_host_cpu.features);
+    LOG_INFO("Features do host: 0x%llX (WHP: 0x%llX), IPA de %u bits",
+             g_host_cpu.features, g_host_cpu.hv_features, g_guest_pa_bits);
     
     LOG_INFO("WHP inicializado com sucesso");
     return 0;
@@ -132,11 +369,18 @@ int run_guest(void)
     LOG_INFO("Guest carregado. PC=0x%llX, SP=0x%llX", 
              GUEST_ENTRY_POINT, GUEST_RAM_BASE + GUEST_RAM_SIZE - 0x1000);
     
-    // Main execution loop
+    // vCPUs secundários ficam estacionados até o guest chamar PSCI CPU_ON
+    if (vm_start_vcpus() != 0) {
+        vm_stop_vcpus();
+        return EXIT_RUN_FAILED;
+    }
+    
+    // Main execution loop (vCPU de boot)
+    vcpu_state_t* vcpu = vcpu_current();
     int exit_count = 0;
     const int max_exits = 10;  // Limite para demo
     
-    while (g_vm.running && exit_count < max_exits) {
+    while (vcpu_wait_online(vcpu) && exit_count < max_exits) {
         int result = vcpu_run();
         exit_count++;
         
@@ -154,6 +398,18 @@ int run_guest(void)
         }
     }
     
+    vm_stop_vcpus();
+    
     LOG_INFO("Execução do guest concluída (%d exits processados)", exit_count);
+    uint64_t exits = 0, run_ns = 0, steal_ns = 0;
+    for (uint32_t i = 0; i < g_vm.vcpu_count; i++) {
+        exits += g_vm.vcpus[i].exits;
+        run_ns += g_vm.metrics.vcpus[i].run_ns;
+        steal_ns += g_vm.metrics.vcpus[i].steal_ns;
+    }
+    LOG_INFO("Métricas: %llu exits, run=%llu us, steal=%llu us, poll parks=%llu, I/O retido=%llu (%llu us)",
+             exits, run_ns / 1000, steal_ns / 1000,
+             (uint64_t)g_vm.metrics.poll_parks, g_vm.metrics.blk_throttled,
+             g_vm.metrics.blk_throttle_ns / 1000);
     return 0;
 }
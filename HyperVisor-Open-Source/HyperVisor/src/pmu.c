@@ -0,0 +1,468 @@
+/* Desenvolvido por: Escanearcpl */
+#include "pmu.h"
+#include "sysreg.h"
+#include "devices.h"
+
+#define PMU_CYCLE_SLOT          PMU_NUM_COUNTERS
+#define PMU_EVENT_MASK          ((1U << PMU_NUM_COUNTERS) - 1)
+#define PMU_COUNTER_MASK        (PMU_EVENT_MASK | (1U << PMU_CYCLE_INDEX))
+#define PMU_EVTYPE_MASK         0xFC00FFFFU     // Filtros P/U/NSK/NSU/NSH/M + evento
+#define PMU_EVTYPE_EVENT(t)     ((t) & 0xFFFF)
+
+#define PMU_SUPPORTED_EVENTS    ((1U << PMU_EVT_SW_INCR) | (1U << PMU_EVT_EXC_TAKEN) | \
+                                 (1U << PMU_EVT_EXC_RETURN) | (1U << PMU_EVT_CPU_CYCLES))
+
+static inline uint32_t pmu_slot_bit(uint32_t slot)
+{
+    return slot == PMU_CYCLE_SLOT ? (1U << PMU_CYCLE_INDEX) : (1U << slot);
+}
+
+static uint32_t pmu_slot_event(const pmu_vcpu_t* pmu, uint32_t slot)
+{
+    return slot == PMU_CYCLE_SLOT ? PMU_EVT_CPU_CYCLES : PMU_EVTYPE_EVENT(pmu->evtype[slot]);
+}
+
+static bool pmu_slot_running(const pmu_vcpu_t* pmu, uint32_t slot)
+{
+    return (pmu->pmcr & PMCR_E) && (pmu->cnten & pmu_slot_bit(slot));
+}
+
+// Soma delta ao contador e marca overflow: contadores de eventos têm 32
+// bits; o de ciclos tem 64 e faz overflow no bit 31 ou 63 (PMCR_EL0.LC)
+static void pmu_add(pmu_vcpu_t* pmu, uint32_t slot, uint64_t delta)
+{
+    uint64_t old = pmu->count[slot];
+    bool overflow;
+
+    if (slot == PMU_CYCLE_SLOT) {
+        pmu->count[slot] = old + delta;
+        overflow = (pmu->pmcr & PMCR_LC) ? pmu->count[slot] < old
+                                         : delta > 0xFFFFFFFFULL - (old & 0xFFFFFFFF);
+    } else {
+        overflow = delta > 0xFFFFFFFFULL - old;
+        pmu->count[slot] = (old + delta) & 0xFFFFFFFF;
+    }
+
+    if (overflow) {
+        pmu->ovs |= pmu_slot_bit(slot);
+    }
+}
+
+static void pmu_sync_slot(pmu_vcpu_t* pmu, uint32_t slot)
+{
+    uint32_t event = pmu_slot_event(pmu, slot);
+    if (event == PMU_EVT_SW_INCR || !pmu->source) {
+        return;  // Só avança por PMSWINC_EL0
+    }
+
+    uint64_t now = pmu->source(pmu->opaque, event);
+    uint64_t delta = now - pmu->base[slot];
+
+    if (!pmu_slot_running(pmu, slot)) {
+        pmu->base[slot] = now;
+        return;
+    }
+
+    // PMCR_EL0.D: um incremento a cada 64 ciclos; o resto fica para o próximo sync
+    if (slot == PMU_CYCLE_SLOT && (pmu->pmcr & PMCR_D)) {
+        delta /= 64;
+        pmu->base[slot] += delta * 64;
+    } else {
+        pmu->base[slot] = now;
+    }
+
+    if (delta) {
+        pmu_add(pmu, slot, delta);
+    }
+}
+
+// Nível da interrupção: algum overflow com interrupção habilitada. O PPI é
+// compartilhado entre os vCPUs no GIC; cada um contribui com o seu nível.
+static void pmu_update_irq(pmu_vcpu_t* pmu)
+{
+    bool level = (pmu->pmcr & PMCR_E) && (pmu->ovs & pmu->inten);
+
+    if (level != pmu->irq_level) {
+        pmu->irq_level = level;
+        gic_set_ppi_level(PMU_IRQ_PPI, pmu->vcpu, level);
+    }
+}
+
+// Ciclos até o overflow do contador no slot (contadores de eventos têm 32
+// bits; o de ciclos 32 ou 64 conforme PMCR_EL0.LC e, com PMCR_EL0.D, conta
+// um a cada 64)
+static uint64_t pmu_cycles_to_overflow(const pmu_vcpu_t* pmu, uint32_t slot)
+{
+    uint64_t count = pmu->count[slot];
+    uint64_t remaining;
+
+    if (slot != PMU_CYCLE_SLOT) {
+        return 0x100000000ULL - count;
+    }
+
+    if (pmu->pmcr & PMCR_LC) {
+        remaining = count ? 0 - count : UINT64_MAX;
+    } else {
+        remaining = 0x100000000ULL - (count & 0xFFFFFFFF);
+    }
+    if (pmu->pmcr & PMCR_D) {
+        remaining = remaining > UINT64_MAX / 64 ? UINT64_MAX : remaining * 64;
+    }
+    return remaining;
+}
+
+// Instante mais cedo em que um contador de CPU_CYCLES com interrupção
+// habilitada pode transbordar, a partir de contagens sincronizadas em now_ns
+static uint64_t pmu_cycles_deadline(const pmu_vcpu_t* pmu, uint64_t now_ns)
+{
+    uint64_t deadline = UINT64_MAX;
+
+    for (uint32_t slot = 0; slot <= PMU_CYCLE_SLOT; slot++) {
+        if (!pmu_slot_running(pmu, slot) || !(pmu->inten & pmu_slot_bit(slot)) ||
+            pmu_slot_event(pmu, slot) != PMU_EVT_CPU_CYCLES) {
+            continue;
+        }
+
+        uint64_t cycles = pmu_cycles_to_overflow(pmu, slot);
+        uint64_t ns = (cycles / PMU_CYCLE_HZ) * 1000000000ULL +
+                      (cycles % PMU_CYCLE_HZ) * 1000000000ULL / PMU_CYCLE_HZ;
+        uint64_t at = ns > UINT64_MAX - now_ns ? UINT64_MAX : now_ns + ns;
+        if (at < deadline) {
+            deadline = at;
+        }
+    }
+    return deadline;
+}
+
+static void pmu_sync_all(pmu_vcpu_t* pmu)
+{
+    for (uint32_t slot = 0; slot <= PMU_CYCLE_SLOT; slot++) {
+        pmu_sync_slot(pmu, slot);
+    }
+}
+
+void pmu_sync(pmu_vcpu_t* pmu)
+{
+    if (!(pmu->pmcr & PMCR_E)) {
+        return;  // Bases são renovadas por pmu_sync_all() antes de habilitar
+    }
+
+    pmu_sync_all(pmu);
+    pmu_update_irq(pmu);
+}
+
+void pmu_poll(pmu_vcpu_t* pmu, uint64_t now_ns)
+{
+    if (!(pmu->pmcr & PMCR_E)) {
+        return;
+    }
+
+    if (now_ns >= pmu->cycles_deadline_ns) {
+        pmu_sync_all(pmu);
+        pmu->cycles_deadline_ns = pmu_cycles_deadline(pmu, now_ns);
+    } else {
+        for (uint32_t slot = 0; slot <= PMU_CYCLE_SLOT; slot++) {
+            if (pmu_slot_event(pmu, slot) != PMU_EVT_CPU_CYCLES) {
+                pmu_sync_slot(pmu, slot);
+            }
+        }
+    }
+    pmu_update_irq(pmu);
+}
+
+void pmu_vcpu_init(pmu_vcpu_t* pmu, uint32_t vcpu, pmu_source_fn source, void* opaque)
+{
+    memset(pmu, 0, sizeof(*pmu));
+    pmu->vcpu = vcpu;
+    pmu->source = source;
+    pmu->opaque = opaque;
+}
+
+// Índice n de PMEVCNTRn_EL0/PMEVTYPERn_EL0: CRm[1:0]:op2
+static inline uint32_t pmu_reg_counter(const sysreg_desc_t* reg)
+{
+    return (((reg->enc >> 3) & 3) << 3) | (reg->enc & 7);
+}
+
+static uint64_t pmcr_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return (0x41ULL << PMCR_IMP_SHIFT) | ((uint64_t)PMU_NUM_COUNTERS << PMCR_N_SHIFT) |
+           vcpu->pmu.pmcr;
+}
+
+static void pmcr_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    (void)reg;
+    pmu_vcpu_t* pmu = &vcpu->pmu;
+
+    pmu_sync_all(pmu);
+    if (value & PMCR_P) {
+        memset(pmu->count, 0, PMU_NUM_COUNTERS * sizeof(pmu->count[0]));
+    }
+    if (value & PMCR_C) {
+        pmu->count[PMU_CYCLE_SLOT] = 0;
+    }
+    pmu->pmcr = (uint32_t)value & PMCR_WRITABLE;
+    pmu->cycles_deadline_ns = 0;
+    pmu_update_irq(pmu);
+}
+
+// Pares SET/CLR: leitura devolve a máscara; op2 (ou CRm) distingue a operação
+static uint64_t cnten_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return vcpu->pmu.cnten;
+}
+
+static void cnten_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    pmu_vcpu_t* pmu = &vcpu->pmu;
+
+    pmu_sync_all(pmu);
+    if ((reg->enc & 7) == 1) {
+        pmu->cnten |= (uint32_t)value & PMU_COUNTER_MASK;
+    } else {
+        pmu->cnten &= ~(uint32_t)value;
+    }
+    pmu->cycles_deadline_ns = 0;
+}
+
+static uint64_t inten_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return vcpu->pmu.inten;
+}
+
+static void inten_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    pmu_vcpu_t* pmu = &vcpu->pmu;
+
+    if ((reg->enc & 7) == 1) {
+        pmu->inten |= (uint32_t)value & PMU_COUNTER_MASK;
+    } else {
+        pmu->inten &= ~(uint32_t)value;
+    }
+    pmu->cycles_deadline_ns = 0;
+    pmu_update_irq(pmu);
+}
+
+static uint64_t ovs_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    pmu_sync(&vcpu->pmu);
+    return vcpu->pmu.ovs;
+}
+
+static void ovs_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    pmu_vcpu_t* pmu = &vcpu->pmu;
+
+    if (((reg->enc >> 3) & 15) == 14) {     // PMOVSSET_EL0
+        pmu->ovs |= (uint32_t)value & PMU_COUNTER_MASK;
+    } else {                                // PMOVSCLR_EL0
+        pmu->ovs &= ~(uint32_t)value;
+    }
+    pmu_update_irq(pmu);
+}
+
+static void swinc_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    (void)reg;
+    pmu_vcpu_t* pmu = &vcpu->pmu;
+
+    for (uint32_t slot = 0; slot < PMU_NUM_COUNTERS; slot++) {
+        if ((value & (1U << slot)) && pmu_slot_running(pmu, slot) &&
+            pmu_slot_event(pmu, slot) == PMU_EVT_SW_INCR) {
+            pmu_add(pmu, slot, 1);
+        }
+    }
+    pmu_update_irq(pmu);
+}
+
+static uint64_t selr_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return vcpu->pmu.selr;
+}
+
+static void selr_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    (void)reg;
+    vcpu->pmu.selr = (uint32_t)value & 0x1F;
+}
+
+static uint64_t userenr_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return vcpu->pmu.userenr;
+}
+
+static void userenr_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    (void)reg;
+    vcpu->pmu.userenr = (uint32_t)value & 0xF;
+}
+
+// Acesso a um contador/tipo pelo índice (0..N-1, PMU_CYCLE_INDEX = ciclos);
+// índices não implementados são RAZ/WI
+static uint64_t pmu_counter_read(pmu_vcpu_t* pmu, uint32_t index)
+{
+    if (index >= PMU_NUM_COUNTERS && index != PMU_CYCLE_INDEX) {
+        return 0;
+    }
+
+    uint32_t slot = index == PMU_CYCLE_INDEX ? PMU_CYCLE_SLOT : index;
+
+    pmu_sync_slot(pmu, slot);
+    pmu_update_irq(pmu);
+    return pmu->count[slot];
+}
+
+static void pmu_counter_write(pmu_vcpu_t* pmu, uint32_t index, uint64_t value)
+{
+    if (index >= PMU_NUM_COUNTERS && index != PMU_CYCLE_INDEX) {
+        return;
+    }
+
+    uint32_t slot = index == PMU_CYCLE_INDEX ? PMU_CYCLE_SLOT : index;
+
+    pmu_sync_slot(pmu, slot);
+    pmu->count[slot] = slot == PMU_CYCLE_SLOT ? value : (value & 0xFFFFFFFF);
+    pmu->cycles_deadline_ns = 0;
+}
+
+static uint64_t pmu_type_read(pmu_vcpu_t* pmu, uint32_t index)
+{
+    if (index == PMU_CYCLE_INDEX) {
+        return pmu->ccfiltr;
+    }
+    return index < PMU_NUM_COUNTERS ? pmu->evtype[index] : 0;
+}
+
+static void pmu_type_write(pmu_vcpu_t* pmu, uint32_t index, uint64_t value)
+{
+    if (index == PMU_CYCLE_INDEX) {
+        pmu->ccfiltr = value & 0xFC000000;  // Só filtros; o evento é fixo
+    } else if (index < PMU_NUM_COUNTERS) {
+        // A fonte muda junto com o evento: acumula o antigo e renova a base
+        pmu_sync_slot(pmu, index);
+        pmu->evtype[index] = (uint32_t)value & PMU_EVTYPE_MASK;
+
+        uint32_t event = pmu_slot_event(pmu, index);
+        pmu->base[index] = (pmu->source && event != PMU_EVT_SW_INCR)
+                         ? pmu->source(pmu->opaque, event) : 0;
+        pmu->cycles_deadline_ns = 0;
+    }
+}
+
+static uint64_t ccntr_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return pmu_counter_read(&vcpu->pmu, PMU_CYCLE_INDEX);
+}
+
+static void ccntr_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    (void)reg;
+    pmu_counter_write(&vcpu->pmu, PMU_CYCLE_INDEX, value);
+}
+
+static uint64_t ccfiltr_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return pmu_type_read(&vcpu->pmu, PMU_CYCLE_INDEX);
+}
+
+static void ccfiltr_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    (void)reg;
+    pmu_type_write(&vcpu->pmu, PMU_CYCLE_INDEX, value);
+}
+
+static uint64_t xevcntr_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return vcpu->pmu.selr < PMU_NUM_COUNTERS ? pmu_counter_read(&vcpu->pmu, vcpu->pmu.selr) : 0;
+}
+
+static void xevcntr_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    (void)reg;
+    if (vcpu->pmu.selr < PMU_NUM_COUNTERS) {
+        pmu_counter_write(&vcpu->pmu, vcpu->pmu.selr, value);
+    }
+}
+
+static uint64_t xevtyper_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return pmu_type_read(&vcpu->pmu, vcpu->pmu.selr);
+}
+
+static void xevtyper_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    (void)reg;
+    pmu_type_write(&vcpu->pmu, vcpu->pmu.selr, value);
+}
+
+static uint64_t evcntr_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    return pmu_counter_read(&vcpu->pmu, pmu_reg_counter(reg));
+}
+
+static void evcntr_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    pmu_counter_write(&vcpu->pmu, pmu_reg_counter(reg), value);
+}
+
+static uint64_t evtyper_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    return pmu_type_read(&vcpu->pmu, pmu_reg_counter(reg));
+}
+
+static void evtyper_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    pmu_type_write(&vcpu->pmu, pmu_reg_counter(reg), value);
+}
+
+#define PMU_EVCNTR(n) \
+    SYSREG_HOOK("PMEVCNTR" #n "_EL0", SYSREG_ENC(3, 3, 14, 8 + ((n) >> 3), (n) & 7), \
+                SYSREG_RW, evcntr_read, evcntr_write)
+#define PMU_EVTYPER(n) \
+    SYSREG_HOOK("PMEVTYPER" #n "_EL0", SYSREG_ENC(3, 3, 14, 12 + ((n) >> 3), (n) & 7), \
+                SYSREG_RW, evtyper_read, evtyper_write)
+
+// PMUv3 (ID_AA64DFR0_EL1.PMUVer = 1); contadores 0..PMU_NUM_COUNTERS-1
+static const sysreg_desc_t g_pmu_regs[] = {
+    SYSREG_HOOK("PMCR_EL0",          SYSREG_ENC(3, 3, 9, 12, 0),  SYSREG_RW, pmcr_read, pmcr_write),
+    SYSREG_HOOK("PMCNTENSET_EL0",    SYSREG_ENC(3, 3, 9, 12, 1),  SYSREG_RW, cnten_read, cnten_write),
+    SYSREG_HOOK("PMCNTENCLR_EL0",    SYSREG_ENC(3, 3, 9, 12, 2),  SYSREG_RW, cnten_read, cnten_write),
+    SYSREG_HOOK("PMOVSCLR_EL0",      SYSREG_ENC(3, 3, 9, 12, 3),  SYSREG_RW, ovs_read, ovs_write),
+    SYSREG_HOOK("PMSWINC_EL0",       SYSREG_ENC(3, 3, 9, 12, 4),  SYSREG_WO, NULL, swinc_write),
+    SYSREG_HOOK("PMSELR_EL0",        SYSREG_ENC(3, 3, 9, 12, 5),  SYSREG_RW, selr_read, selr_write),
+    SYSREG_CONST("PMCEID0_EL0",      SYSREG_ENC(3, 3, 9, 12, 6),  PMU_SUPPORTED_EVENTS),
+    SYSREG_CONST("PMCEID1_EL0",      SYSREG_ENC(3, 3, 9, 12, 7),  0),
+    SYSREG_HOOK("PMCCNTR_EL0",       SYSREG_ENC(3, 3, 9, 13, 0),  SYSREG_RW, ccntr_read, ccntr_write),
+    SYSREG_HOOK("PMXEVTYPER_EL0",    SYSREG_ENC(3, 3, 9, 13, 1),  SYSREG_RW, xevtyper_read, xevtyper_write),
+    SYSREG_HOOK("PMXEVCNTR_EL0",     SYSREG_ENC(3, 3, 9, 13, 2),  SYSREG_RW, xevcntr_read, xevcntr_write),
+    SYSREG_HOOK("PMUSERENR_EL0",     SYSREG_ENC(3, 3, 9, 14, 0),  SYSREG_RW, userenr_read, userenr_write),
+    SYSREG_HOOK("PMINTENSET_EL1",    SYSREG_ENC(3, 0, 9, 14, 1),  SYSREG_RW, inten_read, inten_write),
+    SYSREG_HOOK("PMINTENCLR_EL1",    SYSREG_ENC(3, 0, 9, 14, 2),  SYSREG_RW, inten_read, inten_write),
+    SYSREG_HOOK("PMOVSSET_EL0",      SYSREG_ENC(3, 3, 9, 14, 3),  SYSREG_RW, ovs_read, ovs_write),
+    SYSREG_HOOK("PMCCFILTR_EL0",     SYSREG_ENC(3, 3, 14, 15, 7), SYSREG_RW, ccfiltr_read, ccfiltr_write),
+    PMU_EVCNTR(0), PMU_EVCNTR(1), PMU_EVCNTR(2), PMU_EVCNTR(3), PMU_EVCNTR(4), PMU_EVCNTR(5),
+    PMU_EVTYPER(0), PMU_EVTYPER(1), PMU_EVTYPER(2), PMU_EVTYPER(3), PMU_EVTYPER(4), PMU_EVTYPER(5),
+};
+
+int pmu_init(void)
+{
+    if (sysreg_register(g_pmu_regs, SYSREG_COUNT(g_pmu_regs)) != 0) {
+        LOG_ERROR("Falha ao registrar os registradores do PMU");
+        return -1;
+    }
+
+    LOG_INFO("PMU virtual: %d contadores + ciclos, overflow no PPI %d",
+             PMU_NUM_COUNTERS, PMU_IRQ_PPI);
+    return 0;
+}
@@ -0,0 +1,49 @@
+/* Desenvolvido por: Escanearcpl */
+#include "poll_detect.h"
+#include "devices.h"
+
+void poll_detect_reset(poll_detect_t* pd)
+{
+    pd->pc = 0;
+    pd->gpa = 0;
+    pd->value = 0;
+    pd->generation = 0;
+    pd->repeats = 0;
+}
+
+// Registra uma leitura MMIO concluída; retorna true se o vCPU deve estacionar
+bool poll_detect_observe(poll_detect_t* pd, uint64_t pc, uint64_t gpa,
+                         uint64_t value, uint64_t generation)
+{
+    if (pd->pc == pc && pd->gpa == gpa && pd->value == value) {
+        if (pd->repeats < POLL_DETECT_THRESHOLD) {
+            pd->repeats++;
+        }
+    } else {
+        pd->pc = pc;
+        pd->gpa = gpa;
+        pd->value = value;
+        pd->repeats = 1;
+    }
+    
+    pd->generation = generation;
+    return pd->repeats >= POLL_DETECT_THRESHOLD;
+}
+
+void poll_detect_park(poll_detect_t* pd)
+{
+    device_id_t id = device_id_from_address(pd->gpa);
+    if (id == DEVICE_ID_NONE) {
+        return;
+    }
+    
+    // Se o device mudou depois da leitura, o guest deve reler sem esperar.
+    if (!devices_wait_change(id, pd->generation, POLL_PARK_TIMEOUT_MS)) {
+        LOG_TRACE("Poll em 0x%llX (PC=0x%llX): timeout", pd->gpa, pd->pc);
+    }
+    
+    // Mudança ou timeout: o guest volta a reler normalmente e só estaciona de
+    // novo após outras POLL_DETECT_THRESHOLD leituras idênticas
+    pd->repeats = 0;
+    pd->parks++;
+}
@@ -0,0 +1,154 @@
+/* Desenvolvido por: Escanearcpl */
+#include "psci.h"
+#include "vm.h"
+
+// MPIDR alvo -> vCPU: Aff0 = índice (ver mpidr_read em sysreg.c), demais afinidades zero
+static vcpu_state_t* psci_target(uint64_t mpidr)
+{
+    uint64_t affinity = mpidr & 0xFF00FFFFFFULL;
+
+    if (affinity >= g_vm.vcpu_count || !g_vm.vcpus[affinity].created) {
+        return NULL;
+    }
+    return &g_vm.vcpus[affinity];
+}
+
+// Chamadas SMC32 usam apenas os 32 bits baixos dos argumentos
+static inline uint64_t psci_arg(const hypercall_args_t* call, uint32_t i)
+{
+    return (call->nr & 0x40000000) ? call->args[i] : (call->args[i] & 0xFFFFFFFF);
+}
+
+static int64_t psci_cpu_on(const hypercall_args_t* call)
+{
+    vcpu_state_t* target = psci_target(psci_arg(call, 0));
+    uint64_t entry = psci_arg(call, 1);
+
+    if (!target) {
+        return PSCI_RET_INVALID_PARAMS;
+    }
+    if (!vm_gpa_to_hva(entry, 4)) {
+        return PSCI_RET_INVALID_ADDRESS;
+    }
+
+    switch (vcpu_power_on(target, entry, psci_arg(call, 2))) {
+        case VCPU_POWER_OFF:
+            return PSCI_RET_SUCCESS;
+        case VCPU_POWER_ON_PENDING:
+            return PSCI_RET_ON_PENDING;
+        default:
+            return PSCI_RET_ALREADY_ON;
+    }
+}
+
+// Standby e power down viram a mesma espera ociosa. Um power down que
+// retorna é permitido pela especificação (estado não alcançado), então o
+// guest segue após o HVC sem precisar retomar em entry_point.
+static int64_t psci_cpu_suspend(const hypercall_args_t* call, vcpu_state_t* vcpu)
+{
+    (void)call;  // power_state só aparece no trace
+    LOG_TRACE("CPU_SUSPEND vCPU %u: power_state=0x%llX (%s)", vcpu->index,
+              psci_arg(call, 0), (psci_arg(call, 0) & PSCI_POWER_STATE_TYPE) ? "power down" : "standby");
+
+    vcpu_idle(vcpu, VCPU_IDLE_MAX_MS);
+    return PSCI_RET_SUCCESS;
+}
+
+static int64_t psci_affinity_info(const hypercall_args_t* call)
+{
+    vcpu_state_t* target = psci_target(psci_arg(call, 0));
+
+    if (!target || psci_arg(call, 1) != 0) {
+        return PSCI_RET_INVALID_PARAMS;
+    }
+
+    switch (target->power) {
+        case VCPU_POWER_ON:
+            return PSCI_AFFINITY_ON;
+        case VCPU_POWER_ON_PENDING:
+            return PSCI_AFFINITY_ON_PENDING;
+        default:
+            return PSCI_AFFINITY_OFF;
+    }
+}
+
+static int64_t psci_features(uint32_t fn)
+{
+    switch (fn) {
+        case SMCCC_VERSION:
+        case PSCI_VERSION:
+        case PSCI_CPU_SUSPEND:
+        case PSCI_CPU_SUSPEND_64:   // Formato original de power_state, sem OS-initiated
+        case PSCI_CPU_OFF:
+        case PSCI_CPU_ON:
+        case PSCI_CPU_ON_64:
+        case PSCI_AFFINITY_INFO:
+        case PSCI_AFFINITY_INFO_64:
+        case PSCI_MIGRATE_INFO_TYPE:
+        case PSCI_SYSTEM_OFF:
+        case PSCI_SYSTEM_RESET:
+        case PSCI_FEATURES:
+            return PSCI_RET_SUCCESS;
+        default:
+            return PSCI_RET_NOT_SUPPORTED;
+    }
+}
+
+int64_t psci_dispatch(const hypercall_args_t* call)
+{
+    uint32_t fn = (uint32_t)call->nr;
+    vcpu_state_t* vcpu = vcpu_current();
+
+    switch (fn) {
+        case SMCCC_VERSION:
+            return SMCCC_VERSION_VALUE;
+        case SMCCC_ARCH_FEATURES:
+            return PSCI_RET_NOT_SUPPORTED;  // Nenhum workaround de firmware necessário
+        case PSCI_VERSION:
+            return PSCI_VERSION_VALUE;
+        case PSCI_FEATURES:
+            return psci_features((uint32_t)call->args[0]);
+        case PSCI_MIGRATE_INFO_TYPE:
+            return PSCI_TOS_NOT_PRESENT;
+        default:
+            break;
+    }
+
+    // Gerência de energia exige uma thread de vCPU (caminho WHP)
+    if (!vcpu) {
+        return PSCI_RET_NOT_SUPPORTED;
+    }
+
+    switch (fn) {
+        case PSCI_CPU_ON:
+        case PSCI_CPU_ON_64:
+            return psci_cpu_on(call);
+
+        case PSCI_CPU_OFF:
+            vcpu_power_off(vcpu);
+            return PSCI_RET_SUCCESS;  // Ignorado: o vCPU volta por CPU_ON
+
+        case PSCI_CPU_SUSPEND:
+        case PSCI_CPU_SUSPEND_64:
+            return psci_cpu_suspend(call, vcpu);
+
+        case PSCI_AFFINITY_INFO:
+        case PSCI_AFFINITY_INFO_64:
+            return psci_affinity_info(call);
+
+        case PSCI_SYSTEM_OFF:
+            LOG_INFO("PSCI SYSTEM_OFF do vCPU %u", vcpu->index);
+            vm_request_stop();
+            return PSCI_RET_SUCCESS;
+
+        case PSCI_SYSTEM_RESET:
+            // Sem recarga do guest: o reset encerra a VM como SYSTEM_OFF
+            LOG_INFO("PSCI SYSTEM_RESET do vCPU %u (encerrando a VM)", vcpu->index);
+            vm_request_stop();
+            return PSCI_RET_SUCCESS;
+
+        default:
+            LOG_DEBUG("Função SMCCC não suportada: 0x%08X", fn);
+            return PSCI_RET_NOT_SUPPORTED;
+    }
+}
@@ -0,0 +1,101 @@
+/* Desenvolvido por: Escanearcpl */
+#include "pvclock.h"
+#include "hypercall.h"
+#include "vm.h"
+#include "devices.h"
+
+// Estado do relógio paravirtual no host
+typedef struct {
+    pvclock_page_t* page;     // Página no espaço do guest (NULL = desativado)
+    uint64_t page_gpa;
+    uint64_t mul;
+    uint32_t shift;
+    uint64_t frequency;         // CNTFRQ_EL0 do hardware
+    uint64_t counter_offset;    // Contador do host - CNTVCT_EL0 do guest
+} pvclock_state_t;
+
+static pvclock_state_t g_pvclock = {0};
+
+static int64_t hc_pvclock_register(const hypercall_args_t* call)
+{
+    return pvclock_register(call->args[0], call->args[1]) == 0 ? HC_SUCCESS : HC_ERR_INVALID;
+}
+
+int pvclock_init(void)
+{
+    // Escala do contador do hardware que o guest lê sem trap, não a do
+    // QPC do host nem a do contador emulado em sysreg.c
+    g_pvclock.page = NULL;
+    g_pvclock.page_gpa = 0;
+    g_pvclock.frequency = timer_get_arch_frequency();
+    if (g_pvclock.frequency == 0) {
+        LOG_ERROR("pvclock: CNTFRQ_EL0 do host é zero");
+        return -1;
+    }
+    g_pvclock.shift = PVCLOCK_SHIFT;
+    g_pvclock.mul = pvclock_mul_for_freq(g_pvclock.frequency);
+    
+    // O contador amostrado pelo guest só vale junto do exit que o trouxe
+    return hypercall_register(HC_PVCLOCK_REGISTER, hc_pvclock_register, "pvclock_register", HC_FLAG_NO_BATCH);
+}
+
+int pvclock_register(uint64_t page_gpa, uint64_t guest_counter)
+{
+    if (page_gpa == 0) {
+        g_pvclock.page = NULL;
+        g_pvclock.page_gpa = 0;
+        LOG_INFO("pvclock desativado pelo guest");
+        return 0;
+    }
+    
+    if (page_gpa & ARM64_PAGE_MASK) {
+        LOG_ERROR("pvclock: GPA 0x%llX não alinhado a página", page_gpa);
+        return -1;
+    }
+    
+    pvclock_page_t* page = (pvclock_page_t*)vm_gpa_to_hva(page_gpa, ARM64_PAGE_SIZE);
+    if (!page) {
+        LOG_ERROR("pvclock: GPA 0x%llX fora da RAM guest", page_gpa);
+        return -1;
+    }
+    
+    // O CNTVOFF da partição não é visível ao host: o guest manda o
+    // CNTVCT_EL0 lido logo antes do HVC. O offset erra pela latência do
+    // exit, o que só desloca system_time_ns em alguns microssegundos
+    memset(page, 0, sizeof(*page));
+    g_pvclock.counter_offset = timer_get_arch_counter() - guest_counter;
+    g_pvclock.page = page;
+    g_pvclock.page_gpa = page_gpa;
+    pvclock_update();
+    
+    LOG_INFO("pvclock registrado em 0x%llX (%llu Hz, mul=0x%llX, shift=%u)",
+             page_gpa, g_pvclock.frequency, g_pvclock.mul, g_pvclock.shift);
+    return 0;
+}
+
+void pvclock_update(void)
+{
+    pvclock_page_t* page = g_pvclock.page;
+    if (!page) {
+        return;
+    }
+    
+    // Contador do guest no mesmo instante que o tempo monotônico do host
+    // (o de HC_CLOCK_READ): os dois contadores andam na mesma frequência
+    uint64_t counter = timer_get_arch_counter() - g_pvclock.counter_offset;
+    uint64_t now_ns = timer_get_time_ns();
+    
+    // Seqlock: versão ímpar durante a escrita
+    page->version++;
+    MemoryBarrier();
+    
+    page->counter_timestamp = counter;
+    page->system_time_ns = now_ns;
+    page->mul = g_pvclock.mul;
+    page->shift = g_pvclock.shift;
+    page->counter_frequency = g_pvclock.frequency;
+    page->flags = PVCLOCK_FLAG_STABLE;
+    
+    MemoryBarrier();
+    page->version++;
+}
@@ -0,0 +1,435 @@
+/* Desenvolvido por: Escanearcpl */
+#include "stage2.h"
+#include <string.h>
+
+// Operações do walker comum
+typedef enum {
+    S2_OP_MAP,
+    S2_OP_UNMAP,
+    S2_OP_PROTECT,
+    S2_OP_SPLIT
+} s2_op_t;
+
+typedef struct {
+    s2_op_t op;
+    uint64_t pa;            // S2_OP_MAP: PA correspondente ao IPA corrente
+    uint64_t attrs;         // S2_OP_MAP/S2_OP_PROTECT: atributos do descritor
+} s2_walk_t;
+
+static inline bool s2_is_table(uint64_t desc, uint32_t level)
+{
+    return level < 3 && (desc & S2_DESC_TYPE_MASK) == S2_DESC_TABLE;
+}
+
+static inline uint64_t s2_leaf_type(uint32_t level)
+{
+    return level == 3 ? S2_DESC_PAGE : S2_DESC_BLOCK;
+}
+
+static inline uint32_t s2_index(uint64_t ipa, uint32_t level)
+{
+    return (uint32_t)(ipa >> STAGE2_LEVEL_SHIFT(level)) & (STAGE2_TABLE_ENTRIES - 1);
+}
+
+static inline uint64_t* s2_table_of(const stage2_t* s2, uint64_t desc)
+{
+    return (uint64_t*)s2->mm.phys_to_virt(s2->mm.opaque, desc & S2_DESC_OA_MASK);
+}
+
+static uint64_t s2_make_attrs(uint32_t perms, stage2_memtype_t type)
+{
+    uint64_t attrs = S2_AF;
+
+    if (type == STAGE2_MEM_DEVICE) {
+        attrs |= S2_MEMATTR_DEVICE | S2_XN;  // Nunca executar de MMIO
+    } else {
+        attrs |= S2_MEMATTR_NORMAL | S2_SH_INNER;
+        if (!(perms & STAGE2_PERM_X)) {
+            attrs |= S2_XN;
+        }
+    }
+
+    if (perms & STAGE2_PERM_R) attrs |= S2_AP_R;
+    if (perms & STAGE2_PERM_W) attrs |= S2_AP_W;
+    return attrs;
+}
+
+// Troca um descritor válido respeitando break-before-make
+static void s2_replace(stage2_t* s2, uint64_t* entry, uint64_t desc,
+                       uint64_t ipa, uint32_t level)
+{
+    if ((*entry & S2_DESC_VALID) && s2->mm.tlb_invalidate) {
+        *entry = 0;
+        s2->mm.tlb_invalidate(s2->mm.opaque, ipa, STAGE2_LEVEL_SIZE(level));
+    }
+    *entry = desc;
+}
+
+static void s2_free_table(stage2_t* s2, uint64_t desc, uint32_t level)
+{
+    uint64_t* table = s2_table_of(s2, desc);
+
+    for (uint32_t i = 0; i < STAGE2_TABLE_ENTRIES; i++) {
+        if (s2_is_table(table[i], level + 1)) {
+            s2_free_table(s2, table[i], level + 1);
+        }
+    }
+    s2->mm.free_page(s2->mm.opaque, table, desc & S2_DESC_OA_MASK);
+}
+
+static bool s2_table_empty(const uint64_t* table)
+{
+    for (uint32_t i = 0; i < STAGE2_TABLE_ENTRIES; i++) {
+        if (table[i] & S2_DESC_VALID) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Devolve a tabela do próximo nível para *entry, criando-a se inválida ou
+// dividindo o bloco existente em 512 descritores equivalentes
+static uint64_t* s2_next_table(stage2_t* s2, uint64_t* entry, uint64_t ipa, uint32_t level)
+{
+    uint64_t desc = *entry;
+    if (s2_is_table(desc, level)) {
+        return s2_table_of(s2, desc);
+    }
+
+    uint64_t phys;
+    uint64_t* table = (uint64_t*)s2->mm.alloc_page(s2->mm.opaque, &phys);
+    if (!table) {
+        return NULL;
+    }
+
+    if (desc & S2_DESC_VALID) {
+        uint64_t oa = desc & S2_DESC_OA_MASK;
+        uint64_t attrs = desc & S2_DESC_ATTR_MASK;
+        uint64_t step = STAGE2_LEVEL_SIZE(level + 1);
+
+        for (uint32_t i = 0; i < STAGE2_TABLE_ENTRIES; i++) {
+            table[i] = (oa + i * step) | attrs | s2_leaf_type(level + 1);
+        }
+    }
+
+    s2_replace(s2, entry, phys | S2_DESC_TABLE, ipa & ~(STAGE2_LEVEL_SIZE(level) - 1), level);
+    return table;
+}
+
+static int s2_walk(stage2_t* s2, uint64_t* table, uint32_t level,
+                   uint64_t ipa, uint64_t end, s2_walk_t* w)
+{
+    uint64_t size = STAGE2_LEVEL_SIZE(level);
+
+    while (ipa < end) {
+        uint64_t base = ipa & ~(size - 1);
+        uint64_t next = base + size;
+        if (next > end) {
+            next = end;
+        }
+
+        uint64_t* entry = &table[s2_index(ipa, level)];
+        bool whole = (ipa == base && next == base + size);
+        uint64_t pa_next = w->pa + (next - ipa);
+
+        switch (w->op) {
+            case S2_OP_MAP:
+                // Bloco somente se IPA e PA estiverem alinhados ao tamanho do nível
+                if (whole && (level == 3 || ((w->pa & (size - 1)) == 0))) {
+                    uint64_t old = *entry;
+                    s2_replace(s2, entry, w->pa | w->attrs | s2_leaf_type(level), base, level);
+                    if (s2_is_table(old, level)) {
+                        s2_free_table(s2, old, level);
+                    }
+                    break;
+                }
+                {
+                    uint64_t* child = s2_next_table(s2, entry, ipa, level);
+                    if (!child || s2_walk(s2, child, level + 1, ipa, next, w) != 0) {
+                        return -1;
+                    }
+                }
+                break;
+
+            case S2_OP_UNMAP:
+                if (!(*entry & S2_DESC_VALID)) {
+                    break;
+                }
+                if (whole) {
+                    uint64_t old = *entry;
+                    s2_replace(s2, entry, 0, base, level);
+                    if (s2_is_table(old, level)) {
+                        s2_free_table(s2, old, level);
+                    }
+                    break;
+                }
+                {
+                    uint64_t* child = s2_next_table(s2, entry, ipa, level);
+                    if (!child || s2_walk(s2, child, level + 1, ipa, next, w) != 0) {
+                        return -1;
+                    }
+                    if (s2_table_empty(child)) {
+                        uint64_t old = *entry;
+                        s2_replace(s2, entry, 0, base, level);
+                        s2_free_table(s2, old, level);
+                    }
+                }
+                break;
+
+            case S2_OP_PROTECT:
+                if (!(*entry & S2_DESC_VALID)) {
+                    break;
+                }
+                if (!s2_is_table(*entry, level) && whole) {
+                    // Mantém o tipo de memória; troca AP/XN
+                    uint64_t keep = *entry & ~(S2_AP_R | S2_AP_W | S2_XN);
+                    uint64_t xn = (*entry & S2_MEMATTR_MASK) == S2_MEMATTR_DEVICE ?
+                                  S2_XN : (w->attrs & S2_XN);
+                    s2_replace(s2, entry, keep | (w->attrs & (S2_AP_R | S2_AP_W)) | xn, base, level);
+                    break;
+                }
+                {
+                    uint64_t* child = s2_next_table(s2, entry, ipa, level);
+                    if (!child || s2_walk(s2, child, level + 1, ipa, next, w) != 0) {
+                        return -1;
+                    }
+                }
+                break;
+
+            case S2_OP_SPLIT:
+                if (level == 3 || !(*entry & S2_DESC_VALID)) {
+                    break;
+                }
+                {
+                    uint64_t* child = s2_next_table(s2, entry, ipa, level);
+                    if (!child || s2_walk(s2, child, level + 1, ipa, next, w) != 0) {
+                        return -1;
+                    }
+                }
+                break;
+        }
+
+        w->pa = pa_next;
+        ipa = next;
+    }
+
+    return 0;
+}
+
+// Agrupa de baixo para cima tabelas cujas 512 entradas são folhas contíguas
+// com os mesmos atributos e OA alinhado ao bloco do nível acima
+static void s2_merge_walk(stage2_t* s2, uint64_t* table, uint32_t level,
+                          uint64_t ipa, uint64_t end)
+{
+    uint64_t size = STAGE2_LEVEL_SIZE(level);
+
+    while (ipa < end) {
+        uint64_t base = ipa & ~(size - 1);
+        uint64_t next = base + size;
+        uint64_t* entry = &table[s2_index(ipa, level)];
+
+        if (s2_is_table(*entry, level)) {
+            uint64_t* child = s2_table_of(s2, *entry);
+            if (level + 1 < 3) {
+                s2_merge_walk(s2, child, level + 1, ipa, next < end ? next : end);
+            }
+
+            uint64_t first = child[0];
+            uint64_t oa = first & S2_DESC_OA_MASK;
+            uint64_t attrs = first & S2_DESC_ATTR_MASK;
+            uint64_t step = STAGE2_LEVEL_SIZE(level + 1);
+            bool uniform = (first & S2_DESC_VALID) && !s2_is_table(first, level + 1) &&
+                           (oa & (size - 1)) == 0;
+
+            for (uint32_t i = 1; uniform && i < STAGE2_TABLE_ENTRIES; i++) {
+                uniform = (child[i] & S2_DESC_VALID) && !s2_is_table(child[i], level + 1) &&
+                          (child[i] & S2_DESC_OA_MASK) == oa + i * step &&
+                          (child[i] & S2_DESC_ATTR_MASK) == attrs;
+            }
+
+            if (uniform) {
+                uint64_t old = *entry;
+                s2_replace(s2, entry, oa | attrs | S2_DESC_BLOCK, base, level);
+                s2->mm.free_page(s2->mm.opaque, child, old & S2_DESC_OA_MASK);
+            }
+        }
+
+        ipa = next;
+    }
+}
+
+static int s2_check_range(const stage2_t* s2, uint64_t ipa, uint64_t size)
+{
+    if (!s2->root || size == 0 ||
+        ((ipa | size) & (STAGE2_LEVEL_SIZE(3) - 1)) != 0) {
+        return -1;
+    }
+    if (ipa + size < ipa || ipa + size > (1ULL << s2->ipa_bits)) {
+        return -1;
+    }
+    return 0;
+}
+
+int stage2_init(stage2_t* s2, const stage2_mm_ops_t* mm, uint32_t ipa_bits)
+{
+    memset(s2, 0, sizeof(*s2));
+
+    if (!mm || !mm->alloc_page || !mm->free_page || !mm->phys_to_virt ||
+        ipa_bits < STAGE2_MIN_IPA_BITS || ipa_bits > STAGE2_MAX_IPA_BITS) {
+        return -1;
+    }
+
+    s2->mm = *mm;
+    s2->ipa_bits = ipa_bits;
+    s2->root = (uint64_t*)mm->alloc_page(mm->opaque, &s2->root_phys);
+    return s2->root ? 0 : -1;
+}
+
+void stage2_destroy(stage2_t* s2)
+{
+    if (!s2->root) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < STAGE2_TABLE_ENTRIES; i++) {
+        if (s2_is_table(s2->root[i], STAGE2_START_LEVEL)) {
+            s2_free_table(s2, s2->root[i], STAGE2_START_LEVEL);
+        }
+    }
+    s2->mm.free_page(s2->mm.opaque, s2->root, s2->root_phys);
+    s2->root = NULL;
+}
+
+int stage2_map(stage2_t* s2, uint64_t ipa, uint64_t pa, uint64_t size,
+               uint32_t perms, stage2_memtype_t type)
+{
+    if (s2_check_range(s2, ipa, size) != 0 || (pa & (STAGE2_LEVEL_SIZE(3) - 1)) != 0) {
+        return -1;
+    }
+
+    s2_walk_t w = { S2_OP_MAP, pa, s2_make_attrs(perms, type) };
+    return s2_walk(s2, s2->root, STAGE2_START_LEVEL, ipa, ipa + size, &w);
+}
+
+int stage2_unmap(stage2_t* s2, uint64_t ipa, uint64_t size)
+{
+    if (s2_check_range(s2, ipa, size) != 0) {
+        return -1;
+    }
+
+    s2_walk_t w = { S2_OP_UNMAP, 0, 0 };
+    return s2_walk(s2, s2->root, STAGE2_START_LEVEL, ipa, ipa + size, &w);
+}
+
+int stage2_protect(stage2_t* s2, uint64_t ipa, uint64_t size, uint32_t perms)
+{
+    if (s2_check_range(s2, ipa, size) != 0) {
+        return -1;
+    }
+
+    s2_walk_t w = { S2_OP_PROTECT, 0, s2_make_attrs(perms, STAGE2_MEM_NORMAL) };
+    return s2_walk(s2, s2->root, STAGE2_START_LEVEL, ipa, ipa + size, &w);
+}
+
+int stage2_split(stage2_t* s2, uint64_t ipa, uint64_t size)
+{
+    if (s2_check_range(s2, ipa, size) != 0) {
+        return -1;
+    }
+
+    s2_walk_t w = { S2_OP_SPLIT, 0, 0 };
+    return s2_walk(s2, s2->root, STAGE2_START_LEVEL, ipa, ipa + size, &w);
+}
+
+int stage2_merge(stage2_t* s2, uint64_t ipa, uint64_t size)
+{
+    if (s2_check_range(s2, ipa, size) != 0) {
+        return -1;
+    }
+
+    s2_merge_walk(s2, s2->root, STAGE2_START_LEVEL, ipa, ipa + size);
+    return 0;
+}
+
+bool stage2_lookup(const stage2_t* s2, uint64_t ipa, uint64_t* pa,
+                   uint64_t* desc, uint32_t* level)
+{
+    if (!s2->root || ipa >= (1ULL << s2->ipa_bits)) {
+        return false;
+    }
+
+    const uint64_t* table = s2->root;
+    for (uint32_t l = STAGE2_START_LEVEL; l <= 3; l++) {
+        uint64_t d = table[s2_index(ipa, l)];
+
+        if (!(d & S2_DESC_VALID) || (l == 3 && (d & S2_DESC_TYPE_MASK) != S2_DESC_PAGE)) {
+            return false;
+        }
+        if (s2_is_table(d, l)) {
+            table = s2_table_of(s2, d);
+            continue;
+        }
+
+        if (pa) *pa = (d & S2_DESC_OA_MASK) + (ipa & (STAGE2_LEVEL_SIZE(l) - 1));
+        if (desc) *desc = d;
+        if (level) *level = l;
+        return true;
+    }
+
+    return false;
+}
+
+static void s2_stats_walk(const stage2_t* s2, const uint64_t* table, uint32_t level,
+                          stage2_stats_t* stats)
+{
+    for (uint32_t i = 0; i < STAGE2_TABLE_ENTRIES; i++) {
+        uint64_t d = table[i];
+        if (!(d & S2_DESC_VALID)) {
+            continue;
+        }
+
+        if (s2_is_table(d, level)) {
+            stats->tables++;
+            s2_stats_walk(s2, s2_table_of(s2, d), level + 1, stats);
+        } else if (level == 1) {
+            stats->blocks_1g++;
+        } else if (level == 2) {
+            stats->blocks_2m++;
+        } else {
+            stats->pages_4k++;
+        }
+    }
+}
+
+void stage2_get_stats(const stage2_t* s2, stage2_stats_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (s2->root) {
+        s2_stats_walk(s2, s2->root, STAGE2_START_LEVEL, stats);
+    }
+}
+
+uint32_t stage2_pa_bits(uint32_t parange)
+{
+    static const uint8_t bits[] = { 32, 36, 40, 42, 44, 48 };
+    return bits[parange < 5 ? parange : 5];
+}
+
+uint64_t stage2_vtcr(const stage2_t* s2, uint32_t parange)
+{
+    uint64_t ps = parange < 5 ? parange : 5;
+
+    return (1ULL << 31) |                   // RES1
+           (ps << 16) |                     // PS: tamanho do PA de saída
+           (0ULL << 14) |                   // TG0: granule de 4KB
+           (3ULL << 12) |                   // SH0: inner shareable
+           (1ULL << 10) |                   // ORGN0: write-back
+           (1ULL << 8) |                    // IRGN0: write-back
+           (1ULL << 6) |                    // SL0: início no nível 1
+           (uint64_t)(64 - s2->ipa_bits);   // T0SZ
+}
+
+uint64_t stage2_vttbr(const stage2_t* s2, uint16_t vmid)
+{
+    return ((uint64_t)vmid << 48) | (s2->root_phys & S2_DESC_OA_MASK);
+}
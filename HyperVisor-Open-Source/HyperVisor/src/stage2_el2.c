@@ -0,0 +1,172 @@
+/* Desenvolvido por: Escanearcpl */
+#include "hypervisor.h"
+#include "asm_functions.h"
+
+// Pool de páginas para tabelas stage-2 no modo EL2 (MMU de EL2 em identidade)
+#define STAGE2_POOL_PAGES   64
+
+// Acima disto um TLBI por página custa mais que refazer as traduções do VMID
+#define EL2_TLBI_MAX_PAGES  64
+
+static HV_ALIGN(4096) uint64_t g_stage2_pool[STAGE2_POOL_PAGES][STAGE2_TABLE_ENTRIES];
+static bool g_stage2_pool_used[STAGE2_POOL_PAGES];
+
+hypervisor_context_t g_hyp_context = {0};
+vmid_allocator_t g_vmid_allocator;
+
+// Guest carregado em cada CPU física (el2_guest_switch)
+static el2_guest_t* g_el2_current[EL2_MAX_CPUS];
+
+static void* el2_alloc_page(void* opaque, uint64_t* phys)
+{
+    (void)opaque;
+    for (uint32_t i = 0; i < STAGE2_POOL_PAGES; i++) {
+        if (!g_stage2_pool_used[i]) {
+            g_stage2_pool_used[i] = true;
+            memset(g_stage2_pool[i], 0, sizeof(g_stage2_pool[i]));
+            *phys = (uint64_t)(uintptr_t)g_stage2_pool[i];
+            return g_stage2_pool[i];
+        }
+    }
+    
+    LOG_ERROR("Pool de tabelas stage-2 esgotado");
+    return NULL;
+}
+
+static void el2_free_page(void* opaque, void* page, uint64_t phys)
+{
+    (void)opaque;
+    (void)phys;
+    uint32_t i = (uint32_t)(((uint64_t*)page - &g_stage2_pool[0][0]) / STAGE2_TABLE_ENTRIES);
+    if (i < STAGE2_POOL_PAGES) {
+        g_stage2_pool_used[i] = false;
+    }
+}
+
+static void* el2_phys_to_virt(void* opaque, uint64_t phys)
+{
+    (void)opaque;
+    return (void*)(uintptr_t)phys;
+}
+
+// Invalidação direcionada: só o VMID do guest dono da tabela, sempre o de
+// guest->vttbr. Mesmo com o VMID de uma geração antiga, outra CPU ainda pode
+// estar executando o guest com ele até o próximo vmid_update, e o flush que
+// o rollover agenda só acontece nesse momento. Se o VMID antigo já foi
+// reaproveitado, o TLBI só custa entradas de outro guest. A faixa pode ter
+// sido uma tabela com páginas de 4KB em cache: um TLBI por página, ou o
+// VMID inteiro quando a faixa é grande.
+static void el2_tlb_invalidate(void* opaque, uint64_t ipa, uint64_t size)
+{
+    el2_guest_t* guest = (el2_guest_t*)opaque;
+    uint64_t pages = (size + STAGE2_LEVEL_SIZE(3) - 1) >> STAGE2_LEVEL_SHIFT(3);
+    
+    if (!guest->vttbr) {
+        return;  // Nunca carregado: nenhuma CPU tem traduções dele
+    }
+    if (pages > EL2_TLBI_MAX_PAGES) {
+        el2_tlbi_vmid(guest->vttbr);
+    } else {
+        el2_tlbi_ipa_vmid(guest->vttbr, ipa, pages ? pages : 1);
+    }
+}
+
+int el2_vmid_init(void)
+{
+    uint32_t bits = ((el2_read_mmfr1() >> 4) & 0xF) == 2 ? 16 : 8;
+    
+    if (vmid_allocator_init(&g_vmid_allocator, bits, EL2_MAX_CPUS) != 0) {
+        return -1;
+    }
+    
+    LOG_INFO("VMIDs de %u bits", bits);
+    return 0;
+}
+
+// Cria a tabela stage-2 do guest e mapeia a RAM em identidade com os maiores
+// blocos possíveis. A janela de devices fica sem mapeamento para gerar data
+// aborts em EL2.
+int el2_guest_init(el2_guest_t* guest)
+{
+    stage2_mm_ops_t ops = {
+        el2_alloc_page,
+        el2_free_page,
+        el2_phys_to_virt,
+        el2_tlb_invalidate,
+        guest
+    };
+    
+    guest->vmid = 0;
+    guest->vttbr = 0;
+    memset(&guest->fpsimd, 0, sizeof(guest->fpsimd));
+    sysreg_vcpu_init(&guest->sysregs, 0);
+    
+    // IPA não pode passar do PA do host
+    uint32_t parange = (uint32_t)(el2_read_mmfr0() & 0xF);
+    uint32_t ipa_bits = stage2_pa_bits(parange);
+    if (ipa_bits > STAGE2_MAX_IPA_BITS) {
+        ipa_bits = STAGE2_MAX_IPA_BITS;
+    }
+    
+    if (stage2_init(&guest->s2, &ops, ipa_bits) != 0) {
+        LOG_ERROR("Falha ao criar tabela stage-2");
+        return -1;
+    }
+    
+    if (stage2_map(&guest->s2, GUEST_RAM_BASE, GUEST_RAM_BASE, GUEST_RAM_SIZE,
+                   STAGE2_PERM_RWX, STAGE2_MEM_NORMAL) != 0) {
+        LOG_ERROR("Falha ao mapear RAM do guest no stage-2");
+        stage2_destroy(&guest->s2);
+        return -1;
+    }
+    
+    stage2_stats_t stats;
+    stage2_get_stats(&guest->s2, &stats);
+    LOG_INFO("Stage-2: %u blocos de 1GB, %u de 2MB, %u páginas de 4KB, %u tabelas",
+             stats.blocks_1g, stats.blocks_2m, stats.pages_4k, stats.tables);
+    
+    g_hyp_context.vtcr_el2 = stage2_vtcr(&guest->s2, parange);
+    if (g_vmid_allocator.bits == 16) {
+        g_hyp_context.vtcr_el2 |= 1ULL << 19;  // VS: VMID de 16 bits
+    }
+    return 0;
+}
+
+void el2_guest_destroy(el2_guest_t* guest)
+{
+    // Nenhuma CPU pode reter traduções da tabela que será liberada, nem uma
+    // que ainda use o VMID de uma geração antiga
+    if (guest->vttbr) {
+        el2_tlbi_vmid(guest->vttbr);
+    }
+    el2_fpsimd_guest_release(guest);
+    for (uint32_t cpu = 0; cpu < EL2_MAX_CPUS; cpu++) {
+        if (g_el2_current[cpu] == guest) {
+            g_el2_current[cpu] = NULL;
+        }
+    }
+    stage2_destroy(&guest->s2);
+}
+
+// Troca de guest nesta CPU: garante VMID da geração atual e carrega
+// VTTBR_EL2. A TLB só é invalidada por inteiro após um rollover.
+void el2_guest_switch(el2_guest_t* guest, uint32_t cpu)
+{
+    bool flush = vmid_update(&g_vmid_allocator, &guest->vmid, cpu);
+    
+    guest->vttbr = stage2_vttbr(&guest->s2, vmid_value(&g_vmid_allocator, guest->vmid));
+    g_hyp_context.vttbr_el2 = guest->vttbr;
+    el2_load_vttbr(guest->vttbr, flush);
+    el2_fpsimd_guest_enter(guest, cpu);
+    
+    if (cpu < EL2_MAX_CPUS) {
+        g_el2_current[cpu] = guest;
+    }
+}
+
+// Guest em execução na CPU dona do frame (frames são indexados por CPU)
+el2_guest_t* el2_current_guest(const guest_context_t* ctx)
+{
+    uint32_t cpu = (uint32_t)(ctx - g_cpu_context);
+    return cpu < EL2_MAX_CPUS ? g_el2_current[cpu] : NULL;
+}
@@ -0,0 +1,146 @@
+/* Desenvolvido por: Escanearcpl */
+#include "vm.h"
+#include "hypercall.h"
+
+// Tempo de parede contável entre leituras do runtime do WHP
+#define STEAL_TIME_SAMPLE_NS    1000000ULL
+
+static int64_t hc_steal_time_register(const hypercall_args_t* call)
+{
+    if (call->vcpu >= VM_MAX_VCPUS) {
+        return HC_ERR_INVALID;
+    }
+    
+    vcpu_state_t* vcpu = &g_vm.vcpus[call->vcpu];
+    return steal_time_register(vcpu, call->args[0]) == 0 ? HC_SUCCESS : HC_ERR_INVALID;
+}
+
+int steal_time_init(void)
+{
+    return hypercall_register(HC_STEAL_TIME_REGISTER, hc_steal_time_register,
+                              "steal_time_register", 0);
+}
+
+int steal_time_register(vcpu_state_t* vcpu, uint64_t record_gpa)
+{
+    if (record_gpa == 0) {
+        vcpu->steal_record = NULL;
+        return 0;
+    }
+    
+    if (record_gpa & (STEAL_TIME_ALIGN - 1)) {
+        LOG_ERROR("Steal time: GPA 0x%llX não alinhado a %d bytes", record_gpa, STEAL_TIME_ALIGN);
+        return -1;
+    }
+    
+    steal_time_record_t* record = (steal_time_record_t*)vm_gpa_to_hva(record_gpa, sizeof(*record));
+    if (!record) {
+        LOG_ERROR("Steal time: GPA 0x%llX fora da RAM guest", record_gpa);
+        return -1;
+    }
+    
+    memset(record, 0, sizeof(*record));
+    record->steal_ns = g_vm.metrics.vcpus[vcpu->index].steal_ns;
+    vcpu->steal_record = record;
+    
+    LOG_INFO("Steal time do vCPU %u registrado em 0x%llX", vcpu->index, record_gpa);
+    return 0;
+}
+
+static uint64_t filetime_100ns(const FILETIME* ft)
+{
+    return ((uint64_t)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+}
+
+// Amostra o TotalRuntime do WHP e os tempos da thread do vCPU e converte em
+// steal a parede contável que o vCPU não passou em CPU.
+//
+// Em CPU = runtime do guest + tratamento de exits no VMM. O tempo de modo
+// usuário da thread é o VMM; o de kernel cobre as chamadas WHv* e, conforme
+// o escalonador do host, também o próprio runtime do guest: max() dos dois
+// não conta o guest duas vezes em nenhum dos casos.
+static void steal_time_sample(vcpu_state_t* vcpu)
+{
+    WHV_PROCESSOR_RUNTIME_COUNTERS counters;
+    FILETIME created, exited, kernel, user;
+    UINT32 written;
+    
+    HRESULT hr = WHvGetVirtualProcessorCounters(g_vm.partition, vcpu->index,
+                                                WHvProcessorCounterSetRuntime,
+                                                &counters, sizeof(counters), &written);
+    if (FAILED(hr) || !GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) {
+        return;
+    }
+    
+    uint64_t guest_ns = (counters.TotalRuntime100ns - vcpu->last_runtime_100ns) * 100;
+    uint64_t kernel_ns = (filetime_100ns(&kernel) - vcpu->last_kernel_100ns) * 100;
+    uint64_t user_ns = (filetime_100ns(&user) - vcpu->last_user_100ns) * 100;
+    uint64_t ran_ns = (guest_ns > kernel_ns ? guest_ns : kernel_ns) + user_ns;
+    uint64_t wall_ns = vcpu->sample_wall_ns;
+    
+    vcpu->last_runtime_100ns = counters.TotalRuntime100ns;
+    vcpu->last_kernel_100ns = filetime_100ns(&kernel);
+    vcpu->last_user_100ns = filetime_100ns(&user);
+    vcpu->sample_wall_ns = 0;
+    
+    vcpu_metrics_t* metrics = &g_vm.metrics.vcpus[vcpu->index];
+    uint64_t steal_ns = metrics->steal_ns;
+    steal_time_credit(&steal_ns, &vcpu->steal_balance_ns, wall_ns, ran_ns);
+    if (steal_ns == metrics->steal_ns) {
+        return;
+    }
+    metrics->steal_ns = steal_ns;
+    
+    steal_time_record_t* record = vcpu->steal_record;
+    if (record) {
+        record->version++;
+        MemoryBarrier();
+        record->steal_ns = steal_ns;
+        MemoryBarrier();
+        record->version++;
+    }
+}
+
+// Chamado após cada WHvRunVirtualProcessor com o início e o tempo de parede
+// da chamada.
+//
+// Steal é o tempo em que o vCPU estava pronto para executar mas fora de CPU
+// física. Fora do guest o vCPU está pronto enquanto o VMM trata o exit: o
+// intervalo entre o fim de uma chamada e o início da seguinte entra na
+// amostra, exceto quando a thread esperou de propósito no meio
+// (steal_time_wait()).
+//
+// Dentro da chamada, o WHP não separa o tempo fora de CPU do tempo em WFI (o
+// halt é tratado dentro do hypervisor, sem exit), então só contam as janelas
+// em que o guest não pode ter parado: um vCPU em WFI só sai dele por
+// interrupção, e sem mudança no GIC durante a janela o exit prova que ele
+// não estava parado. Janelas com interrupção ou canceladas ficam de fora e
+// encerram a amostra.
+//
+// Os contadores são lidos a cada STEAL_TIME_SAMPLE_NS de parede contável ou
+// ao fim de uma janela não contável, não a cada exit.
+void steal_time_account(vcpu_state_t* vcpu, uint64_t start_ns, uint64_t wall_ns, bool countable)
+{
+    vcpu_metrics_t* metrics = &g_vm.metrics.vcpus[vcpu->index];
+    metrics->run_ns += wall_ns;
+    
+    if (vcpu->exit_ns != 0 && start_ns > vcpu->exit_ns) {
+        vcpu->sample_wall_ns += start_ns - vcpu->exit_ns;
+    }
+    vcpu->exit_ns = start_ns + wall_ns;
+    
+    if (countable) {
+        vcpu->sample_wall_ns += wall_ns;
+        if (vcpu->sample_wall_ns < STEAL_TIME_SAMPLE_NS) {
+            return;
+        }
+    }
+    steal_time_sample(vcpu);
+}
+
+// A thread do vCPU vai esperar sem estar pronta (WFI/CPU_SUSPEND, CPU_OFF,
+// spin-poll estacionado): o tratamento do exit corrente não conta
+void steal_time_wait(vcpu_state_t* vcpu)
+{
+    vcpu->exit_ns = 0;
+}
@@ -0,0 +1,328 @@
+/* Desenvolvido por: Escanearcpl */
+#include "sysreg.h"
+#include "devices.h"
+
+#define SYSREG_TICK_NS          (1000000000ULL / SYSREG_CNTFRQ)
+
+#define TIMER_CTL_ENABLE        0x1
+#define TIMER_CTL_IMASK         0x2
+#define TIMER_CTL_ISTATUS       0x4
+
+#define PPI_VIRT_TIMER          27
+#define PPI_PHYS_TIMER          30
+
+#define CNTP_CTL_EL0            SYSREG_ENC(3, 3, 14, 2, 1)
+#define CNTP_CVAL_EL0           SYSREG_ENC(3, 3, 14, 2, 2)
+#define CNTV_CTL_EL0            SYSREG_ENC(3, 3, 14, 3, 1)
+#define CNTV_CVAL_EL0           SYSREG_ENC(3, 3, 14, 3, 2)
+
+// Registro: slot -> descritor, codificação -> slot+1 (0 = não registrado)
+static const sysreg_desc_t* g_sysreg_regs[SYSREG_MAX_REGS];
+static uint64_t g_sysreg_reset[SYSREG_MAX_REGS];
+static uint32_t g_sysreg_count;
+static uint8_t g_sysreg_index[1 << 16];
+
+static inline uint64_t* sysreg_shadow_enc(sysreg_vcpu_t* vcpu, uint16_t enc)
+{
+    return &vcpu->shadow[g_sysreg_index[enc] - 1];
+}
+
+uint64_t sysreg_counter_at(uint64_t ns)
+{
+    return (ns / 1000000000ULL) * SYSREG_CNTFRQ +
+           (ns % 1000000000ULL) * SYSREG_CNTFRQ / 1000000000ULL;
+}
+
+// Contador do guest derivado do relógio monotônico do host
+static uint64_t sysreg_counter(void)
+{
+    return sysreg_counter_at(timer_get_time_ns());
+}
+
+static uint64_t counter_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)vcpu;
+    (void)reg;
+    return sysreg_counter();
+}
+
+static uint64_t mpidr_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    return (1ULL << 31) | (vcpu->vcpu & 0xFF);  // RES1 + Aff0 = índice do vCPU
+}
+
+// CCSIDR_EL1 depende do cache selecionado em CSSELR_EL1
+static uint64_t ccsidr_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    (void)reg;
+    uint64_t csselr = *sysreg_shadow_enc(vcpu, SYSREG_ENC(3, 2, 0, 0, 0));
+
+    switch (csselr & 0xF) {
+        case 0:  // L1 dados: 32KB, 4 vias, linhas de 64B
+        case 1:  // L1 instruções
+            return (127ULL << 13) | (3ULL << 3) | 2;
+        case 2:  // L2 unificado: 1MB, 16 vias
+            return (1023ULL << 13) | (15ULL << 3) | 2;
+        default:
+            return 0;
+    }
+}
+
+// Operações de cache por set/way não são virtualizáveis; com a RAM do guest
+// mapeada como cacheável no stage-2 o host mantém a coerência
+static void dc_set_way_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    (void)vcpu;
+    (void)reg;           // Só no trace
+    (void)value;
+    LOG_TRACE("%s ignorado", reg->name);
+}
+
+// Timers genéricos: CTL/CVAL em shadow, TVAL derivado de CVAL. A saída do
+// timer é um nível (ENABLE && !IMASK && ISTATUS) recalculado a cada escrita
+// e em sysreg_timer_poll(): o PPI sobe quando o nível sobe e desce quando o
+// guest desliga o timer, mascara ou move o deadline para frente. Em escrita
+// (rearm) um nível que continua alto é reafirmado, como faria o GIC com uma
+// linha por nível que o guest já reconheceu. Devolve o deadline ainda armado
+// em ns do host.
+static uint64_t timer_check(sysreg_vcpu_t* vcpu, uint16_t ctl_enc, uint16_t cval_enc,
+                            uint32_t ppi, bool rearm)
+{
+    uint64_t ctl = *sysreg_shadow_enc(vcpu, ctl_enc);
+    uint64_t cval = *sysreg_shadow_enc(vcpu, cval_enc);
+    uint32_t bit = 1U << (ppi == PPI_VIRT_TIMER ? 0 : 1);
+    uint64_t deadline = UINT64_MAX;
+    bool level = false;
+
+    if ((ctl & TIMER_CTL_ENABLE) && !(ctl & TIMER_CTL_IMASK)) {
+        if (sysreg_counter() >= cval) {
+            level = true;
+        } else if (cval <= UINT64_MAX / SYSREG_TICK_NS) {
+            deadline = cval * SYSREG_TICK_NS;
+        }
+    }
+
+    if (level && (rearm || !(vcpu->timer_level & bit))) {
+        vcpu->timer_level |= bit;
+        gic_set_ppi_level(ppi, vcpu->vcpu, true);
+    } else if (!level && (vcpu->timer_level & bit)) {
+        vcpu->timer_level &= ~bit;
+        gic_set_ppi_level(ppi, vcpu->vcpu, false);
+    }
+    return deadline;
+}
+
+static bool timer_is_virtual(const sysreg_desc_t* reg)
+{
+    return ((reg->enc >> 3) & 15) == 3;  // CRm 3 = CNTV_*, CRm 2 = CNTP_*
+}
+
+// Escrita em CTL/CVAL/TVAL programa um novo deadline e recalcula o nível
+static void timer_rearm(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    bool virt = timer_is_virtual(reg);
+
+    timer_check(vcpu, (uint16_t)((reg->enc & ~7) | 1), (uint16_t)((reg->enc & ~7) | 2),
+                virt ? PPI_VIRT_TIMER : PPI_PHYS_TIMER, true);
+}
+
+static uint64_t timer_ctl_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    uint16_t cval_enc = (uint16_t)((reg->enc & ~7) | 2);
+    uint64_t ctl = *sysreg_shadow(vcpu, reg) & (TIMER_CTL_ENABLE | TIMER_CTL_IMASK);
+
+    if ((ctl & TIMER_CTL_ENABLE) && sysreg_counter() >= *sysreg_shadow_enc(vcpu, cval_enc)) {
+        ctl |= TIMER_CTL_ISTATUS;
+    }
+    return ctl;
+}
+
+static void timer_ctl_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    *sysreg_shadow(vcpu, reg) = value & (TIMER_CTL_ENABLE | TIMER_CTL_IMASK);
+    timer_rearm(vcpu, reg);
+}
+
+static void timer_cval_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    *sysreg_shadow(vcpu, reg) = value;
+    timer_rearm(vcpu, reg);
+}
+
+static uint64_t timer_tval_read(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    uint64_t cval = *sysreg_shadow_enc(vcpu, (uint16_t)((reg->enc & ~7) | 2));
+    return (cval - sysreg_counter()) & 0xFFFFFFFF;
+}
+
+static void timer_tval_write(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg, uint64_t value)
+{
+    uint16_t cval_enc = (uint16_t)((reg->enc & ~7) | 2);
+    *sysreg_shadow_enc(vcpu, cval_enc) = sysreg_counter() + (uint64_t)(int64_t)(int32_t)value;
+    timer_rearm(vcpu, reg);
+}
+
+// Registradores de identificação (valores de um Cortex-A57; ver modelos de CPU)
+static const sysreg_desc_t g_id_regs[] = {
+    SYSREG_CONST("MIDR_EL1",         SYSREG_MIDR_EL1,         0x411FD070),
+    SYSREG_HOOK("MPIDR_EL1",         SYSREG_MPIDR_EL1,        SYSREG_RO, mpidr_read, NULL),
+    SYSREG_CONST("REVIDR_EL1",       SYSREG_ENC(3, 0, 0, 0, 6), 0),
+    SYSREG_CONST("ID_AA64PFR0_EL1",  SYSREG_ID_AA64PFR0_EL1,  0x0000000000002222ULL),
+    SYSREG_CONST("ID_AA64PFR1_EL1",  SYSREG_ID_AA64PFR1_EL1,  0),
+    SYSREG_CONST("ID_AA64DFR0_EL1",  SYSREG_ID_AA64DFR0_EL1,  0x0000000010305106ULL),
+    SYSREG_CONST("ID_AA64DFR1_EL1",  SYSREG_ENC(3, 0, 0, 5, 1), 0),
+    SYSREG_CONST("ID_AA64ISAR0_EL1", SYSREG_ID_AA64ISAR0_EL1, 0x0000000000011120ULL),
+    SYSREG_CONST("ID_AA64ISAR1_EL1", SYSREG_ID_AA64ISAR1_EL1, 0),
+    SYSREG_CONST("ID_AA64MMFR0_EL1", SYSREG_ID_AA64MMFR0_EL1, 0x0000000000001124ULL),
+    SYSREG_CONST("ID_AA64MMFR1_EL1", SYSREG_ID_AA64MMFR1_EL1, 0),
+    SYSREG_CONST("ID_AA64MMFR2_EL1", SYSREG_ID_AA64MMFR2_EL1, 0),
+};
+
+// Identificação e manutenção de caches
+static const sysreg_desc_t g_cache_regs[] = {
+    SYSREG_CONST("CTR_EL0",          SYSREG_CTR_EL0,          0x8444C004),
+    SYSREG_CONST("CLIDR_EL1",        SYSREG_ENC(3, 1, 0, 0, 1), 0x0A200023),
+    SYSREG_SHADOW("CSSELR_EL1",      SYSREG_ENC(3, 2, 0, 0, 0), SYSREG_RW, 0, 0xF),
+    SYSREG_HOOK("CCSIDR_EL1",        SYSREG_ENC(3, 1, 0, 0, 0), SYSREG_RO, ccsidr_read, NULL),
+    SYSREG_HOOK("DC ISW",            SYSREG_ENC(1, 0, 7, 6, 2),  SYSREG_WO, NULL, dc_set_way_write),
+    SYSREG_HOOK("DC CSW",            SYSREG_ENC(1, 0, 7, 10, 2), SYSREG_WO, NULL, dc_set_way_write),
+    SYSREG_HOOK("DC CISW",           SYSREG_ENC(1, 0, 7, 14, 2), SYSREG_WO, NULL, dc_set_way_write),
+};
+
+// Timer genérico. Só chegam aqui os acessos que CNTHCTL_EL2 desvia no modo
+// EL2 (el2_timer_traps): CNTP_* e CNTPCT sempre, CNTV_* e CNTVCT só com
+// FEAT_ECV. Sob o WHP nenhum deles é interceptado e o guest usa o timer da
+// partição.
+static const sysreg_desc_t g_timer_regs[] = {
+    SYSREG_CONST("CNTFRQ_EL0",       SYSREG_ENC(3, 3, 14, 0, 0), SYSREG_CNTFRQ),
+    SYSREG_HOOK("CNTPCT_EL0",        SYSREG_ENC(3, 3, 14, 0, 1), SYSREG_RO, counter_read, NULL),
+    SYSREG_HOOK("CNTVCT_EL0",        SYSREG_ENC(3, 3, 14, 0, 2), SYSREG_RO, counter_read, NULL),
+    SYSREG_HOOK("CNTP_TVAL_EL0",     SYSREG_ENC(3, 3, 14, 2, 0), SYSREG_RW, timer_tval_read, timer_tval_write),
+    SYSREG_HOOK("CNTP_CTL_EL0",      CNTP_CTL_EL0,               SYSREG_RW, timer_ctl_read, timer_ctl_write),
+    SYSREG_HOOK("CNTP_CVAL_EL0",     CNTP_CVAL_EL0,              SYSREG_RW, NULL, timer_cval_write),
+    SYSREG_HOOK("CNTV_TVAL_EL0",     SYSREG_ENC(3, 3, 14, 3, 0), SYSREG_RW, timer_tval_read, timer_tval_write),
+    SYSREG_HOOK("CNTV_CTL_EL0",      CNTV_CTL_EL0,               SYSREG_RW, timer_ctl_read, timer_ctl_write),
+    SYSREG_HOOK("CNTV_CVAL_EL0",     CNTV_CVAL_EL0,              SYSREG_RW, NULL, timer_cval_write),
+};
+
+int sysreg_init(void)
+{
+    g_sysreg_count = 0;
+    memset(g_sysreg_index, 0, sizeof(g_sysreg_index));
+
+    if (sysreg_register(g_id_regs, SYSREG_COUNT(g_id_regs)) != 0 ||
+        sysreg_register(g_cache_regs, SYSREG_COUNT(g_cache_regs)) != 0 ||
+        sysreg_register(g_timer_regs, SYSREG_COUNT(g_timer_regs)) != 0) {
+        return -1;
+    }
+
+    LOG_INFO("Tabela de registradores de sistema: %u entradas", g_sysreg_count);
+    return 0;
+}
+
+int sysreg_register(const sysreg_desc_t* regs, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        const sysreg_desc_t* reg = &regs[i];
+
+        if (g_sysreg_count >= SYSREG_MAX_REGS) {
+            LOG_ERROR("Tabela de registradores de sistema cheia (%s)", reg->name);
+            return -1;
+        }
+        if (g_sysreg_index[reg->enc]) {
+            LOG_ERROR("Registrador de sistema %s já registrado (%s)", reg->name,
+                      g_sysreg_regs[g_sysreg_index[reg->enc] - 1]->name);
+            return -1;
+        }
+
+        g_sysreg_regs[g_sysreg_count] = reg;
+        g_sysreg_reset[g_sysreg_count] = reg->reset;
+        g_sysreg_count++;
+        g_sysreg_index[reg->enc] = (uint8_t)g_sysreg_count;
+    }
+
+    return 0;
+}
+
+const sysreg_desc_t* sysreg_lookup(uint16_t enc)
+{
+    uint8_t idx = g_sysreg_index[enc];
+    return idx ? g_sysreg_regs[idx - 1] : NULL;
+}
+
+int sysreg_set_reset(uint16_t enc, uint64_t value)
+{
+    uint8_t idx = g_sysreg_index[enc];
+    if (!idx) {
+        return -1;
+    }
+
+    g_sysreg_reset[idx - 1] = value;
+    return 0;
+}
+
+void sysreg_vcpu_init(sysreg_vcpu_t* vcpu, uint32_t index)
+{
+    memset(vcpu, 0, sizeof(*vcpu));
+    vcpu->vcpu = index;
+
+    for (uint32_t i = 0; i < g_sysreg_count; i++) {
+        vcpu->shadow[i] = g_sysreg_reset[i];
+    }
+}
+
+uint64_t* sysreg_shadow(sysreg_vcpu_t* vcpu, const sysreg_desc_t* reg)
+{
+    return sysreg_shadow_enc(vcpu, reg->enc);
+}
+
+uint64_t sysreg_timer_poll(sysreg_vcpu_t* vcpu)
+{
+    uint64_t virt = timer_check(vcpu, CNTV_CTL_EL0, CNTV_CVAL_EL0, PPI_VIRT_TIMER, false);
+    uint64_t phys = timer_check(vcpu, CNTP_CTL_EL0, CNTP_CVAL_EL0, PPI_PHYS_TIMER, false);
+    return virt < phys ? virt : phys;
+}
+
+// Espaço de IDs ainda não alocados (op0=3, op1=0, CRn=0, CRm=1..7): RAZ
+static bool sysreg_is_id_space(uint16_t enc)
+{
+    uint32_t crm = (enc >> 3) & 15;
+    return (enc & 0xFF80) == SYSREG_ENC(3, 0, 0, 0, 0) && crm >= 1 && crm <= 7;
+}
+
+sysreg_result_t sysreg_access(sysreg_vcpu_t* vcpu, uint16_t enc, bool is_read, uint64_t* value)
+{
+    const sysreg_desc_t* reg = sysreg_lookup(enc);
+
+    if (!reg) {
+        if (is_read && sysreg_is_id_space(enc)) {
+            *value = 0;
+            return SYSREG_OK;
+        }
+        LOG_DEBUG("Registrador de sistema não emulado: op0=%u op1=%u CRn=%u CRm=%u op2=%u",
+                  enc >> 14, (enc >> 11) & 7, (enc >> 7) & 15, (enc >> 3) & 15, enc & 7);
+        return SYSREG_UNDEF;
+    }
+
+    if (is_read) {
+        if (!(reg->flags & SYSREG_RO)) {
+            return SYSREG_UNDEF;
+        }
+        *value = reg->read ? reg->read(vcpu, reg) : *sysreg_shadow(vcpu, reg);
+        LOG_TRACE("MRS %s = 0x%llX", reg->name, *value);
+    } else {
+        if (!(reg->flags & SYSREG_WO)) {
+            return SYSREG_UNDEF;
+        }
+        LOG_TRACE("MSR %s, 0x%llX", reg->name, *value);
+        if (reg->write) {
+            reg->write(vcpu, reg, *value);
+        } else {
+            uint64_t* shadow = sysreg_shadow(vcpu, reg);
+            *shadow = (*shadow & ~reg->mask) | (*value & reg->mask);
+        }
+    }
+
+    return SYSREG_OK;
+}
@@ -1,8 +1,32 @@
 /* Desenvolvido por: Escanearcpl */
 #include "vm.h"
+#include "devices.h"
 
 // Global VM state
 vm_state_t g_vm = {0};
+HV_THREAD_LOCAL vcpu_state_t* g_current_vcpu = NULL;
+
+// SCTLR_EL1 de reset: MMU e caches desligados (apenas bits RES1)
+#define SCTLR_EL1_RESET     0x30D00800ULL
+#define PSTATE_EL1H_MASKED  0x3C5           // EL1h, DAIF mascarados
+#define ESR_EL1_IL          (1ULL << 25)    // Instrução de 32 bits; EC 0 = Unknown
+
+int vm_set_cpu_model(const char* name)
+{
+    if (cpu_model_resolve(name, &g_host_cpu, &g_vm.cpu) != 0) {
+        LOG_ERROR("Modelo de CPU '%s' desconhecido ou não suportado por este host", name);
+        return -1;
+    }
+    
+    // Registradores de ID coerentes com o modelo em todos os vCPUs
+    sysreg_set_reset(SYSREG_ID_AA64PFR0_EL1, g_vm.cpu.id_aa64pfr0);
+    sysreg_set_reset(SYSREG_ID_AA64ISAR0_EL1, g_vm.cpu.id_aa64isar0);
+    sysreg_set_reset(SYSREG_ID_AA64ISAR1_EL1, g_vm.cpu.id_aa64isar1);
+    
+    LOG_INFO("Modelo de CPU: %s (features 0x%llX, ISAR0=0x%llX)",
+             g_vm.cpu.name, g_vm.cpu.features, g_vm.cpu.id_aa64isar0);
+    return 0;
+}
 
 int vm_create(void)
 {
@@ -19,7 +43,8 @@ int vm_create(void)
     WHV_PARTITION_PROPERTY property;
     
     // Definir contadores de processador
-    property.ProcessorCount = 1;
+    g_vm.vcpu_count = VM_DEFAULT_VCPUS;
+    property.ProcessorCount = g_vm.vcpu_count;
     hr = WHvSetPartitionProperty(g_vm.partition, WHvPartitionPropertyCodeProcessorCount,
                                 &property, sizeof(property));
     if (FAILED(hr)) {
@@ -28,9 +53,9 @@ int vm_create(void)
         return -1;
     }
     
-    // Configurar features ARM64
+    // Configurar features ARM64 conforme o modelo de CPU
     memset(&property, 0, sizeof(property));
-    property.ProcessorFeatures.AsUINT64 = 0;  // Features básicos ARM64
+    property.ProcessorFeatures.AsUINT64 = g_vm.cpu.partition_features;
     hr = WHvSetPartitionProperty(g_vm.partition, WHvPartitionPropertyCodeProcessorFeatures,
                                 &property, sizeof(property));
     if (FAILED(hr)) {
@@ -39,6 +64,16 @@ int vm_create(void)
         return -1;
     }
     
+    // IPA da partição igual ao usado no layout dos devices (virtio_alloc_gpa).
+    // Builds sem a propriedade ficam no padrão do WHP, o máximo do host
+    memset(&property, 0, sizeof(property));
+    property.PhysicalAddressWidth = g_guest_pa_bits;
+    hr = WHvSetPartitionProperty(g_vm.partition, WHvPartitionPropertyCodePhysicalAddressWidth,
+                                &property, sizeof(property));
+    if (FAILED(hr)) {
+        LOG_INFO("Largura de IPA da partição não configurável (0x%08X); usando a padrão", hr);
+    }
+    
     // Setup da partição
     hr = WHvSetupPartition(g_vm.partition);
     if (FAILED(hr)) {
@@ -74,6 +109,13 @@ void vm_destroy(void)
         
         g_vm.running = false;
         
+        for (uint32_t i = 0; i < VM_MAX_VCPUS; i++) {
+            if (g_vm.vcpus[i].wake) {
+                CloseHandle(g_vm.vcpus[i].wake);
+                g_vm.vcpus[i].wake = NULL;
+            }
+        }
+        
         // Liberar memória guest
         if (g_vm.guest_memory) {
             VirtualFree(g_vm.guest_memory, 0, MEM_RELEASE);
@@ -81,6 +123,7 @@ void vm_destroy(void)
         }
         
         // Deletar partição
+        memset(g_vm.memslots, 0, sizeof(g_vm.memslots));
         WHvDeletePartition(g_vm.partition);
         g_vm.partition = NULL;
         
@@ -103,12 +146,9 @@ int vm_setup_memory(void)
     g_vm.guest_memory_size = GUEST_RAM_SIZE;
     
     // Mapear memória guest na partição
-    HRESULT hr = WHvMapGpaRange(g_vm.partition, g_vm.guest_memory, 
-                               GUEST_RAM_BASE, GUEST_RAM_SIZE,
-                               WHvMapGpaRangeFlagRead | WHvMapGpaRangeFlagWrite | 
-                               WHvMapGpaRangeFlagExecute);
-    if (FAILED(hr)) {
-        LOG_ERROR("Falha ao mapear GPA range: 0x%08X", hr);
+    if (vm_map_gpa_range(g_vm.guest_memory, GUEST_RAM_BASE, GUEST_RAM_SIZE,
+                         WHvMapGpaRangeFlagRead | WHvMapGpaRangeFlagWrite | 
+                         WHvMapGpaRangeFlagExecute) != 0) {
         return -1;
     }
     
@@ -118,18 +158,142 @@ int vm_setup_memory(void)
     return 0;
 }
 
-int vm_setup_vcpu(void)
+int vm_map_gpa_range(void* host_addr, uint64_t guest_addr, uint64_t size, WHV_MAP_GPA_RANGE_FLAGS flags)
 {
-    LOG_INFO("Configurando vCPU ARM64...");
+    if ((guest_addr | size) & ARM64_PAGE_MASK) {
+        LOG_ERROR("Range GPA não alinhado: 0x%llX (+0x%llX)", guest_addr, size);
+        return -1;
+    }
     
-    g_vm.vpindex = 0;
+    vm_memslot_t* slot = NULL;
+    for (int i = 0; i < VM_MAX_MEMSLOTS; i++) {
+        if (!g_vm.memslots[i].in_use) {
+            slot = &g_vm.memslots[i];
+            break;
+        }
+    }
+    
+    if (!slot) {
+        LOG_ERROR("Sem slots de memória livres para 0x%llX", guest_addr);
+        return -1;
+    }
+    
+    HRESULT hr = WHvMapGpaRange(g_vm.partition, host_addr, guest_addr, size, flags);
+    if (FAILED(hr)) {
+        LOG_ERROR("Falha ao mapear GPA range 0x%llX: 0x%08X", guest_addr, hr);
+        return -1;
+    }
+    
+    slot->in_use = true;
+    slot->guest_addr = guest_addr;
+    slot->size = size;
+    slot->host_addr = host_addr;
+    slot->flags = flags;
+    return 0;
+}
+
+int vm_unmap_gpa_range(uint64_t guest_addr, uint64_t size)
+{
+    for (int i = 0; i < VM_MAX_MEMSLOTS; i++) {
+        vm_memslot_t* slot = &g_vm.memslots[i];
+        if (slot->in_use && slot->guest_addr == guest_addr && slot->size == size) {
+            HRESULT hr = WHvUnmapGpaRange(g_vm.partition, guest_addr, size);
+            if (FAILED(hr)) {
+                LOG_ERROR("Falha ao desmapear GPA range 0x%llX: 0x%08X", guest_addr, hr);
+                return -1;
+            }
+            memset(slot, 0, sizeof(*slot));
+            return 0;
+        }
+    }
+    
+    LOG_ERROR("GPA range 0x%llX não está mapeado", guest_addr);
+    return -1;
+}
+
+int vm_map_gpa_view(void* host_addr, uint64_t guest_addr, uint64_t size, WHV_MAP_GPA_RANGE_FLAGS flags)
+{
+    if ((guest_addr | size | (uint64_t)(uintptr_t)host_addr) & ARM64_PAGE_MASK) {
+        LOG_ERROR("View GPA não alinhada: 0x%llX (+0x%llX)", guest_addr, size);
+        return -1;
+    }
     
-    // Criar vCPU
-    HRESULT hr = WHvCreateVirtualProcessor(g_vm.partition, g_vm.vpindex, 0);
+    HRESULT hr = WHvMapGpaRange(g_vm.partition, host_addr, guest_addr, size, flags);
+    if (FAILED(hr)) {
+        LOG_ERROR("Falha ao mapear view em 0x%llX: 0x%08X", guest_addr, hr);
+        return -1;
+    }
+    return 0;
+}
+
+int vm_unmap_gpa_view(uint64_t guest_addr, uint64_t size)
+{
+    HRESULT hr = WHvUnmapGpaRange(g_vm.partition, guest_addr, size);
     if (FAILED(hr)) {
-        LOG_ERROR("Falha ao criar vCPU: 0x%08X", hr);
+        LOG_ERROR("Falha ao desmapear view em 0x%llX: 0x%08X", guest_addr, hr);
         return -1;
     }
+    return 0;
+}
+
+// Fonte dos eventos do PMU virtual; chamada na thread do vCPU. Ciclos são o
+// tempo que o WHP reporta como executado pelo guest, convertido para a
+// frequência nominal PMU_CYCLE_HZ: uma fonte só, numa unidade só
+static uint64_t vcpu_pmu_source(void* opaque, uint32_t event)
+{
+    vcpu_state_t* vcpu = (vcpu_state_t*)opaque;
+    
+    switch (event) {
+        case PMU_EVT_CPU_CYCLES: {
+            // Só em leituras dos contadores e nos prazos de overflow (pmu_poll)
+            WHV_PROCESSOR_RUNTIME_COUNTERS counters;
+            UINT32 written;
+            if (SUCCEEDED(WHvGetVirtualProcessorCounters(g_vm.partition, vcpu->index,
+                                                         WHvProcessorCounterSetRuntime,
+                                                         &counters, sizeof(counters), &written))) {
+                vcpu->pmu_runtime_100ns = counters.TotalRuntime100ns;
+            }
+            return vcpu->pmu_runtime_100ns * (PMU_CYCLE_HZ / 10000000ULL);
+        }
+        case PMU_EVT_EXC_TAKEN:
+        case PMU_EVT_EXC_RETURN:
+            return vcpu->exits;
+        default:
+            return 0;
+    }
+}
+
+int vm_setup_vcpu(void)
+{
+    LOG_INFO("Configurando %u vCPUs ARM64...", g_vm.vcpu_count);
+    
+    // Todos os vCPUs são criados aqui; os secundários ficam desligados até
+    // CPU_ON, que só precisa acordar a thread já existente
+    for (uint32_t i = 0; i < g_vm.vcpu_count; i++) {
+        vcpu_state_t* vcpu = &g_vm.vcpus[i];
+        
+        HRESULT hr = WHvCreateVirtualProcessor(g_vm.partition, i, 0);
+        if (FAILED(hr)) {
+            LOG_ERROR("Falha ao criar vCPU %u: 0x%08X", i, hr);
+            return -1;
+        }
+        
+        vcpu->index = i;
+        vcpu->created = true;
+        vcpu->power = VCPU_POWER_OFF;
+        vcpu->wake = CreateEventA(NULL, FALSE, FALSE, NULL);
+        if (!vcpu->wake) {
+            LOG_ERROR("Falha ao criar evento do vCPU %u", i);
+            return -1;
+        }
+        sysreg_vcpu_init(&vcpu->sysregs, i);
+        pmu_vcpu_init(&vcpu->sysregs.pmu, i, vcpu_pmu_source, vcpu);
+    }
+    
+    // vCPU de boot executa na thread principal
+    g_current_vcpu = &g_vm.vcpus[0];
+    g_vm.vcpus[0].power = VCPU_POWER_ON;
+    g_vm.vcpus_online = 1;
     
     // Configurar registradores iniciais ARM64
     WHV_REGISTER_NAME reg_names[] = {
@@ -152,12 +316,12 @@ int vm_setup_vcpu(void)
     reg_values[2].Reg64 = 0;  // X2
     reg_values[3].Reg64 = GUEST_RAM_BASE + GUEST_RAM_SIZE - 0x1000;  // SP
     reg_values[4].Reg64 = GUEST_ENTRY_POINT;  // PC
-    reg_values[5].Reg64 = 0x3C5;  // PSTATE (EL1h, interrupts masked)
+    reg_values[5].Reg64 = PSTATE_EL1H_MASKED;  // PSTATE (EL1h, interrupts masked)
     reg_values[6].Reg64 = 0;  // ELR
     reg_values[7].Reg64 = 0;  // SPSR
     
-    hr = WHvSetVirtualProcessorRegisters(g_vm.partition, g_vm.vpindex,
-                                        reg_names, 8, reg_values);
+    HRESULT hr = WHvSetVirtualProcessorRegisters(g_vm.partition, 0,
+                                                reg_names, 8, reg_values);
     if (FAILED(hr)) {
         LOG_ERROR("Falha ao configurar registradores: 0x%08X", hr);
         return -1;
@@ -187,17 +351,234 @@ int vm_load_guest_code(const void* code, size_t code_size, uint64_t load_addr)
     return 0;
 }
 
+int vm_read_guest_memory(uint64_t guest_addr, void* buffer, size_t size)
+{
+    void* src = vm_gpa_to_hva(guest_addr, size);
+    if (!src) {
+        LOG_ERROR("Leitura fora da RAM guest: 0x%llX (+%zu)", guest_addr, size);
+        return -1;
+    }
+    
+    memcpy(buffer, src, size);
+    return 0;
+}
+
+int vm_write_guest_memory(uint64_t guest_addr, const void* buffer, size_t size)
+{
+    void* dst = vm_gpa_to_hva(guest_addr, size);
+    if (!dst) {
+        LOG_ERROR("Escrita fora da RAM guest: 0x%llX (+%zu)", guest_addr, size);
+        return -1;
+    }
+    
+    memcpy(dst, buffer, size);
+    return 0;
+}
+
+void* vm_gpa_to_hva(uint64_t guest_addr, uint64_t size)
+{
+    // Traduz GPA para endereço host; NULL se [addr, addr+size) não estiver
+    // inteiramente em um slot que o próprio guest pode escrever
+    if (g_vm.guest_memory && guest_addr >= GUEST_RAM_BASE) {
+        uint64_t offset = guest_addr - GUEST_RAM_BASE;
+        if (offset <= g_vm.guest_memory_size && size <= g_vm.guest_memory_size - offset) {
+            return (char*)g_vm.guest_memory + offset;
+        }
+    }
+    
+    for (int i = 0; i < VM_MAX_MEMSLOTS; i++) {
+        vm_memslot_t* slot = &g_vm.memslots[i];
+        if (!slot->in_use || !(slot->flags & WHvMapGpaRangeFlagWrite) ||
+            guest_addr < slot->guest_addr) {
+            continue;
+        }
+        
+        uint64_t offset = guest_addr - slot->guest_addr;
+        if (offset <= slot->size && size <= slot->size - offset) {
+            return (char*)slot->host_addr + offset;
+        }
+    }
+    
+    return NULL;
+}
+
+static DWORD WINAPI vcpu_thread_main(LPVOID param)
+{
+    vcpu_state_t* vcpu = (vcpu_state_t*)param;
+    g_current_vcpu = vcpu;
+    
+    while (vcpu_wait_online(vcpu)) {
+        if (vcpu_run() != 0) {
+            LOG_ERROR("Erro na execução do vCPU %u", vcpu->index);
+            vcpu_power_off(vcpu);
+        }
+    }
+    
+    return 0;
+}
+
+int vm_start_vcpus(void)
+{
+    for (uint32_t i = 1; i < g_vm.vcpu_count; i++) {
+        vcpu_state_t* vcpu = &g_vm.vcpus[i];
+        
+        vcpu->thread = CreateThread(NULL, 0, vcpu_thread_main, vcpu, 0, NULL);
+        if (!vcpu->thread) {
+            LOG_ERROR("Falha ao criar thread do vCPU %u", i);
+            return -1;
+        }
+    }
+    
+    LOG_INFO("%u vCPUs secundários aguardando CPU_ON", g_vm.vcpu_count - 1);
+    return 0;
+}
+
+// Pode ser chamado de qualquer thread de vCPU (SYSTEM_OFF, último CPU_OFF)
+void vm_request_stop(void)
+{
+    g_vm.running = false;
+    
+    for (uint32_t i = 0; i < g_vm.vcpu_count; i++) {
+        vcpu_state_t* vcpu = &g_vm.vcpus[i];
+        if (!vcpu->created) {
+            continue;
+        }
+        SetEvent(vcpu->wake);
+        if (vcpu != vcpu_current()) {
+            WHvCancelRunVirtualProcessor(g_vm.partition, vcpu->index, 0);
+        }
+    }
+    
+    // Acordar vCPUs ociosos em vcpu_idle()
+    devices_signal_change(DEVICE_ID_GIC);
+}
+
+// Thread principal: encerra e aguarda as threads dos vCPUs secundários
+void vm_stop_vcpus(void)
+{
+    vm_request_stop();
+    
+    for (uint32_t i = 1; i < g_vm.vcpu_count; i++) {
+        vcpu_state_t* vcpu = &g_vm.vcpus[i];
+        if (vcpu->thread) {
+            WaitForSingleObject(vcpu->thread, INFINITE);
+            CloseHandle(vcpu->thread);
+            vcpu->thread = NULL;
+        }
+    }
+}
+
+// CPU_ON: devolve o estado anterior; só VCPU_POWER_OFF significa aceito.
+// PC/X0 são aplicados pela thread do próprio vCPU em vcpu_wait_online(),
+// já que a thread de origem não pode tocar registradores de um vCPU alheio
+// que ainda esteja saindo de WHvRunVirtualProcessor.
+vcpu_power_t vcpu_power_on(vcpu_state_t* vcpu, uint64_t entry, uint64_t context)
+{
+    LONG previous = InterlockedCompareExchange(&vcpu->power, VCPU_POWER_ON_PENDING, VCPU_POWER_OFF);
+    if (previous != VCPU_POWER_OFF) {
+        return (vcpu_power_t)previous;
+    }
+    
+    vcpu->entry_pc = entry;
+    vcpu->entry_context = context;
+    InterlockedIncrement(&g_vm.vcpus_online);
+    MemoryBarrier();
+    SetEvent(vcpu->wake);
+    return VCPU_POWER_OFF;
+}
+
+// CPU_OFF: a thread estaciona em vcpu_wait_online() no retorno do exit
+void vcpu_power_off(vcpu_state_t* vcpu)
+{
+    if (InterlockedExchange(&vcpu->power, VCPU_POWER_OFF) == VCPU_POWER_OFF) {
+        return;
+    }
+    
+    LOG_INFO("vCPU %u desligado", vcpu->index);
+    if (InterlockedDecrement(&g_vm.vcpus_online) == 0) {
+        LOG_INFO("Nenhum vCPU ligado, encerrando a VM");
+        vm_request_stop();
+    }
+}
+
+// Estaciona o vCPU enquanto estiver desligado; false quando a VM encerra
+bool vcpu_wait_online(vcpu_state_t* vcpu)
+{
+    while (g_vm.running && vcpu->power != VCPU_POWER_ON) {
+        steal_time_wait(vcpu);
+        WaitForSingleObject(vcpu->wake, INFINITE);
+        
+        if (g_vm.running && vcpu->power == VCPU_POWER_ON_PENDING) {
+            // Estado de entrada PSCI: PC = entry, X0 = context, EL1h com
+            // DAIF mascarados e MMU desligada
+            WHV_REGISTER_NAME reg_names[4] = {
+                WHvArm64RegisterPc, WHvArm64RegisterX0,
+                WHvArm64RegisterPstateReg, WHvArm64RegisterSctlrEl1
+            };
+            WHV_REGISTER_VALUE reg_values[4];
+            memset(reg_values, 0, sizeof(reg_values));
+            reg_values[0].Reg64 = vcpu->entry_pc;
+            reg_values[1].Reg64 = vcpu->entry_context;
+            reg_values[2].Reg64 = PSTATE_EL1H_MASKED;
+            reg_values[3].Reg64 = SCTLR_EL1_RESET;
+            
+            if (vcpu_set_registers(reg_names, reg_values, 4) != 0) {
+                vcpu_power_off(vcpu);
+                continue;
+            }
+            
+            InterlockedExchange(&vcpu->power, VCPU_POWER_ON);
+            LOG_INFO("vCPU %u ligado em 0x%llX", vcpu->index, vcpu->entry_pc);
+        }
+    }
+    
+    return g_vm.running;
+}
+
+// Caminho ocioso (CPU_SUSPEND): dorme até haver interrupção pendente no GIC,
+// o encerramento da VM ou timeout, sem girar na CPU do host
+void vcpu_idle(vcpu_state_t* vcpu, uint32_t timeout_ms)
+{
+    uint64_t deadline = GetTickCount64() + timeout_ms;
+    
+    // Timers da partição não são vistos daqui; timeout_ms limita o sono
+    steal_time_wait(vcpu);
+    while (g_vm.running) {
+        uint64_t generation = devices_change_generation(DEVICE_ID_GIC);
+        if (gic_get_pending_interrupt() != 1023) {
+            break;
+        }
+        
+        uint64_t now = GetTickCount64();
+        if (now >= deadline ||
+            !devices_wait_change(DEVICE_ID_GIC, generation, (uint32_t)(deadline - now))) {
+            break;
+        }
+    }
+}
+
 int vcpu_run(void)
 {
     WHV_RUN_VP_EXIT_CONTEXT exit_context;
+    vcpu_state_t* vcpu = vcpu_current();
     
-    HRESULT hr = WHvRunVirtualProcessor(g_vm.partition, g_vm.vpindex, 
+    uint64_t generation = devices_change_generation(DEVICE_ID_GIC);
+    uint64_t start_ns = timer_get_time_ns();
+    HRESULT hr = WHvRunVirtualProcessor(g_vm.partition, vcpu->index, 
                                        &exit_context, sizeof(exit_context));
+    uint64_t wall_ns = timer_get_time_ns() - start_ns;
     if (FAILED(hr)) {
         LOG_ERROR("Falha na execução do vCPU: 0x%08X", hr);
         return -1;
     }
     
+    // Sem interrupção nova durante a janela o guest não pode ter ficado em WFI
+    vcpu->exits++;
+    steal_time_account(vcpu, start_ns, wall_ns,
+                       exit_context.ExitReason != WHvRunVpExitReasonCanceled &&
+                       devices_change_generation(DEVICE_ID_GIC) == generation);
+    pmu_poll(&vcpu->sysregs.pmu, start_ns + wall_ns);
+    
     // Process exit context - implementado em exit_handler.c
     extern int handle_vm_exit(const WHV_RUN_VP_EXIT_CONTEXT* exit_context);
     return handle_vm_exit(&exit_context);
@@ -205,7 +586,7 @@ int vcpu_run(void)
 
 int vcpu_get_registers(WHV_REGISTER_NAME* reg_names, WHV_REGISTER_VALUE* reg_values, UINT32 count)
 {
-    HRESULT hr = WHvGetVirtualProcessorRegisters(g_vm.partition, g_vm.vpindex,
+    HRESULT hr = WHvGetVirtualProcessorRegisters(g_vm.partition, vcpu_current()->index,
                                                 reg_names, count, reg_values);
     if (FAILED(hr)) {
         LOG_ERROR("Falha ao ler registradores: 0x%08X", hr);
@@ -216,7 +597,7 @@ int vcpu_get_registers(WHV_REGISTER_NAME* reg_names, WHV_REGISTER_VALUE* reg_val
 
 int vcpu_set_registers(WHV_REGISTER_NAME* reg_names, WHV_REGISTER_VALUE* reg_values, UINT32 count)
 {
-    HRESULT hr = WHvSetVirtualProcessorRegisters(g_vm.partition, g_vm.vpindex,
+    HRESULT hr = WHvSetVirtualProcessorRegisters(g_vm.partition, vcpu_current()->index,
                                                 reg_names, count, reg_values);
     if (FAILED(hr)) {
         LOG_ERROR("Falha ao escrever registradores: 0x%08X", hr);
@@ -268,3 +649,39 @@ int vcpu_set_sp(uint64_t sp)
     
     return vcpu_set_registers(&reg_name, &reg_value, 1);
 }
+
+// UNDEFINED na instrução em PC: entrada de exceção síncrona em EL1 feita à
+// mão, já que o WHP não injeta exceções síncronas no ARM64
+int vcpu_inject_undef(void)
+{
+    WHV_REGISTER_NAME reg_names[5] = {
+        WHvArm64RegisterPc, WHvArm64RegisterPstateReg, WHvArm64RegisterVbarEl1,
+        WHvArm64RegisterElr, WHvArm64RegisterSpsr
+    };
+    WHV_REGISTER_VALUE reg_values[5];
+    
+    if (vcpu_get_registers(reg_names, reg_values, 3) != 0) {
+        return -1;
+    }
+    
+    uint64_t pc = reg_values[0].Reg64;
+    uint64_t pstate = reg_values[1].Reg64;
+    uint64_t vector;
+    
+    // Vetor síncrono conforme a origem: EL1t, EL1h, EL0 AArch64 ou AArch32
+    if (pstate & 0x10) {
+        vector = 0x600;
+    } else if ((pstate & 0xF) == 0) {
+        vector = 0x400;
+    } else {
+        vector = (pstate & 1) ? 0x200 : 0x000;
+    }
+    
+    reg_values[0].Reg64 = reg_values[2].Reg64 + vector;
+    reg_values[1].Reg64 = PSTATE_EL1H_MASKED;
+    reg_values[2].Reg64 = ESR_EL1_IL;
+    reg_names[2] = WHvArm64RegisterEsrEl1;
+    reg_values[3].Reg64 = pc;
+    reg_values[4].Reg64 = pstate;
+    return vcpu_set_registers(reg_names, reg_values, 5);
+}
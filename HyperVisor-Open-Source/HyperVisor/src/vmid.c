@@ -0,0 +1,167 @@
+/* Desenvolvido por: Escanearcpl */
+#include "vmid.h"
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Spinlock mínimo: o modo EL2 não tem primitivas do sistema
+static inline void vmid_lock(vmid_allocator_t* alloc)
+{
+#if defined(_MSC_VER)
+    while (_InterlockedExchange(&alloc->lock, 1) != 0) {
+        while (alloc->lock) {
+        }
+    }
+#else
+    while (__atomic_exchange_n(&alloc->lock, 1, __ATOMIC_ACQUIRE) != 0) {
+        while (__atomic_load_n(&alloc->lock, __ATOMIC_RELAXED)) {
+        }
+    }
+#endif
+}
+
+static inline void vmid_unlock(vmid_allocator_t* alloc)
+{
+#if defined(_MSC_VER)
+    _InterlockedExchange(&alloc->lock, 0);
+#else
+    __atomic_store_n(&alloc->lock, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline uint64_t vmid_mask(const vmid_allocator_t* alloc)
+{
+    return (1ULL << alloc->bits) - 1;
+}
+
+static inline void vmid_set(vmid_allocator_t* alloc, uint64_t value)
+{
+    alloc->map[value / 64] |= 1ULL << (value % 64);
+}
+
+static inline bool vmid_test(const vmid_allocator_t* alloc, uint64_t value)
+{
+    return (alloc->map[value / 64] >> (value % 64)) & 1;
+}
+
+int vmid_allocator_init(vmid_allocator_t* alloc, uint32_t bits, uint32_t ncpus)
+{
+    if ((bits != 8 && bits != 16) || ncpus == 0 || ncpus > VMID_MAX_CPUS) {
+        return -1;
+    }
+
+    memset(alloc, 0, sizeof(*alloc));
+    alloc->bits = bits;
+    alloc->ncpus = ncpus;
+    alloc->generation = 1ULL << bits;
+    alloc->next = 1;
+    vmid_set(alloc, 0);  // VMID 0 fica reservado ao hypervisor
+    return 0;
+}
+
+bool vmid_is_current(const vmid_allocator_t* alloc, uint64_t guest_vmid)
+{
+    return guest_vmid != 0 && (guest_vmid & ~vmid_mask(alloc)) == alloc->generation;
+}
+
+// Nova geração: mantém os VMIDs em uso em cada CPU e agenda um flush por CPU
+static void vmid_rollover(vmid_allocator_t* alloc)
+{
+    alloc->generation += 1ULL << alloc->bits;
+    alloc->rollovers++;
+    memset(alloc->map, 0, sizeof(alloc->map));
+    vmid_set(alloc, 0);
+
+    for (uint32_t cpu = 0; cpu < alloc->ncpus; cpu++) {
+        uint64_t vmid = alloc->active[cpu];
+        
+        // CPU sem guest desde o último rollover mantém o reservado anterior
+        if (vmid == 0) {
+            vmid = alloc->reserved[cpu];
+        }
+        if (vmid != 0) {
+            vmid_set(alloc, vmid & vmid_mask(alloc));
+        }
+        alloc->reserved[cpu] = vmid;
+        alloc->active[cpu] = 0;
+        alloc->flush_pending[cpu] = true;
+    }
+    
+    alloc->next = 1;
+}
+
+// Um guest de geração antiga que estava ativo no rollover mantém o mesmo
+// valor (outras CPUs podem ter entradas dele na TLB)
+static bool vmid_claim_reserved(vmid_allocator_t* alloc, uint64_t old, uint64_t* guest_vmid)
+{
+    bool hit = false;
+    uint64_t renewed = alloc->generation | (old & vmid_mask(alloc));
+
+    for (uint32_t cpu = 0; cpu < alloc->ncpus; cpu++) {
+        if (alloc->reserved[cpu] == old) {
+            alloc->reserved[cpu] = renewed;
+            hit = true;
+        }
+    }
+
+    if (hit) {
+        *guest_vmid = renewed;
+    }
+    return hit;
+}
+
+static uint64_t vmid_new(vmid_allocator_t* alloc, uint64_t old)
+{
+    uint32_t count = 1u << alloc->bits;
+
+    if (old != 0) {
+        uint64_t renewed;
+        if (vmid_claim_reserved(alloc, old, &renewed)) {
+            return renewed;
+        }
+        
+        // Reaproveitar o mesmo valor se ninguém o pegou nesta geração
+        if (!vmid_test(alloc, old & vmid_mask(alloc))) {
+            vmid_set(alloc, old & vmid_mask(alloc));
+            return alloc->generation | (old & vmid_mask(alloc));
+        }
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t v = alloc->next; v < count; v++) {
+            if (!vmid_test(alloc, v)) {
+                vmid_set(alloc, v);
+                alloc->next = v + 1;
+                return alloc->generation | v;
+            }
+        }
+        
+        // Sem VMIDs livres: avançar a geração e procurar de novo
+        vmid_rollover(alloc);
+    }
+
+    return 0;  // Inalcançável: após o rollover há ao menos count - ncpus - 1 livres
+}
+
+bool vmid_update(vmid_allocator_t* alloc, uint64_t* guest_vmid, uint32_t cpu)
+{
+    if (cpu >= alloc->ncpus) {
+        return true;
+    }
+
+    vmid_lock(alloc);
+
+    if (!vmid_is_current(alloc, *guest_vmid)) {
+        *guest_vmid = vmid_new(alloc, *guest_vmid);
+    }
+
+    alloc->active[cpu] = *guest_vmid;
+
+    bool flush = alloc->flush_pending[cpu];
+    alloc->flush_pending[cpu] = false;
+
+    vmid_unlock(alloc);
+    return flush;
+}
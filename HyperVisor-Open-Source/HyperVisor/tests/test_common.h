@@ -0,0 +1,41 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+// Verificações dos testes de unidade, sem framework. Uma falha é reportada e
+// o teste continua, para que uma execução mostre todas; main() devolve
+// TEST_RESULT() e o ctest lê o código de saída.
+
+#include <stdio.h>
+
+static int g_test_failures;
+
+#define CHECK(cond)                                                             \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            fprintf(stderr, "%s:%d: falhou: %s\n", __FILE__, __LINE__, #cond);  \
+            g_test_failures++;                                                  \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                          \
+    do {                                                                        \
+        unsigned long long check_a_ = (unsigned long long)(a);                  \
+        unsigned long long check_b_ = (unsigned long long)(b);                  \
+        if (check_a_ != check_b_) {                                             \
+            fprintf(stderr, "%s:%d: falhou: %s == %s (0x%llX != 0x%llX)\n",     \
+                    __FILE__, __LINE__, #a, #b, check_a_, check_b_);            \
+            g_test_failures++;                                                  \
+        }                                                                       \
+    } while (0)
+
+#define RUN_TEST(fn)                                                            \
+    do {                                                                        \
+        int before_ = g_test_failures;                                          \
+        fn();                                                                   \
+        printf("%s %s\n", g_test_failures == before_ ? "ok  " : "FALHA", #fn);  \
+    } while (0)
+
+#define TEST_RESULT() (g_test_failures ? 1 : 0)
+
+#endif // TEST_COMMON_H
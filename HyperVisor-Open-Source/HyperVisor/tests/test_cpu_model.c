@@ -0,0 +1,107 @@
+/* Desenvolvido por: Escanearcpl */
+#include "cpu_model.h"
+#include "test_common.h"
+
+// Banco do WHP com todos os bits: o que sair do resolve é o que o modelo pede
+#define HOST_BANK_ALL       0x00007FFFFFFFFFFFULL
+#define HV_PLATFORM_BITS    (HOST_BANK_ALL & ~((0xFULL << 9) | (0xFFFFFFULL << 20)))
+
+#define HV_FP               (1ULL << 9)
+#define HV_ADVSIMD          (1ULL << 11)
+#define HV_AES              (1ULL << 20)
+#define HV_POLYMUL          (1ULL << 21)
+#define HV_SHA1             (1ULL << 22)
+#define HV_SHA256           (1ULL << 23)
+#define HV_SHA512           (1ULL << 24)
+#define HV_CRC32            (1ULL << 25)
+#define HV_ATOMIC           (1ULL << 26)
+#define HV_RDM              (1ULL << 27)
+#define HV_SM3              (1ULL << 29)
+
+#define FEAT_ALL            (CPU_FEAT_V80 | CPU_FEAT_CRYPTO | CPU_FEAT_SHA512 | CPU_FEAT_SHA3 | \
+                             CPU_FEAT_CRC32 | CPU_FEAT_ATOMICS | CPU_FEAT_RDM | CPU_FEAT_FP16 | \
+                             CPU_FEAT_DOTPROD | CPU_FEAT_JSCVT | CPU_FEAT_LRCPC)
+
+static const cpu_host_t g_full_host = { FEAT_ALL, HOST_BANK_ALL };
+
+static void test_normalize(void)
+{
+    CHECK_EQ(cpu_features_normalize(CPU_FEAT_V80 | CPU_FEAT_PMULL), CPU_FEAT_V80);
+    CHECK_EQ(cpu_features_normalize(CPU_FEAT_V80 | CPU_FEAT_SHA3 | CPU_FEAT_SHA256),
+             CPU_FEAT_V80 | CPU_FEAT_SHA256);
+    CHECK_EQ(cpu_features_normalize(CPU_FEAT_FP | CPU_FEAT_AES | CPU_FEAT_CRC32), CPU_FEAT_FP | CPU_FEAT_CRC32);
+}
+
+static void test_unknown_model(void)
+{
+    cpu_model_config_t cfg;
+    CHECK(cpu_model_resolve("cortex-x9", &g_full_host, &cfg) != 0);
+}
+
+// host: tudo, inclusive extensões que nenhum modelo descreve
+static void test_host_passthrough(void)
+{
+    cpu_model_config_t cfg;
+
+    CHECK(cpu_model_resolve("host", &g_full_host, &cfg) == 0);
+    CHECK_EQ(cfg.features, FEAT_ALL);
+    CHECK_EQ(cfg.partition_features, HOST_BANK_ALL);
+}
+
+// baseline: plataforma do host, mas só FP/AdvSIMD entre as extensões
+static void test_baseline(void)
+{
+    cpu_model_config_t cfg;
+
+    CHECK(cpu_model_resolve("baseline", &g_full_host, &cfg) == 0);
+    CHECK_EQ(cfg.features, CPU_FEAT_V80);
+    CHECK_EQ(cfg.partition_features, HV_PLATFORM_BITS | HV_FP | HV_ADVSIMD);
+    CHECK_EQ(cfg.id_aa64isar0, 0);
+    CHECK_EQ(cfg.id_aa64isar1, 0);
+    CHECK_EQ(cfg.id_aa64pfr0, 0x2222);          // FP e AdvSIMD presentes, sem FP16
+}
+
+// migratable: banco e registradores de ID só com o conjunto do modelo, mesmo
+// num host que tem mais
+static void test_migratable(void)
+{
+    cpu_model_config_t cfg;
+
+    CHECK(cpu_model_resolve("migratable", &g_full_host, &cfg) == 0);
+    CHECK_EQ(cfg.partition_features,
+             HV_PLATFORM_BITS | HV_FP | HV_ADVSIMD | HV_AES | HV_POLYMUL | HV_SHA1 | HV_SHA256 |
+             HV_CRC32 | HV_ATOMIC | HV_RDM);
+    CHECK(!(cfg.partition_features & (HV_SHA512 | HV_SM3)));
+
+    // AES com PMULL, SHA1, SHA256, CRC32, LSE, RDM
+    CHECK_EQ(cfg.id_aa64isar0, (2ULL << 4) | (1ULL << 8) | (1ULL << 12) | (1ULL << 16) |
+                               (2ULL << 20) | (1ULL << 28));
+    CHECK_EQ(cfg.id_aa64isar1, 0);
+}
+
+// Modelo estrito recusa host sem o conjunto inteiro; o banco nunca pede um
+// bit que o host não oferece
+static void test_host_limits(void)
+{
+    cpu_model_config_t cfg;
+    cpu_host_t host = { CPU_FEAT_V80 | CPU_FEAT_CRYPTO | CPU_FEAT_CRC32, HOST_BANK_ALL };
+
+    CHECK(cpu_model_resolve("migratable", &host, &cfg) != 0);
+
+    host.features = FEAT_ALL;
+    host.hv_features = HOST_BANK_ALL & ~HV_CRC32;
+    CHECK(cpu_model_resolve("migratable", &host, &cfg) == 0);
+    CHECK(!(cfg.partition_features & HV_CRC32));
+    CHECK(cfg.partition_features & HV_AES);
+}
+
+int main(void)
+{
+    RUN_TEST(test_normalize);
+    RUN_TEST(test_unknown_model);
+    RUN_TEST(test_host_passthrough);
+    RUN_TEST(test_baseline);
+    RUN_TEST(test_migratable);
+    RUN_TEST(test_host_limits);
+    return TEST_RESULT();
+}
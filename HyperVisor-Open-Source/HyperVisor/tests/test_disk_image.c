@@ -0,0 +1,160 @@
+/* Desenvolvido por: Escanearcpl */
+#include "disk_image.h"
+#include "test_common.h"
+
+// Imagens HVDK reais no diretório corrente: uma base preenchida e um
+// overlay sobre ela. O teste faz o papel do device: escreve os dados no
+// trecho traduzido por disk_map() e chama disk_commit() na conclusão. Uma
+// queda é simulada reabrindo a imagem por outro disk_t.
+
+#define TEST_BASE           "test_disk_base.img"
+#define TEST_TOP            "test_disk_top.img"
+#define CLUSTER             (1ULL << DISK_CLUSTER_BITS)
+#define BASE_BYTE           0xBB
+#define DATA_BYTE           0xCC
+
+static uint8_t g_buffer[CLUSTER];
+
+// Dados do trecho gravados direto no arquivo da camada, como o device faz
+static void write_extent(const char* path, const disk_extent_t* extent, uint8_t value)
+{
+    FILE* file = fopen(path, "r+b");
+
+    CHECK(file != NULL);
+    memset(g_buffer, value, sizeof(g_buffer));
+    for (uint64_t done = 0; file && done < extent->len; done += CLUSTER) {
+        uint64_t chunk = extent->len - done < CLUSTER ? extent->len - done : CLUSTER;
+        CHECK(fseek(file, (long)(extent->host_offset + done), SEEK_SET) == 0);
+        CHECK_EQ(fwrite(g_buffer, 1, (size_t)chunk, file), chunk);
+    }
+    if (file) {
+        fclose(file);
+    }
+}
+
+// Byte em 'offset' visto por uma abertura nova do overlay (estado em disco).
+// Aberto gravável: o compartilhamento precisa aceitar o handle do teste
+static int read_after_crash(uint64_t offset)
+{
+    disk_t* disk;
+    disk_extent_t extent;
+    int value = 0;
+
+    CHECK(disk_open(TEST_TOP, false, &disk) == 0);
+    CHECK(disk_map(disk, offset, 1, false, &extent) == 0);
+    if (extent.kind == DISK_EXTENT_DATA) {
+        FILE* file = fopen(disk_layer_path(disk, extent.layer), "rb");
+        CHECK(file != NULL);
+        if (file) {
+            fseek(file, (long)extent.host_offset, SEEK_SET);
+            value = fgetc(file);
+            fclose(file);
+        }
+    }
+    disk_close(disk);
+    return value;
+}
+
+static disk_t* setup(void)
+{
+    disk_t* disk;
+    disk_extent_t extent;
+
+    DeleteFileA(TEST_TOP);
+    DeleteFileA(TEST_BASE);
+
+    CHECK(disk_create(TEST_BASE, 8 * CLUSTER, NULL) == 0);
+    CHECK(disk_open(TEST_BASE, false, &disk) == 0);
+    for (uint64_t offset = 0; offset < 8 * CLUSTER; offset += extent.len) {
+        CHECK(disk_map(disk, offset, 8 * CLUSTER - offset, true, &extent) == 0);
+        CHECK_EQ(extent.pending, 0);            // Sem base: nada a esconder
+        write_extent(TEST_BASE, &extent, BASE_BYTE);
+    }
+    disk_close(disk);
+
+    CHECK(disk_create(TEST_TOP, 0, TEST_BASE) == 0);
+    CHECK(disk_open(TEST_TOP, false, &disk) == 0);
+    return disk;
+}
+
+// Clusters inteiros sem cópia COW: a entrada só vai ao arquivo no commit,
+// então uma queda antes dele lê a base, com ou sem os dados gravados
+static void test_full_cluster_published_on_commit(void)
+{
+    disk_t* disk = setup();
+    disk_extent_t extent;
+
+    CHECK(disk_map(disk, 0, 2 * CLUSTER, true, &extent) == 0);
+    CHECK_EQ(extent.len, 2 * CLUSTER);
+    CHECK_EQ(extent.pending, 2);
+    CHECK_EQ(read_after_crash(0), BASE_BYTE);
+
+    write_extent(TEST_TOP, &extent, DATA_BYTE);
+    CHECK_EQ(read_after_crash(CLUSTER), BASE_BYTE);
+
+    CHECK(disk_commit(disk, 0, &extent, true) == 0);
+    CHECK_EQ(read_after_crash(0), DATA_BYTE);
+    CHECK_EQ(read_after_crash(CLUSTER), DATA_BYTE);
+    disk_close(disk);
+}
+
+// Outra escrita num cluster pendente usa a mesma alocação e não o publica
+static void test_pending_shared_by_overlap(void)
+{
+    disk_t* disk = setup();
+    disk_extent_t extent, overlap;
+
+    CHECK(disk_map(disk, 0, CLUSTER, true, &extent) == 0);
+    CHECK(disk_map(disk, 100, 10, true, &overlap) == 0);
+    CHECK_EQ(overlap.host_offset, extent.host_offset + 100);
+    CHECK_EQ(overlap.pending, 0);
+
+    CHECK(disk_commit(disk, 0, &extent, true) == 0);
+    disk_close(disk);
+}
+
+// Escrita parcial: o cluster inteiro é copiado da base antes da entrada,
+// publicada na hora
+static void test_partial_cluster_copied(void)
+{
+    disk_t* disk = setup();
+    disk_extent_t extent;
+
+    CHECK(disk_map(disk, CLUSTER + 10, 10, true, &extent) == 0);
+    CHECK_EQ(extent.pending, 0);
+    CHECK_EQ(read_after_crash(CLUSTER + 10), BASE_BYTE);
+
+    write_extent(TEST_TOP, &extent, DATA_BYTE);
+    CHECK_EQ(read_after_crash(CLUSTER + 10), DATA_BYTE);
+    CHECK_EQ(read_after_crash(CLUSTER), BASE_BYTE);
+    disk_close(disk);
+}
+
+// Escrita que falhou: o cluster volta a ler da base e é alocado de novo
+static void test_failed_write_released(void)
+{
+    disk_t* disk = setup();
+    disk_extent_t extent, again;
+
+    CHECK(disk_map(disk, 3 * CLUSTER, CLUSTER, true, &extent) == 0);
+    CHECK_EQ(extent.pending, 1);
+    CHECK(disk_commit(disk, 3 * CLUSTER, &extent, false) == 0);
+
+    CHECK(disk_map(disk, 3 * CLUSTER, 1, false, &again) == 0);
+    CHECK_EQ(again.layer, 1);
+    CHECK(disk_map(disk, 3 * CLUSTER, CLUSTER, true, &again) == 0);
+    CHECK(again.host_offset != extent.host_offset);
+    CHECK(disk_commit(disk, 3 * CLUSTER, &again, true) == 0);
+    disk_close(disk);
+}
+
+int main(void)
+{
+    RUN_TEST(test_full_cluster_published_on_commit);
+    RUN_TEST(test_pending_shared_by_overlap);
+    RUN_TEST(test_partial_cluster_copied);
+    RUN_TEST(test_failed_write_released);
+    DeleteFileA(TEST_TOP);
+    DeleteFileA(TEST_BASE);
+    return TEST_RESULT();
+}
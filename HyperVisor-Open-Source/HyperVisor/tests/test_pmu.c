@@ -0,0 +1,188 @@
+/* Desenvolvido por: Escanearcpl */
+#include "sysreg.h"
+#include "devices.h"
+#include "test_common.h"
+
+// PMU virtual sobre a tabela de sysregs: a fonte de eventos é controlada pelo
+// teste e conta quantas vezes CPU_CYCLES foi amostrado (no VMM, uma chamada
+// ao WHP). O nível do PPI é registrado por vCPU.
+
+#define PMCR_EL0            SYSREG_ENC(3, 3, 9, 12, 0)
+#define PMCNTENSET_EL0      SYSREG_ENC(3, 3, 9, 12, 1)
+#define PMOVSCLR_EL0        SYSREG_ENC(3, 3, 9, 12, 3)
+#define PMCCNTR_EL0         SYSREG_ENC(3, 3, 9, 13, 0)
+#define PMINTENSET_EL1      SYSREG_ENC(3, 0, 9, 14, 1)
+#define PMEVCNTR0_EL0       SYSREG_ENC(3, 3, 14, 8, 0)
+#define PMEVTYPER0_EL0      SYSREG_ENC(3, 3, 14, 12, 0)
+
+#define CYCLE_BIT           (1U << PMU_CYCLE_INDEX)
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t exits;
+    uint32_t cycle_reads;
+} test_source_t;
+
+static test_source_t g_source[2];
+static sysreg_vcpu_t g_vcpu[2];
+static bool g_ppi_level[2];
+
+// ---------------------------------------------------------------------------
+// Dependências do PMU e da tabela de sysregs
+// ---------------------------------------------------------------------------
+
+uint64_t timer_get_time_ns(void)
+{
+    return 0;
+}
+
+void gic_set_ppi_level(uint32_t ppi, uint32_t vcpu, bool level)
+{
+    CHECK_EQ(ppi, PMU_IRQ_PPI);
+    if (vcpu < 2) {
+        g_ppi_level[vcpu] = level;
+    }
+}
+
+static uint64_t test_source(void* opaque, uint32_t event)
+{
+    test_source_t* src = (test_source_t*)opaque;
+
+    switch (event) {
+        case PMU_EVT_CPU_CYCLES:
+            src->cycle_reads++;
+            return src->cycles;
+        case PMU_EVT_EXC_TAKEN:
+            return src->exits;
+        default:
+            return 0;
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+static void msr(uint32_t cpu, uint16_t enc, uint64_t value)
+{
+    CHECK(sysreg_access(&g_vcpu[cpu], enc, false, &value) == SYSREG_OK);
+}
+
+static uint64_t mrs(uint32_t cpu, uint16_t enc)
+{
+    uint64_t value = 0;
+    CHECK(sysreg_access(&g_vcpu[cpu], enc, true, &value) == SYSREG_OK);
+    return value;
+}
+
+static void setup(void)
+{
+    memset(g_source, 0, sizeof(g_source));
+    memset(g_ppi_level, 0, sizeof(g_ppi_level));
+    CHECK(sysreg_init() == 0);
+    CHECK(pmu_init() == 0);
+    for (uint32_t cpu = 0; cpu < 2; cpu++) {
+        sysreg_vcpu_init(&g_vcpu[cpu], cpu);
+        pmu_vcpu_init(&g_vcpu[cpu].pmu, cpu, test_source, &g_source[cpu]);
+    }
+}
+
+// Contador de ciclos a 2000 ciclos do overflow (1 us a PMU_CYCLE_HZ): os
+// exits antes do prazo não amostram CPU_CYCLES
+static void test_cycles_sampled_at_deadline(void)
+{
+    setup();
+    pmu_vcpu_t* pmu = &g_vcpu[0].pmu;
+
+    msr(0, PMCR_EL0, PMCR_E);
+    msr(0, PMCNTENSET_EL0, CYCLE_BIT);
+    msr(0, PMINTENSET_EL1, CYCLE_BIT);
+    msr(0, PMCCNTR_EL0, 0x100000000ULL - 2000);
+
+    pmu_poll(pmu, 0);                       // Escritas pedem uma amostra nova
+    uint32_t reads = g_source[0].cycle_reads;
+    CHECK_EQ(pmu->cycles_deadline_ns, 1000);
+
+    g_source[0].cycles = 1500;
+    pmu_poll(pmu, 400);
+    pmu_poll(pmu, 999);
+    CHECK_EQ(g_source[0].cycle_reads, reads);
+    CHECK(!g_ppi_level[0]);
+
+    g_source[0].cycles = 2000;
+    pmu_poll(pmu, 1000);
+    CHECK_EQ(g_source[0].cycle_reads, reads + 1);
+    CHECK(g_ppi_level[0]);
+
+    // Leitura do guest sempre amostra
+    g_source[0].cycles = 2010;
+    CHECK_EQ(mrs(0, PMCCNTR_EL0), 0x100000000ULL + 10);
+}
+
+// Sem interrupção habilitada não há prazo: só leituras amostram ciclos
+static void test_no_deadline_without_inten(void)
+{
+    setup();
+    pmu_vcpu_t* pmu = &g_vcpu[0].pmu;
+
+    msr(0, PMCR_EL0, PMCR_E);
+    msr(0, PMCNTENSET_EL0, CYCLE_BIT);
+    pmu_poll(pmu, 0);
+    uint32_t reads = g_source[0].cycle_reads;
+    CHECK_EQ(pmu->cycles_deadline_ns, UINT64_MAX);
+
+    g_source[0].cycles = 1000000;
+    pmu_poll(pmu, 1000000000ULL);
+    CHECK_EQ(g_source[0].cycle_reads, reads);
+    CHECK_EQ(mrs(0, PMCCNTR_EL0), 1000000);
+}
+
+// Eventos baratos acompanham cada exit, sem amostrar CPU_CYCLES
+static void test_exit_events_every_poll(void)
+{
+    setup();
+    pmu_vcpu_t* pmu = &g_vcpu[0].pmu;
+
+    msr(0, PMEVTYPER0_EL0, PMU_EVT_EXC_TAKEN);
+    msr(0, PMEVCNTR0_EL0, 0xFFFFFFFF);
+    msr(0, PMCR_EL0, PMCR_E);
+    msr(0, PMCNTENSET_EL0, 1);
+    msr(0, PMINTENSET_EL1, 1);
+    pmu_poll(pmu, 0);
+    uint32_t reads = g_source[0].cycle_reads;
+
+    g_source[0].exits = 1;
+    pmu_poll(pmu, 10);
+    CHECK_EQ(g_source[0].cycle_reads, reads);
+    CHECK(g_ppi_level[0]);
+    CHECK_EQ(mrs(0, PMEVCNTR0_EL0), 0);
+}
+
+// Cada vCPU sinaliza o próprio nível: baixar o de um não mexe no do outro
+static void test_irq_level_per_vcpu(void)
+{
+    setup();
+
+    for (uint32_t cpu = 0; cpu < 2; cpu++) {
+        msr(cpu, PMEVTYPER0_EL0, PMU_EVT_EXC_TAKEN);
+        msr(cpu, PMEVCNTR0_EL0, 0xFFFFFFFF);
+        msr(cpu, PMCR_EL0, PMCR_E);
+        msr(cpu, PMCNTENSET_EL0, 1);
+        msr(cpu, PMINTENSET_EL1, 1);
+        g_source[cpu].exits = 1;
+        pmu_poll(&g_vcpu[cpu].pmu, 0);
+    }
+    CHECK(g_ppi_level[0]);
+    CHECK(g_ppi_level[1]);
+
+    msr(0, PMOVSCLR_EL0, 1);
+    CHECK(!g_ppi_level[0]);
+    CHECK(g_ppi_level[1]);
+}
+
+int main(void)
+{
+    RUN_TEST(test_cycles_sampled_at_deadline);
+    RUN_TEST(test_no_deadline_without_inten);
+    RUN_TEST(test_exit_events_every_poll);
+    RUN_TEST(test_irq_level_per_vcpu);
+    return TEST_RESULT();
+}
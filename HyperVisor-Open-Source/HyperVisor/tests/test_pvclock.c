@@ -0,0 +1,78 @@
+/* Desenvolvido por: Escanearcpl */
+#include "pvclock.h"
+#include "test_common.h"
+
+// Frequências de CNTFRQ_EL0 encontradas em hardware real
+#define FREQ_19M2           19200000ULL
+#define FREQ_24M            24000000ULL
+#define FREQ_1G             1000000000ULL
+
+static uint64_t ticks_to_ns(uint64_t ticks, uint64_t freq)
+{
+    return pvclock_scale_delta(ticks, pvclock_mul_for_freq(freq), PVCLOCK_SHIFT);
+}
+
+// Diferença absoluta, para escalas com arredondamento
+static uint64_t diff(uint64_t a, uint64_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+static void test_known_deltas(void)
+{
+    // Deltas exatos em ns em cada frequência
+    CHECK_EQ(ticks_to_ns(FREQ_24M, FREQ_24M), 1000000000ULL);
+    CHECK_EQ(ticks_to_ns(24, FREQ_24M), 1000);
+    CHECK_EQ(ticks_to_ns(24000, FREQ_24M), 1000000);
+    CHECK_EQ(ticks_to_ns(12345, FREQ_1G), 12345);
+    CHECK_EQ(ticks_to_ns(1, 62500000ULL), 16);
+    CHECK_EQ(ticks_to_ns(0, FREQ_24M), 0);
+
+    // 52,083... ns por tick: o truncamento de pvclock_scale_delta perde até 1 ns
+    CHECK(diff(ticks_to_ns(192, FREQ_19M2), 10000) <= 1);
+
+    // Um dia de ticks: o produto passa de 64 bits e o erro fica abaixo de
+    // 1 ns por segundo
+    CHECK(diff(ticks_to_ns(86400ULL * FREQ_24M, FREQ_24M), 86400ULL * 1000000000ULL) <= 86400);
+    CHECK(diff(ticks_to_ns(86400ULL * FREQ_19M2, FREQ_19M2), 86400ULL * 1000000000ULL) <= 86400);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+static uint64_t g_counter;
+
+static uint64_t read_counter(void)
+{
+    return g_counter;
+}
+
+// Página publicada com o contador do guest e o tempo do host no mesmo
+// instante: o guest soma o delta escalado ao tempo publicado
+static void test_read_page(void)
+{
+    pvclock_page_t page = { 0 };
+
+    page.version = 2;
+    page.counter_timestamp = 5000000000ULL;
+    page.system_time_ns = 777000000000ULL;
+    page.mul = pvclock_mul_for_freq(FREQ_24M);
+    page.shift = PVCLOCK_SHIFT;
+    page.counter_frequency = FREQ_24M;
+    page.flags = PVCLOCK_FLAG_STABLE;
+
+    g_counter = page.counter_timestamp;
+    CHECK_EQ(pvclock_read_ns(&page, read_counter), 777000000000ULL);
+    g_counter = page.counter_timestamp + 2400;
+    CHECK_EQ(pvclock_read_ns(&page, read_counter), 777000100000ULL);
+    g_counter = page.counter_timestamp + 3 * FREQ_24M;
+    CHECK_EQ(pvclock_read_ns(&page, read_counter), 780000000000ULL);
+}
+#endif
+
+int main(void)
+{
+    RUN_TEST(test_known_deltas);
+#if defined(__GNUC__) || defined(__clang__)
+    RUN_TEST(test_read_page);
+#endif
+    return TEST_RESULT();
+}
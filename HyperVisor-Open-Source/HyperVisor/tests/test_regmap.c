@@ -0,0 +1,192 @@
+/* Desenvolvido por: Escanearcpl */
+#include "devices.h"
+#include "test_common.h"
+
+// Mapa de teste com os tipos de registrador dos devices: campo simples,
+// pares set/clear por bit (como GICD_ISENABLER/ICENABLER), array de bytes
+// (como GICD_IPRIORITYR) e um registrador com leitura destrutiva (como o DR
+// da UART).
+
+#define REG_CTRL        0x000
+#define REG_DATA        0x010
+#define REG_SET         0x100
+#define REG_CLEAR       0x180
+#define REG_PRIO        0x400
+
+typedef struct {
+    uint32_t ctrl;
+    uint32_t bits[2];
+    uint32_t prio[8];
+    uint32_t data_reads;
+    uint64_t data_written;
+    uint32_t bits_reads;
+} test_state_t;
+
+static test_state_t g_state;
+
+static uint64_t bits_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)reg;
+    ((test_state_t*)state)->bits_reads++;
+    return ((test_state_t*)state)->bits[index];
+}
+
+static void bits_set_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)reg;
+    ((test_state_t*)state)->bits[index] |= (uint32_t)value;
+}
+
+static void bits_clear_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)reg;
+    ((test_state_t*)state)->bits[index] &= ~(uint32_t)value;
+}
+
+static uint64_t data_read(void* state, const regmap_reg_t* reg, uint32_t index)
+{
+    (void)reg; (void)index;
+    ((test_state_t*)state)->data_reads++;
+    return 0xAB;
+}
+
+static void data_write(void* state, const regmap_reg_t* reg, uint32_t index, uint64_t value)
+{
+    (void)reg; (void)index;
+    ((test_state_t*)state)->data_written = value;
+}
+
+static const regmap_reg_t test_regs[] = {
+    REGMAP_REG("CTRL", REG_CTRL, REGMAP_RW, offsetof(test_state_t, ctrl), 0xFFFFFFFF, 0),
+    REGMAP_HOOK("DATA", REG_DATA, 1, REGMAP_RW, REGMAP_F_VOLATILE, data_read, data_write),
+    REGMAP_HOOK("SET", REG_SET, 2, REGMAP_RW, REGMAP_F_W1, bits_read, bits_set_write),
+    REGMAP_HOOK("CLEAR", REG_CLEAR, 2, REGMAP_RW, REGMAP_F_W1, bits_read, bits_clear_write),
+    REGMAP_ARRAY("PRIO", REG_PRIO, 8, 1, REGMAP_RW, offsetof(test_state_t, prio), 0xFF),
+};
+
+static regmap_t g_map = {
+    .name = "test",
+    .base = 0,
+    .size = 0x1000,
+    .state = &g_state,
+    .regs = test_regs,
+    .nregs = REGMAP_COUNT(test_regs),
+};
+
+static uint64_t map_read(uint32_t offset, uint32_t size)
+{
+    uint64_t value = 0;
+    CHECK(regmap_read(&g_map, offset, size, &value));
+    return value;
+}
+
+static void map_write(uint32_t offset, uint32_t size, uint64_t value)
+{
+    CHECK(regmap_write(&g_map, offset, size, value));
+}
+
+static void setup(void)
+{
+    memset(&g_state, 0, sizeof(g_state));
+    CHECK(regmap_init(&g_map) == 0);
+}
+
+// Byte no offset 1 de um banco set/clear: bits 8-15, os outros intocados
+static void test_byte_write_set_clear(void)
+{
+    setup();
+
+    map_write(REG_SET + 1, 1, 0x01);
+    CHECK_EQ(g_state.bits[0], 0x100);
+    map_write(REG_SET + 4 + 3, 1, 0x80);
+    CHECK_EQ(g_state.bits[1], 0x80000000);
+
+    g_state.bits[0] = 0xFFFFFFFF;
+    map_write(REG_CLEAR + 1, 1, 0x01);
+    CHECK_EQ(g_state.bits[0], 0xFFFFFEFF);
+    map_write(REG_CLEAR + 2, 2, 0x8001);
+    CHECK_EQ(g_state.bits[0], 0x7FFEFEFF);
+}
+
+// Campo simples: os bytes escritos na posição, o resto preservado
+static void test_subword_write_merges(void)
+{
+    setup();
+    g_state.ctrl = 0x11223344;
+
+    map_write(REG_CTRL + 2, 1, 0xAA);
+    CHECK_EQ(g_state.ctrl, 0x11AA3344);
+    map_write(REG_CTRL + 2, 2, 0xBEEF);
+    CHECK_EQ(g_state.ctrl, 0xBEEF3344);
+    map_write(REG_CTRL, 1, 0x155);              // Só o byte do acesso
+    CHECK_EQ(g_state.ctrl, 0xBEEF3355);
+
+    CHECK_EQ(map_read(REG_CTRL + 1, 1), 0x33);
+    CHECK_EQ(map_read(REG_CTRL + 2, 2), 0xBEEF);
+}
+
+// Leitura destrutiva: uma escrita estreita não consome o registrador
+static void test_subword_write_volatile(void)
+{
+    setup();
+
+    map_write(REG_DATA, 1, 0x41);
+    CHECK_EQ(g_state.data_reads, 0);
+    CHECK_EQ(g_state.data_written, 0x41);
+    map_write(REG_DATA + 1, 1, 0x42);
+    CHECK_EQ(g_state.data_reads, 0);
+    CHECK_EQ(g_state.data_written, 0x4200);
+}
+
+// Elementos de 1 byte: acesso de 32 bits cobre quatro elementos
+static void test_byte_array(void)
+{
+    setup();
+
+    map_write(REG_PRIO + 4, 4, 0x40302010);
+    CHECK_EQ(g_state.prio[4], 0x10);
+    CHECK_EQ(g_state.prio[7], 0x40);
+    map_write(REG_PRIO + 5, 1, 0xA0);
+    CHECK_EQ(g_state.prio[5], 0xA0);
+    CHECK_EQ(map_read(REG_PRIO + 4, 4), 0x4030A010);
+    CHECK_EQ(map_read(REG_PRIO + 6, 1), 0x30);
+}
+
+// Página sombra: uma escrita relê só os elementos escritos e os aliases
+// deles (SET e CLEAR leem o mesmo banco), não a janela inteira
+static void test_shadow_sync_on_write(void)
+{
+    static uint32_t shadow[0x1000 / 4];
+    device_io_t io = { .address = REG_SET + 4, .data = 0x10, .size = 4, .is_write = true };
+
+    setup();
+    memset(shadow, 0, sizeof(shadow));
+    g_map.shadow = shadow;
+    g_state.ctrl = 0x1234;                      // Sem sync: a sombra fica com 0
+
+    CHECK(regmap_access(&g_map, &io) == DEVICE_ACCESS_OK);
+    CHECK_EQ(g_state.bits_reads, 2);
+    CHECK_EQ(shadow[(REG_SET + 4) / 4], 0x10);
+    CHECK_EQ(shadow[(REG_CLEAR + 4) / 4], 0x10);
+    CHECK_EQ(shadow[REG_SET / 4], 0);
+    CHECK_EQ(shadow[REG_CTRL / 4], 0);
+
+    io.address = REG_PRIO + 2;
+    io.data = 0x55;
+    io.size = 1;
+    CHECK(regmap_access(&g_map, &io) == DEVICE_ACCESS_OK);
+    CHECK_EQ(shadow[REG_PRIO / 4], 0x550000);
+    CHECK_EQ(g_state.bits_reads, 2);
+
+    g_map.shadow = NULL;
+}
+
+int main(void)
+{
+    RUN_TEST(test_byte_write_set_clear);
+    RUN_TEST(test_subword_write_merges);
+    RUN_TEST(test_subword_write_volatile);
+    RUN_TEST(test_byte_array);
+    RUN_TEST(test_shadow_sync_on_write);
+    return TEST_RESULT();
+}
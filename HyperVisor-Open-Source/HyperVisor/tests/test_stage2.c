@@ -0,0 +1,282 @@
+/* Desenvolvido por: Escanearcpl */
+#include "stage2.h"
+#include "test_common.h"
+#include <string.h>
+
+// Memória de tabelas simulada: "endereço físico" = (índice + 1) * 4KB
+#define TEST_PAGES      32
+#define TEST_MAX_TLBI   64
+
+#define RAM_IPA         0x40000000ULL
+#define SZ_4K           0x1000ULL
+#define SZ_2M           0x200000ULL
+#define SZ_1G           0x40000000ULL
+
+typedef struct {
+    uint64_t ipa;
+    uint64_t size;
+    bool broken;                // Faixa sem tradução no momento do TLBI
+} test_tlbi_t;
+
+typedef struct {
+    uint64_t pages[TEST_PAGES][STAGE2_TABLE_ENTRIES];
+    bool used[TEST_PAGES];
+    uint32_t in_use;
+    stage2_t* s2;
+    test_tlbi_t tlbi[TEST_MAX_TLBI];
+    uint32_t tlbi_count;
+} test_mm_t;
+
+static test_mm_t g_mm;
+
+static void* test_alloc_page(void* opaque, uint64_t* phys)
+{
+    test_mm_t* mm = (test_mm_t*)opaque;
+
+    for (uint32_t i = 0; i < TEST_PAGES; i++) {
+        if (!mm->used[i]) {
+            mm->used[i] = true;
+            mm->in_use++;
+            memset(mm->pages[i], 0, sizeof(mm->pages[i]));
+            *phys = (uint64_t)(i + 1) << 12;
+            return mm->pages[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_free_page(void* opaque, void* page, uint64_t phys)
+{
+    test_mm_t* mm = (test_mm_t*)opaque;
+    uint32_t i = (uint32_t)(phys >> 12) - 1;
+
+    CHECK(i < TEST_PAGES && mm->used[i] && page == mm->pages[i]);
+    if (i < TEST_PAGES && mm->used[i]) {
+        mm->used[i] = false;
+        mm->in_use--;
+    }
+}
+
+static void* test_phys_to_virt(void* opaque, uint64_t phys)
+{
+    test_mm_t* mm = (test_mm_t*)opaque;
+    return mm->pages[(phys >> 12) - 1];
+}
+
+// Break-before-make: quando o TLBI é emitido o descritor antigo já saiu da
+// tabela, então nenhum endereço da faixa pode traduzir
+static void test_tlb_invalidate(void* opaque, uint64_t ipa, uint64_t size)
+{
+    test_mm_t* mm = (test_mm_t*)opaque;
+    bool broken = true;
+
+    for (uint64_t off = 0; off < size; off += SZ_4K) {
+        if (stage2_lookup(mm->s2, ipa + off, NULL, NULL, NULL)) {
+            broken = false;
+            break;
+        }
+    }
+
+    if (mm->tlbi_count < TEST_MAX_TLBI) {
+        mm->tlbi[mm->tlbi_count].ipa = ipa;
+        mm->tlbi[mm->tlbi_count].size = size;
+        mm->tlbi[mm->tlbi_count].broken = broken;
+    }
+    mm->tlbi_count++;
+}
+
+static void test_setup(stage2_t* s2, uint32_t ipa_bits)
+{
+    stage2_mm_ops_t ops = {
+        test_alloc_page,
+        test_free_page,
+        test_phys_to_virt,
+        test_tlb_invalidate,
+        &g_mm
+    };
+
+    memset(&g_mm, 0, sizeof(g_mm));
+    g_mm.s2 = s2;
+    CHECK(stage2_init(s2, &ops, ipa_bits) == 0);
+}
+
+static void test_teardown(stage2_t* s2)
+{
+    stage2_destroy(s2);
+    CHECK_EQ(g_mm.in_use, 0);
+}
+
+static void check_tlbi(uint32_t index, uint64_t ipa, uint64_t size)
+{
+    CHECK(index < g_mm.tlbi_count);
+    if (index < g_mm.tlbi_count && index < TEST_MAX_TLBI) {
+        CHECK_EQ(g_mm.tlbi[index].ipa, ipa);
+        CHECK_EQ(g_mm.tlbi[index].size, size);
+        CHECK(g_mm.tlbi[index].broken);
+    }
+}
+
+// Maiores blocos que o alinhamento permite, com os atributos de cada tipo
+static void test_descriptors(void)
+{
+    stage2_t s2;
+    uint64_t pa;
+    uint64_t desc;
+    uint32_t level;
+
+    test_setup(&s2, 39);
+    CHECK(stage2_map(&s2, RAM_IPA, RAM_IPA, SZ_1G + SZ_2M + SZ_4K, STAGE2_PERM_RW,
+                     STAGE2_MEM_NORMAL) == 0);
+    CHECK(stage2_map(&s2, 0x09000000ULL, 0x09000000ULL, SZ_4K, STAGE2_PERM_RWX,
+                     STAGE2_MEM_DEVICE) == 0);
+
+    CHECK(stage2_lookup(&s2, RAM_IPA + 0x1234, &pa, &desc, &level));
+    CHECK_EQ(level, 1);
+    CHECK_EQ(pa, RAM_IPA + 0x1234);
+    CHECK_EQ(desc & S2_DESC_TYPE_MASK, S2_DESC_BLOCK);
+    CHECK_EQ(desc & S2_DESC_OA_MASK, RAM_IPA);
+    CHECK_EQ(desc & S2_MEMATTR_MASK, S2_MEMATTR_NORMAL);
+    CHECK_EQ(desc & (S2_AP_R | S2_AP_W | S2_SH_INNER | S2_AF | S2_XN),
+             S2_AP_R | S2_AP_W | S2_SH_INNER | S2_AF | S2_XN);
+
+    CHECK(stage2_lookup(&s2, RAM_IPA + SZ_1G, NULL, &desc, &level));
+    CHECK_EQ(level, 2);
+    CHECK_EQ(desc & S2_DESC_TYPE_MASK, S2_DESC_BLOCK);
+
+    CHECK(stage2_lookup(&s2, RAM_IPA + SZ_1G + SZ_2M, NULL, &desc, &level));
+    CHECK_EQ(level, 3);
+    CHECK_EQ(desc & S2_DESC_TYPE_MASK, S2_DESC_PAGE);
+    CHECK(!stage2_lookup(&s2, RAM_IPA + SZ_1G + SZ_2M + SZ_4K, NULL, NULL, NULL));
+
+    // MMIO: Device-nGnRE e nunca executável, mesmo pedindo X
+    CHECK(stage2_lookup(&s2, 0x09000000ULL, NULL, &desc, &level));
+    CHECK_EQ(level, 3);
+    CHECK_EQ(desc & S2_MEMATTR_MASK, S2_MEMATTR_DEVICE);
+    CHECK_EQ(desc & S2_XN, S2_XN);
+
+    stage2_stats_t stats;
+    stage2_get_stats(&s2, &stats);
+    CHECK_EQ(stats.blocks_1g, 1);
+    CHECK_EQ(stats.blocks_2m, 1);
+    CHECK_EQ(stats.pages_4k, 2);
+
+    // Fora do IPA configurado, desalinhado ou vazio
+    CHECK(stage2_map(&s2, 1ULL << 39, 0, SZ_4K, STAGE2_PERM_R, STAGE2_MEM_NORMAL) != 0);
+    CHECK(stage2_map(&s2, RAM_IPA + 0x800, 0, SZ_4K, STAGE2_PERM_R, STAGE2_MEM_NORMAL) != 0);
+    CHECK(stage2_map(&s2, RAM_IPA, 0, 0, STAGE2_PERM_R, STAGE2_MEM_NORMAL) != 0);
+    test_teardown(&s2);
+}
+
+// VTCR_EL2: T0SZ do IPA, início no nível 1 e PS do PARange do host
+static void test_vtcr(void)
+{
+    stage2_t s2;
+    const uint64_t fixed = (1ULL << 31) | (3ULL << 12) | (1ULL << 10) | (1ULL << 8) | (1ULL << 6);
+
+    test_setup(&s2, 39);
+    CHECK_EQ(stage2_vtcr(&s2, 2), fixed | (2ULL << 16) | 25);
+    CHECK_EQ(stage2_vtcr(&s2, 5), fixed | (5ULL << 16) | 25);
+    CHECK_EQ(stage2_vtcr(&s2, 6), fixed | (5ULL << 16) | 25);     // 52 bits exige LPA2
+    CHECK_EQ(stage2_vttbr(&s2, 0x1234), (0x1234ULL << 48) | s2.root_phys);
+    test_teardown(&s2);
+
+    // IPA pequeno num host de PA grande: PS continua sendo o do host
+    test_setup(&s2, 32);
+    CHECK_EQ(stage2_vtcr(&s2, 4), fixed | (4ULL << 16) | 32);
+    test_teardown(&s2);
+
+    CHECK_EQ(stage2_pa_bits(0), 32);
+    CHECK_EQ(stage2_pa_bits(2), 40);
+    CHECK_EQ(stage2_pa_bits(5), 48);
+    CHECK_EQ(stage2_pa_bits(6), 48);
+}
+
+// Mapear sobre entradas inválidas não precisa de TLBI
+static void test_map_invalid_no_tlbi(void)
+{
+    stage2_t s2;
+
+    test_setup(&s2, 39);
+    CHECK(stage2_map(&s2, RAM_IPA, RAM_IPA, SZ_1G + SZ_2M + SZ_4K, STAGE2_PERM_RWX,
+                     STAGE2_MEM_NORMAL) == 0);
+    CHECK_EQ(g_mm.tlbi_count, 0);
+    test_teardown(&s2);
+}
+
+// Proteger uma página de um bloco de 2MB divide o bloco: o descritor de
+// bloco é quebrado e invalidado antes de a tabela entrar
+static void test_split_breaks_block(void)
+{
+    stage2_t s2;
+    uint64_t desc;
+    uint32_t level;
+
+    test_setup(&s2, 39);
+    CHECK(stage2_map(&s2, RAM_IPA, RAM_IPA, SZ_2M, STAGE2_PERM_RWX, STAGE2_MEM_NORMAL) == 0);
+    CHECK(stage2_protect(&s2, RAM_IPA + SZ_4K, SZ_4K, STAGE2_PERM_R) == 0);
+
+    CHECK_EQ(g_mm.tlbi_count, 2);
+    check_tlbi(0, RAM_IPA, SZ_2M);              // Bloco -> tabela
+    check_tlbi(1, RAM_IPA + SZ_4K, SZ_4K);      // Página: novas permissões
+
+    CHECK(stage2_lookup(&s2, RAM_IPA + SZ_4K, NULL, &desc, &level));
+    CHECK_EQ(level, 3);
+    CHECK(!(desc & S2_AP_W));
+    CHECK(stage2_lookup(&s2, RAM_IPA, NULL, &desc, &level));
+    CHECK_EQ(level, 3);
+    CHECK(desc & S2_AP_W);
+    test_teardown(&s2);
+}
+
+// Tabela uniforme volta a ser bloco; a tabela é invalidada por inteiro
+static void test_merge_breaks_table(void)
+{
+    stage2_t s2;
+    uint32_t level;
+
+    test_setup(&s2, 39);
+    CHECK(stage2_map(&s2, RAM_IPA, RAM_IPA, SZ_2M, STAGE2_PERM_RWX, STAGE2_MEM_NORMAL) == 0);
+    CHECK(stage2_split(&s2, RAM_IPA, SZ_2M) == 0);
+    CHECK_EQ(g_mm.in_use, 3);                   // Raiz, L2, L3
+
+    g_mm.tlbi_count = 0;
+    CHECK(stage2_merge(&s2, RAM_IPA, SZ_2M) == 0);
+    CHECK_EQ(g_mm.tlbi_count, 1);
+    check_tlbi(0, RAM_IPA, SZ_2M);
+    CHECK(stage2_lookup(&s2, RAM_IPA + SZ_4K, NULL, NULL, &level));
+    CHECK_EQ(level, 2);
+    CHECK_EQ(g_mm.in_use, 2);
+    test_teardown(&s2);
+}
+
+// Desmapear parte de um bloco divide, quebra a página e libera a tabela
+// quando ela fica vazia
+static void test_unmap(void)
+{
+    stage2_t s2;
+
+    test_setup(&s2, 39);
+    CHECK(stage2_map(&s2, RAM_IPA, RAM_IPA, SZ_2M, STAGE2_PERM_RW, STAGE2_MEM_NORMAL) == 0);
+    CHECK(stage2_unmap(&s2, RAM_IPA, SZ_4K) == 0);
+    CHECK(!stage2_lookup(&s2, RAM_IPA, NULL, NULL, NULL));
+    CHECK(stage2_lookup(&s2, RAM_IPA + SZ_4K, NULL, NULL, NULL));
+    for (uint32_t i = 0; i < g_mm.tlbi_count && i < TEST_MAX_TLBI; i++) {
+        CHECK(g_mm.tlbi[i].broken);
+    }
+
+    CHECK(stage2_unmap(&s2, RAM_IPA, SZ_2M) == 0);
+    CHECK(!stage2_lookup(&s2, RAM_IPA + SZ_4K, NULL, NULL, NULL));
+    CHECK_EQ(g_mm.in_use, 1);                   // Só a raiz: L2 e L3 vazias liberadas
+    test_teardown(&s2);
+}
+
+int main(void)
+{
+    RUN_TEST(test_descriptors);
+    RUN_TEST(test_vtcr);
+    RUN_TEST(test_map_invalid_no_tlbi);
+    RUN_TEST(test_split_breaks_block);
+    RUN_TEST(test_merge_breaks_table);
+    RUN_TEST(test_unmap);
+    return TEST_RESULT();
+}
@@ -0,0 +1,76 @@
+/* Desenvolvido por: Escanearcpl */
+#include "steal_time.h"
+#include "test_common.h"
+
+#define MS      1000000ULL
+
+// Parede além do tempo em CPU vira steal na hora
+static void test_credit_excess(void)
+{
+    uint64_t steal = 0;
+    int64_t balance = 0;
+
+    steal_time_credit(&steal, &balance, 3 * MS, 1 * MS);
+    CHECK_EQ(steal, 2 * MS);
+    CHECK_EQ(balance, 0);
+    steal_time_credit(&steal, &balance, 1 * MS, 1 * MS);
+    CHECK_EQ(steal, 2 * MS);
+}
+
+// Tempo de thread com granularidade de tick: amostras sem CPU seguidas de
+// uma com o tick inteiro. O déficit da última desconta das seguintes e o
+// total acompanha o steal real
+static void test_credit_carries_deficit(void)
+{
+    uint64_t steal = 0;
+    int64_t balance = 0;
+
+    steal_time_credit(&steal, &balance, 1 * MS, 0);
+    steal_time_credit(&steal, &balance, 1 * MS, 0);
+    CHECK_EQ(steal, 2 * MS);
+    steal_time_credit(&steal, &balance, 1 * MS, 5 * MS);
+    CHECK_EQ(steal, 2 * MS);
+    CHECK_EQ(balance, -(int64_t)(4 * MS));
+
+    steal_time_credit(&steal, &balance, 6 * MS, 1 * MS);
+    CHECK_EQ(steal, 3 * MS);
+    CHECK_EQ(balance, 0);
+}
+
+// Déficit limitado: CPU de janelas fora da parede não zera o steal futuro
+static void test_credit_deficit_capped(void)
+{
+    uint64_t steal = 7;
+    int64_t balance = 0;
+
+    steal_time_credit(&steal, &balance, 0, 1000 * MS);
+    CHECK_EQ(steal, 7);
+    CHECK_EQ(balance, -STEAL_TIME_CARRY_NS);
+
+    steal_time_credit(&steal, &balance, (uint64_t)STEAL_TIME_CARRY_NS + 10, 0);
+    CHECK_EQ(steal, 17);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+// Registro publicado pelo host, lido pelo guest fora de uma atualização
+static void test_read_record(void)
+{
+    steal_time_record_t record = { 0 };
+
+    CHECK_EQ(sizeof(record), STEAL_TIME_ALIGN);
+    record.steal_ns = 12345;
+    record.version = 2;
+    CHECK_EQ(steal_time_read_ns(&record), 12345);
+}
+#endif
+
+int main(void)
+{
+    RUN_TEST(test_credit_excess);
+    RUN_TEST(test_credit_carries_deficit);
+    RUN_TEST(test_credit_deficit_capped);
+#if defined(__GNUC__) || defined(__clang__)
+    RUN_TEST(test_read_record);
+#endif
+    return TEST_RESULT();
+}
@@ -0,0 +1,144 @@
+/* Desenvolvido por: Escanearcpl */
+#include "sysreg.h"
+#include "devices.h"
+#include "test_common.h"
+
+// Timer genérico emulado: o teste controla o relógio do host e registra o
+// nível que o emulador impõe a cada PPI.
+
+#define CNTV_TVAL_EL0       SYSREG_ENC(3, 3, 14, 3, 0)
+#define CNTV_CTL_EL0        SYSREG_ENC(3, 3, 14, 3, 1)
+#define CNTV_CVAL_EL0       SYSREG_ENC(3, 3, 14, 3, 2)
+#define CNTP_CTL_EL0        SYSREG_ENC(3, 3, 14, 2, 1)
+#define CNTP_CVAL_EL0       SYSREG_ENC(3, 3, 14, 2, 2)
+
+#define CTL_ENABLE          0x1
+#define CTL_IMASK           0x2
+#define CTL_ISTATUS         0x4
+
+#define PPI_VIRT            27
+#define PPI_PHYS            30
+
+static uint64_t g_now_ns;
+static bool g_line[32];
+static uint32_t g_asserts[32];
+static sysreg_vcpu_t g_vcpu;
+
+// ---------------------------------------------------------------------------
+// Dependências do emulador
+// ---------------------------------------------------------------------------
+
+uint64_t timer_get_time_ns(void)
+{
+    return g_now_ns;
+}
+
+void gic_set_ppi_level(uint32_t ppi, uint32_t vcpu, bool level)
+{
+    CHECK_EQ(vcpu, 0);
+    g_line[ppi] = level;
+    g_asserts[ppi] += level;
+}
+
+// ---------------------------------------------------------------------------
+
+static void msr(uint16_t enc, uint64_t value)
+{
+    CHECK(sysreg_access(&g_vcpu, enc, false, &value) == SYSREG_OK);
+}
+
+static uint64_t mrs(uint16_t enc)
+{
+    uint64_t value = 0;
+    CHECK(sysreg_access(&g_vcpu, enc, true, &value) == SYSREG_OK);
+    return value;
+}
+
+// Avança o relógio até o contador do guest chegar a ticks
+static void advance_to(uint64_t ticks)
+{
+    g_now_ns = ticks * (1000000000ULL / SYSREG_CNTFRQ);
+}
+
+static void setup(void)
+{
+    memset(g_line, 0, sizeof(g_line));
+    memset(g_asserts, 0, sizeof(g_asserts));
+    g_now_ns = 0;
+    CHECK(sysreg_init() == 0);
+    sysreg_vcpu_init(&g_vcpu, 0);
+}
+
+// Deadline futuro: a linha sobe no poll que o vê vencido, uma vez
+static void test_deadline_raises_line(void)
+{
+    setup();
+
+    msr(CNTV_CVAL_EL0, 1000);
+    msr(CNTV_CTL_EL0, CTL_ENABLE);
+    CHECK(!g_line[PPI_VIRT]);
+    CHECK_EQ(sysreg_timer_poll(&g_vcpu), 1000 * (1000000000ULL / SYSREG_CNTFRQ));
+
+    advance_to(1000);
+    CHECK_EQ(sysreg_timer_poll(&g_vcpu), UINT64_MAX);
+    CHECK(g_line[PPI_VIRT]);
+    CHECK_EQ(mrs(CNTV_CTL_EL0), CTL_ENABLE | CTL_ISTATUS);
+
+    // Sem mudança de nível o poll não reafirma o PPI
+    sysreg_timer_poll(&g_vcpu);
+    CHECK_EQ(g_asserts[PPI_VIRT], 1);
+    CHECK(!g_line[PPI_PHYS]);
+}
+
+// Cada forma de o guest tirar a condição de disparo baixa a linha
+static void test_line_lowered(void)
+{
+    setup();
+    advance_to(500);
+
+    msr(CNTV_CVAL_EL0, 100);
+    msr(CNTV_CTL_EL0, CTL_ENABLE);
+    CHECK(g_line[PPI_VIRT]);
+    msr(CNTV_CTL_EL0, CTL_ENABLE | CTL_IMASK);
+    CHECK(!g_line[PPI_VIRT]);
+
+    msr(CNTV_CTL_EL0, CTL_ENABLE);
+    CHECK(g_line[PPI_VIRT]);
+    msr(CNTV_CTL_EL0, 0);
+    CHECK(!g_line[PPI_VIRT]);
+
+    msr(CNTV_CTL_EL0, CTL_ENABLE);
+    CHECK(g_line[PPI_VIRT]);
+    msr(CNTV_CVAL_EL0, 2000);
+    CHECK(!g_line[PPI_VIRT]);
+
+    msr(CNTV_CVAL_EL0, 100);
+    CHECK(g_line[PPI_VIRT]);
+    msr(CNTV_TVAL_EL0, 100);
+    CHECK(!g_line[PPI_VIRT]);
+    sysreg_timer_poll(&g_vcpu);
+    CHECK(!g_line[PPI_VIRT]);
+}
+
+// Reprogramar um deadline já vencido reafirma o PPI que o guest reconheceu
+static void test_rearm_reasserts(void)
+{
+    setup();
+    advance_to(500);
+
+    msr(CNTP_CVAL_EL0, 100);
+    msr(CNTP_CTL_EL0, CTL_ENABLE);
+    CHECK_EQ(g_asserts[PPI_PHYS], 1);
+    msr(CNTP_CVAL_EL0, 200);
+    CHECK_EQ(g_asserts[PPI_PHYS], 2);
+    CHECK(g_line[PPI_PHYS]);
+    CHECK(!g_line[PPI_VIRT]);
+}
+
+int main(void)
+{
+    RUN_TEST(test_deadline_raises_line);
+    RUN_TEST(test_line_lowered);
+    RUN_TEST(test_rearm_reasserts);
+    return TEST_RESULT();
+}
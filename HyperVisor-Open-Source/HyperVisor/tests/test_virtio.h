@@ -0,0 +1,233 @@
+/* Desenvolvido por: Escanearcpl */
+#ifndef TEST_VIRTIO_H
+#define TEST_VIRTIO_H
+
+// Guest simulado para os testes de devices virtio: RAM em memória, stubs
+// do resto da VM (tradução de GPA, GIC, relógio) e um driver mínimo sobre
+// o transporte MMIO, com filas split de TEST_VQ_SIZE entradas e sem
+// EVENT_IDX. Incluído por um único arquivo de cada executável de teste.
+
+#include "virtio.h"
+#include "vm.h"
+#include "test_common.h"
+#include <string.h>
+
+#define TEST_RAM_GPA        0x40000000ULL
+#define TEST_RAM_SIZE       (4u * 1024 * 1024)
+#define TEST_DEV_SLOTS      8
+#define TEST_VQ_SIZE        16
+#define TEST_VQ_AREA        0x400       // desc, avail (+0x100) e used (+0x200) de uma fila
+#define TEST_HEAP_START     (TEST_DEV_SLOTS * VIRTIO_MAX_QUEUES * TEST_VQ_AREA)
+
+typedef struct {
+    void* addr;
+    uint32_t len;
+} test_seg_t;
+
+typedef struct {
+    uint32_t slot;
+    uint32_t index;
+    virtq_desc_t* desc;
+    virtq_avail_t* avail;
+    virtq_used_t* used;
+    uint16_t next_desc;                 // Descritores em rodízio
+    uint16_t last_used;
+    void* bufs[TEST_VQ_SIZE];           // Primeiro segmento de cada cabeça
+} test_vq_t;
+
+static uint64_t g_test_ram[TEST_RAM_SIZE / 8];
+static uint32_t g_test_heap = TEST_HEAP_START;
+static volatile LONG g_test_irqs[TEST_DEV_SLOTS];
+
+// ---------------------------------------------------------------------------
+// Dependências da VM
+// ---------------------------------------------------------------------------
+
+uint32_t g_guest_pa_bits = 40;
+
+void* vm_gpa_to_hva(uint64_t guest_addr, uint64_t size)
+{
+    if (guest_addr < TEST_RAM_GPA || guest_addr - TEST_RAM_GPA > TEST_RAM_SIZE ||
+        size > TEST_RAM_SIZE - (guest_addr - TEST_RAM_GPA)) {
+        return NULL;
+    }
+    return (uint8_t*)g_test_ram + (guest_addr - TEST_RAM_GPA);
+}
+
+void gic_set_interrupt(uint32_t irq_num, bool pending)
+{
+    if (pending && irq_num >= VIRTIO_IRQ_BASE && irq_num < VIRTIO_IRQ_BASE + TEST_DEV_SLOTS) {
+        InterlockedIncrement(&g_test_irqs[irq_num - VIRTIO_IRQ_BASE]);
+    }
+}
+
+void devices_signal_change(device_id_t id)
+{
+    (void)id;
+}
+
+uint64_t timer_get_time_ns(void)
+{
+    return 1000000000ULL;
+}
+
+// ---------------------------------------------------------------------------
+// RAM do guest
+// ---------------------------------------------------------------------------
+
+static inline uint64_t test_gpa(const void* p)
+{
+    return TEST_RAM_GPA + (uint64_t)((const uint8_t*)p - (const uint8_t*)g_test_ram);
+}
+
+// Buffers do guest depois dos anéis, alinhados a 16 bytes
+static inline void* test_alloc(uint32_t size)
+{
+    uint8_t* p = (uint8_t*)g_test_ram + g_test_heap;
+
+    g_test_heap += (size + 15) & ~15u;
+    CHECK(g_test_heap <= TEST_RAM_SIZE);
+    memset(p, 0, size);
+    return p;
+}
+
+// Entre testes, depois de virtio_mmio_cleanup()
+static inline void test_ram_reset(void)
+{
+    memset(g_test_ram, 0, sizeof(g_test_ram));
+    g_test_heap = TEST_HEAP_START;
+    for (uint32_t i = 0; i < TEST_DEV_SLOTS; i++) {
+        g_test_irqs[i] = 0;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Driver
+// ---------------------------------------------------------------------------
+
+static inline uint32_t test_mmio_read(uint32_t slot, uint32_t reg)
+{
+    device_io_t io;
+
+    memset(&io, 0, sizeof(io));
+    io.address = VIRTIO_MMIO_BASE + (uint64_t)slot * VIRTIO_MMIO_SLOT_SIZE + reg;
+    io.size = 4;
+    CHECK(virtio_mmio_handle_access(&io) == DEVICE_ACCESS_OK);
+    return (uint32_t)io.data;
+}
+
+static inline void test_mmio_write(uint32_t slot, uint32_t reg, uint32_t value)
+{
+    device_io_t io;
+
+    memset(&io, 0, sizeof(io));
+    io.address = VIRTIO_MMIO_BASE + (uint64_t)slot * VIRTIO_MMIO_SLOT_SIZE + reg;
+    io.data = value;
+    io.size = 4;
+    io.is_write = true;
+    CHECK(virtio_mmio_handle_access(&io) == DEVICE_ACCESS_OK);
+}
+
+static inline void test_mmio_write64(uint32_t slot, uint32_t reg, uint64_t value)
+{
+    test_mmio_write(slot, reg, (uint32_t)value);
+    test_mmio_write(slot, reg + 4, (uint32_t)(value >> 32));
+}
+
+// Sequência de inicialização (seção 3.1.1) com os features dados e as
+// filas em áreas fixas por slot; falso se o device recusar
+static inline bool test_virtio_init(uint32_t slot, uint64_t features, test_vq_t* vqs, uint32_t num_queues)
+{
+    const uint32_t status = VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER;
+
+    test_mmio_write(slot, VIRTIO_MMIO_STATUS, 0);
+    test_mmio_write(slot, VIRTIO_MMIO_STATUS, status);
+    test_mmio_write(slot, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 0);
+    test_mmio_write(slot, VIRTIO_MMIO_DRIVER_FEATURES, (uint32_t)features);
+    test_mmio_write(slot, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 1);
+    test_mmio_write(slot, VIRTIO_MMIO_DRIVER_FEATURES, (uint32_t)(features >> 32));
+    test_mmio_write(slot, VIRTIO_MMIO_STATUS, status | VIRTIO_STATUS_FEATURES_OK);
+    if (!(test_mmio_read(slot, VIRTIO_MMIO_STATUS) & VIRTIO_STATUS_FEATURES_OK)) {
+        return false;
+    }
+
+    for (uint32_t q = 0; q < num_queues; q++) {
+        test_vq_t* vq = &vqs[q];
+        uint8_t* area = (uint8_t*)g_test_ram + (slot * VIRTIO_MAX_QUEUES + q) * TEST_VQ_AREA;
+
+        memset(area, 0, TEST_VQ_AREA);
+        memset(vq, 0, sizeof(*vq));
+        vq->slot = slot;
+        vq->index = q;
+        vq->desc = (virtq_desc_t*)area;
+        vq->avail = (virtq_avail_t*)(area + 0x100);
+        vq->used = (virtq_used_t*)(area + 0x200);
+
+        test_mmio_write(slot, VIRTIO_MMIO_QUEUE_SEL, q);
+        test_mmio_write(slot, VIRTIO_MMIO_QUEUE_NUM, TEST_VQ_SIZE);
+        test_mmio_write64(slot, VIRTIO_MMIO_QUEUE_DESC_LOW, test_gpa(vq->desc));
+        test_mmio_write64(slot, VIRTIO_MMIO_QUEUE_DRIVER_LOW, test_gpa(vq->avail));
+        test_mmio_write64(slot, VIRTIO_MMIO_QUEUE_DEVICE_LOW, test_gpa(vq->used));
+        test_mmio_write(slot, VIRTIO_MMIO_QUEUE_READY, 1);
+        CHECK_EQ(test_mmio_read(slot, VIRTIO_MMIO_QUEUE_READY), 1);
+    }
+
+    test_mmio_write(slot, VIRTIO_MMIO_STATUS, status | VIRTIO_STATUS_FEATURES_OK | VIRTIO_STATUS_DRIVER_OK);
+    return true;
+}
+
+// Publica uma cadeia (lidos pelo device, depois escritos); não notifica
+static inline uint16_t test_vq_add(test_vq_t* vq, const test_seg_t* out, uint32_t out_num,
+                                   const test_seg_t* in, uint32_t in_num)
+{
+    uint16_t head = vq->next_desc;
+    uint32_t total = out_num + in_num;
+
+    for (uint32_t i = 0; i < total; i++) {
+        const test_seg_t* seg = i < out_num ? &out[i] : &in[i - out_num];
+        uint16_t d = (uint16_t)((head + i) % TEST_VQ_SIZE);
+
+        vq->desc[d].addr = test_gpa(seg->addr);
+        vq->desc[d].len = seg->len;
+        vq->desc[d].flags = (uint16_t)((i >= out_num ? VIRTQ_DESC_F_WRITE : 0) |
+                                       (i + 1 < total ? VIRTQ_DESC_F_NEXT : 0));
+        vq->desc[d].next = (uint16_t)((d + 1) % TEST_VQ_SIZE);
+    }
+    vq->next_desc = (uint16_t)((head + total) % TEST_VQ_SIZE);
+    vq->bufs[head] = out_num ? out[0].addr : in[0].addr;
+
+    // Descritores antes da entrada do anel, a entrada antes de idx
+    MemoryBarrier();
+    vq->avail->ring[vq->avail->idx % TEST_VQ_SIZE] = head;
+    MemoryBarrier();
+    vq->avail->idx++;
+    return head;
+}
+
+static inline void test_vq_kick(test_vq_t* vq)
+{
+    test_mmio_write(vq->slot, VIRTIO_MMIO_QUEUE_NOTIFY, vq->index);
+}
+
+// Cadeias devolvidas e ainda não lidas pelo driver
+static inline uint16_t test_vq_pending(const test_vq_t* vq)
+{
+    return (uint16_t)(*(volatile uint16_t*)&vq->used->idx - vq->last_used);
+}
+
+// Próxima cadeia devolvida; falso se o device não devolveu nenhuma
+static inline bool test_vq_used(test_vq_t* vq, uint16_t* head, uint32_t* len)
+{
+    if (!test_vq_pending(vq)) {
+        return false;
+    }
+
+    MemoryBarrier();
+    virtq_used_elem_t elem = vq->used->ring[vq->last_used % TEST_VQ_SIZE];
+    vq->last_used++;
+    *head = (uint16_t)elem.id;
+    *len = elem.len;
+    return true;
+}
+
+#endif // TEST_VIRTIO_H
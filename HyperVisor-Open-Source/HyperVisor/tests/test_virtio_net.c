@@ -0,0 +1,454 @@
+/* Desenvolvido por: Escanearcpl */
+#include "vswitch.h"
+#include "test_virtio.h"
+
+// Placas virtio-net ligadas pelo switch do processo, dirigidas por guests
+// simulados através do transporte MMIO: offloads entre placas com e sem
+// cada feature, buffers de RX mergeable e escolha da fila de RX por fluxo.
+
+#define VIRTIO_NET_F_CSUM           (1ULL << 0)
+#define VIRTIO_NET_F_GUEST_CSUM     (1ULL << 1)
+#define VIRTIO_NET_F_GUEST_TSO4     (1ULL << 7)
+#define VIRTIO_NET_F_HOST_TSO4      (1ULL << 11)
+#define VIRTIO_NET_F_MRG_RXBUF      (1ULL << 15)
+#define VIRTIO_NET_F_CTRL_VQ        (1ULL << 17)
+#define VIRTIO_NET_F_MQ             (1ULL << 22)
+
+#define TEST_NICS                   3
+#define TEST_RX_BUF                 1536
+#define TEST_FRAME_MAX              8192
+#define TEST_HDRS                   54      // Ethernet + IPv4 + TCP sem opções
+#define TEST_MSS                    1000
+
+typedef struct {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t num_buffers;
+} test_net_hdr_t;
+
+typedef struct {
+    uint32_t slot;
+    test_vq_t vqs[VIRTIO_MAX_QUEUES];
+} test_nic_t;
+
+static test_nic_t g_nics[TEST_NICS];
+static uint32_t g_nic_count;
+static uint8_t g_frame[TEST_FRAME_MAX];
+static uint8_t g_rx[TEST_FRAME_MAX];
+
+// ---------------------------------------------------------------------------
+// Frames
+// ---------------------------------------------------------------------------
+
+static uint16_t test_get16(const uint8_t* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void test_put16(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint32_t test_sum(uint32_t sum, const uint8_t* p, uint32_t len)
+{
+    for (; len > 1; p += 2, len -= 2) {
+        sum += test_get16(p);
+    }
+    if (len) {
+        sum += (uint32_t)p[0] << 8;
+    }
+    return sum;
+}
+
+static uint16_t test_fold(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+static uint32_t test_pseudo(const uint8_t* ip, uint32_t tcp_len)
+{
+    return test_sum(0, ip + 12, 8) + 6 + tcp_len;
+}
+
+static bool test_tcp_csum_ok(const uint8_t* frame, uint32_t len)
+{
+    uint32_t tcp_len = len - 34;
+    return test_fold(test_sum(test_pseudo(frame + 14, tcp_len), frame + 34, tcp_len)) == 0xFFFF;
+}
+
+// Broadcast TCP/IPv4 para g_frame; o campo de checksum leva só o
+// pseudo-cabeçalho, como o driver envia com NEEDS_CSUM
+static uint32_t test_tcp_frame(uint16_t sport, uint32_t payload, uint8_t tcp_flags)
+{
+    static const uint8_t src_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    static const uint8_t addrs[8] = { 10, 0, 0, 1, 10, 0, 0, 2 };
+    uint8_t* ip = g_frame + 14;
+    uint8_t* tcp = g_frame + 34;
+    uint32_t len = TEST_HDRS + payload;
+
+    memset(g_frame, 0, TEST_HDRS);
+    memset(g_frame, 0xFF, 6);
+    memcpy(g_frame + 6, src_mac, sizeof(src_mac));
+    test_put16(g_frame + 12, 0x0800);
+
+    ip[0] = 0x45;
+    test_put16(ip + 2, len - 14);
+    test_put16(ip + 4, 100);
+    test_put16(ip + 6, 0x4000);
+    ip[8] = 64;
+    ip[9] = 6;
+    memcpy(ip + 12, addrs, sizeof(addrs));
+    test_put16(ip + 10, (uint16_t)~test_fold(test_sum(0, ip, 20)));
+
+    test_put16(tcp, sport);
+    test_put16(tcp + 2, 80);
+    test_put16(tcp + 6, 1000);
+    test_put16(tcp + 10, 1);
+    tcp[12] = 5 << 4;
+    tcp[13] = tcp_flags;
+    test_put16(tcp + 14, 0xFFFF);
+    test_put16(tcp + 16, test_fold(test_pseudo(ip, len - 34)));
+
+    for (uint32_t i = 0; i < payload; i++) {
+        g_frame[TEST_HDRS + i] = (uint8_t)(i * 7);
+    }
+    return len;
+}
+
+// ---------------------------------------------------------------------------
+// Placas
+// ---------------------------------------------------------------------------
+
+static uint32_t test_nic_queues(uint32_t pairs)
+{
+    return pairs > 1 ? 2 * pairs + 1 : 2;
+}
+
+static test_nic_t* test_nic_create(uint32_t pairs, uint64_t features)
+{
+    test_nic_t* nic = &g_nics[g_nic_count];
+
+    CHECK(virtio_net_create("", pairs) == 0);
+    nic->slot = g_nic_count++;
+    CHECK_EQ(test_mmio_read(nic->slot, VIRTIO_MMIO_DEVICE_ID), VIRTIO_ID_NET);
+    CHECK(test_virtio_init(nic->slot, VIRTIO_F_VERSION_1 | features, nic->vqs, test_nic_queues(pairs)));
+    return nic;
+}
+
+static void test_teardown(void)
+{
+    virtio_mmio_cleanup();
+    test_ram_reset();
+    g_nic_count = 0;
+}
+
+static void test_nic_post_rx(test_nic_t* nic, uint32_t queue, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        test_seg_t in = { test_alloc(TEST_RX_BUF), TEST_RX_BUF };
+        test_vq_add(&nic->vqs[queue], NULL, 0, &in, 1);
+    }
+    test_vq_kick(&nic->vqs[queue]);
+}
+
+// Cabeçalho e frame em descritores separados; o TX é consumido na hora
+static void test_nic_send(test_nic_t* nic, const test_net_hdr_t* hdr, uint32_t len)
+{
+    test_vq_t* vq = &nic->vqs[1];
+    test_seg_t out[2] = {
+        { test_alloc(sizeof(*hdr)), sizeof(*hdr) },
+        { test_alloc(len), len },
+    };
+    uint16_t head;
+    uint32_t used_len;
+
+    memcpy(out[0].addr, hdr, sizeof(*hdr));
+    memcpy(out[1].addr, g_frame, len);
+    uint16_t sent = test_vq_add(vq, out, 2, NULL, 0);
+    test_vq_kick(vq);
+    CHECK(test_vq_used(vq, &head, &used_len));
+    CHECK_EQ(head, sent);
+}
+
+// Próximo frame da fila para g_rx, reunindo os num_buffers buffers;
+// 0 se não chegou nada
+static uint32_t test_nic_recv(test_nic_t* nic, uint32_t queue, test_net_hdr_t* hdr)
+{
+    test_vq_t* vq = &nic->vqs[queue];
+    uint16_t head;
+    uint32_t len;
+
+    if (!test_vq_used(vq, &head, &len)) {
+        return 0;
+    }
+    CHECK(len >= sizeof(*hdr) && len <= TEST_RX_BUF);
+    memcpy(hdr, vq->bufs[head], sizeof(*hdr));
+
+    uint32_t total = len - (uint32_t)sizeof(*hdr);
+    memcpy(g_rx, (const uint8_t*)vq->bufs[head] + sizeof(*hdr), total);
+    for (uint16_t i = 1; i < hdr->num_buffers; i++) {
+        if (!test_vq_used(vq, &head, &len) || total + len > TEST_FRAME_MAX) {
+            CHECK(false);
+            break;
+        }
+        memcpy(g_rx + total, vq->bufs[head], len);
+        total += len;
+    }
+    return total;
+}
+
+// Fila de RX que recebeu o último frame (uma só), ou -1
+static int test_nic_rx_queue(test_nic_t* nic, uint32_t pairs)
+{
+    int found = -1;
+
+    for (uint32_t pair = 0; pair < pairs; pair++) {
+        if (test_vq_pending(&nic->vqs[2 * pair])) {
+            CHECK(found < 0);
+            found = (int)(2 * pair);
+        }
+    }
+    return found;
+}
+
+// ---------------------------------------------------------------------------
+// Testes
+// ---------------------------------------------------------------------------
+
+// GSO de quem tem HOST_TSO4 chega segmentado a quem não tem GUEST_TSO4
+static void test_tso_to_plain_guest(void)
+{
+    test_nic_t* tx = test_nic_create(1, VIRTIO_NET_F_CSUM | VIRTIO_NET_F_HOST_TSO4);
+    test_nic_t* rx = test_nic_create(1, 0);
+    test_net_hdr_t hdr = { 1, VSWITCH_GSO_TCPV4, TEST_HDRS, TEST_MSS, 34, 16, 0 };
+    test_net_hdr_t got;
+    const uint32_t payload = 3500;
+
+    test_nic_post_rx(rx, 0, 8);
+    test_nic_send(tx, &hdr, test_tcp_frame(40000, payload, 0x19));
+
+    for (uint32_t n = 0; n < 4; n++) {
+        uint32_t chunk = n < 3 ? TEST_MSS : payload - 3 * TEST_MSS;
+        uint32_t len = test_nic_recv(rx, 0, &got);
+
+        CHECK_EQ(len, TEST_HDRS + chunk);
+        CHECK_EQ(got.flags, 0);
+        CHECK_EQ(got.gso_type, VSWITCH_GSO_NONE);
+        CHECK_EQ(got.num_buffers, 1);
+        CHECK_EQ(test_get16(g_rx + 14 + 2), 40 + chunk);
+        CHECK_EQ(test_get16(g_rx + 14 + 4), 100 + n);
+        CHECK_EQ(test_fold(test_sum(0, g_rx + 14, 20)), 0xFFFF);
+        CHECK_EQ(test_get16(g_rx + 34 + 6), 1000 + n * TEST_MSS);
+        CHECK_EQ(g_rx[34 + 13], n == 3 ? 0x19 : 0x10);
+        CHECK(len >= TEST_HDRS && test_tcp_csum_ok(g_rx, len));
+        CHECK(memcmp(g_rx + TEST_HDRS, g_frame + TEST_HDRS + n * TEST_MSS, chunk) == 0);
+    }
+    CHECK_EQ(test_vq_pending(&rx->vqs[0]), 0);
+
+    // Uma interrupção de RX para o lote
+    CHECK(test_mmio_read(rx->slot, VIRTIO_MMIO_INTERRUPT_STATUS) & VIRTIO_INT_USED_RING);
+    CHECK_EQ(g_test_irqs[rx->slot], 1);
+
+    test_teardown();
+}
+
+// Checksum parcial: completado para quem não tem GUEST_CSUM, repassado a
+// quem tem
+static void test_csum_fill(void)
+{
+    test_nic_t* tx = test_nic_create(1, VIRTIO_NET_F_CSUM);
+    test_nic_t* plain = test_nic_create(1, 0);
+    test_nic_t* offload = test_nic_create(1, VIRTIO_NET_F_GUEST_CSUM);
+    test_net_hdr_t hdr = { 1, VSWITCH_GSO_NONE, 0, 0, 34, 16, 0 };
+    test_net_hdr_t got;
+
+    test_nic_post_rx(plain, 0, 2);
+    test_nic_post_rx(offload, 0, 2);
+    uint32_t len = test_tcp_frame(40000, 301, 0x18);
+    test_nic_send(tx, &hdr, len);
+
+    CHECK_EQ(test_nic_recv(plain, 0, &got), len);
+    CHECK_EQ(got.flags, 0);
+    CHECK(test_tcp_csum_ok(g_rx, len));
+    CHECK(memcmp(g_rx, g_frame, 50) == 0);
+    CHECK(memcmp(g_rx + 52, g_frame + 52, len - 52) == 0);
+
+    CHECK_EQ(test_nic_recv(offload, 0, &got), len);
+    CHECK_EQ(got.flags, 1);
+    CHECK_EQ(got.csum_start, 34);
+    CHECK_EQ(got.csum_offset, 16);
+    CHECK(memcmp(g_rx, g_frame, len) == 0);
+
+    test_teardown();
+}
+
+// Offload que o driver de TX não negociou: o frame não sai da placa
+static void test_offload_not_negotiated(void)
+{
+    test_nic_t* tx = test_nic_create(1, VIRTIO_NET_F_CSUM);
+    test_nic_t* rx = test_nic_create(1, VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_GUEST_TSO4);
+    test_net_hdr_t gso = { 1, VSWITCH_GSO_TCPV4, TEST_HDRS, TEST_MSS, 34, 16, 0 };
+    test_net_hdr_t plain = { 0, VSWITCH_GSO_NONE, 0, 0, 0, 0, 0 };
+    test_net_hdr_t got;
+
+    test_nic_post_rx(rx, 0, 2);
+    test_nic_send(tx, &gso, test_tcp_frame(40000, 1200, 0x10));
+    CHECK_EQ(test_vq_pending(&rx->vqs[0]), 0);
+
+    uint32_t len = test_tcp_frame(40000, 100, 0x10);
+    test_nic_send(tx, &plain, len);
+    CHECK_EQ(test_nic_recv(rx, 0, &got), len);
+
+    test_teardown();
+}
+
+// MRG_RXBUF: um frame GSO maior que um buffer ocupa vários, com
+// num_buffers no cabeçalho do primeiro; sem o feature o frame é
+// descartado e os buffers voltam ao anel
+static void test_mergeable_rx(void)
+{
+    test_nic_t* tx = test_nic_create(1, VIRTIO_NET_F_CSUM | VIRTIO_NET_F_HOST_TSO4);
+    test_nic_t* mrg = test_nic_create(1, VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_GUEST_TSO4 |
+                                         VIRTIO_NET_F_MRG_RXBUF);
+    test_nic_t* single = test_nic_create(1, VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_GUEST_TSO4);
+    test_net_hdr_t hdr = { 1, VSWITCH_GSO_TCPV4, TEST_HDRS, TEST_MSS, 34, 16, 0 };
+    test_net_hdr_t got;
+    uint16_t head;
+    uint32_t used_len;
+
+    test_nic_post_rx(mrg, 0, 4);
+    test_nic_post_rx(single, 0, 4);
+    uint32_t len = test_tcp_frame(40000, 3500, 0x18);
+    test_nic_send(tx, &hdr, len);
+
+    CHECK_EQ(test_vq_pending(&mrg->vqs[0]), 3);
+    CHECK_EQ(test_nic_recv(mrg, 0, &got), len);
+    CHECK_EQ(got.num_buffers, 3);
+    CHECK_EQ(got.flags, 1);
+    CHECK_EQ(got.gso_type, VSWITCH_GSO_TCPV4);
+    CHECK_EQ(got.gso_size, TEST_MSS);
+    CHECK(memcmp(g_rx, g_frame, len) == 0);
+
+    CHECK_EQ(test_vq_pending(&single->vqs[0]), 0);
+    CHECK_EQ(mrg->vqs[0].used->ring[2].len, len + sizeof(test_net_hdr_t) - 2 * TEST_RX_BUF);
+
+    // O próximo frame usa o primeiro buffer, devolvido pelo descarte
+    hdr.gso_type = VSWITCH_GSO_NONE;
+    hdr.gso_size = 0;
+    len = test_tcp_frame(40000, 100, 0x18);
+    test_nic_send(tx, &hdr, len);
+    CHECK(test_vq_used(&single->vqs[0], &head, &used_len));
+    CHECK_EQ(head, 0);
+    CHECK_EQ(used_len, len + sizeof(test_net_hdr_t));
+
+    test_teardown();
+}
+
+// Multiqueue: VQ_PAIRS_SET pela fila de controle e a fila de RX pelo hash
+// do fluxo, sempre a mesma para o mesmo fluxo
+static void test_multiqueue(void)
+{
+    const uint32_t pairs = 4;
+    const uint32_t ctrl = 2 * pairs;
+    test_nic_t* tx = test_nic_create(1, 0);
+    test_nic_t* rx = test_nic_create(pairs, VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ);
+    test_net_hdr_t hdr = { 0, VSWITCH_GSO_NONE, 0, 0, 0, 0, 0 };
+    test_net_hdr_t got;
+    int queues[16] = { 0 };
+    uint32_t used_mask = 0;
+
+    for (uint32_t pair = 0; pair < pairs; pair++) {
+        test_nic_post_rx(rx, 2 * pair, 4);
+    }
+
+    // Antes do comando, só o primeiro par
+    for (uint16_t flow = 0; flow < 4; flow++) {
+        test_nic_send(tx, &hdr, test_tcp_frame((uint16_t)(40000 + flow), 10, 0x10));
+        CHECK_EQ(test_nic_rx_queue(rx, pairs), 0);
+        test_nic_recv(rx, 0, &got);
+        test_nic_post_rx(rx, 0, 1);
+    }
+
+    // Pares fora de 1..max recusados, depois 4 aceitos
+    const uint16_t requests[3] = { 0, 5, 4 };
+    for (uint32_t i = 0; i < 3; i++) {
+        uint8_t* cmd = (uint8_t*)test_alloc(4);
+        uint8_t* ack = (uint8_t*)test_alloc(1);
+        test_seg_t out = { cmd, 4 };
+        test_seg_t in = { ack, 1 };
+        uint16_t head;
+        uint32_t used_len;
+
+        cmd[0] = 4;                     // VIRTIO_NET_CTRL_MQ
+        cmd[1] = 0;                     // VQ_PAIRS_SET
+        memcpy(cmd + 2, &requests[i], sizeof(uint16_t));
+        *ack = 0xFF;
+        test_vq_add(&rx->vqs[ctrl], &out, 1, &in, 1);
+        test_vq_kick(&rx->vqs[ctrl]);
+        CHECK(test_vq_used(&rx->vqs[ctrl], &head, &used_len));
+        CHECK_EQ(used_len, 1);
+        CHECK_EQ(*ack, requests[i] == pairs ? 0 : 1);
+    }
+
+    for (uint32_t round = 0; round < 2; round++) {
+        for (uint16_t flow = 0; flow < 16; flow++) {
+            test_nic_send(tx, &hdr, test_tcp_frame((uint16_t)(40000 + flow), 10, 0x10));
+            int queue = test_nic_rx_queue(rx, pairs);
+            CHECK(queue >= 0);
+            if (queue < 0) {
+                continue;
+            }
+            if (round == 0) {
+                queues[flow] = queue;
+                used_mask |= 1u << queue;
+            } else {
+                CHECK_EQ(queue, queues[flow]);
+            }
+            CHECK(test_nic_recv(rx, (uint32_t)queue, &got) > 0);
+            CHECK_EQ(test_get16(g_rx + 34), 40000 + flow);
+            test_nic_post_rx(rx, (uint32_t)queue, 1);
+        }
+    }
+    // Fluxos espalhados por mais de uma fila
+    CHECK(used_mask != 0 && (used_mask & (used_mask - 1)) != 0);
+
+    // Frame sem IP não tem fluxo: primeiro par
+    uint32_t len = test_tcp_frame(40000, 10, 0x10);
+    test_put16(g_frame + 12, 0x88B5);
+    test_nic_send(tx, &hdr, len);
+    CHECK_EQ(test_nic_rx_queue(rx, pairs), 0);
+
+    // Reset do device volta a um par
+    CHECK(test_virtio_init(rx->slot, VIRTIO_F_VERSION_1 | VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ,
+                           rx->vqs, test_nic_queues(pairs)));
+    for (uint32_t pair = 0; pair < pairs; pair++) {
+        test_nic_post_rx(rx, 2 * pair, 2);
+    }
+    for (uint16_t flow = 0; flow < 4; flow++) {
+        test_nic_send(tx, &hdr, test_tcp_frame((uint16_t)(40000 + flow), 10, 0x10));
+    }
+    CHECK_EQ(test_vq_pending(&rx->vqs[0]), 2);
+    CHECK_EQ(test_vq_pending(&rx->vqs[2]) + test_vq_pending(&rx->vqs[4]) + test_vq_pending(&rx->vqs[6]), 0);
+
+    test_teardown();
+}
+
+int main(void)
+{
+    RUN_TEST(test_tso_to_plain_guest);
+    RUN_TEST(test_csum_fill);
+    RUN_TEST(test_offload_not_negotiated);
+    RUN_TEST(test_mergeable_rx);
+    RUN_TEST(test_multiqueue);
+    vswitch_cleanup();
+    return TEST_RESULT();
+}
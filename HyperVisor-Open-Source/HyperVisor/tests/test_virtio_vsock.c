@@ -0,0 +1,425 @@
+/* Desenvolvido por: Escanearcpl */
+#include <winsock2.h>
+#include <afunix.h>
+#include "test_virtio.h"
+
+// virtio-vsock com o lado do host em sockets AF_UNIX reais: o teste é ao
+// mesmo tempo o guest (filas pelo transporte MMIO) e os serviços do host
+// (sockets no diretório corrente). A thread de I/O do device roda de
+// verdade, então cada pacote esperado é aguardado com limite de tempo.
+
+#define TEST_PATH               "test_vsock.sock"
+#define TEST_SERVICE_PATH       "test_vsock.sock_5000"
+#define TEST_GUEST_CID          3
+#define TEST_HOST_CID           2
+#define TEST_SERVICE_PORT       5000
+#define TEST_GUEST_PORT         1234
+#define TEST_EPHEMERAL_PORT     49152
+#define TEST_HOST_BUF_ALLOC     (256 * 1024)
+
+#define TEST_RX_BUFS            8
+#define TEST_RX_BUF             4096
+#define TEST_WAIT_MS            2000
+
+#define VSOCK_QUEUE_RX          0
+#define VSOCK_QUEUE_TX          1
+#define VSOCK_QUEUES            3
+
+#define VIRTIO_VSOCK_TYPE_STREAM        1
+#define VIRTIO_VSOCK_OP_REQUEST         1
+#define VIRTIO_VSOCK_OP_RESPONSE        2
+#define VIRTIO_VSOCK_OP_RST             3
+#define VIRTIO_VSOCK_OP_SHUTDOWN        4
+#define VIRTIO_VSOCK_OP_RW              5
+#define VIRTIO_VSOCK_OP_CREDIT_UPDATE   6
+#define VIRTIO_VSOCK_OP_CREDIT_REQUEST  7
+#define VIRTIO_VSOCK_SHUTDOWN_BOTH      3
+
+#pragma pack(push, 1)
+typedef struct {
+    uint64_t src_cid;
+    uint64_t dst_cid;
+    uint32_t src_port;
+    uint32_t dst_port;
+    uint32_t len;
+    uint16_t type;
+    uint16_t op;
+    uint32_t flags;
+    uint32_t buf_alloc;
+    uint32_t fwd_cnt;
+} test_vsock_hdr_t;
+#pragma pack(pop)
+
+static test_vq_t g_vqs[VSOCK_QUEUES];
+static uint8_t g_pkt[TEST_RX_BUF];
+
+// ---------------------------------------------------------------------------
+// Lado do guest
+// ---------------------------------------------------------------------------
+
+static void test_setup(void)
+{
+    test_vq_t* rx = &g_vqs[VSOCK_QUEUE_RX];
+
+    CHECK(virtio_vsock_create(TEST_GUEST_CID, TEST_PATH) == 0);
+    CHECK_EQ(test_mmio_read(0, VIRTIO_MMIO_DEVICE_ID), VIRTIO_ID_VSOCK);
+    CHECK_EQ(test_mmio_read(0, VIRTIO_MMIO_CONFIG), TEST_GUEST_CID);
+    CHECK(test_virtio_init(0, VIRTIO_F_VERSION_1, g_vqs, VSOCK_QUEUES));
+
+    for (uint32_t i = 0; i < TEST_RX_BUFS; i++) {
+        test_seg_t in = { test_alloc(TEST_RX_BUF), TEST_RX_BUF };
+        test_vq_add(rx, NULL, 0, &in, 1);
+    }
+    test_vq_kick(rx);
+}
+
+static void test_teardown(void)
+{
+    virtio_mmio_cleanup();
+    test_ram_reset();
+}
+
+// Próximo pacote de RX, copiado para g_pkt; o buffer volta ao anel. NULL
+// se nada chegou em TEST_WAIT_MS
+static const test_vsock_hdr_t* test_rx(const uint8_t** data)
+{
+    test_vq_t* vq = &g_vqs[VSOCK_QUEUE_RX];
+    uint16_t head;
+    uint32_t len;
+
+    for (uint32_t waited = 0; !test_vq_used(vq, &head, &len); waited++) {
+        if (waited == TEST_WAIT_MS) {
+            return NULL;
+        }
+        Sleep(1);
+    }
+
+    const test_vsock_hdr_t* hdr = (const test_vsock_hdr_t*)vq->bufs[head];
+    CHECK(len >= sizeof(*hdr) && len <= TEST_RX_BUF);
+    CHECK_EQ(len, sizeof(*hdr) + hdr->len);
+    CHECK_EQ(hdr->src_cid, TEST_HOST_CID);
+    CHECK_EQ(hdr->dst_cid, TEST_GUEST_CID);
+    memcpy(g_pkt, hdr, len <= TEST_RX_BUF ? len : TEST_RX_BUF);
+
+    test_seg_t in = { vq->bufs[head], TEST_RX_BUF };
+    test_vq_add(vq, NULL, 0, &in, 1);
+    test_vq_kick(vq);
+
+    if (data) {
+        *data = g_pkt + sizeof(*hdr);
+    }
+    return (const test_vsock_hdr_t*)g_pkt;
+}
+
+// Próximo pacote deve ter a operação dada
+static const test_vsock_hdr_t* test_rx_op(uint16_t op, const uint8_t** data)
+{
+    const test_vsock_hdr_t* hdr = test_rx(data);
+
+    CHECK(hdr != NULL);
+    if (hdr) {
+        CHECK_EQ(hdr->op, op);
+    }
+    return hdr;
+}
+
+// Pacote do guest; espera o device consumir a cadeia
+static void test_tx(uint32_t src_port, uint32_t dst_port, uint16_t op, uint32_t flags,
+                    uint32_t buf_alloc, uint32_t fwd_cnt, const void* data, uint32_t len)
+{
+    test_vq_t* vq = &g_vqs[VSOCK_QUEUE_TX];
+    test_vsock_hdr_t* hdr = (test_vsock_hdr_t*)test_alloc((uint32_t)sizeof(*hdr) + len);
+    test_seg_t out = { hdr, (uint32_t)sizeof(*hdr) + len };
+    uint16_t head;
+    uint32_t used_len;
+
+    hdr->src_cid = TEST_GUEST_CID;
+    hdr->dst_cid = TEST_HOST_CID;
+    hdr->src_port = src_port;
+    hdr->dst_port = dst_port;
+    hdr->len = len;
+    hdr->type = VIRTIO_VSOCK_TYPE_STREAM;
+    hdr->op = op;
+    hdr->flags = flags;
+    hdr->buf_alloc = buf_alloc;
+    hdr->fwd_cnt = fwd_cnt;
+    if (len) {
+        memcpy(hdr + 1, data, len);
+    }
+
+    uint16_t sent = test_vq_add(vq, &out, 1, NULL, 0);
+    test_vq_kick(vq);
+    for (uint32_t waited = 0; !test_vq_used(vq, &head, &used_len) && waited < TEST_WAIT_MS; waited++) {
+        Sleep(1);
+    }
+    CHECK_EQ(head, sent);
+}
+
+// ---------------------------------------------------------------------------
+// Lado do host
+// ---------------------------------------------------------------------------
+
+static void test_unix_addr(struct sockaddr_un* addr, const char* path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", path);
+}
+
+static SOCKET test_listen(const char* path)
+{
+    struct sockaddr_un addr;
+    SOCKET sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    test_unix_addr(&addr, path);
+    DeleteFileA(path);
+    CHECK(sock != INVALID_SOCKET);
+    CHECK(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(listen(sock, 4) == 0);
+    return sock;
+}
+
+static SOCKET test_connect(const char* path)
+{
+    struct sockaddr_un addr;
+    SOCKET sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    test_unix_addr(&addr, path);
+    CHECK(sock != INVALID_SOCKET);
+    CHECK(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    return sock;
+}
+
+static bool test_recv_exact(SOCKET sock, void* buf, int len)
+{
+    for (int got = 0; got < len;) {
+        int r = recv(sock, (char*)buf + got, len - got, 0);
+        if (r <= 0) {
+            return false;
+        }
+        got += r;
+    }
+    return true;
+}
+
+static void test_send_all(SOCKET sock, const void* buf, int len)
+{
+    CHECK_EQ(send(sock, (const char*)buf, len, 0), len);
+}
+
+// Guest conecta no serviço do host; devolve o lado aceito pelo serviço
+static SOCKET test_guest_connect(SOCKET listener, uint32_t buf_alloc)
+{
+    test_tx(TEST_GUEST_PORT, TEST_SERVICE_PORT, VIRTIO_VSOCK_OP_REQUEST, 0, buf_alloc, 0, NULL, 0);
+
+    const test_vsock_hdr_t* hdr = test_rx_op(VIRTIO_VSOCK_OP_RESPONSE, NULL);
+    if (hdr) {
+        CHECK_EQ(hdr->src_port, TEST_SERVICE_PORT);
+        CHECK_EQ(hdr->dst_port, TEST_GUEST_PORT);
+        CHECK_EQ(hdr->buf_alloc, TEST_HOST_BUF_ALLOC);
+    }
+
+    SOCKET sock = accept(listener, NULL, NULL);
+    CHECK(sock != INVALID_SOCKET);
+    return sock;
+}
+
+// ---------------------------------------------------------------------------
+// Testes
+// ---------------------------------------------------------------------------
+
+// Guest -> host: RST sem serviço; com serviço RESPONSE, dados nos dois
+// sentidos e o fechamento pelo guest vira EOF no host
+static void test_guest_to_host(void)
+{
+    const test_vsock_hdr_t* hdr;
+    const uint8_t* data;
+    char buf[16];
+
+    test_setup();
+
+    test_tx(TEST_GUEST_PORT, TEST_SERVICE_PORT, VIRTIO_VSOCK_OP_REQUEST, 0, 65536, 0, NULL, 0);
+    hdr = test_rx_op(VIRTIO_VSOCK_OP_RST, NULL);
+    CHECK(hdr && hdr->dst_port == TEST_GUEST_PORT && hdr->src_port == TEST_SERVICE_PORT);
+
+    SOCKET listener = test_listen(TEST_SERVICE_PATH);
+    SOCKET sock = test_guest_connect(listener, 65536);
+
+    test_tx(TEST_GUEST_PORT, TEST_SERVICE_PORT, VIRTIO_VSOCK_OP_RW, 0, 65536, 0, "hello", 5);
+    CHECK(test_recv_exact(sock, buf, 5) && memcmp(buf, "hello", 5) == 0);
+
+    test_send_all(sock, "world", 5);
+    hdr = test_rx_op(VIRTIO_VSOCK_OP_RW, &data);
+    CHECK(hdr && hdr->len == 5 && memcmp(data, "world", 5) == 0);
+
+    // fwd_cnt conta só o que chegou ao socket
+    test_tx(TEST_GUEST_PORT, TEST_SERVICE_PORT, VIRTIO_VSOCK_OP_CREDIT_REQUEST, 0, 65536, 5, NULL, 0);
+    hdr = test_rx_op(VIRTIO_VSOCK_OP_CREDIT_UPDATE, NULL);
+    CHECK(hdr && hdr->fwd_cnt == 5 && hdr->buf_alloc == TEST_HOST_BUF_ALLOC);
+
+    test_tx(TEST_GUEST_PORT, TEST_SERVICE_PORT, VIRTIO_VSOCK_OP_SHUTDOWN, VIRTIO_VSOCK_SHUTDOWN_BOTH,
+            65536, 5, NULL, 0);
+    test_rx_op(VIRTIO_VSOCK_OP_RST, NULL);
+    CHECK_EQ(recv(sock, buf, 1, 0), 0);
+
+    closesocket(sock);
+    closesocket(listener);
+    DeleteFileA(TEST_SERVICE_PATH);
+    test_teardown();
+}
+
+// Host -> guest limitado pelo crédito: buf_alloc - (enviados - fwd_cnt)
+static void test_guest_credit(void)
+{
+    static uint8_t data[300];
+    const test_vsock_hdr_t* hdr;
+    const uint8_t* payload;
+    uint32_t got = 0;
+
+    test_setup();
+    SOCKET listener = test_listen(TEST_SERVICE_PATH);
+    SOCKET sock = test_guest_connect(listener, 100);
+
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i % 251);
+    }
+    test_send_all(sock, data, (int)sizeof(data));
+
+    // Três janelas: 100 bytes, +100 com fwd_cnt 100, o resto com buf_alloc 1000
+    const uint32_t windows[3][2] = { { 100, 0 }, { 100, 100 }, { 1000, 200 } };
+    for (uint32_t w = 0; w < 3; w++) {
+        uint32_t limit = w < 2 ? 100 * (w + 1) : (uint32_t)sizeof(data);
+
+        if (w) {
+            test_tx(TEST_GUEST_PORT, TEST_SERVICE_PORT, VIRTIO_VSOCK_OP_CREDIT_UPDATE, 0,
+                    windows[w][0], windows[w][1], NULL, 0);
+        }
+        while (got < limit && (hdr = test_rx_op(VIRTIO_VSOCK_OP_RW, &payload)) != NULL) {
+            CHECK(got + hdr->len <= limit);
+            if (got + hdr->len <= sizeof(data)) {
+                CHECK(memcmp(payload, data + got, hdr->len) == 0);
+            }
+            got += hdr->len;
+        }
+        CHECK_EQ(got, limit);
+
+        // Crédito esgotado: nada mais até o guest liberar
+        Sleep(50);
+        CHECK_EQ(test_vq_pending(&g_vqs[VSOCK_QUEUE_RX]), 0);
+    }
+
+    // Host fecha: SHUTDOWN completo, o guest encerra com RST
+    closesocket(sock);
+    hdr = test_rx_op(VIRTIO_VSOCK_OP_SHUTDOWN, NULL);
+    CHECK(hdr && hdr->flags == VIRTIO_VSOCK_SHUTDOWN_BOTH);
+    test_tx(TEST_GUEST_PORT, TEST_SERVICE_PORT, VIRTIO_VSOCK_OP_RST, 0, 0, 0, NULL, 0);
+
+    closesocket(listener);
+    DeleteFileA(TEST_SERVICE_PATH);
+    test_teardown();
+}
+
+// Host -> guest: "CONNECT <porta>" vira REQUEST, o RESPONSE vira "OK
+// <porta>"; volume do guest gera CREDIT_UPDATE a cada meio buf_alloc
+static void test_host_to_guest(void)
+{
+    static uint8_t block[4000];
+    static uint8_t echo[4000];
+    const test_vsock_hdr_t* hdr;
+    const uint8_t* data;
+    char buf[16];
+    uint32_t updates = 0;
+
+    test_setup();
+
+    SOCKET sock = test_connect(TEST_PATH);
+    test_send_all(sock, "CONNECT 80\n", 11);
+    hdr = test_rx_op(VIRTIO_VSOCK_OP_REQUEST, NULL);
+    CHECK(hdr && hdr->dst_port == 80 && hdr->src_port == TEST_EPHEMERAL_PORT);
+
+    test_tx(80, TEST_EPHEMERAL_PORT, VIRTIO_VSOCK_OP_RESPONSE, 0, 65536, 0, NULL, 0);
+    memset(buf, 0, sizeof(buf));
+    CHECK(test_recv_exact(sock, buf, 9) && strcmp(buf, "OK 49152\n") == 0);
+
+    test_tx(80, TEST_EPHEMERAL_PORT, VIRTIO_VSOCK_OP_RW, 0, 65536, 0, "ping", 4);
+    CHECK(test_recv_exact(sock, buf, 4) && memcmp(buf, "ping", 4) == 0);
+
+    // A linha "OK" não conta no fwd_cnt anunciado ao guest
+    test_tx(80, TEST_EPHEMERAL_PORT, VIRTIO_VSOCK_OP_CREDIT_REQUEST, 0, 65536, 0, NULL, 0);
+    hdr = test_rx_op(VIRTIO_VSOCK_OP_CREDIT_UPDATE, NULL);
+    CHECK(hdr && hdr->fwd_cnt == 4);
+
+    test_send_all(sock, "pong", 4);
+    hdr = test_rx_op(VIRTIO_VSOCK_OP_RW, &data);
+    CHECK(hdr && hdr->src_port == TEST_EPHEMERAL_PORT && memcmp(data, "pong", 4) == 0);
+
+    // 64 x 4000 bytes: um único CREDIT_UPDATE ao passar de 128KB
+    for (uint32_t k = 0; k < 64; k++) {
+        memset(block, (int)k, sizeof(block));
+        test_tx(80, TEST_EPHEMERAL_PORT, VIRTIO_VSOCK_OP_RW, 0, 65536, 4, block, sizeof(block));
+        CHECK(test_recv_exact(sock, echo, (int)sizeof(echo)) && memcmp(block, echo, sizeof(echo)) == 0);
+        while (test_vq_pending(&g_vqs[VSOCK_QUEUE_RX])) {
+            if (test_rx_op(VIRTIO_VSOCK_OP_CREDIT_UPDATE, NULL)) {
+                updates++;
+            }
+        }
+    }
+    Sleep(20);
+    while (test_vq_pending(&g_vqs[VSOCK_QUEUE_RX])) {
+        if (test_rx_op(VIRTIO_VSOCK_OP_CREDIT_UPDATE, NULL)) {
+            updates++;
+        }
+    }
+    CHECK_EQ(updates, 1);
+
+    // Guest fecha: RST de volta e EOF no host
+    test_tx(80, TEST_EPHEMERAL_PORT, VIRTIO_VSOCK_OP_SHUTDOWN, VIRTIO_VSOCK_SHUTDOWN_BOTH, 65536, 4, NULL, 0);
+    test_rx_op(VIRTIO_VSOCK_OP_RST, NULL);
+    CHECK_EQ(recv(sock, buf, 1, 0), 0);
+    closesocket(sock);
+
+    // Guest recusa com RST: o host vê EOF sem "OK"
+    sock = test_connect(TEST_PATH);
+    test_send_all(sock, "CONNECT 81\n", 11);
+    hdr = test_rx_op(VIRTIO_VSOCK_OP_REQUEST, NULL);
+    if (hdr) {
+        uint32_t port = hdr->src_port;
+        test_tx(81, port, VIRTIO_VSOCK_OP_RST, 0, 0, 0, NULL, 0);
+    }
+    CHECK_EQ(recv(sock, buf, 1, 0), 0);
+    closesocket(sock);
+
+    test_teardown();
+}
+
+// Reset do device fecha as conexões abertas
+static void test_reset_closes(void)
+{
+    char buf[4];
+
+    test_setup();
+
+    SOCKET sock = test_connect(TEST_PATH);
+    test_send_all(sock, "CONNECT 82\n", 11);
+    test_rx_op(VIRTIO_VSOCK_OP_REQUEST, NULL);
+    test_mmio_write(0, VIRTIO_MMIO_STATUS, 0);
+    CHECK_EQ(recv(sock, buf, 1, 0), 0);
+    closesocket(sock);
+
+    test_teardown();
+}
+
+int main(void)
+{
+    WSADATA wsa;
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        return 1;
+    }
+    RUN_TEST(test_guest_to_host);
+    RUN_TEST(test_guest_credit);
+    RUN_TEST(test_host_to_guest);
+    RUN_TEST(test_reset_closes);
+    WSACleanup();
+    return TEST_RESULT();
+}
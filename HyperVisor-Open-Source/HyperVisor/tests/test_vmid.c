@@ -0,0 +1,92 @@
+/* Desenvolvido por: Escanearcpl */
+#include "vmid.h"
+#include "test_common.h"
+
+static vmid_allocator_t g_alloc;
+
+static void test_init_rejects_bad_config(void)
+{
+    CHECK(vmid_allocator_init(&g_alloc, 12, 2) != 0);
+    CHECK(vmid_allocator_init(&g_alloc, 8, 0) != 0);
+    CHECK(vmid_allocator_init(&g_alloc, 8, VMID_MAX_CPUS + 1) != 0);
+    CHECK(vmid_allocator_init(&g_alloc, 16, VMID_MAX_CPUS) == 0);
+}
+
+static void test_allocate_and_reuse(void)
+{
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    CHECK(vmid_allocator_init(&g_alloc, 8, 2) == 0);
+
+    // VMID 0 é do hypervisor; troca de guest sem rollover não invalida a TLB
+    CHECK(!vmid_update(&g_alloc, &a, 0));
+    CHECK(!vmid_update(&g_alloc, &b, 1));
+    CHECK_EQ(vmid_value(&g_alloc, a), 1);
+    CHECK_EQ(vmid_value(&g_alloc, b), 2);
+    CHECK(vmid_is_current(&g_alloc, a));
+    CHECK(vmid_is_current(&g_alloc, b));
+    CHECK(!vmid_is_current(&g_alloc, 0));
+
+    uint64_t before = a;
+    CHECK(!vmid_update(&g_alloc, &a, 1));
+    CHECK_EQ(a, before);
+
+    // CPU fora da faixa: sem VMID, invalidação completa por segurança
+    CHECK(vmid_update(&g_alloc, &a, 2));
+    CHECK_EQ(a, before);
+}
+
+// 8 bits: 255 VMIDs por geração. O guest que esgota a geração provoca o
+// rollover; os ativos em cada CPU mantêm o valor e cada CPU invalida uma vez.
+static void test_rollover(void)
+{
+    uint64_t a = 0;
+    uint64_t b = 0;
+    uint64_t last = 0;
+    uint64_t c = 0;
+
+    CHECK(vmid_allocator_init(&g_alloc, 8, 2) == 0);
+    vmid_update(&g_alloc, &a, 0);           // 1
+    vmid_update(&g_alloc, &b, 1);           // 2, ativo na CPU 1
+
+    for (uint32_t v = 3; v <= 255; v++) {
+        last = 0;
+        CHECK(!vmid_update(&g_alloc, &last, 0));
+        CHECK_EQ(vmid_value(&g_alloc, last), v);
+    }
+    CHECK_EQ(g_alloc.rollovers, 0);
+
+    // Novo guest sem VMID livre: rollover e flush nesta CPU
+    CHECK(vmid_update(&g_alloc, &c, 0));
+    CHECK_EQ(g_alloc.rollovers, 1);
+    CHECK(vmid_is_current(&g_alloc, c));
+    CHECK(!vmid_is_current(&g_alloc, a));
+    CHECK(!vmid_is_current(&g_alloc, b));
+    CHECK(!vmid_is_current(&g_alloc, last));
+    CHECK(vmid_value(&g_alloc, c) != 2 && vmid_value(&g_alloc, c) != 255);
+
+    // b estava ativo na CPU 1: mantém o valor na nova geração; a CPU 1
+    // ainda deve sua invalidação
+    uint64_t b_old = b;
+    CHECK(vmid_update(&g_alloc, &b, 1));
+    CHECK(vmid_is_current(&g_alloc, b));
+    CHECK_EQ(vmid_value(&g_alloc, b), vmid_value(&g_alloc, b_old));
+    CHECK(!vmid_update(&g_alloc, &b, 1));
+
+    // a não estava ativo: seu valor antigo pode ter sido dado a c
+    vmid_update(&g_alloc, &a, 0);
+    CHECK(vmid_is_current(&g_alloc, a));
+    CHECK(vmid_value(&g_alloc, a) != vmid_value(&g_alloc, c));
+    CHECK(vmid_value(&g_alloc, a) != vmid_value(&g_alloc, b));
+    CHECK_EQ(g_alloc.rollovers, 1);
+    CHECK_EQ(g_alloc.lock, 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_init_rejects_bad_config);
+    RUN_TEST(test_allocate_and_reuse);
+    RUN_TEST(test_rollover);
+    return TEST_RESULT();
+}
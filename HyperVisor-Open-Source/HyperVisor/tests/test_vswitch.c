@@ -0,0 +1,497 @@
+/* Desenvolvido por: Escanearcpl */
+#include "vswitch.h"
+#include "vm.h"
+#include "test_common.h"
+#include <string.h>
+
+// Portas de teste em loopback: o deliver copia o frame para slots em
+// memória (capacidade controlada, para simular anel de RX vazio) e o
+// signal só conta. O relógio do switch é controlado pelo teste.
+
+#define TEST_SLOTS      16
+#define TEST_SLOT_SIZE  8192
+#define TEST_PAYLOAD    54              // Ethernet + IPv4 + TCP sem opções
+
+typedef struct {
+    vswitch_port_t port;
+    uint8_t slots[TEST_SLOTS][TEST_SLOT_SIZE];
+    uint32_t lens[TEST_SLOTS];
+    vswitch_offload_t offs[TEST_SLOTS];
+    uint32_t count;                     // Frames entregues
+    uint32_t capacity;                  // Buffers de RX "livres"
+    uint32_t signals;
+} test_port_t;
+
+static const uint8_t MAC_A[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0A };
+static const uint8_t MAC_B[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0B };
+static const uint8_t MAC_C[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0C };
+static const uint8_t MAC_BCAST[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static test_port_t g_ports[3];
+static uint64_t g_now_ns = 1000000000ULL;
+static uint8_t g_frame[TEST_SLOT_SIZE];
+
+// ---------------------------------------------------------------------------
+// Dependências do switch e das virtqueues
+// ---------------------------------------------------------------------------
+
+uint64_t timer_get_time_ns(void)
+{
+    return g_now_ns;
+}
+
+void* vm_gpa_to_hva(uint64_t guest_addr, uint64_t size)
+{
+    (void)guest_addr;
+    (void)size;
+    return NULL;
+}
+
+bool virtio_has_feature(const virtio_dev_t* dev, uint64_t feature)
+{
+    return (dev->driver_features & feature) != 0;
+}
+
+// ---------------------------------------------------------------------------
+// Portas
+// ---------------------------------------------------------------------------
+
+static int test_deliver(vswitch_port_t* port, const vswitch_frame_t* frame)
+{
+    test_port_t* tp = (test_port_t*)port->ctx;
+
+    if (tp->count >= tp->capacity) {
+        return VSWITCH_NO_BUFFER;
+    }
+    if (tp->count >= TEST_SLOTS || frame->len > TEST_SLOT_SIZE) {
+        return VSWITCH_DROPPED;
+    }
+
+    virtq_iov_t iov = { tp->slots[tp->count], TEST_SLOT_SIZE };
+    tp->lens[tp->count] = (uint32_t)vswitch_frame_copy(frame, &iov, 1, 0);
+    tp->offs[tp->count] = frame->off;
+    tp->count++;
+    return VSWITCH_DELIVERED;
+}
+
+static void test_signal(vswitch_port_t* port)
+{
+    ((test_port_t*)port->ctx)->signals++;
+}
+
+static const vswitch_port_ops_t test_port_ops = {
+    test_deliver,
+    test_signal,
+};
+
+static void test_setup(void)
+{
+    static const char* const names[] = { "a", "b", "c" };
+
+    memset(g_ports, 0, sizeof(g_ports));
+    for (uint32_t i = 0; i < 3; i++) {
+        g_ports[i].capacity = TEST_SLOTS;
+        CHECK(vswitch_port_add(&g_ports[i].port, names[i], &test_port_ops, &g_ports[i]) == 0);
+    }
+}
+
+static void test_teardown(void)
+{
+    for (uint32_t i = 0; i < 3; i++) {
+        vswitch_port_remove(&g_ports[i].port);
+    }
+}
+
+static void test_reset_counts(void)
+{
+    for (uint32_t i = 0; i < 3; i++) {
+        g_ports[i].count = 0;
+        g_ports[i].signals = 0;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Frames
+// ---------------------------------------------------------------------------
+
+static uint16_t test_get16(const uint8_t* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void test_put16(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint32_t test_sum(uint32_t sum, const uint8_t* p, uint32_t len)
+{
+    for (; len > 1; p += 2, len -= 2) {
+        sum += test_get16(p);
+    }
+    if (len) {
+        sum += (uint32_t)p[0] << 8;
+    }
+    return sum;
+}
+
+static uint16_t test_fold(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+// Soma do pseudo-cabeçalho IPv4 de um segmento TCP (sem complemento)
+static uint32_t test_pseudo(const uint8_t* ip, uint32_t tcp_len)
+{
+    return test_sum(0, ip + 12, 8) + 6 + tcp_len;
+}
+
+// Checksum TCP conferido como o receptor faria: tudo somado dá 0xFFFF
+static bool test_tcp_csum_ok(const uint8_t* frame, uint32_t len)
+{
+    uint32_t tcp_len = len - 34;
+    return test_fold(test_sum(test_pseudo(frame + 14, tcp_len), frame + 34, tcp_len)) == 0xFFFF;
+}
+
+// Frame sem IP: o byte 14 identifica o frame
+static vswitch_frame_t test_raw_frame(virtq_iov_t* iov, const uint8_t* dst, const uint8_t* src, uint8_t tag)
+{
+    vswitch_frame_t frame;
+
+    memset(g_frame, 0, 64);
+    memcpy(g_frame, dst, 6);
+    memcpy(g_frame + 6, src, 6);
+    test_put16(g_frame + 12, 0x88B5);
+    g_frame[14] = tag;
+
+    iov->addr = g_frame;
+    iov->len = 64;
+    memset(&frame, 0, sizeof(frame));
+    frame.iov = iov;
+    frame.iov_count = 1;
+    frame.len = 64;
+    return frame;
+}
+
+// TCP/IPv4 com checksum parcial (campo com o pseudo-cabeçalho, como o
+// driver envia); cabeçalhos e payload em segmentos separados
+static vswitch_frame_t test_tcp_frame(virtq_iov_t* iov, const uint8_t* dst, const uint8_t* src,
+                                      uint32_t payload, uint8_t tcp_flags)
+{
+    static const uint8_t addrs[8] = { 10, 0, 0, 1, 10, 0, 0, 2 };
+    uint8_t* ip = g_frame + 14;
+    uint8_t* tcp = g_frame + 34;
+    uint32_t len = TEST_PAYLOAD + payload;
+    vswitch_frame_t frame;
+
+    memset(g_frame, 0, TEST_PAYLOAD);
+    memcpy(g_frame, dst, 6);
+    memcpy(g_frame + 6, src, 6);
+    test_put16(g_frame + 12, 0x0800);
+
+    ip[0] = 0x45;
+    test_put16(ip + 2, len - 14);
+    test_put16(ip + 4, 100);            // Identification
+    test_put16(ip + 6, 0x4000);         // DF
+    ip[8] = 64;
+    ip[9] = 6;
+    memcpy(ip + 12, addrs, sizeof(addrs));
+    test_put16(ip + 10, (uint16_t)~test_fold(test_sum(0, ip, 20)));
+
+    test_put16(tcp, 40000);
+    test_put16(tcp + 2, 80);
+    test_put16(tcp + 4, 0);
+    test_put16(tcp + 6, 1000);          // seq
+    test_put16(tcp + 10, 1);            // ack
+    tcp[12] = 5 << 4;
+    tcp[13] = tcp_flags;
+    test_put16(tcp + 14, 0xFFFF);
+    test_put16(tcp + 16, test_fold(test_pseudo(ip, len - 34)));
+
+    for (uint32_t i = 0; i < payload; i++) {
+        g_frame[TEST_PAYLOAD + i] = (uint8_t)i;
+    }
+
+    iov[0].addr = g_frame;
+    iov[0].len = TEST_PAYLOAD;
+    iov[1].addr = g_frame + TEST_PAYLOAD;
+    iov[1].len = payload;
+    memset(&frame, 0, sizeof(frame));
+    frame.iov = iov;
+    frame.iov_count = 2;
+    frame.len = len;
+    frame.off.flags = VSWITCH_CSUM_PARTIAL;
+    frame.off.csum_start = 34;
+    frame.off.csum_offset = 16;
+    return frame;
+}
+
+static void test_send(uint32_t from, const uint8_t* dst, const uint8_t* src, uint8_t tag)
+{
+    virtq_iov_t iov;
+    vswitch_frame_t frame = test_raw_frame(&iov, dst, src, tag);
+    vswitch_send(&g_ports[from].port, &frame);
+}
+
+// ---------------------------------------------------------------------------
+// Testes
+// ---------------------------------------------------------------------------
+
+// Destino desconhecido inunda; depois de aprendido vai só para a porta
+static void test_flood_and_learn(void)
+{
+    test_setup();
+
+    test_send(0, MAC_B, MAC_A, 1);
+    CHECK_EQ(g_ports[0].count, 0);
+    CHECK_EQ(g_ports[1].count, 1);
+    CHECK_EQ(g_ports[2].count, 1);
+
+    test_send(1, MAC_A, MAC_B, 2);
+    CHECK_EQ(g_ports[0].count, 1);
+    CHECK_EQ(g_ports[0].slots[0][14], 2);
+    CHECK_EQ(g_ports[2].count, 1);
+
+    test_send(0, MAC_B, MAC_A, 3);
+    CHECK_EQ(g_ports[1].count, 2);
+    CHECK_EQ(g_ports[1].slots[1][14], 3);
+    CHECK_EQ(g_ports[2].count, 1);
+
+    // Broadcast inunda mesmo com o destino "aprendido"
+    test_send(2, MAC_BCAST, MAC_C, 4);
+    CHECK_EQ(g_ports[0].count, 2);
+    CHECK_EQ(g_ports[1].count, 3);
+    CHECK_EQ(g_ports[2].count, 1);
+
+    // Destino aprendido na própria porta de origem: nada é entregue
+    test_send(0, MAC_A, MAC_A, 5);
+    CHECK_EQ(g_ports[0].count, 2);
+    CHECK_EQ(g_ports[1].count, 3);
+    CHECK_EQ(g_ports[2].count, 1);
+
+    // O MAC muda de porta com o próximo frame de origem
+    test_send(2, MAC_BCAST, MAC_B, 6);
+    test_send(0, MAC_B, MAC_A, 7);
+    CHECK_EQ(g_ports[2].count, 2);
+    CHECK_EQ(g_ports[2].slots[1][14], 7);
+    CHECK_EQ(g_ports[1].count, 4);
+
+    test_teardown();
+}
+
+// Sem RX livre o switch retém os frames e os entrega em ordem no drain;
+// frames novos entram atrás dos retidos
+static void test_queue_and_drain(void)
+{
+    test_setup();
+    test_send(1, MAC_BCAST, MAC_B, 0);
+    test_reset_counts();
+
+    g_ports[1].capacity = 0;
+    for (uint8_t i = 1; i <= 3; i++) {
+        test_send(0, MAC_B, MAC_A, i);
+    }
+    CHECK_EQ(g_ports[1].count, 0);
+    CHECK_EQ(g_ports[1].port.queue_len, 3);
+    CHECK_EQ(g_ports[1].port.stats.rx_queued, 3);
+
+    g_ports[1].capacity = 2;
+    vswitch_port_drain(&g_ports[1].port);
+    CHECK_EQ(g_ports[1].count, 2);
+    CHECK_EQ(g_ports[1].port.queue_len, 1);
+
+    // Há RX livre, mas o frame novo não passa na frente do retido
+    g_ports[1].capacity = TEST_SLOTS;
+    test_send(0, MAC_B, MAC_A, 4);
+    CHECK_EQ(g_ports[1].count, 2);
+    CHECK_EQ(g_ports[1].port.queue_len, 2);
+
+    vswitch_port_drain(&g_ports[1].port);
+    CHECK_EQ(g_ports[1].count, 4);
+    CHECK_EQ(g_ports[1].port.queue_len, 0);
+    for (uint32_t i = 0; i < 4; i++) {
+        CHECK_EQ(g_ports[1].slots[i][14], i + 1);
+        CHECK_EQ(g_ports[1].lens[i], 64);
+    }
+
+    // Reset do device descarta os retidos
+    g_ports[1].capacity = 0;
+    test_send(0, MAC_B, MAC_A, 5);
+    CHECK_EQ(g_ports[1].port.queue_len, 1);
+    vswitch_port_reset(&g_ports[1].port);
+    CHECK_EQ(g_ports[1].port.queue_len, 0);
+    g_ports[1].capacity = TEST_SLOTS;
+    vswitch_port_drain(&g_ports[1].port);
+    CHECK_EQ(g_ports[1].count, 4);
+
+    test_teardown();
+}
+
+// Um signal por porta que recebeu frames desde o último flush
+static void test_flush_signals(void)
+{
+    test_setup();
+
+    test_send(0, MAC_BCAST, MAC_A, 1);
+    test_send(0, MAC_BCAST, MAC_A, 2);
+    test_send(1, MAC_A, MAC_B, 3);
+    vswitch_flush();
+    CHECK_EQ(g_ports[0].signals, 1);
+    CHECK_EQ(g_ports[1].signals, 1);
+    CHECK_EQ(g_ports[2].signals, 1);
+
+    vswitch_flush();
+    CHECK_EQ(g_ports[0].signals, 1);
+    CHECK_EQ(g_ports[1].signals, 1);
+    CHECK_EQ(g_ports[2].signals, 1);
+
+    // Frame só retido não sinaliza; a entrega pelo drain sim
+    g_ports[2].capacity = g_ports[2].count;
+    test_send(0, MAC_BCAST, MAC_A, 4);
+    test_send(0, MAC_C, MAC_A, 5);
+    vswitch_flush();
+    CHECK_EQ(g_ports[1].signals, 2);
+    CHECK_EQ(g_ports[2].signals, 1);
+    g_ports[2].capacity = TEST_SLOTS;
+    vswitch_port_drain(&g_ports[2].port);
+    vswitch_flush();
+    CHECK_EQ(g_ports[2].signals, 2);
+
+    test_teardown();
+}
+
+// Checksum parcial completado só para a porta sem CAP_CSUM
+static void test_soft_csum(void)
+{
+    virtq_iov_t iov[2];
+
+    test_setup();
+    vswitch_port_set_caps(&g_ports[1].port, VSWITCH_CAP_CSUM);
+
+    vswitch_frame_t frame = test_tcp_frame(iov, MAC_BCAST, MAC_A, 301, 0x18);
+    vswitch_send(&g_ports[0].port, &frame);
+
+    // Com a capacidade: intacto, ainda parcial
+    CHECK_EQ(g_ports[1].count, 1);
+    CHECK_EQ(g_ports[1].offs[0].flags, VSWITCH_CSUM_PARTIAL);
+    CHECK(memcmp(g_ports[1].slots[0], g_frame, frame.len) == 0);
+    CHECK_EQ(g_ports[1].port.stats.rx_soft_csum, 0);
+
+    // Sem: checksum completo e o resto do frame igual
+    CHECK_EQ(g_ports[2].count, 1);
+    CHECK_EQ(g_ports[2].lens[0], frame.len);
+    CHECK_EQ(g_ports[2].offs[0].flags, 0);
+    CHECK(test_tcp_csum_ok(g_ports[2].slots[0], g_ports[2].lens[0]));
+    CHECK(memcmp(g_ports[2].slots[0], g_frame, 50) == 0);
+    CHECK(memcmp(g_ports[2].slots[0] + 52, g_frame + 52, frame.len - 52) == 0);
+    CHECK_EQ(g_ports[2].port.stats.rx_soft_csum, 1);
+
+    test_teardown();
+}
+
+// TSO em software: segmentos de MSS com seq, IP ID, tamanhos, flags e
+// checksums refeitos; a porta com TSO recebe o frame inteiro
+static void test_soft_tso(void)
+{
+    virtq_iov_t iov[2];
+    const uint32_t mss = 1000;
+    const uint32_t payload = 3500;
+
+    test_setup();
+    vswitch_port_set_caps(&g_ports[1].port, VSWITCH_CAP_CSUM | VSWITCH_CAP_TSO4);
+    vswitch_port_set_caps(&g_ports[2].port, VSWITCH_CAP_CSUM);
+
+    vswitch_frame_t frame = test_tcp_frame(iov, MAC_BCAST, MAC_A, payload, 0x19);   // ACK|PSH|FIN
+    frame.off.gso_type = VSWITCH_GSO_TCPV4;
+    frame.off.gso_size = (uint16_t)mss;
+    frame.off.hdr_len = TEST_PAYLOAD;
+    vswitch_send(&g_ports[0].port, &frame);
+
+    CHECK_EQ(g_ports[1].count, 1);
+    CHECK_EQ(g_ports[1].lens[0], TEST_PAYLOAD + payload);
+    CHECK_EQ(g_ports[1].offs[0].gso_type, VSWITCH_GSO_TCPV4);
+    CHECK_EQ(g_ports[1].offs[0].gso_size, mss);
+
+    // Sem TSO4 (mesmo com CSUM) a porta recebe os segmentos
+    CHECK_EQ(g_ports[2].count, 4);
+    CHECK_EQ(g_ports[2].port.stats.rx_soft_segments, 4);
+    for (uint32_t n = 0; n < g_ports[2].count; n++) {
+        const uint8_t* seg = g_ports[2].slots[n];
+        const uint8_t* ip = seg + 14;
+        const uint8_t* tcp = seg + 34;
+        uint32_t chunk = n < 3 ? mss : payload - 3 * mss;
+        bool last = n == 3;
+
+        CHECK_EQ(g_ports[2].lens[n], TEST_PAYLOAD + chunk);
+        CHECK_EQ(g_ports[2].offs[n].gso_type, VSWITCH_GSO_NONE);
+        CHECK_EQ(g_ports[2].offs[n].flags, VSWITCH_CSUM_VALID);
+        CHECK_EQ(test_get16(ip + 2), 40 + chunk);
+        CHECK_EQ(test_get16(ip + 4), 100 + n);
+        CHECK_EQ(test_fold(test_sum(0, ip, 20)), 0xFFFF);
+        CHECK_EQ(((uint32_t)test_get16(tcp + 4) << 16) | test_get16(tcp + 6), 1000 + n * mss);
+        CHECK_EQ(tcp[13], last ? 0x19 : 0x10);
+        CHECK(test_tcp_csum_ok(seg, g_ports[2].lens[n]));
+        CHECK_EQ(seg[TEST_PAYLOAD], (uint8_t)(n * mss));
+        CHECK_EQ(seg[TEST_PAYLOAD + chunk - 1], (uint8_t)(n * mss + chunk - 1));
+    }
+
+    // GSO sem checksum parcial é inválido e não sai da origem
+    frame.off.flags = 0;
+    vswitch_send(&g_ports[0].port, &frame);
+    CHECK_EQ(g_ports[0].port.stats.tx_dropped, 1);
+    CHECK_EQ(g_ports[1].count, 1);
+    CHECK_EQ(g_ports[2].count, 4);
+
+    test_teardown();
+}
+
+// Porta removida esquece os MACs dela; entradas antigas expiram
+static void test_remove_and_age(void)
+{
+    test_port_t extra;
+
+    test_setup();
+    test_send(1, MAC_BCAST, MAC_B, 0);
+    test_send(2, MAC_BCAST, MAC_C, 0);
+
+    // A porta nova reaproveita o id de B: sem esquecer, receberia sozinha
+    vswitch_port_remove(&g_ports[1].port);
+    memset(&extra, 0, sizeof(extra));
+    extra.capacity = TEST_SLOTS;
+    CHECK(vswitch_port_add(&extra.port, "d", &test_port_ops, &extra) == 0);
+    CHECK_EQ(extra.port.id, g_ports[1].port.id);
+    test_reset_counts();
+
+    test_send(0, MAC_B, MAC_A, 1);
+    CHECK_EQ(extra.count, 1);
+    CHECK_EQ(g_ports[2].count, 1);
+
+    // C aprendido: direto; depois do envelhecimento, inunda de novo
+    test_send(0, MAC_C, MAC_A, 2);
+    CHECK_EQ(extra.count, 1);
+    CHECK_EQ(g_ports[2].count, 2);
+    g_now_ns += (uint64_t)VSWITCH_MAC_AGE_MS * 1000000ULL;
+    test_send(0, MAC_C, MAC_A, 3);
+    CHECK_EQ(extra.count, 2);
+    CHECK_EQ(g_ports[2].count, 3);
+
+    vswitch_port_remove(&extra.port);
+    vswitch_port_remove(&g_ports[0].port);
+    vswitch_port_remove(&g_ports[2].port);
+}
+
+int main(void)
+{
+    RUN_TEST(test_flood_and_learn);
+    RUN_TEST(test_queue_and_drain);
+    RUN_TEST(test_flush_signals);
+    RUN_TEST(test_soft_csum);
+    RUN_TEST(test_soft_tso);
+    RUN_TEST(test_remove_and_age);
+    vswitch_cleanup();
+    return TEST_RESULT();
+}